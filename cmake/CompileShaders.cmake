@@ -0,0 +1,38 @@
+# GLSL shaders in resources/shaders are compiled to .spv next to their sources by the 'shaders' target,
+# which every sample depends on. A shader is recompiled when it or any header in resources/shaders is newer
+# than its .spv, so the binaries can't go stale. Without glslangValidator the checked in .spv files are used.
+
+set(SHADERS_DIR ${CMAKE_SOURCE_DIR}/resources/shaders)
+file(GLOB SHADER_HEADERS ${SHADERS_DIR}/*.h)
+
+find_program(GLSLANG_VALIDATOR glslangValidator HINTS $ENV{VULKAN_SDK}/bin $ENV{VULKAN_SDK}/Bin)
+if(NOT GLSLANG_VALIDATOR)
+  message(WARNING "glslangValidator was not found, checked in .spv files are used as they are")
+endif()
+
+# compile_shader(<source> <output> [glslangValidator flags...])
+function(compile_shader a_source a_output)
+  if(NOT GLSLANG_VALIDATOR)
+    return()
+  endif()
+  add_custom_command(OUTPUT ${SHADERS_DIR}/${a_output}
+                     COMMAND ${GLSLANG_VALIDATOR} -V ${ARGN} ${a_source} -o ${a_output}
+                     WORKING_DIRECTORY ${SHADERS_DIR}
+                     DEPENDS ${SHADERS_DIR}/${a_source} ${SHADER_HEADERS}
+                     COMMENT "Compiling ${a_output}"
+                     VERBATIM)
+  set_property(GLOBAL APPEND PROPERTY COMPILED_SHADERS ${SHADERS_DIR}/${a_output})
+endfunction()
+
+# compile_shaders(<source>...) - every source to <source>.spv with default flags
+function(compile_shaders)
+  foreach(source ${ARGN})
+    compile_shader(${source} ${source}.spv)
+  endforeach()
+endfunction()
+
+# the target is added after all shaders are declared
+function(add_shaders_target)
+  get_property(outputs GLOBAL PROPERTY COMPILED_SHADERS)
+  add_custom_target(shaders ALL DEPENDS ${outputs})
+endfunction()
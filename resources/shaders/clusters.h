@@ -0,0 +1,30 @@
+#ifndef VK_GRAPHICS_BASIC_CLUSTERS_H
+#define VK_GRAPHICS_BASIC_CLUSTERS_H
+
+// needs ClusterParams from common.h
+
+// near and far depth of a slice
+vec2 SliceDepthRange(ClusterParams a_params, uint a_slice)
+{
+  const float ratio = a_params.projection.w / a_params.projection.z;
+  return a_params.projection.z * vec2(pow(ratio, float(a_slice) / CLUSTER_SLICES), pow(ratio, float(a_slice + 1) / CLUSTER_SLICES));
+}
+
+// a_fragCoord in pixels of the main pass viewport, a_depth is the distance along the view direction
+uint ClusterIndex(ClusterParams a_params, vec2 a_fragCoord, float a_depth)
+{
+  const vec2  uv    = clamp(a_fragCoord / a_params.viewport.xy, vec2(0.0f), vec2(0.9999f));
+  const uvec2 tile  = uvec2(uv * vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y));
+  const float slice = log(max(a_depth, 1e-6f)) * a_params.sliceScaleBias.x + a_params.sliceScaleBias.y;
+  return (uint(clamp(slice, 0.0f, float(CLUSTER_SLICES - 1))) * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x;
+}
+
+// inverse square falloff which smoothly reaches zero at the radius of influence
+float LightAttenuation(float a_dist, float a_radius)
+{
+  const float ratio  = a_dist / a_radius;
+  const float window = clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+  return window * window / (a_dist * a_dist + 1.0f);
+}
+
+#endif // VK_GRAPHICS_BASIC_CLUSTERS_H
@@ -28,4 +28,121 @@ struct UniformParams
   bool animateLightColor;
 };
 
+// shadows of the directional light: the view frustum is split in depth into cascades, cascade i is rendered
+// to layer i of the shadow map with an orthographic projection fitted to its part of the frustum
+#define SHADOW_CASCADES 4
+
+struct ShadowParams
+{
+  mat4 cascadeMatrices[SHADOW_CASCADES]; // world to light clip space
+  vec4 splits;         // view depth of the far plane of every cascade
+  vec4 viewDepth;      // view depth of world point p is dot(viewDepth, vec4(p, 1))
+  vec4 lightDir;       // xyz - direction to the light, w - 1 if cascades are used, 0 - UniformParams::lightMatrix and layer 0
+  vec4 filtering;      // x - 1 if variance shadow maps are used, y - minimal variance, z - light bleeding reduction
+};
+
+// variance shadow maps: depth and its square are blurred by a separable gaussian of SHADOW_BLUR_RADIUS texels,
+// a workgroup of the blur filters SHADOW_BLUR_GROUP texels of a row (or a column)
+#define SHADOW_BLUR_GROUP  64
+#define SHADOW_BLUR_RADIUS 4
+
+// per instance input of GPU culling
+struct CullInstance
+{
+  vec4 boxMin;         // world space bounding box
+  vec4 boxMax;
+  uint indexCount;     // indexed draw of the instance mesh
+  uint firstIndex;
+  int  vertexOffset;
+  uint pad;
+};
+
+struct CullParams
+{
+  mat4 viewProj;       // current view, frustum test and late phase occlusion test
+  mat4 prevViewProj;   // view of the previous frame, its depth pyramid is used by the early phase
+  vec4 viewport;       // xy - main pass viewport of the current frame in pixels, zw - of the previous frame
+  vec4 pyramid;        // x - 1 if the depth pyramid of the previous frame is valid
+};
+
+// point light of the scene, world space
+struct PointLight
+{
+  vec4 posAndRadius;   // xyz - position, w - radius of influence
+  vec4 color;          // rgb - intensity
+};
+
+// lights of the main view are binned to a grid of clusters: screen tiles times depth slices,
+// slices are spaced exponentially between the near and far planes
+#define CLUSTER_TILES_X        16
+#define CLUSTER_TILES_Y        16
+#define CLUSTER_SLICES         24
+#define CLUSTERS_NUM           (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+#define MAX_LIGHTS_PER_CLUSTER 256
+
+struct ClusterParams
+{
+  mat4 view;
+  vec4 viewport;        // xy - main pass viewport in pixels
+  vec4 projection;      // xy - scale of view space x and y by the projection, zw - near and far planes of the slices
+  vec4 sliceScaleBias;  // slice = log(depth) * x + y
+  uint lightsNum;       // 0 - clustered lights are off
+  uint pad0;
+  uint pad1;
+  uint pad2;
+};
+
+// shadows of point lights: six faces of a cube per light are square tiles of one depth atlas, the most important
+// lights get the largest tiles, see ShadowAtlas
+#define SHADOW_ATLAS_SIZE   4096
+#define SHADOW_TILE_MIN     128
+#define SHADOW_TILE_MAX     1024
+#define MAX_SHADOWED_LIGHTS 16
+#define NO_SHADOW           0xFFFFFFFFu
+
+struct ShadowView
+{
+  mat4 viewProj;       // world to clip space of the cube face
+  vec4 rect;           // xy - offset of the tile in the atlas, zw - size, in texture coordinates
+};
+
+// threads per group of simple.comp, the grid is sized from the array length
+#define SIMPLE_COMPUTE_GROUP 256
+
+// compute primitives (ComputePrimitives): a group of PRIM_GROUP threads scans a tile of PRIM_ITEMS rows of PRIM_GROUP
+// elements, reduce takes PRIM_ITEMS elements per thread and has at most PRIM_REDUCE_GROUPS partial results
+#define PRIM_GROUP         256
+#define PRIM_ITEMS         8
+#define PRIM_TILE          (PRIM_GROUP * PRIM_ITEMS)
+#define PRIM_REDUCE_GROUPS 1024
+#define PRIM_NONE          0xFFFFFFFFu
+
+#define PRIM_MODE_EXCLUSIVE 0
+#define PRIM_MODE_INCLUSIVE 1
+#define PRIM_MODE_COMPACT   2
+
+#define PRIM_OP_SUM 0
+#define PRIM_OP_MIN 1
+#define PRIM_OP_MAX 2
+
+#define PRIM_TYPE_UINT  0
+#define PRIM_TYPE_FLOAT 1
+
+// states of tiles of the single pass scan
+#define PRIM_TILE_NOT_READY 0
+#define PRIM_TILE_AGGREGATE 1  // sum of the tile is known
+#define PRIM_TILE_PREFIX    2  // sum of the tile and all tiles before it is known
+
+struct PrimParams
+{
+  uint length;  // elements of the source
+  uint mode;    // scan: PRIM_MODE_*
+  uint op;      // reduce: PRIM_OP_*
+  uint type;    // reduce: PRIM_TYPE_*
+  uint src;     // offset of the source in the scratch buffer, PRIM_NONE - input (or flags of compaction) buffer
+  uint dst;     // offset of the destination in the scratch buffer, PRIM_NONE - output (or result) buffer
+  uint carry;   // offset of the sums of all previous tiles, one per tile, in the scratch buffer, PRIM_NONE - zero
+  uint pad0;
+};
+
 #endif //VK_GRAPHICS_BASIC_COMMON_H
@@ -5,7 +5,9 @@ import pathlib
 if __name__ == '__main__':
     glslang_cmd = "glslangValidator"
 
-    shader_list = ["simple.vert", "quad.vert", "quad.frag", "simple_shadow.frag"]
+    shader_list = ["simple.vert", "quad.vert", "quad.frag", "simple_shadow.frag", "upscale.vert", "upscale.frag",
+                   "simple_instanced.vert", "depth_pyramid.comp", "occlusion_cull.comp",
+                   "depth_prepass.vert", "light_binning.comp", "shadow_blur.comp"]
 
     for shader in shader_list:
         subprocess.run([glslang_cmd, "-V", shader, "-o", "{}.spv".format(shader)])
@@ -5,8 +5,15 @@ import pathlib
 if __name__ == '__main__':
     glslang_cmd = "glslangValidator"
 
-    shader_list = ["simple.comp"]
+    shader_list = ["simple.comp", "prim_reduce.comp", "prim_tile_reduce.comp", "prim_tile_scan.comp"]
 
     for shader in shader_list:
         subprocess.run([glslang_cmd, "-V", shader, "-o", "{}.spv".format(shader)])
 
+    # compute primitives with subgroup operations (SPIR-V 1.3), the single pass scan has no other version
+    subgroup_list = ["prim_reduce.comp", "prim_tile_reduce.comp", "prim_tile_scan.comp", "prim_scan.comp"]
+
+    for shader in subgroup_list:
+        subprocess.run([glslang_cmd, "-V", "--target-env", "vulkan1.1", "-DPRIM_SUBGROUPS", shader,
+                        "-o", "{}_subgroup.comp.spv".format(shader[:-len(".comp")])])
+
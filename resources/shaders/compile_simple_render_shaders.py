@@ -5,7 +5,7 @@ import pathlib
 if __name__ == '__main__':
     glslang_cmd = "glslangValidator"
 
-    shader_list = ["simple.vert", "simple.frag"]
+    shader_list = ["simple.vert", "depth_prepass.vert", "simple.frag", "gbuffer.frag", "upscale.vert", "deferred_light.frag"]
 
     for shader in shader_list:
         subprocess.run([glslang_cmd, "-V", shader, "-o", "{}.spv".format(shader)])
@@ -0,0 +1,59 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.h"
+#include "gbuffer.h"
+
+layout(location = 0) out vec4 out_fragColor;
+
+layout(binding = 0, set = 0) uniform AppData
+{
+    UniformParams Params;
+};
+
+// written by the previous subpass, only the texel of this pixel can be read
+layout(input_attachment_index = 0, binding = 0, set = 1) uniform usubpassInput inGBuffer;
+layout(input_attachment_index = 1, binding = 1, set = 1) uniform subpassInput  inDepth;
+
+layout(push_constant) uniform params_t
+{
+    mat4 mInvProjView;
+    vec2 invScreenSize;
+} params;
+
+// same lights as simple.frag
+void main()
+{
+    const float depth = subpassLoad(inDepth).r;
+    if(depth == 1.0f) // nothing was drawn here, keep the clear color of the forward render
+    {
+        out_fragColor = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    vec3 albedo, N;
+    UnpackGBuffer(subpassLoad(inGBuffer).xy, albedo, N);
+
+    const vec2 ndc  = gl_FragCoord.xy * params.invScreenSize * 2.0f - 1.0f;
+    const vec4 wPos = params.mInvProjView * vec4(ndc, depth, 1.0f);
+    const vec3 pos  = wPos.xyz / wPos.w;
+
+    vec3 lightDir1 = normalize(Params.lightPos - pos);
+    vec3 lightDir2 = vec3(0.0f, 0.0f, 1.0f);
+
+    const vec4 dark_violet = vec4(0.59f, 0.0f, 0.82f, 1.0f);
+    const vec4 chartreuse  = vec4(0.5f, 1.0f, 0.0f, 1.0f);
+
+    vec4 lightColor1 = mix(dark_violet, chartreuse, 0.5f);
+    if(Params.animateLightColor)
+        lightColor1 = mix(dark_violet, chartreuse, abs(sin(Params.time)));
+
+    vec4 lightColor2 = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+    vec4 color1 = max(dot(N, lightDir1), 0.0f) * lightColor1;
+    vec4 color2 = max(dot(N, lightDir2), 0.0f) * lightColor2;
+    vec4 color_lights = mix(color1, color2, 0.2f);
+
+    out_fragColor = color_lights * vec4(albedo, 1.0f);
+}
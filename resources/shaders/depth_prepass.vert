@@ -0,0 +1,20 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 vPos;
+
+layout(push_constant) uniform params_t
+{
+    mat4 mProjView;
+    mat4 mModel;
+} params;
+
+// positions only, for the depth pre-pass and shadow passes (see SceneManager::GetPositionBuffer());
+// main pass tests depth for EQUAL, so position is computed exactly as in simple.vert
+out gl_PerVertex { invariant vec4 gl_Position; };
+
+void main(void)
+{
+    const vec3 wPos = (params.mModel * vec4(vPos, 1.0f)).xyz;
+    gl_Position     = params.mProjView * vec4(wPos, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.h"
+#include "gbuffer.h"
+
+layout(location = 0) out uvec2 out_gbuffer;
+
+layout (location = 0 ) in VS_OUT
+{
+    vec3 wPos;
+    vec3 wNorm;
+    vec3 wTangent;
+    vec2 texCoord;
+} surf;
+
+layout(binding = 0, set = 0) uniform AppData
+{
+    UniformParams Params;
+};
+
+// surface attributes only, lighting is done once per pixel in deferred_light.frag
+void main()
+{
+    out_gbuffer = PackGBuffer(Params.baseColor, surf.wNorm);
+}
@@ -0,0 +1,41 @@
+#ifndef VK_GRAPHICS_BASIC_GBUFFER_H
+#define VK_GRAPHICS_BASIC_GBUFFER_H
+
+// G-buffer texel of the deferred render, R32G32_UINT, 8 bytes per pixel:
+//   x - albedo, packed RGBA8 unorm (alpha is not used yet)
+//   y - world space normal, octahedral encoding packed to two snorm16
+// position is not stored, it is reconstructed from the depth buffer
+
+vec2 OctWrap(vec2 v)
+{
+  return (1.0f - abs(v.yx)) * vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+// unit vector to [-1, 1]^2: projected to the octahedron |x| + |y| + |z| = 1, lower half is folded over the diagonals
+vec2 OctEncode(vec3 n)
+{
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  return n.z >= 0.0f ? n.xy : OctWrap(n.xy);
+}
+
+vec3 OctDecode(vec2 f)
+{
+  vec3 n = vec3(f, 1.0f - abs(f.x) - abs(f.y));
+  const float t = clamp(-n.z, 0.0f, 1.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return normalize(n);
+}
+
+uvec2 PackGBuffer(vec3 a_albedo, vec3 a_normal)
+{
+  return uvec2(packUnorm4x8(vec4(a_albedo, 1.0f)), packSnorm2x16(OctEncode(normalize(a_normal))));
+}
+
+void UnpackGBuffer(uvec2 a_texel, out vec3 a_albedo, out vec3 a_normal)
+{
+  a_albedo = unpackUnorm4x8(a_texel.x).rgb;
+  a_normal = OctDecode(unpackSnorm2x16(a_texel.y));
+}
+
+#endif// VK_GRAPHICS_BASIC_GBUFFER_H
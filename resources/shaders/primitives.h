@@ -0,0 +1,217 @@
+#ifndef VK_GRAPHICS_BASIC_PRIMITIVES_H
+#define VK_GRAPHICS_BASIC_PRIMITIVES_H
+
+// needs PrimParams and PRIM_* from common.h; shaders compiled with PRIM_SUBGROUPS enable
+// GL_KHR_shader_subgroup_basic, _arithmetic and _ballot, group-wide operations then use subgroups instead of
+// a shared memory tree; local size must be PRIM_GROUP
+
+// every primitive uses the same bindings, the ones it doesn't need are bound to the scratch buffer
+layout(std430, binding = 0) readonly  buffer Input   { uint inputs[];  };  // floats of reduce as bits
+layout(std430, binding = 1) readonly  buffer Flags   { uint flags[];   };  // compaction keeps inputs with non-zero flags
+layout(std430, binding = 2) writeonly buffer Output  { uint outputs[]; };
+layout(std430, binding = 3) writeonly buffer Result  { uint result[];  };  // reduced value or number of kept elements
+layout(std430, binding = 4) coherent  buffer Scratch { uint scratch[]; };  // partial sums, tile states
+
+layout(push_constant) uniform params_t { PrimParams params; };
+
+shared uint primShared[PRIM_GROUP];
+shared uint primTotal;
+
+// position of the thread in the group; with subgroups, threads of a subgroup are consecutive whatever the
+// mapping of gl_LocalInvocationIndex to subgroups is, PRIM_GROUP must be a multiple of the subgroup size
+uint PrimRank()
+{
+#ifdef PRIM_SUBGROUPS
+  return gl_SubgroupID * gl_SubgroupSize + gl_SubgroupInvocationID;
+#else
+  return gl_LocalInvocationIndex;
+#endif
+}
+
+uint Identity(uint a_op, uint a_type)
+{
+  if (a_op == PRIM_OP_SUM)
+    return 0u;  // 0.0f too
+  if (a_type == PRIM_TYPE_FLOAT)
+    return a_op == PRIM_OP_MIN ? 0x7F800000u : 0xFF800000u;  // +inf, -inf
+  return a_op == PRIM_OP_MIN ? 0xFFFFFFFFu : 0u;
+}
+
+uint Combine(uint a, uint b, uint a_op, uint a_type)
+{
+  if (a_type == PRIM_TYPE_FLOAT)
+  {
+    const float x = uintBitsToFloat(a);
+    const float y = uintBitsToFloat(b);
+    return floatBitsToUint(a_op == PRIM_OP_SUM ? x + y : (a_op == PRIM_OP_MIN ? min(x, y) : max(x, y)));
+  }
+  return a_op == PRIM_OP_SUM ? a + b : (a_op == PRIM_OP_MIN ? min(a, b) : max(a, b));
+}
+
+#ifdef PRIM_SUBGROUPS
+uint SubgroupReduce(uint a_value, uint a_op, uint a_type)
+{
+  if (a_type == PRIM_TYPE_FLOAT)
+  {
+    const float x = uintBitsToFloat(a_value);
+    if (a_op == PRIM_OP_SUM)
+      return floatBitsToUint(subgroupAdd(x));
+    return floatBitsToUint(a_op == PRIM_OP_MIN ? subgroupMin(x) : subgroupMax(x));
+  }
+  if (a_op == PRIM_OP_SUM)
+    return subgroupAdd(a_value);
+  return a_op == PRIM_OP_MIN ? subgroupMin(a_value) : subgroupMax(a_value);
+}
+#endif
+
+// a_value combined over the whole group, returned to every thread
+uint GroupReduce(uint a_value, uint a_op, uint a_type)
+{
+#ifdef PRIM_SUBGROUPS
+  const uint x = SubgroupReduce(a_value, a_op, a_type);
+  if (subgroupElect())
+    primShared[gl_SubgroupID] = x;
+  barrier();
+
+  // the first subgroup combines the results of all subgroups, gl_SubgroupSize of them at once
+  if (gl_SubgroupID == 0)
+  {
+    uint acc = Identity(a_op, a_type);
+    for (uint first = 0; first < gl_NumSubgroups; first += gl_SubgroupSize)
+    {
+      const uint i = first + gl_SubgroupInvocationID;
+      acc = Combine(acc, SubgroupReduce(i < gl_NumSubgroups ? primShared[i] : Identity(a_op, a_type), a_op, a_type), a_op, a_type);
+    }
+    if (subgroupElect())
+      primTotal = acc;
+  }
+  barrier();
+  const uint total = primTotal;
+#else
+  const uint rank = PrimRank();
+  primShared[rank] = a_value;
+  barrier();
+  for (uint stride = PRIM_GROUP / 2; stride > 0; stride /= 2)
+  {
+    if (rank < stride)
+      primShared[rank] = Combine(primShared[rank], primShared[rank + stride], a_op, a_type);
+    barrier();
+  }
+  const uint total = primShared[0];
+#endif
+  barrier();  // shared memory is reused by the next call
+  return total;
+}
+
+// inclusive prefix sum of a_value over the threads of the group in PrimRank() order, a_total is the sum of all
+uint GroupInclusiveAdd(uint a_value, out uint a_total)
+{
+#ifdef PRIM_SUBGROUPS
+  const uint x = subgroupInclusiveAdd(a_value);
+  if (gl_SubgroupInvocationID == gl_SubgroupSize - 1)
+    primShared[gl_SubgroupID] = x;
+  barrier();
+
+  // the first subgroup replaces the sums of the subgroups with the sums of all subgroups before them
+  if (gl_SubgroupID == 0)
+  {
+    uint carry = 0;
+    for (uint first = 0; first < gl_NumSubgroups; first += gl_SubgroupSize)
+    {
+      const uint i   = first + gl_SubgroupInvocationID;
+      const uint sum = i < gl_NumSubgroups ? primShared[i] : 0;
+      const uint before = carry + subgroupExclusiveAdd(sum);
+      if (i < gl_NumSubgroups)
+        primShared[i] = before;
+      carry += subgroupAdd(sum);
+    }
+    if (subgroupElect())
+      primTotal = carry;
+  }
+  barrier();
+  const uint inclusive = x + primShared[gl_SubgroupID];
+  a_total = primTotal;
+#else
+  // Hillis-Steele: log2(PRIM_GROUP) steps over shared memory
+  const uint rank = PrimRank();
+  primShared[rank] = a_value;
+  barrier();
+  for (uint offset = 1; offset < PRIM_GROUP; offset *= 2)
+  {
+    const uint add = rank >= offset ? primShared[rank - offset] : 0;
+    barrier();
+    primShared[rank] += add;
+    barrier();
+  }
+  const uint inclusive = primShared[rank];
+  a_total = primShared[PRIM_GROUP - 1];
+#endif
+  barrier();  // shared memory is reused by the next call
+  return inclusive;
+}
+
+// element of the scanned sequence: a level of tile sums in scratch, 0 or 1 for flags of compaction, or an input
+uint LoadScanSource(uint i)
+{
+  if (params.src != PRIM_NONE)
+    return scratch[params.src + i];
+  if (params.mode == PRIM_MODE_COMPACT)
+    return flags[i] != 0 ? 1u : 0u;
+  return inputs[i];
+}
+
+// a_exclusive is the sum of all elements before i; levels in scratch are scanned exclusively in place
+void StoreScanResult(uint i, uint a_exclusive, uint a_value)
+{
+  if (params.dst != PRIM_NONE)
+    scratch[params.dst + i] = a_exclusive;
+  else if (params.mode == PRIM_MODE_COMPACT)
+  {
+    if (a_value != 0)
+      outputs[a_exclusive] = inputs[i];
+  }
+  else
+    outputs[i] = params.mode == PRIM_MODE_INCLUSIVE ? a_exclusive + a_value : a_exclusive;
+}
+
+// every thread takes element PrimRank() of each row of the tile so that loads are coalesced; returns the sum of
+// the tile, a_exclusive are sums of the elements of the tile before the ones of the thread
+uint ScanTile(uint a_tile, out uint a_values[PRIM_ITEMS], out uint a_exclusive[PRIM_ITEMS])
+{
+  const uint first = a_tile * PRIM_TILE + PrimRank();
+  for (uint row = 0; row < PRIM_ITEMS; ++row)
+  {
+    const uint i = first + row * PRIM_GROUP;
+    a_values[row] = i < params.length ? LoadScanSource(i) : 0;
+  }
+
+  uint sum = 0;
+  for (uint row = 0; row < PRIM_ITEMS; ++row)
+  {
+    uint rowSum;
+    a_exclusive[row] = sum + GroupInclusiveAdd(a_values[row], rowSum) - a_values[row];
+    sum += rowSum;
+  }
+  return sum;
+}
+
+void StoreTile(uint a_tile, uint a_carry, uint a_values[PRIM_ITEMS], uint a_exclusive[PRIM_ITEMS])
+{
+  const uint first = a_tile * PRIM_TILE + PrimRank();
+  for (uint row = 0; row < PRIM_ITEMS; ++row)
+  {
+    const uint i = first + row * PRIM_GROUP;
+    if (i < params.length)
+      StoreScanResult(i, a_carry + a_exclusive[row], a_values[row]);
+  }
+}
+
+// compaction writes the number of kept elements after the last tile of the input
+void StoreCount(uint a_tile, uint a_count)
+{
+  if (params.dst == PRIM_NONE && params.mode == PRIM_MODE_COMPACT && a_tile == (params.length - 1) / PRIM_TILE &&
+      PrimRank() == 0)
+    result[0] = a_count;
+}
+
+#endif// VK_GRAPHICS_BASIC_PRIMITIVES_H
@@ -24,7 +24,7 @@ layout (location = 0 ) out VS_OUT
 
 } vOut;
 
-out gl_PerVertex { vec4 gl_Position; };
+out gl_PerVertex { invariant vec4 gl_Position; }; // same depth as in depth_prepass.vert
 void main(void)
 {
     const vec4 wNorm = vec4(DecodeNormal(floatBitsToInt(vPosNorm.w)),         0.0f);
@@ -0,0 +1,43 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "unpack_attributes.h"
+
+
+layout(location = 0) in vec4 vPosNorm;
+layout(location = 1) in vec4 vTexCoordAndTang;
+
+layout(push_constant) uniform params_t
+{
+    mat4 mProjView;
+    mat4 mModel;  // not used, model matrix of the instance is taken from instanceMatrices
+} params;
+
+// draws come from GPU culling, firstInstance of every draw is the instance id
+layout(std430, binding = 2) readonly buffer InstanceMatrices { mat4 instanceMatrices[]; };
+
+
+layout (location = 0 ) out VS_OUT
+{
+    vec3 wPos;
+    vec3 wNorm;
+    vec3 wTangent;
+    vec2 texCoord;
+
+} vOut;
+
+out gl_PerVertex { vec4 gl_Position; };
+void main(void)
+{
+    const mat4 mModel = instanceMatrices[gl_InstanceIndex];
+    const vec4 wNorm = vec4(DecodeNormal(floatBitsToInt(vPosNorm.w)),         0.0f);
+    const vec4 wTang = vec4(DecodeNormal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
+
+    vOut.wPos     = (mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
+    vOut.wNorm    = normalize(AdjugateMatrix(mModel) * wNorm.xyz);
+    vOut.wTangent = normalize(AdjugateMatrix(mModel) * wTang.xyz);
+    vOut.texCoord = vTexCoordAndTang.xy;
+
+    gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
+}
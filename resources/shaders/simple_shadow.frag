@@ -3,6 +3,7 @@
 #extension GL_GOOGLE_include_directive : require
 
 #include "common.h"
+#include "clusters.h"
 
 layout(location = 0) out vec4 out_fragColor;
 
@@ -19,16 +20,114 @@ layout(binding = 0, set = 0) uniform AppData
   UniformParams Params;
 };
 
-layout (binding = 1) uniform sampler2D shadowMap;
+layout (binding = 1) uniform sampler2DArray shadowMap;
 
-void main()
+// clustered point lights, see light_binning.comp
+layout(std430, binding = 3) readonly buffer Lights       { PointLight lights[]; };
+layout(std430, binding = 4) readonly buffer LightCounts  { uint lightCounts[]; };
+layout(std430, binding = 5) readonly buffer LightIndices { uint lightIndices[]; };
+layout(binding = 6) uniform ClusterParamsUBO { ClusterParams clusters; };
+layout(binding = 7) uniform ShadowParamsUBO { ShadowParams shadows; };
+
+// point light shadows, see ShadowAtlas
+layout(std430, binding = 8) readonly buffer ShadowViews { ShadowView shadowViews[]; };
+layout(std430, binding = 9) readonly buffer LightViews  { uint lightViews[]; };
+layout(binding = 10) uniform sampler2D shadowAtlas;
+layout(binding = 11) uniform sampler2DArray shadowMoments; // blurred depth and its square, see shadow_blur.comp
+
+// 1 if the fragment is lit by the point light or the light is not shadowed, 0 if it is in shadow
+float PointLightShadow(uint a_light, vec3 a_lightPos)
 {
-  const vec4 posLightClipSpace = Params.lightMatrix*vec4(surf.wPos, 1.0f); // 
+  const uint firstView = lightViews[a_light];
+  if(firstView == NO_SHADOW)
+    return 1.0f;
+
+  // cube face by the major axis of the direction from the light: +X, -X, +Y, -Y, +Z, -Z
+  const vec3 dir  = surf.wPos - a_lightPos;
+  const vec3 axis = abs(dir);
+  uint face = 4 + (dir.z < 0.0f ? 1 : 0);
+  if(axis.x >= axis.y && axis.x >= axis.z)
+    face = dir.x < 0.0f ? 1 : 0;
+  else if(axis.y >= axis.z)
+    face = dir.y < 0.0f ? 3 : 2;
+  const ShadowView view = shadowViews[firstView + face];
+
+  // the position is pushed off the surface in proportion to the texel size at its distance
+  const float texel = 2.0f * length(dir) / (view.rect.z * float(SHADOW_ATLAS_SIZE));
+  const vec4  clip  = view.viewProj * vec4(surf.wPos + surf.wNorm * texel, 1.0f);
+  const vec3  ndc   = clip.xyz / clip.w;
+
+  // filtering must not reach neighbouring tiles
+  const vec2 halfTexel = vec2(0.5f / float(SHADOW_ATLAS_SIZE));
+  const vec2 uv        = clamp(view.rect.xy + (ndc.xy * 0.5f + 0.5f) * view.rect.zw, view.rect.xy + halfTexel,
+                               view.rect.xy + view.rect.zw - halfTexel);
+  return ndc.z < textureLod(shadowAtlas, uv, 0).x + 0.0005f ? 1.0f : 0.0f;
+}
+
+// point lights of the cluster of the fragment
+vec3 ClusteredLights()
+{
+  vec3 color = vec3(0.0f);
+  if(clusters.lightsNum == 0)
+    return color;
+
+  const float depth   = -(clusters.view * vec4(surf.wPos, 1.0f)).z;
+  const uint  cluster = ClusterIndex(clusters, gl_FragCoord.xy, depth);
+  const uint  count   = lightCounts[cluster];
+  for(uint i = 0; i < count; ++i)
+  {
+    const uint       index = lightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+    const PointLight light = lights[index];
+    const vec3  toLight = light.posAndRadius.xyz - surf.wPos;
+    const float dist    = max(length(toLight), 1e-4f);
+    const float lit     = max(dot(surf.wNorm, toLight / dist), 0.0f) * LightAttenuation(dist, light.posAndRadius.w);
+    if(lit > 0.0f)
+      color += lit * PointLightShadow(index, light.posAndRadius.xyz) * light.color.rgb;
+  }
+  return color;
+}
+
+// upper bound of the lit fraction of the filter footprint by Chebyshev's inequality
+float VarianceShadow(vec3 a_shadowCoord, uint a_layer)
+{
+  const vec2 moments = textureLod(shadowMoments, vec3(a_shadowCoord.xy, a_layer), 0).xy;
+  if(a_shadowCoord.z <= moments.x)
+    return 1.0f;
+  const float variance = max(moments.y - moments.x * moments.x, shadows.filtering.y);
+  const float delta    = a_shadowCoord.z - moments.x;
+  const float lit      = variance / (variance + delta * delta);
+  return clamp((lit - shadows.filtering.z) / (1.0f - shadows.filtering.z), 0.0f, 1.0f);
+}
+
+// 1 if the fragment is lit by the shadow casting light, 0 if it is in shadow, between them with variance shadow maps
+float Shadow()
+{
+  uint layer       = 0;
+  mat4 lightMatrix = Params.lightMatrix;
+  if(shadows.lightDir.w != 0.0f)
+  {
+    // the first cascade which reaches the fragment, beyond the last one nothing is shadowed
+    const float depth = dot(shadows.viewDepth, vec4(surf.wPos, 1.0f));
+    if(depth > shadows.splits[SHADOW_CASCADES - 1])
+      return 1.0f;
+    while(layer < SHADOW_CASCADES - 1 && depth > shadows.splits[layer])
+      layer++;
+    lightMatrix = shadows.cascadeMatrices[layer];
+  }
+
+  const vec4 posLightClipSpace = lightMatrix*vec4(surf.wPos, 1.0f); // 
   const vec3 posLightSpaceNDC  = posLightClipSpace.xyz/posLightClipSpace.w;    // for orto matrix, we don't need perspective division, you can remove it if you want; this is general case;
   const vec2 shadowTexCoord    = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);  // just shift coords from [-1,1] to [0,1]               
     
   const bool  outOfView = (shadowTexCoord.x < 0.0001f || shadowTexCoord.x > 0.9999f || shadowTexCoord.y < 0.0091f || shadowTexCoord.y > 0.9999f);
-  const float shadow    = ((posLightSpaceNDC.z < textureLod(shadowMap, shadowTexCoord, 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+  if(shadows.filtering.x != 0.0f)
+    return outOfView ? 1.0f : VarianceShadow(vec3(shadowTexCoord, posLightSpaceNDC.z), layer);
+  return ((posLightSpaceNDC.z < textureLod(shadowMap, vec3(shadowTexCoord, layer), 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+}
+
+void main()
+{
+  const float shadow = Shadow();
 
   const vec4 dark_violet = vec4(0.59f, 0.0f, 0.82f, 1.0f);
   const vec4 chartreuse  = vec4(0.5f, 1.0f, 0.0f, 1.0f);
@@ -36,7 +135,7 @@ void main()
   vec4 lightColor1 = mix(dark_violet, chartreuse, abs(sin(Params.time)));
   vec4 lightColor2 = vec4(1.0f, 1.0f, 1.0f, 1.0f);
    
-  vec3 lightDir   = normalize(Params.lightPos - surf.wPos);
+  vec3 lightDir   = shadows.lightDir.w != 0.0f ? shadows.lightDir.xyz : normalize(Params.lightPos - surf.wPos);
   vec4 lightColor = max(dot(surf.wNorm, lightDir), 0.0f) * lightColor1;
-  out_fragColor   = (lightColor*shadow + vec4(0.1f)) * vec4(Params.baseColor, 1.0f);
+  out_fragColor   = (lightColor*shadow + vec4(0.1f) + vec4(ClusteredLights(), 0.0f)) * vec4(Params.baseColor, 1.0f);
 }
@@ -0,0 +1,45 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) out vec4 color;
+
+layout (binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform params_t
+{
+  vec4 uvScaleAndMax;      // xy - rendered part of the image in uv, zw - last uv which is not blended with unrendered texels
+  vec4 texelAndSharpness;  // xy - texel size of the image, z - sharpness, 0 for plain bilinear
+} params;
+
+layout (location = 0 ) in VS_OUT
+{
+  vec2 texCoord;
+} surf;
+
+vec3 fetch(vec2 uv)
+{
+  return textureLod(sceneColor, clamp(uv, 0.5 * params.texelAndSharpness.xy, params.uvScaleAndMax.zw), 0).rgb;
+}
+
+void main()
+{
+  const vec2 uv = surf.texCoord * params.uvScaleAndMax.xy;
+  vec3 c = fetch(uv);
+
+  const float sharpness = params.texelAndSharpness.z;
+  if(sharpness > 0.0)
+  {
+    // unsharp mask with the 4 neighbours of the source texel, clamped to their range to avoid ringing on edges
+    const vec2 texel = params.texelAndSharpness.xy;
+    const vec3 l = fetch(uv - vec2(texel.x, 0));
+    const vec3 r = fetch(uv + vec2(texel.x, 0));
+    const vec3 t = fetch(uv - vec2(0, texel.y));
+    const vec3 b = fetch(uv + vec2(0, texel.y));
+
+    const vec3 minC = min(c, min(min(l, r), min(t, b)));
+    const vec3 maxC = max(c, max(max(l, r), max(t, b)));
+    c = clamp(c + sharpness * (c - 0.25 * (l + r + t + b)), minC, maxC);
+  }
+
+  color = vec4(c, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (location = 0 ) out VS_OUT
+{
+  vec2 texCoord;
+} vOut;
+
+// full screen triangle, texCoord is (0,0) in the top left corner of the screen
+void main() {
+  vec2 xy = gl_VertexIndex == 0 ? vec2(-1, -1) : (gl_VertexIndex == 1 ? vec2(3, -1) : vec2(-1, 3));
+  gl_Position   = vec4(xy, 0, 1);
+  vOut.texCoord = xy * 0.5 + 0.5;
+}
@@ -1,4 +1,5 @@
 #include "hydraxml.h"
+#include "../utils/profiler.h"
 
 #include <iostream>
 #include <sstream>
@@ -94,6 +95,7 @@ namespace hydra_xml
 #else
   int HydraScene::LoadState(const std::string &path)
   {
+    PROFILE_FUNCTION();
     auto loaded = m_xmlDoc.load_file(path.c_str());
 
     if(!loaded)
@@ -265,6 +267,7 @@ namespace hydra_xml
       inst.instId    = instNode.attribute(L"id").as_uint();
       inst.lightId   = instNode.attribute(L"light_id").as_uint(); 
       inst.lightNode = lights[inst.lightId];
+      inst.matrix    = float4x4FromString(instNode.attribute(L"matrix").as_string());
       result.push_back(inst);
     }
     return result;
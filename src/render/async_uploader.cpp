@@ -0,0 +1,404 @@
+#include "async_uploader.h"
+#include "../utils/profiler.h"
+#include <vk_utils.h>
+#include <vk_buffers.h>
+
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+  constexpr VkDeviceSize STAGING_ALIGNMENT = 16;  ///!< covers texel size of all formats uploaded through it
+
+  VkDeviceSize alignUp(VkDeviceSize a_value, VkDeviceSize a_alignment)
+  {
+    return (a_value + a_alignment - 1) / a_alignment * a_alignment;
+  }
+
+  double toMB(VkDeviceSize a_bytes)
+  {
+    return double(a_bytes) / (1024.0 * 1024.0);
+  }
+}
+
+AsyncUploader::AsyncUploader(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator,
+                             VkQueue a_transferQueue, uint32_t a_transferQId, VkQueue a_graphicsQueue, uint32_t a_graphicsQId,
+                             VkDeviceSize a_stagingSize) :
+  m_device(a_device), m_pAllocator(std::move(a_pAllocator)), m_transferQueue(a_transferQueue),
+  m_graphicsQueue(a_graphicsQueue), m_transferQId(a_transferQId), m_graphicsQId(a_graphicsQId),
+  m_stagingSize(alignUp(a_stagingSize, STAGING_ALIGNMENT))
+{
+  m_transferPool = vk_utils::createCommandPool(m_device, m_transferQId, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  if(!SameFamily())
+    m_graphicsPool = vk_utils::createCommandPool(m_device, m_graphicsQId, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+  m_staging      = vk_utils::createBuffer(m_device, m_stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+  m_stagingAlloc = m_pAllocator->AllocateForBuffer(m_staging, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+AsyncUploader::~AsyncUploader()
+{
+  WaitAll();
+
+  for(auto &pBatch : m_batches)
+  {
+    vkDestroyFence(m_device, pBatch->fence, nullptr);
+    vkDestroySemaphore(m_device, pBatch->transferDone, nullptr);
+  }
+  m_batches.clear();
+
+  vkDestroyCommandPool(m_device, m_transferPool, nullptr);
+  if(m_graphicsPool != VK_NULL_HANDLE)
+    vkDestroyCommandPool(m_device, m_graphicsPool, nullptr);
+
+  vkDestroyBuffer(m_device, m_staging, nullptr);
+  m_pAllocator->Free(m_stagingAlloc);
+}
+
+AsyncUploader::Batch &AsyncUploader::CurrentBatch()
+{
+  if(m_pCurrent != nullptr)
+    return *m_pCurrent;
+
+  // recycle whatever is already done before taking a new batch
+  while(PollOldest()) {}
+
+  if(m_freeBatches.empty())
+  {
+    auto pBatch = std::make_unique<Batch>();
+    pBatch->transferCmd = vk_utils::createCommandBuffers(m_device, m_transferPool, 1)[0];
+    if(!SameFamily())
+    {
+      pBatch->acquireCmd = vk_utils::createCommandBuffers(m_device, m_graphicsPool, 1)[0];
+
+      VkSemaphoreCreateInfo semaphoreInfo = {};
+      semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &pBatch->transferDone));
+    }
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &pBatch->fence));
+
+    m_freeBatches.push_back(pBatch.get());
+    m_batches.push_back(std::move(pBatch));
+  }
+
+  m_pCurrent = m_freeBatches.back();
+  m_freeBatches.pop_back();
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(m_pCurrent->transferCmd, &beginInfo));
+
+  return *m_pCurrent;
+}
+
+std::pair<VkBuffer, VkDeviceSize> AsyncUploader::AllocateStaging(VkDeviceSize a_size, void **a_ppMapped)
+{
+  // large uploads would block the ring for everyone, they get own staging buffer released with the batch
+  if(a_size > m_stagingSize / 2)
+  {
+    VkBuffer buffer = vk_utils::createBuffer(m_device, a_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    auto alloc = m_pAllocator->AllocateForBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    (*a_ppMapped) = alloc.mapped;
+    CurrentBatch().ownStaging.emplace_back(buffer, alloc);
+    return {buffer, 0};
+  }
+
+  while(true)
+  {
+    VkDeviceSize start = alignUp(m_ringHead, STAGING_ALIGNMENT);
+    if(start % m_stagingSize + a_size > m_stagingSize)
+      start = alignUp(start, m_stagingSize);  // doesn't fit before the end of the ring, wrap around
+
+    if(start + a_size - m_ringTail <= m_stagingSize)
+    {
+      m_ringHead = start + a_size;
+      (*a_ppMapped) = (char*)m_stagingAlloc.mapped + start % m_stagingSize;
+      return {m_staging, start % m_stagingSize};
+    }
+
+    // ring is full: submit the current batch if it is the one holding the space and wait for the oldest one
+    ++m_ringStalls;
+    if(m_inFlight.empty())
+      FlushImpl();
+
+    if(m_inFlight.empty())
+      m_ringHead = m_ringTail = alignUp(m_ringHead, m_stagingSize);  // nothing is in use, start from the beginning
+    else
+      RetireOldest();
+  }
+}
+
+void AsyncUploader::UploadBuffer(VkBuffer a_dst, VkDeviceSize a_dstOffset, const void *a_src, VkDeviceSize a_size)
+{
+  if(a_size == 0)
+    return;
+
+  void *pMapped = nullptr;
+  auto [src, srcOffset] = AllocateStaging(a_size, &pMapped);
+  memcpy(pMapped, a_src, a_size);
+
+  Batch &batch = CurrentBatch();
+
+  VkBufferCopy region = {};
+  region.srcOffset = srcOffset;
+  region.dstOffset = a_dstOffset;
+  region.size      = a_size;
+  vkCmdCopyBuffer(batch.transferCmd, src, a_dst, 1, &region);
+
+  bool known = false;
+  for(const auto &barrier : batch.bufferBarriers)
+    known = known || barrier.buffer == a_dst;
+
+  if(!known)
+  {
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = SameFamily() ? VK_QUEUE_FAMILY_IGNORED : m_transferQId;
+    barrier.dstQueueFamilyIndex = SameFamily() ? VK_QUEUE_FAMILY_IGNORED : m_graphicsQId;
+    barrier.buffer              = a_dst;
+    barrier.offset              = 0;
+    barrier.size                = VK_WHOLE_SIZE;
+    batch.bufferBarriers.push_back(barrier);
+  }
+
+  batch.copies++;
+  batch.bytes += a_size;
+}
+
+void AsyncUploader::UploadImage(VkImage a_dst, const void *a_src, uint32_t a_width, uint32_t a_height,
+                                uint32_t a_bytesPerPixel, VkImageLayout a_finalLayout)
+{
+  const VkDeviceSize size = VkDeviceSize(a_width) * a_height * a_bytesPerPixel;
+
+  void *pMapped = nullptr;
+  auto [src, srcOffset] = AllocateStaging(size, &pMapped);
+  memcpy(pMapped, a_src, size);
+
+  Batch &batch = CurrentBatch();
+
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask       = 0;
+  barrier.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image               = a_dst;
+  barrier.subresourceRange    = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  vkCmdPipelineBarrier(batch.transferCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                       0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region = {};
+  region.bufferOffset      = srcOffset;
+  region.imageSubresource  = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent       = VkExtent3D{a_width, a_height, 1};
+  vkCmdCopyBufferToImage(batch.transferCmd, src, a_dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+  // layout transition is done by the release (and acquire) barrier in Flush()
+  barrier.oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout           = a_finalLayout;
+  barrier.srcQueueFamilyIndex = SameFamily() ? VK_QUEUE_FAMILY_IGNORED : m_transferQId;
+  barrier.dstQueueFamilyIndex = SameFamily() ? VK_QUEUE_FAMILY_IGNORED : m_graphicsQId;
+  batch.imageBarriers.push_back(barrier);
+
+  batch.copies++;
+  batch.bytes += size;
+}
+
+AsyncUploader::Token AsyncUploader::Flush()
+{
+  return FlushImpl();
+}
+
+AsyncUploader::Token AsyncUploader::FlushImpl()
+{
+  if(m_pCurrent == nullptr)
+    return m_lastSubmitted;
+
+  PROFILE_FUNCTION();
+  Batch &batch = *m_pCurrent;
+  m_pCurrent = nullptr;
+
+  batch.token   = ++m_lastSubmitted;
+  batch.ringEnd = m_ringHead;
+
+  // release: make transfer writes available, for the same family this is the only barrier needed
+  for(auto &barrier : batch.bufferBarriers)
+  {
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = SameFamily() ? VK_ACCESS_MEMORY_READ_BIT : 0;
+  }
+  for(auto &barrier : batch.imageBarriers)
+  {
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = SameFamily() ? VK_ACCESS_MEMORY_READ_BIT : 0;
+  }
+
+  const VkPipelineStageFlags releaseDst = SameFamily() ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  vkCmdPipelineBarrier(batch.transferCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, releaseDst, 0, 0, nullptr,
+                       uint32_t(batch.bufferBarriers.size()), batch.bufferBarriers.data(),
+                       uint32_t(batch.imageBarriers.size()), batch.imageBarriers.data());
+  VK_CHECK_RESULT(vkEndCommandBuffer(batch.transferCmd));
+
+  VkSubmitInfo submitInfo = {};
+  submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers    = &batch.transferCmd;
+
+  if(SameFamily())
+  {
+    // graphics queue itself, so that later frames are ordered after the copies by the barrier above
+    VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, batch.fence));
+  }
+  else
+  {
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores    = &batch.transferDone;
+    VK_CHECK_RESULT(vkQueueSubmit(m_transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    // acquire: same barriers, access masks on the other side
+    for(auto &barrier : batch.bufferBarriers)
+    {
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    }
+    for(auto &barrier : batch.imageBarriers)
+    {
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(batch.acquireCmd, &beginInfo));
+    vkCmdPipelineBarrier(batch.acquireCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         0, nullptr, uint32_t(batch.bufferBarriers.size()), batch.bufferBarriers.data(),
+                         uint32_t(batch.imageBarriers.size()), batch.imageBarriers.data());
+    VK_CHECK_RESULT(vkEndCommandBuffer(batch.acquireCmd));
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo acquireInfo = {};
+    acquireInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    acquireInfo.waitSemaphoreCount = 1;
+    acquireInfo.pWaitSemaphores    = &batch.transferDone;
+    acquireInfo.pWaitDstStageMask  = &waitStage;
+    acquireInfo.commandBufferCount = 1;
+    acquireInfo.pCommandBuffers    = &batch.acquireCmd;
+    VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &acquireInfo, batch.fence));
+  }
+
+  m_totalBatches++;
+  m_totalCopies += batch.copies;
+  m_totalBytes  += batch.bytes;
+
+  m_inFlight.push_back(&batch);
+  return batch.token;
+}
+
+bool AsyncUploader::PollOldest()
+{
+  if(m_inFlight.empty() || vkGetFenceStatus(m_device, m_inFlight.front()->fence) != VK_SUCCESS)
+    return false;
+
+  RetireOldest();
+  return true;
+}
+
+void AsyncUploader::RetireOldest()
+{
+  Batch &batch = *m_inFlight.front();
+  m_inFlight.pop_front();
+
+  VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &batch.fence, VK_TRUE, UINT64_MAX));
+  VK_CHECK_RESULT(vkResetFences(m_device, 1, &batch.fence));
+
+  // batches are submitted and retired in order
+  m_ringTail      = batch.ringEnd;
+  m_lastCompleted = batch.token;
+
+  for(auto &[buffer, alloc] : batch.ownStaging)
+  {
+    vkDestroyBuffer(m_device, buffer, nullptr);
+    m_pAllocator->Free(alloc);
+  }
+
+  vkResetCommandBuffer(batch.transferCmd, 0);
+  if(batch.acquireCmd != VK_NULL_HANDLE)
+    vkResetCommandBuffer(batch.acquireCmd, 0);
+
+  batch.bufferBarriers.clear();
+  batch.imageBarriers.clear();
+  batch.ownStaging.clear();
+  batch.copies = 0;
+  batch.bytes  = 0;
+  m_freeBatches.push_back(&batch);
+}
+
+bool AsyncUploader::IsComplete(Token a_token)
+{
+  while(PollOldest()) {}
+  return a_token <= m_lastCompleted;
+}
+
+void AsyncUploader::Wait(Token a_token)
+{
+  PROFILE_FUNCTION();
+  if(a_token > m_lastSubmitted)
+    FlushImpl();
+
+  while(m_lastCompleted < a_token && !m_inFlight.empty())
+    RetireOldest();
+}
+
+void AsyncUploader::PrintStats() const
+{
+  std::cout << "[AsyncUploader] " << m_totalCopies << " copies in " << m_totalBatches << " submissions, "
+            << toMB(m_totalBytes) << " MB uploaded, staging ring " << toMB(m_stagingSize) << " MB was full "
+            << m_ringStalls << " times" << std::endl;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+vk_utils::VulkanImageMem createTextureFromDataLDR(DeviceAllocator &a_allocator, AsyncUploader &a_uploader,
+                                                  const unsigned char *a_data, uint32_t a_width, uint32_t a_height,
+                                                  VkFormat a_format, DeviceAllocation &a_outAlloc, VkImageUsageFlags a_usage)
+{
+  VkDevice device = a_allocator.GetDevice();
+
+  vk_utils::VulkanImageMem result = {};
+  result.format     = a_format;
+  result.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+  VkImageCreateInfo imageInfo = {};
+  imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imageInfo.format        = a_format;
+  imageInfo.extent        = VkExtent3D{a_width, a_height, 1};
+  imageInfo.mipLevels     = 1;
+  imageInfo.arrayLayers   = 1;
+  imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage         = a_usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK_RESULT(vkCreateImage(device, &imageInfo, nullptr, &result.image));
+
+  a_outAlloc = a_allocator.AllocateForImage(result.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  VkImageViewCreateInfo viewInfo = {};
+  viewInfo.sType            = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image            = result.image;
+  viewInfo.viewType         = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format           = a_format;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  VK_CHECK_RESULT(vkCreateImageView(device, &viewInfo, nullptr, &result.view));
+
+  a_uploader.UploadImage(result.image, a_data, a_width, a_height, 4, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  return result;
+}
@@ -0,0 +1,121 @@
+#ifndef VK_GRAPHICS_BASIC_ASYNC_UPLOADER_H
+#define VK_GRAPHICS_BASIC_ASYNC_UPLOADER_H
+
+#include "volk.h"
+#include "device_allocator.h"
+#include <vk_images.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+/**
+\brief Asynchronous uploads to device local buffers and images through the transfer queue.
+
+  Unlike vk_utils::ICopyEngine, uploads do not wait. Source data is copied into a persistently mapped staging ring
+  buffer right away, copy commands are recorded into the current batch and everything recorded since the previous
+  Flush() goes to the transfer queue in one submission. Flush() returns a completion token: IsComplete() / Wait()
+  are only needed when the CPU has to know that the copy is done, GPU consumers are ordered automatically.
+
+  When transfer and graphics queue families differ, ownership of uploaded resources is released on the transfer
+  queue and acquired on the graphics queue by a small command buffer which waits for the transfer submission.
+  Commands submitted to the graphics queue after Flush() see uploaded data without any extra synchronization.
+
+  Not thread safe: Flush() and uploads which overflow the staging ring submit to the graphics queue, so the uploader
+  belongs to the thread which submits frames.
+*/
+class AsyncUploader
+{
+public:
+  using Token = uint64_t;  ///!< 0 is "nothing uploaded", always complete
+
+  AsyncUploader(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator,
+                VkQueue a_transferQueue, uint32_t a_transferQId, VkQueue a_graphicsQueue, uint32_t a_graphicsQId,
+                VkDeviceSize a_stagingSize = 32 * 1024 * 1024);
+  ~AsyncUploader();
+
+  AsyncUploader(const AsyncUploader &) = delete;
+  AsyncUploader &operator=(const AsyncUploader &) = delete;
+
+  // a_src may be released right after the call. With different queue families content of a_dst outside of
+  // the ranges written in the same batch is undefined afterwards (ownership is not acquired by the transfer queue)
+  void UploadBuffer(VkBuffer a_dst, VkDeviceSize a_dstOffset, const void *a_src, VkDeviceSize a_size);
+  // whole mip level 0, layer 0 of a color image; the image is left in a_finalLayout
+  void UploadImage(VkImage a_dst, const void *a_src, uint32_t a_width, uint32_t a_height, uint32_t a_bytesPerPixel,
+                   VkImageLayout a_finalLayout);
+
+  // submit current batch, returns token of the last submitted batch if nothing was recorded
+  Token Flush();
+  bool  IsComplete(Token a_token);
+  void  Wait(Token a_token);
+  void  WaitAll() { Wait(Flush()); }
+
+  void PrintStats() const;
+
+private:
+  struct Batch
+  {
+    VkCommandBuffer transferCmd  = VK_NULL_HANDLE;
+    VkCommandBuffer acquireCmd   = VK_NULL_HANDLE;
+    VkSemaphore     transferDone = VK_NULL_HANDLE;
+    VkFence         fence        = VK_NULL_HANDLE;
+    Token           token        = 0;
+    VkDeviceSize    ringEnd      = 0;  ///!< staging ring position to release when the batch completes
+
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    std::vector<VkImageMemoryBarrier>  imageBarriers;
+    std::vector<std::pair<VkBuffer, DeviceAllocation>> ownStaging;  ///!< uploads which don't fit the ring
+    uint32_t     copies = 0;
+    VkDeviceSize bytes  = 0;
+  };
+
+  // returns staging buffer and offset for a_size bytes, may wait for earlier batches
+  std::pair<VkBuffer, VkDeviceSize> AllocateStaging(VkDeviceSize a_size, void **a_ppMapped);
+  Batch &CurrentBatch();
+  Token  FlushImpl();
+  void   RetireOldest();
+  bool   PollOldest();
+
+  bool SameFamily() const { return m_transferQId == m_graphicsQId; }
+
+  VkDevice                         m_device = VK_NULL_HANDLE;
+  std::shared_ptr<DeviceAllocator> m_pAllocator;
+
+  VkQueue  m_transferQueue = VK_NULL_HANDLE;
+  VkQueue  m_graphicsQueue = VK_NULL_HANDLE;
+  uint32_t m_transferQId   = UINT32_MAX;
+  uint32_t m_graphicsQId   = UINT32_MAX;
+
+  VkCommandPool m_transferPool = VK_NULL_HANDLE;
+  VkCommandPool m_graphicsPool = VK_NULL_HANDLE;
+
+  // staging ring, positions grow monotonically and are taken modulo m_stagingSize
+  VkBuffer         m_staging       = VK_NULL_HANDLE;
+  DeviceAllocation m_stagingAlloc;
+  VkDeviceSize     m_stagingSize   = 0;
+  VkDeviceSize     m_ringHead      = 0;
+  VkDeviceSize     m_ringTail      = 0;
+
+  Batch               *m_pCurrent = nullptr;
+  std::deque<Batch *>  m_inFlight;
+  std::vector<Batch *> m_freeBatches;
+  std::vector<std::unique_ptr<Batch>> m_batches;
+
+  Token m_lastSubmitted = 0;
+  Token m_lastCompleted = 0;
+
+  // over uploader lifetime
+  uint64_t     m_totalBatches = 0;
+  uint64_t     m_totalCopies  = 0;
+  VkDeviceSize m_totalBytes   = 0;
+  uint64_t     m_ringStalls   = 0;
+};
+
+// same as vk_utils::allocateColorTextureFromDataLDR (single mip level, 4 bytes per pixel), but memory is taken from
+// a_allocator and the upload is asynchronous; free memory with a_outAlloc instead of a_result.mem
+vk_utils::VulkanImageMem createTextureFromDataLDR(DeviceAllocator &a_allocator, AsyncUploader &a_uploader,
+                                                  const unsigned char *a_data, uint32_t a_width, uint32_t a_height,
+                                                  VkFormat a_format, DeviceAllocation &a_outAlloc,
+                                                  VkImageUsageFlags a_usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+#endif// VK_GRAPHICS_BASIC_ASYNC_UPLOADER_H
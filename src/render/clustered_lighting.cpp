@@ -0,0 +1,108 @@
+#include "clustered_lighting.h"
+#include "pipeline_builder.h"
+#include "../utils/profiler.h"
+
+#include <vk_utils.h>
+#include <vk_buffers.h>
+
+#include <cmath>
+#include <iostream>
+
+ClusteredLighting::ClusteredLighting(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator, PipelineCache &a_cache) :
+  m_device(a_device), m_pAllocator(std::move(a_pAllocator)), m_cache(a_cache)
+{
+  // the grid only depends on the CLUSTER_* constants, it is fully written by every binning
+  const VkDeviceSize countsSize  = VkDeviceSize(CLUSTERS_NUM) * sizeof(uint32_t);
+  const VkDeviceSize indicesSize = VkDeviceSize(CLUSTERS_NUM) * MAX_LIGHTS_PER_CLUSTER * sizeof(uint32_t);
+  m_paramsBuf  = vk_utils::createBuffer(m_device, sizeof(ClusterParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_countsBuf  = vk_utils::createBuffer(m_device, countsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  m_indicesBuf = vk_utils::createBuffer(m_device, indicesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  m_alloc      = m_pAllocator->AllocateForBuffers({m_paramsBuf, m_countsBuf, m_indicesBuf}, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+  DestroyPipeline();
+  m_pBindings = nullptr;
+
+  for(auto buffer : {m_paramsBuf, m_countsBuf, m_indicesBuf})
+  {
+    if(buffer != VK_NULL_HANDLE)
+      vkDestroyBuffer(m_device, buffer, nullptr);
+  }
+  m_pAllocator->Free(m_alloc);
+}
+
+void ClusteredLighting::SetScene(const SceneManager &a_scene)
+{
+  PROFILE_FUNCTION();
+  DestroyPipeline();
+  m_lightsNum = a_scene.LightsNum();
+
+  std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3},
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1}
+  };
+  m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 1);
+
+  m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+  m_pBindings->BindBuffer(0, a_scene.GetLightsBuffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(1, m_countsBuf,  VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(2, m_indicesBuf, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(3, m_paramsBuf,  VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  m_pBindings->BindEnd(&m_binDS, &m_binDSLayout);
+
+  m_binPipeline = PipelineBuilder::BuildCompute(m_device, m_cache, "../resources/shaders/light_binning.comp.spv",
+                                                m_binDSLayout, 0, &m_binLayout);
+
+  std::cout << "[ClusteredLighting] " << m_lightsNum << " point lights, " << CLUSTER_TILES_X << "x" << CLUSTER_TILES_Y
+            << "x" << CLUSTER_SLICES << " clusters" << std::endl;
+}
+
+void ClusteredLighting::DestroyPipeline()
+{
+  if(m_binPipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(m_device, m_binPipeline, nullptr);
+  if(m_binLayout != VK_NULL_HANDLE)
+    vkDestroyPipelineLayout(m_device, m_binLayout, nullptr);
+  m_binPipeline = VK_NULL_HANDLE;
+  m_binLayout   = VK_NULL_HANDLE;
+}
+
+void ClusteredLighting::CmdBinLights(VkCommandBuffer a_cmdBuff, const LiteMath::float4x4 &a_view, const LiteMath::float4x4 &a_proj,
+                                     VkExtent2D a_viewport, float a_zNear, float a_zFar)
+{
+  PROFILE_FUNCTION();
+  const bool dispatch = m_enabled && m_lightsNum != 0 && m_binPipeline != VK_NULL_HANDLE;
+
+  // slice = CLUSTER_SLICES * log(depth / near) / log(far / near)
+  const float sliceScale = float(CLUSTER_SLICES) / std::log(a_zFar / a_zNear);
+  m_params.view           = a_view;
+  m_params.viewport       = LiteMath::float4(float(a_viewport.width), float(a_viewport.height), 0.0f, 0.0f);
+  m_params.projection     = LiteMath::float4(a_proj(0, 0), a_proj(1, 1), a_zNear, a_zFar);
+  m_params.sliceScaleBias = LiteMath::float4(sliceScale, -sliceScale * std::log(a_zNear), 0.0f, 0.0f);
+  m_params.lightsNum      = dispatch ? m_lightsNum : 0u;
+
+  // the previous frame may still shade with the parameters and the grid
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+  vkCmdUpdateBuffer(a_cmdBuff, m_paramsBuf, 0, sizeof(m_params), &m_params);
+
+  VkMemoryBarrier barrier = {};
+  barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       0, 1, &barrier, 0, nullptr, 0, nullptr);
+  if(!dispatch)
+    return;
+
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_binPipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_binLayout, 0, 1, &m_binDS, 0, nullptr);
+  vkCmdDispatch(a_cmdBuff, CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES);
+
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
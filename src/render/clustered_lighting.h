@@ -0,0 +1,72 @@
+#ifndef VK_GRAPHICS_BASIC_CLUSTERED_LIGHTING_H
+#define VK_GRAPHICS_BASIC_CLUSTERED_LIGHTING_H
+
+#include "volk.h"
+#include "device_allocator.h"
+#include "pipeline_cache.h"
+#include "scene_mgr.h"
+#include "../../resources/shaders/common.h"
+#include <vk_descriptor_sets.h>
+
+#include <memory>
+
+/**
+\brief Clustered forward lighting: point lights of the scene are binned to a froxel grid of the main view every frame.
+
+  The view frustum is split into CLUSTER_TILES_X x CLUSTER_TILES_Y screen tiles and CLUSTER_SLICES depth slices with
+  exponential spacing. CmdBinLights() runs a compute group per cluster which tests the bounding spheres of all lights
+  against the view space box of the cluster and writes up to MAX_LIGHTS_PER_CLUSTER light indices for it.
+  Fragment shaders find their cluster from gl_FragCoord and view depth (see clusters.h) and loop only over its lights,
+  so shading cost depends on how many lights overlap a pixel, not on the number of lights in the scene.
+
+  Shaders read the scene light buffer, GetCountsBuffer(), GetIndicesBuffer() and GetParamsBuffer() (ClusterParams).
+*/
+class ClusteredLighting
+{
+public:
+  ClusteredLighting(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator, PipelineCache &a_cache);
+  ~ClusteredLighting();
+
+  ClusteredLighting(const ClusteredLighting &) = delete;
+  ClusteredLighting &operator=(const ClusteredLighting &) = delete;
+
+  // light buffer of the scene is read every frame, frames which use the previous one must be finished
+  void SetScene(const SceneManager &a_scene);
+
+  // if disabled, lightsNum of the parameters is 0 and shaders skip clustered lights, binning is not dispatched
+  void SetEnabled(bool a_enabled) { m_enabled = a_enabled; }
+  bool Enabled() const { return m_enabled; }
+
+  // outside of a render pass; a_proj must be symmetric, a_viewport is the part of the target the main pass renders to,
+  // a_zNear and a_zFar bound the slices; results are visible to fragment shaders afterwards
+  void CmdBinLights(VkCommandBuffer a_cmdBuff, const LiteMath::float4x4 &a_view, const LiteMath::float4x4 &a_proj,
+                    VkExtent2D a_viewport, float a_zNear, float a_zFar);
+
+  VkBuffer GetParamsBuffer()  const { return m_paramsBuf; }
+  VkBuffer GetCountsBuffer()  const { return m_countsBuf; }   ///!< uint per cluster
+  VkBuffer GetIndicesBuffer() const { return m_indicesBuf; }  ///!< MAX_LIGHTS_PER_CLUSTER uints per cluster
+
+private:
+  void DestroyPipeline();
+
+  VkDevice                         m_device = VK_NULL_HANDLE;
+  std::shared_ptr<DeviceAllocator> m_pAllocator;
+  PipelineCache                   &m_cache;
+  bool                             m_enabled = true;
+
+  uint32_t      m_lightsNum = 0;
+  ClusterParams m_params {};
+
+  VkBuffer         m_paramsBuf  = VK_NULL_HANDLE;
+  VkBuffer         m_countsBuf  = VK_NULL_HANDLE;
+  VkBuffer         m_indicesBuf = VK_NULL_HANDLE;
+  DeviceAllocation m_alloc;
+
+  std::shared_ptr<vk_utils::DescriptorMaker> m_pBindings;
+  VkDescriptorSet       m_binDS       = VK_NULL_HANDLE;
+  VkDescriptorSetLayout m_binDSLayout = VK_NULL_HANDLE;
+  VkPipelineLayout      m_binLayout   = VK_NULL_HANDLE;
+  VkPipeline            m_binPipeline = VK_NULL_HANDLE;
+};
+
+#endif// VK_GRAPHICS_BASIC_CLUSTERED_LIGHTING_H
@@ -4,6 +4,7 @@
 #include "volk.h"
 #include "vk_utils.h"
 #include <cstring>
+#include <algorithm>
 //#include <memory>
 
 
@@ -14,6 +15,16 @@ struct pipeline_data_t
 };
 
 
+// groups of a_groupSize threads needed to cover a_count elements, at most a_maxGroups
+// (VkPhysicalDeviceLimits::maxComputeWorkGroupCount); if the grid is smaller, shaders loop over the elements
+// with a stride of the whole grid
+inline uint32_t GridSize(uint64_t a_count, uint32_t a_groupSize, uint32_t a_maxGroups)
+{
+  const uint64_t groups = (a_count + a_groupSize - 1) / a_groupSize;
+  return static_cast<uint32_t>(std::min<uint64_t>(std::max<uint64_t>(groups, 1), a_maxGroups));
+}
+
+
 class ICompute
 {
 public:
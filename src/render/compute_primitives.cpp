@@ -0,0 +1,345 @@
+#include "compute_primitives.h"
+#include "compute_common.h"
+#include "pipeline_builder.h"
+#include "../utils/profiler.h"
+
+#include <vk_buffers.h>
+#include <vk_utils.h>
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+  uint32_t TilesNum(uint64_t a_length) { return static_cast<uint32_t>((a_length + PRIM_TILE - 1) / PRIM_TILE); }
+
+  void CmdBarrier(VkCommandBuffer a_cmdBuff, VkPipelineStageFlags a_srcStage, VkAccessFlags a_srcAccess,
+                  VkPipelineStageFlags a_dstStage, VkAccessFlags a_dstAccess)
+  {
+    VkMemoryBarrier barrier = {};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = a_srcAccess;
+    barrier.dstAccessMask = a_dstAccess;
+    vkCmdPipelineBarrier(a_cmdBuff, a_srcStage, a_dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  // between dispatches of one primitive
+  void CmdComputeBarrier(VkCommandBuffer a_cmdBuff)
+  {
+    CmdBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+  }
+
+  // the previous primitive may still use the scratch buffer
+  void CmdScratchBarrier(VkCommandBuffer a_cmdBuff)
+  {
+    CmdBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+               VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+  }
+
+  PrimParams MakeParams(uint32_t a_length)
+  {
+    PrimParams params = {};
+    params.length = a_length;
+    params.src    = PRIM_NONE;
+    params.dst    = PRIM_NONE;
+    params.carry  = PRIM_NONE;
+    return params;
+  }
+}
+
+bool ComputePrimitives::SubgroupsSupported(VkPhysicalDevice a_physDevice)
+{
+  VkPhysicalDeviceSubgroupProperties subgroup = {};
+  subgroup.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+  VkPhysicalDeviceProperties2 props = {};
+  props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  props.pNext = &subgroup;
+  vkGetPhysicalDeviceProperties2(a_physDevice, &props);
+
+  const VkSubgroupFeatureFlags needed = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT |
+                                        VK_SUBGROUP_FEATURE_BALLOT_BIT;
+  return props.properties.apiVersion >= VK_API_VERSION_1_1 &&
+         (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+         (subgroup.supportedOperations & needed) == needed &&
+         subgroup.subgroupSize != 0 && PRIM_GROUP % subgroup.subgroupSize == 0;
+}
+
+ComputePrimitives::ComputePrimitives(VkDevice a_device, VkPhysicalDevice a_physDevice,
+                                     std::shared_ptr<DeviceAllocator> a_pAllocator, PipelineCache &a_cache,
+                                     uint32_t a_framesInFlight)
+  : m_device(a_device), m_pAllocator(std::move(a_pAllocator)), m_cache(a_cache), m_framePools(std::max(a_framesInFlight, 1u))
+{
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(a_physDevice, &props);
+  m_maxGroups  = props.limits.maxComputeWorkGroupCount[0];
+  m_subgroups  = SubgroupsSupported(a_physDevice);
+  m_singlePass = m_subgroups;
+
+  // every primitive uses the same bindings, the ones it doesn't need are bound to the scratch buffer
+  std::array<VkDescriptorSetLayoutBinding, 5> bindings = {};
+  for(uint32_t i = 0; i < bindings.size(); ++i)
+  {
+    bindings[i].binding         = i;
+    bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings    = bindings.data();
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_dsLayout));
+}
+
+ComputePrimitives::~ComputePrimitives()
+{
+  DestroyPipelines();
+  DestroyScratch();
+
+  for(auto &frame : m_framePools)
+    for(VkDescriptorPool pool : frame.pools)
+      vkDestroyDescriptorPool(m_device, pool, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_dsLayout, nullptr);
+}
+
+std::vector<ComputePrimitives::Level> ComputePrimitives::ScanLevels(uint32_t a_length) const
+{
+  std::vector<Level> levels;
+  uint32_t offset = 0;
+  uint32_t length = a_length;
+  while(length > PRIM_TILE)
+  {
+    length = TilesNum(length);
+    levels.push_back({offset, length});
+    offset += length;
+  }
+  return levels;
+}
+
+void ComputePrimitives::SetMaxLength(uint32_t a_maxLength)
+{
+  PROFILE_FUNCTION();
+  DestroyPipelines();
+  DestroyScratch();
+  m_maxLength = a_maxLength;
+
+  // partial results of reduce, tile states of the single pass scan or levels of the multi-pass one
+  VkDeviceSize scratchLength = std::max<VkDeviceSize>(PRIM_REDUCE_GROUPS, 1 + 3 * VkDeviceSize(TilesNum(a_maxLength)));
+  const auto levels = ScanLevels(a_maxLength);
+  if(!levels.empty())
+    scratchLength = std::max<VkDeviceSize>(scratchLength, levels.back().offset + levels.back().length);
+
+  m_scratch      = vk_utils::createBuffer(m_device, sizeof(uint32_t) * scratchLength,
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_scratchAlloc = m_pAllocator->AllocateForBuffer(m_scratch, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  const std::string suffix = m_subgroups ? "_subgroup.comp.spv" : ".comp.spv";
+  auto build = [this, &suffix](const std::string &a_name, Kernel &a_kernel) {
+    a_kernel.pipeline = PipelineBuilder::BuildCompute(m_device, m_cache, "../resources/shaders/" + a_name + suffix,
+                                                      m_dsLayout, sizeof(PrimParams), &a_kernel.layout);
+  };
+  build("prim_reduce", m_reduce);
+  build("prim_tile_reduce", m_tileReduce);
+  build("prim_tile_scan", m_tileScan);
+  if(m_subgroups)
+    build("prim_scan", m_scan);
+}
+
+void ComputePrimitives::DestroyPipelines()
+{
+  for(Kernel *kernel : {&m_reduce, &m_tileReduce, &m_tileScan, &m_scan})
+  {
+    if(kernel->pipeline != VK_NULL_HANDLE)
+      vkDestroyPipeline(m_device, kernel->pipeline, nullptr);
+    if(kernel->layout != VK_NULL_HANDLE)
+      vkDestroyPipelineLayout(m_device, kernel->layout, nullptr);
+    *kernel = Kernel{};
+  }
+}
+
+void ComputePrimitives::DestroyScratch()
+{
+  if(m_scratch != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_scratch, nullptr);
+    m_pAllocator->Free(m_scratchAlloc);
+  }
+  m_scratch   = VK_NULL_HANDLE;
+  m_maxLength = 0;
+}
+
+void ComputePrimitives::BeginFrame(uint32_t a_frame)
+{
+  if(a_frame >= m_framePools.size())
+    RUN_TIME_ERROR("[ComputePrimitives::BeginFrame] frame is out of frames in flight");
+
+  m_frame = a_frame;
+  auto &frame = m_framePools[m_frame];
+  for(VkDescriptorPool pool : frame.pools)
+    VK_CHECK_RESULT(vkResetDescriptorPool(m_device, pool, 0));
+  frame.setsUsed = 0;
+}
+
+VkDescriptorSet ComputePrimitives::NewSet(const BufferSet &a_buffers)
+{
+  auto &frame = m_framePools[m_frame];
+  if(frame.setsUsed == frame.pools.size() * SETS_PER_POOL)
+  {
+    VkDescriptorPoolSize poolSize = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * SETS_PER_POOL};
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets       = SETS_PER_POOL;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes    = &poolSize;
+    VkDescriptorPool pool  = VK_NULL_HANDLE;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &pool));
+    frame.pools.push_back(pool);
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool     = frame.pools[frame.setsUsed / SETS_PER_POOL];
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts        = &m_dsLayout;
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(m_device, &allocInfo, &set));
+  frame.setsUsed++;
+
+  std::array<VkDescriptorBufferInfo, 5> bufferInfos = {};
+  std::array<VkWriteDescriptorSet, 5>   writes      = {};
+  for(uint32_t i = 0; i < writes.size(); ++i)
+  {
+    const VkBuffer buffer = i < a_buffers.size() && a_buffers[i] != VK_NULL_HANDLE ? a_buffers[i] : m_scratch;
+    bufferInfos[i] = VkDescriptorBufferInfo{buffer, 0, VK_WHOLE_SIZE};
+
+    writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet          = set;
+    writes[i].dstBinding      = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo     = &bufferInfos[i];
+  }
+  vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+  return set;
+}
+
+void ComputePrimitives::CmdDispatch(VkCommandBuffer a_cmdBuff, const Kernel &a_kernel, VkDescriptorSet a_set,
+                                    const PrimParams &a_params, uint32_t a_groups)
+{
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, a_kernel.pipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, a_kernel.layout, 0, 1, &a_set, 0, nullptr);
+  vkCmdPushConstants(a_cmdBuff, a_kernel.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PrimParams), &a_params);
+  vkCmdDispatch(a_cmdBuff, a_groups, 1, 1);
+}
+
+void ComputePrimitives::CmdReduce(VkCommandBuffer a_cmdBuff, VkBuffer a_input, uint32_t a_length, Op a_op, Type a_type,
+                                  VkBuffer a_result)
+{
+  PROFILE_FUNCTION();
+  if(a_length > m_maxLength)
+    RUN_TIME_ERROR("[ComputePrimitives::CmdReduce] length is larger than SetMaxLength()");
+
+  CmdScratchBarrier(a_cmdBuff);
+  const VkDescriptorSet set = NewSet({a_input, VK_NULL_HANDLE, VK_NULL_HANDLE, a_result});
+
+  PrimParams params = MakeParams(a_length);
+  params.op   = static_cast<uint32_t>(a_op);
+  params.type = static_cast<uint32_t>(a_type);
+
+  const uint32_t groups = GridSize(a_length, PRIM_GROUP * PRIM_ITEMS, std::min<uint32_t>(m_maxGroups, PRIM_REDUCE_GROUPS));
+  if(groups == 1)
+  {
+    CmdDispatch(a_cmdBuff, m_reduce, set, params, 1);
+    return;
+  }
+
+  // partial result per group, then one group combines them
+  params.dst = 0;
+  CmdDispatch(a_cmdBuff, m_reduce, set, params, groups);
+  CmdComputeBarrier(a_cmdBuff);
+
+  params.length = groups;
+  params.src    = 0;
+  params.dst    = PRIM_NONE;
+  CmdDispatch(a_cmdBuff, m_reduce, set, params, 1);
+}
+
+void ComputePrimitives::CmdScan(VkCommandBuffer a_cmdBuff, VkBuffer a_input, VkBuffer a_output, uint32_t a_length,
+                                bool a_inclusive)
+{
+  PROFILE_FUNCTION();
+  if(a_length > m_maxLength)
+    RUN_TIME_ERROR("[ComputePrimitives::CmdScan] length is larger than SetMaxLength()");
+  if(a_length == 0)
+    return;
+
+  CmdScratchBarrier(a_cmdBuff);
+  const VkDescriptorSet set = NewSet({a_input, VK_NULL_HANDLE, a_output, VK_NULL_HANDLE});
+  CmdScanImpl(a_cmdBuff, set, a_length, a_inclusive ? PRIM_MODE_INCLUSIVE : PRIM_MODE_EXCLUSIVE);
+}
+
+void ComputePrimitives::CmdCompact(VkCommandBuffer a_cmdBuff, VkBuffer a_values, VkBuffer a_flags, VkBuffer a_output,
+                                   VkBuffer a_count, uint32_t a_length)
+{
+  PROFILE_FUNCTION();
+  if(a_length > m_maxLength)
+    RUN_TIME_ERROR("[ComputePrimitives::CmdCompact] length is larger than SetMaxLength()");
+
+  if(a_length == 0)
+  {
+    vkCmdFillBuffer(a_cmdBuff, a_count, 0, sizeof(uint32_t), 0);
+    return;
+  }
+
+  CmdScratchBarrier(a_cmdBuff);
+  const VkDescriptorSet set = NewSet({a_values, a_flags, a_output, a_count});
+  CmdScanImpl(a_cmdBuff, set, a_length, PRIM_MODE_COMPACT);
+}
+
+void ComputePrimitives::CmdScanImpl(VkCommandBuffer a_cmdBuff, VkDescriptorSet a_set, uint32_t a_length, uint32_t a_mode)
+{
+  PrimParams params = MakeParams(a_length);
+  params.mode = a_mode;
+
+  if(m_singlePass)
+  {
+    // tile counter and states of all tiles start from zero
+    vkCmdFillBuffer(a_cmdBuff, m_scratch, 0, sizeof(uint32_t) * (1 + 3 * VkDeviceSize(TilesNum(a_length))), 0);
+    CmdBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    CmdDispatch(a_cmdBuff, m_scan, a_set, params, GridSize(a_length, PRIM_TILE, m_maxGroups));
+    return;
+  }
+
+  // up-sweep: sums of the tiles of every level are the next level
+  const auto levels = ScanLevels(a_length);
+  for(size_t k = 0; k < levels.size(); ++k)
+  {
+    PrimParams up = params;
+    up.length = k == 0 ? a_length : levels[k - 1].length;
+    up.src    = k == 0 ? PRIM_NONE : levels[k - 1].offset;
+    up.dst    = levels[k].offset;
+    CmdDispatch(a_cmdBuff, m_tileReduce, a_set, up, GridSize(up.length, PRIM_TILE, m_maxGroups));
+    CmdComputeBarrier(a_cmdBuff);
+  }
+
+  // down-sweep: levels are scanned exclusively in place from the last one, which is a single tile, and give
+  // every tile of the level below the sum of all tiles before it
+  for(size_t k = levels.size(); k-- > 0;)
+  {
+    PrimParams down = params;
+    down.mode   = PRIM_MODE_EXCLUSIVE;
+    down.length = levels[k].length;
+    down.src    = levels[k].offset;
+    down.dst    = levels[k].offset;
+    down.carry  = k + 1 < levels.size() ? levels[k + 1].offset : PRIM_NONE;
+    CmdDispatch(a_cmdBuff, m_tileScan, a_set, down, GridSize(down.length, PRIM_TILE, m_maxGroups));
+    CmdComputeBarrier(a_cmdBuff);
+  }
+
+  params.carry = levels.empty() ? PRIM_NONE : levels[0].offset;
+  CmdDispatch(a_cmdBuff, m_tileScan, a_set, params, GridSize(a_length, PRIM_TILE, m_maxGroups));
+}
@@ -0,0 +1,137 @@
+#ifndef VK_GRAPHICS_BASIC_COMPUTE_PRIMITIVES_H
+#define VK_GRAPHICS_BASIC_COMPUTE_PRIMITIVES_H
+
+#include "volk.h"
+#include "device_allocator.h"
+#include "pipeline_cache.h"
+#include "../../resources/shaders/common.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+/**
+\brief Parallel primitives on buffers of 32 bit elements: reduce, inclusive and exclusive scan, stream compaction.
+
+  Reduce (sum, min or max of uints or floats) is two dispatches: at most PRIM_REDUCE_GROUPS groups combine
+  elements a grid apart and write partial results, one group combines them.
+
+  Scan and compaction (an exclusive scan of the flags followed by a scatter) take tiles of PRIM_TILE elements.
+  When the device has subgroup arithmetic and ballot in compute shaders, it's a single pass with decoupled
+  look-back: every tile publishes its sum and finds the sum of all previous tiles from the published ones, so the
+  input is read once. Otherwise (or with SetSinglePass(false)) it's reduce-then-scan: tile sums are written and
+  scanned level by level, the input is read twice. Group-wide operations use subgroups wherever they are supported.
+
+  Buffers are bound whole and must not be larger than maxStorageBufferRange, the length is limited by
+  SetMaxLength(). Every Cmd* call takes a new descriptor set from the pools of the current frame, so buffers
+  may be destroyed and their handles reused once the frames which used them are finished. BeginFrame(a_frame)
+  must be called before recording a frame: it resets the pools of a_frame, whose command buffers must have
+  finished by then.
+  Cmd* are recorded outside of a render pass; writes of the inputs must be made visible to compute shaders by the
+  caller, as well as the results to whatever reads them.
+*/
+class ComputePrimitives
+{
+public:
+  enum class Op : uint32_t
+  {
+    SUM = PRIM_OP_SUM,
+    MIN = PRIM_OP_MIN,
+    MAX = PRIM_OP_MAX
+  };
+
+  enum class Type : uint32_t
+  {
+    UINT  = PRIM_TYPE_UINT,
+    FLOAT = PRIM_TYPE_FLOAT
+  };
+
+  // subgroup arithmetic and ballot in compute shaders with subgroups which fill a group of PRIM_GROUP threads
+  static bool SubgroupsSupported(VkPhysicalDevice a_physDevice);
+
+  ComputePrimitives(VkDevice a_device, VkPhysicalDevice a_physDevice, std::shared_ptr<DeviceAllocator> a_pAllocator,
+                    PipelineCache &a_cache, uint32_t a_framesInFlight = 1);
+  ~ComputePrimitives();
+
+  ComputePrimitives(const ComputePrimitives &) = delete;
+  ComputePrimitives &operator=(const ComputePrimitives &) = delete;
+
+  // scratch memory for up to a_maxLength elements, frames which use the previous one must be finished
+  void SetMaxLength(uint32_t a_maxLength);
+
+  // descriptor sets of a_frame are freed and Cmd* take new ones from its pools until the next call
+  void BeginFrame(uint32_t a_frame);
+
+  // single pass scan if subgroups are supported, multi-pass otherwise
+  void SetSinglePass(bool a_enabled) { m_singlePass = a_enabled && m_subgroups; }
+  bool SinglePass() const { return m_singlePass; }
+  bool Subgroups() const { return m_subgroups; }
+
+  // a_result[0] = a_input[0] op ... op a_input[a_length - 1], identity of op if a_length is 0
+  void CmdReduce(VkCommandBuffer a_cmdBuff, VkBuffer a_input, uint32_t a_length, Op a_op, Type a_type, VkBuffer a_result);
+
+  // a_output[i] = sum of a_input[0..i], i included if a_inclusive; a_output may be a_input
+  void CmdScan(VkCommandBuffer a_cmdBuff, VkBuffer a_input, VkBuffer a_output, uint32_t a_length, bool a_inclusive);
+
+  // a_values[i] with non-zero a_flags[i] are written to a_output in the same order, their number to a_count[0]
+  // (by vkCmdFillBuffer if a_length is 0, a_count needs transfer dst usage); a_output must not be a_values
+  void CmdCompact(VkCommandBuffer a_cmdBuff, VkBuffer a_values, VkBuffer a_flags, VkBuffer a_output, VkBuffer a_count,
+                  uint32_t a_length);
+
+private:
+  static constexpr uint32_t SETS_PER_POOL = 16;
+
+  // input, flags, output, result
+  using BufferSet = std::array<VkBuffer, 4>;
+
+  struct Kernel
+  {
+    VkPipelineLayout layout   = VK_NULL_HANDLE;
+    VkPipeline       pipeline = VK_NULL_HANDLE;
+  };
+
+  // level k + 1 of the multi-pass scan holds tile sums of level k (of the input for the first one),
+  // the last level fits into a single tile
+  struct Level
+  {
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  std::vector<Level> ScanLevels(uint32_t a_length) const;
+  VkDescriptorSet NewSet(const BufferSet &a_buffers);
+  void CmdDispatch(VkCommandBuffer a_cmdBuff, const Kernel &a_kernel, VkDescriptorSet a_set,
+                   const PrimParams &a_params, uint32_t a_groups);
+  void CmdScanImpl(VkCommandBuffer a_cmdBuff, VkDescriptorSet a_set, uint32_t a_length, uint32_t a_mode);
+  void DestroyPipelines();
+  void DestroyScratch();
+
+  VkDevice                         m_device = VK_NULL_HANDLE;
+  std::shared_ptr<DeviceAllocator> m_pAllocator;
+  PipelineCache                   &m_cache;
+  uint32_t                         m_maxGroups  = 65535;
+  uint32_t                         m_maxLength  = 0;
+  bool                             m_subgroups  = false;
+  bool                             m_singlePass = false;
+
+  VkBuffer         m_scratch = VK_NULL_HANDLE;  ///!< partial results of reduce, tile sums or tile states of scan
+  DeviceAllocation m_scratchAlloc;
+
+  // pools of a frame are kept between frames, so there are as many as the most sets a frame has taken
+  struct FramePools
+  {
+    std::vector<VkDescriptorPool> pools;  ///!< SETS_PER_POOL sets each
+    uint32_t                      setsUsed = 0;
+  };
+
+  std::vector<FramePools> m_framePools;
+  uint32_t                m_frame    = 0;
+  VkDescriptorSetLayout   m_dsLayout = VK_NULL_HANDLE;
+
+  Kernel m_reduce;
+  Kernel m_tileReduce;  ///!< up-sweep of the multi-pass scan
+  Kernel m_tileScan;    ///!< down-sweep of the multi-pass scan
+  Kernel m_scan;        ///!< single pass, only with subgroups
+};
+
+#endif// VK_GRAPHICS_BASIC_COMPUTE_PRIMITIVES_H
@@ -0,0 +1,615 @@
+#include "cpu_occlusion_culler.h"
+#include "../utils/profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+  constexpr uint32_t LANES  = 8;   // pixels of a row processed at once
+  constexpr uint32_t BLOCK  = 8;   // blocks of BLOCK x BLOCK pixels keep their farthest depth
+  constexpr uint32_t TILE_W = 64;  // screen tiles are rasterized by threads independently
+  constexpr uint32_t TILE_H = 32;
+  constexpr uint32_t INSTANCES_PER_TASK = 256;
+
+  constexpr float NEAR_W     = 1e-3f;  // occluders are clipped at this clip space w
+  constexpr float GUARD_BAND = 4.0f;   // and at 4x of the viewport, so that edge functions keep their precision
+
+  // 8 floats and lane masks (all bits of a lane set) with the few operations the kernels use
+#if defined(__AVX2__)
+  using vfloat = __m256;
+  inline vfloat vset(float a)                         { return _mm256_set1_ps(a); }
+  inline vfloat vramp()                               { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+  inline vfloat vload(const float *a_ptr)             { return _mm256_loadu_ps(a_ptr); }
+  inline void   vstore(float *a_ptr, vfloat a)        { _mm256_storeu_ps(a_ptr, a); }
+  inline vfloat vadd(vfloat a, vfloat b)              { return _mm256_add_ps(a, b); }
+  inline vfloat vmul(vfloat a, vfloat b)              { return _mm256_mul_ps(a, b); }
+  inline vfloat vmin(vfloat a, vfloat b)              { return _mm256_min_ps(a, b); }
+  inline vfloat vmax(vfloat a, vfloat b)              { return _mm256_max_ps(a, b); }
+  inline vfloat vge(vfloat a, vfloat b)               { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+  inline vfloat vle(vfloat a, vfloat b)               { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+  inline vfloat vand(vfloat a, vfloat b)              { return _mm256_and_ps(a, b); }
+  inline vfloat vselect(vfloat m, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, m); }
+  inline bool   vany(vfloat m)                        { return _mm256_movemask_ps(m) != 0; }
+  inline float  vhmin(vfloat a)
+  {
+    __m128 m = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+  }
+  constexpr const char *SIMD_NAME = "AVX2";
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  struct vfloat { float32x4_t lo, hi; };
+  inline uint32x4_t asMask(float32x4_t a)             { return vreinterpretq_u32_f32(a); }
+  inline float32x4_t asFloat(uint32x4_t a)            { return vreinterpretq_f32_u32(a); }
+  inline vfloat vset(float a)                         { return {vdupq_n_f32(a), vdupq_n_f32(a)}; }
+  inline vfloat vramp()
+  {
+    const float ramp[LANES] = {0, 1, 2, 3, 4, 5, 6, 7};
+    return {vld1q_f32(ramp), vld1q_f32(ramp + 4)};
+  }
+  inline vfloat vload(const float *a_ptr)             { return {vld1q_f32(a_ptr), vld1q_f32(a_ptr + 4)}; }
+  inline void   vstore(float *a_ptr, vfloat a)        { vst1q_f32(a_ptr, a.lo); vst1q_f32(a_ptr + 4, a.hi); }
+  inline vfloat vadd(vfloat a, vfloat b)              { return {vaddq_f32(a.lo, b.lo), vaddq_f32(a.hi, b.hi)}; }
+  inline vfloat vmul(vfloat a, vfloat b)              { return {vmulq_f32(a.lo, b.lo), vmulq_f32(a.hi, b.hi)}; }
+  inline vfloat vmin(vfloat a, vfloat b)              { return {vminq_f32(a.lo, b.lo), vminq_f32(a.hi, b.hi)}; }
+  inline vfloat vmax(vfloat a, vfloat b)              { return {vmaxq_f32(a.lo, b.lo), vmaxq_f32(a.hi, b.hi)}; }
+  inline vfloat vge(vfloat a, vfloat b)               { return {asFloat(vcgeq_f32(a.lo, b.lo)), asFloat(vcgeq_f32(a.hi, b.hi))}; }
+  inline vfloat vle(vfloat a, vfloat b)               { return {asFloat(vcleq_f32(a.lo, b.lo)), asFloat(vcleq_f32(a.hi, b.hi))}; }
+  inline vfloat vand(vfloat a, vfloat b)
+  {
+    return {asFloat(vandq_u32(asMask(a.lo), asMask(b.lo))), asFloat(vandq_u32(asMask(a.hi), asMask(b.hi)))};
+  }
+  inline vfloat vselect(vfloat m, vfloat a, vfloat b)
+  {
+    return {vbslq_f32(asMask(m.lo), a.lo, b.lo), vbslq_f32(asMask(m.hi), a.hi, b.hi)};
+  }
+  inline bool   vany(vfloat m)                        { return vmaxvq_u32(vorrq_u32(asMask(m.lo), asMask(m.hi))) != 0; }
+  inline float  vhmin(vfloat a)                       { return vminvq_f32(vminq_f32(a.lo, a.hi)); }
+  constexpr const char *SIMD_NAME = "NEON";
+#else
+  struct vfloat { float v[LANES]; };  // masks are 0 or 1
+  template<typename Func>
+  inline vfloat vmap(Func a_func)
+  {
+    vfloat r;
+    for(uint32_t i = 0; i < LANES; ++i)
+      r.v[i] = a_func(i);
+    return r;
+  }
+  inline vfloat vset(float a)                         { return vmap([&](uint32_t) { return a; }); }
+  inline vfloat vramp()                               { return vmap([](uint32_t i) { return float(i); }); }
+  inline vfloat vload(const float *a_ptr)             { return vmap([&](uint32_t i) { return a_ptr[i]; }); }
+  inline void   vstore(float *a_ptr, vfloat a)        { std::copy(a.v, a.v + LANES, a_ptr); }
+  inline vfloat vadd(vfloat a, vfloat b)              { return vmap([&](uint32_t i) { return a.v[i] + b.v[i]; }); }
+  inline vfloat vmul(vfloat a, vfloat b)              { return vmap([&](uint32_t i) { return a.v[i] * b.v[i]; }); }
+  inline vfloat vmin(vfloat a, vfloat b)              { return vmap([&](uint32_t i) { return std::min(a.v[i], b.v[i]); }); }
+  inline vfloat vmax(vfloat a, vfloat b)              { return vmap([&](uint32_t i) { return std::max(a.v[i], b.v[i]); }); }
+  inline vfloat vge(vfloat a, vfloat b)               { return vmap([&](uint32_t i) { return a.v[i] >= b.v[i] ? 1.0f : 0.0f; }); }
+  inline vfloat vle(vfloat a, vfloat b)               { return vmap([&](uint32_t i) { return a.v[i] <= b.v[i] ? 1.0f : 0.0f; }); }
+  inline vfloat vand(vfloat a, vfloat b)              { return vmul(a, b); }
+  inline vfloat vselect(vfloat m, vfloat a, vfloat b) { return vmap([&](uint32_t i) { return m.v[i] != 0.0f ? a.v[i] : b.v[i]; }); }
+  inline bool   vany(vfloat m)                        { return std::any_of(m.v, m.v + LANES, [](float a) { return a != 0.0f; }); }
+  inline float  vhmin(vfloat a)                       { return *std::min_element(a.v, a.v + LANES); }
+  constexpr const char *SIMD_NAME = "scalar";
+#endif
+
+  using LiteMath::float2;
+  using LiteMath::float4;
+
+  // distances to the clipping planes of occluders, a vertex is inside when all are >= 0
+  constexpr uint32_t CLIP_PLANES = 5;
+  inline float clipDistance(const float4 &a_v, uint32_t a_plane)
+  {
+    switch(a_plane)
+    {
+      case 0:  return a_v.w - NEAR_W;
+      case 1:  return GUARD_BAND * a_v.w + a_v.x;
+      case 2:  return GUARD_BAND * a_v.w - a_v.x;
+      case 3:  return GUARD_BAND * a_v.w + a_v.y;
+      default: return GUARD_BAND * a_v.w - a_v.y;
+    }
+  }
+
+  // Sutherland-Hodgman, a triangle clipped by 5 planes has at most 8 vertices
+  uint32_t clipPolygon(float4 *a_poly, uint32_t a_count)
+  {
+    float4 tmp[3 + CLIP_PLANES];
+    for(uint32_t plane = 0; plane < CLIP_PLANES && a_count > 0; ++plane)
+    {
+      uint32_t count = 0;
+      for(uint32_t i = 0; i < a_count; ++i)
+      {
+        const float4 &a  = a_poly[i];
+        const float4 &b  = a_poly[(i + 1) % a_count];
+        const float   da = clipDistance(a, plane);
+        const float   db = clipDistance(b, plane);
+        if(da >= 0.0f)
+          tmp[count++] = a;
+        if((da >= 0.0f) != (db >= 0.0f))
+          tmp[count++] = a + (b - a) * (da / (da - db));
+      }
+      std::copy(tmp, tmp + count, a_poly);
+      a_count = count;
+    }
+    return a_count;
+  }
+
+  float4 boxCorner(const LiteMath::Box4f &a_box, uint32_t a_corner)
+  {
+    return float4((a_corner & 1) == 0 ? a_box.boxMin.x : a_box.boxMax.x,
+                  (a_corner & 2) == 0 ? a_box.boxMin.y : a_box.boxMax.y,
+                  (a_corner & 4) == 0 ? a_box.boxMin.z : a_box.boxMax.z, 1.0f);
+  }
+}
+
+CpuOcclusionCuller::CpuOcclusionCuller(const CpuCullingParams &a_params) : m_params(a_params)
+{
+  uint32_t threadsNum = m_params.threadsNum;
+  if(threadsNum == 0)
+    threadsNum = std::max(1u, std::thread::hardware_concurrency());
+  for(uint32_t i = 1; i < threadsNum; ++i)
+    m_workers.emplace_back(&CpuOcclusionCuller::WorkerLoop, this);
+
+  std::cout << "[CpuOcclusionCuller] " << SIMD_NAME << " kernels, " << threadsNum << " threads" << std::endl;
+  SetViewport(VkExtent2D{m_params.width, m_params.width});
+}
+
+CpuOcclusionCuller::~CpuOcclusionCuller()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_wake.notify_all();
+  for(auto &worker : m_workers)
+    worker.join();
+}
+
+void CpuOcclusionCuller::SetScene(const SceneManager &a_scene)
+{
+  PROFILE_FUNCTION();
+  const auto  sceneBox   = a_scene.GetSceneBbox();
+  const float sceneSize  = length3f(sceneBox.boxMax - sceneBox.boxMin);
+  const uint32_t stride  = a_scene.GetVertexStride();
+
+  // meshes with few triangles (walls, floors, buildings) are copied, so the scene manager may change its CPU geometry;
+  // their instances with large world bboxes are candidates, the bbox of an instance is the transformed mesh bbox
+  m_meshes.clear();
+  m_meshes.resize(a_scene.MeshesNum());
+  for(uint32_t meshId = 0; meshId < a_scene.MeshesNum(); ++meshId)
+  {
+    const auto info = a_scene.GetMeshInfo(meshId);
+    if(info.m_indNum / 3 > m_params.maxOccluderTris)
+      continue;
+
+    auto &mesh = m_meshes[meshId];
+    const float *vertices = a_scene.GetVertexData() + size_t(info.m_vertexOffset) * stride;
+    mesh.positions.resize(info.m_vertNum);
+    for(uint32_t i = 0; i < info.m_vertNum; ++i)
+      mesh.positions[i] = float4(vertices[i * stride + 0], vertices[i * stride + 1], vertices[i * stride + 2], 1.0f);
+    mesh.indices.assign(a_scene.GetIndexData() + info.m_indexOffset, a_scene.GetIndexData() + info.m_indexOffset + info.m_indNum);
+  }
+
+  const uint32_t instancesNum = a_scene.InstancesNum();
+  m_candidates.clear();
+  m_instanceMeshes.resize(instancesNum);
+  m_instanceMatrices.resize(instancesNum);
+  m_instanceBoxes.resize(instancesNum);
+  m_visible.assign(instancesNum, 1);
+  for(uint32_t i = 0; i < instancesNum; ++i)
+  {
+    m_instanceMeshes[i]   = a_scene.GetInstanceInfo(i).mesh_id;
+    m_instanceMatrices[i] = a_scene.GetInstanceMatrix(i);
+    m_instanceBoxes[i]    = a_scene.GetInstanceBbox(i);
+
+    const auto &box = m_instanceBoxes[i];
+    if(!m_meshes[m_instanceMeshes[i]].indices.empty() && length3f(box.boxMax - box.boxMin) >= m_params.minOccluderSize * sceneSize)
+      m_candidates.push_back(i);
+  }
+
+  std::cout << "[CpuOcclusionCuller] " << m_candidates.size() << " of " << instancesNum << " instances may be occluders" << std::endl;
+}
+
+void CpuOcclusionCuller::SetViewport(VkExtent2D a_extent)
+{
+  // width and height are multiples of the block size, so rows of blocks and SIMD rows never cross the buffer edge
+  m_width  = std::max((m_params.width + BLOCK - 1) / BLOCK * BLOCK, BLOCK);
+  m_height = uint32_t(std::lround(float(m_width) * float(a_extent.height) / float(std::max(a_extent.width, 1u))));
+  m_height = std::max((m_height + BLOCK - 1) / BLOCK * BLOCK, BLOCK);
+  m_tilesX = (m_width + TILE_W - 1) / TILE_W;
+  m_tilesY = (m_height + TILE_H - 1) / TILE_H;
+
+  m_depth.assign(size_t(m_width) * m_height, 0.0f);
+  m_blockMin.assign(size_t(m_width / BLOCK) * (m_height / BLOCK), 0.0f);
+  m_tileTriangles.resize(size_t(m_tilesX) * m_tilesY);
+}
+
+void CpuOcclusionCuller::Cull(const LiteMath::float4x4 &a_viewProj)
+{
+  PROFILE_FUNCTION();
+  const auto start = std::chrono::steady_clock::now();
+
+  SelectOccluders(a_viewProj);
+
+  m_triangles.resize(m_occluders.size());
+  ParallelFor(uint32_t(m_occluders.size()), [&](uint32_t a_occluder) { TransformOccluder(a_occluder, a_viewProj); });
+
+  // bins are filled on one thread, it's cheap next to the rasterization
+  m_stats.occluders    = uint32_t(m_occluders.size());
+  m_stats.occluderTris = 0;
+  for(auto &tile : m_tileTriangles)
+    tile.clear();
+  for(const auto &triangles : m_triangles)
+  {
+    m_stats.occluderTris += uint32_t(triangles.size());
+    for(const auto &tri : triangles)
+    {
+      const float minX = std::min({tri.x[0], tri.x[1], tri.x[2]});
+      const float maxX = std::max({tri.x[0], tri.x[1], tri.x[2]});
+      const float minY = std::min({tri.y[0], tri.y[1], tri.y[2]});
+      const float maxY = std::max({tri.y[0], tri.y[1], tri.y[2]});
+      if(maxX < 0.0f || maxY < 0.0f || minX >= float(m_width) || minY >= float(m_height))
+        continue;
+
+      const uint32_t tx0 = uint32_t(std::max(minX, 0.0f)) / TILE_W;
+      const uint32_t ty0 = uint32_t(std::max(minY, 0.0f)) / TILE_H;
+      const uint32_t tx1 = std::min(uint32_t(maxX) / TILE_W, m_tilesX - 1);
+      const uint32_t ty1 = std::min(uint32_t(maxY) / TILE_H, m_tilesY - 1);
+      for(uint32_t ty = ty0; ty <= ty1; ++ty)
+        for(uint32_t tx = tx0; tx <= tx1; ++tx)
+          m_tileTriangles[ty * m_tilesX + tx].push_back(&tri);
+    }
+  }
+
+  ParallelFor(m_tilesX * m_tilesY, [this](uint32_t a_tile) { RasterizeTile(a_tile); });
+  const auto rasterized = std::chrono::steady_clock::now();
+
+  // counters are merged per task, so threads don't share cache lines in the loop
+  const uint32_t instancesNum = uint32_t(m_visible.size());
+  const uint32_t tasksNum     = (instancesNum + INSTANCES_PER_TASK - 1) / INSTANCES_PER_TASK;
+  std::atomic<uint32_t> culledFrustum {0};
+  std::atomic<uint32_t> culledOcclusion {0};
+  ParallelFor(tasksNum, [&](uint32_t a_task) {
+    uint32_t frustum = 0, occlusion = 0;
+    const uint32_t end = std::min((a_task + 1) * INSTANCES_PER_TASK, instancesNum);
+    for(uint32_t i = a_task * INSTANCES_PER_TASK; i < end; ++i)
+    {
+      bool outside = false;
+      m_visible[i] = TestBox(m_instanceBoxes[i], a_viewProj, outside) ? 1 : 0;
+      frustum   += outside ? 1 : 0;
+      occlusion += (!outside && m_visible[i] == 0) ? 1 : 0;
+    }
+    culledFrustum   += frustum;
+    culledOcclusion += occlusion;
+  });
+
+  m_stats.culledFrustum   = culledFrustum;
+  m_stats.culledOcclusion = culledOcclusion;
+  m_stats.rasterMs = std::chrono::duration<float, std::milli>(rasterized - start).count();
+  m_stats.testMs   = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - rasterized).count();
+}
+
+void CpuOcclusionCuller::SelectOccluders(const LiteMath::float4x4 &a_viewProj)
+{
+  // screen coverage of the bbox; a box which crosses the near plane surrounds the camera, i.e. floor or walls
+  std::vector<std::pair<float, uint32_t>> scored;
+  scored.reserve(m_candidates.size());
+  for(uint32_t instId : m_candidates)
+  {
+    float2 rectMin(1.0f, 1.0f), rectMax(-1.0f, -1.0f);
+    bool   nearCrossed = false;
+    for(uint32_t c = 0; c < 8; ++c)
+    {
+      const float4 p = a_viewProj * boxCorner(m_instanceBoxes[instId], c);
+      if(p.w <= NEAR_W)
+      {
+        nearCrossed = true;
+        break;
+      }
+      rectMin = min(rectMin, float2(p.x, p.y) / p.w);
+      rectMax = max(rectMax, float2(p.x, p.y) / p.w);
+    }
+
+    float coverage = 1.0f;
+    if(!nearCrossed)
+    {
+      rectMin = clamp(rectMin, float2(-1.0f), float2(1.0f));
+      rectMax = clamp(rectMax, float2(-1.0f), float2(1.0f));
+      coverage = std::max(rectMax.x - rectMin.x, 0.0f) * std::max(rectMax.y - rectMin.y, 0.0f) * 0.25f;
+    }
+    if(coverage >= m_params.minCoverage)
+      scored.emplace_back(coverage, instId);
+  }
+
+  const size_t count = std::min<size_t>(scored.size(), m_params.maxOccluders);
+  std::partial_sort(scored.begin(), scored.begin() + count, scored.end(),
+                    [](const auto &a, const auto &b) { return a.first > b.first; });
+
+  m_occluders.resize(count);
+  for(size_t i = 0; i < count; ++i)
+    m_occluders[i] = scored[i].second;
+}
+
+void CpuOcclusionCuller::TransformOccluder(uint32_t a_occluder, const LiteMath::float4x4 &a_viewProj)
+{
+  const uint32_t instId = m_occluders[a_occluder];
+  const auto    &mesh   = m_meshes[m_instanceMeshes[instId]];
+  const auto     mvp    = a_viewProj * m_instanceMatrices[instId];
+
+  auto &triangles = m_triangles[a_occluder];
+  triangles.clear();
+
+  // both faces are rasterized, meshes of the scenes have no consistent winding
+  for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+  {
+    float4 poly[3 + CLIP_PLANES];
+    for(uint32_t v = 0; v < 3; ++v)
+      poly[v] = mvp * mesh.positions[mesh.indices[i + v]];
+
+    uint32_t count = 3;
+    for(uint32_t plane = 0; plane < CLIP_PLANES; ++plane)
+    {
+      if(clipDistance(poly[0], plane) < 0.0f || clipDistance(poly[1], plane) < 0.0f || clipDistance(poly[2], plane) < 0.0f)
+      {
+        count = clipPolygon(poly, 3);
+        break;
+      }
+    }
+
+    // to pixels and 1/w; y of Vulkan clip space points down, as rows of the buffer
+    for(uint32_t v = 0; v < count; ++v)
+    {
+      const float invW = 1.0f / poly[v].w;
+      poly[v] = float4((poly[v].x * invW * 0.5f + 0.5f) * float(m_width), (poly[v].y * invW * 0.5f + 0.5f) * float(m_height), invW, 0.0f);
+    }
+    for(uint32_t v = 1; v + 1 < count; ++v)
+    {
+      Triangle tri;
+      const float4 *fan[3] = {&poly[0], &poly[v], &poly[v + 1]};
+      for(uint32_t k = 0; k < 3; ++k)
+      {
+        tri.x[k]    = fan[k]->x;
+        tri.y[k]    = fan[k]->y;
+        tri.invW[k] = fan[k]->z;
+      }
+      triangles.push_back(tri);
+    }
+  }
+}
+
+void CpuOcclusionCuller::RasterizeTile(uint32_t a_tile)
+{
+  const uint32_t x0 = (a_tile % m_tilesX) * TILE_W;
+  const uint32_t y0 = (a_tile / m_tilesX) * TILE_H;
+  const uint32_t x1 = std::min(x0 + TILE_W, m_width);
+  const uint32_t y1 = std::min(y0 + TILE_H, m_height);
+
+  for(uint32_t y = y0; y < y1; ++y)
+    std::fill(m_depth.begin() + size_t(y) * m_width + x0, m_depth.begin() + size_t(y) * m_width + x1, 0.0f);
+
+  const vfloat ramp = vramp();
+  const vfloat zero = vset(0.0f);
+  for(const Triangle *pTri : m_tileTriangles[a_tile])
+  {
+    const Triangle &tri = *pTri;
+
+    // counterclockwise on screen after the swap, inside is where all edge functions are >= 0
+    float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+    if(std::abs(area) < 1e-8f)
+      continue;
+    const uint32_t i1 = area > 0.0f ? 1 : 2;
+    const uint32_t i2 = area > 0.0f ? 2 : 1;
+    const float xs[3] = {tri.x[0], tri.x[i1], tri.x[i2]};
+    const float ys[3] = {tri.y[0], tri.y[i1], tri.y[i2]};
+    const float zs[3] = {tri.invW[0], tri.invW[i1], tri.invW[i2]};
+    area = std::abs(area);
+
+    // E(x, y) = A x + B y + C for edges 0-1, 1-2, 2-0
+    float A[3], B[3], C[3];
+    for(uint32_t e = 0; e < 3; ++e)
+    {
+      const uint32_t a = e, b = (e + 1) % 3;
+      A[e] = ys[a] - ys[b];
+      B[e] = xs[b] - xs[a];
+      C[e] = -(A[e] * xs[a] + B[e] * ys[a]);
+    }
+
+    // 1/w plane, lowered by its largest change within half a pixel and never farther than the farthest vertex
+    const float dzdx = ((zs[1] - zs[0]) * (ys[2] - ys[0]) - (zs[2] - zs[0]) * (ys[1] - ys[0])) / area;
+    const float dzdy = ((zs[2] - zs[0]) * (xs[1] - xs[0]) - (zs[1] - zs[0]) * (xs[2] - xs[0])) / area;
+    const float zBias = 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+    const float zMin  = std::min({zs[0], zs[1], zs[2]});
+    const float zC    = zs[0] - dzdx * xs[0] - dzdy * ys[0] - zBias;
+
+    const float minX = std::min({xs[0], xs[1], xs[2]});
+    const float maxX = std::max({xs[0], xs[1], xs[2]});
+    const float minY = std::min({ys[0], ys[1], ys[2]});
+    const float maxY = std::max({ys[0], ys[1], ys[2]});
+    const uint32_t bx0 = std::max(uint32_t(std::max(minX, 0.0f)) / LANES * LANES, x0);
+    const uint32_t by0 = std::max(uint32_t(std::max(minY, 0.0f)), y0);
+    const uint32_t bx1 = std::min(uint32_t(std::max(std::ceil(maxX), 0.0f)), x1);
+    const uint32_t by1 = std::min(uint32_t(std::max(std::ceil(maxY), 0.0f)), y1);
+
+    const vfloat stepE[3] = {vmul(ramp, vset(A[0])), vmul(ramp, vset(A[1])), vmul(ramp, vset(A[2]))};
+    const vfloat stepZ    = vmul(ramp, vset(dzdx));
+    const vfloat vzMin    = vset(zMin);
+    for(uint32_t y = by0; y < by1; ++y)
+    {
+      const float py  = float(y) + 0.5f;
+      float      *row = m_depth.data() + size_t(y) * m_width;
+      for(uint32_t x = bx0; x < bx1; x += LANES)
+      {
+        const float px = float(x) + 0.5f;
+        const vfloat e0 = vadd(vset(A[0] * px + B[0] * py + C[0]), stepE[0]);
+        const vfloat e1 = vadd(vset(A[1] * px + B[1] * py + C[1]), stepE[1]);
+        const vfloat e2 = vadd(vset(A[2] * px + B[2] * py + C[2]), stepE[2]);
+        const vfloat covered = vand(vand(vge(e0, zero), vge(e1, zero)), vge(e2, zero));
+        if(!vany(covered))
+          continue;
+
+        const vfloat z     = vmax(vadd(vset(zC + dzdx * px + dzdy * py), stepZ), vzMin);
+        const vfloat depth = vload(row + x);
+        vstore(row + x, vselect(covered, vmax(depth, z), depth));
+      }
+    }
+  }
+
+  // the tile is a whole number of blocks, except at the right and bottom buffer edges which are block aligned too
+  for(uint32_t by = y0; by < y1; by += BLOCK)
+  {
+    for(uint32_t bx = x0; bx < x1; bx += BLOCK)
+    {
+      vfloat farthest = vload(m_depth.data() + size_t(by) * m_width + bx);
+      for(uint32_t y = by + 1; y < by + BLOCK; ++y)
+        farthest = vmin(farthest, vload(m_depth.data() + size_t(y) * m_width + bx));
+      m_blockMin[(by / BLOCK) * (m_width / BLOCK) + bx / BLOCK] = vhmin(farthest);
+    }
+  }
+}
+
+bool CpuOcclusionCuller::TestBox(const LiteMath::Box4f &a_box, const LiteMath::float4x4 &a_viewProj, bool &a_outside) const
+{
+  a_outside = false;
+
+  // outside if all corners are behind the same clip plane, visible if the box crosses the near plane
+  uint32_t outside[6] = {};
+  bool     nearCrossed = false;
+  float2   rectMin(1e30f), rectMax(-1e30f);
+  float    nearest = 0.0f;
+  for(uint32_t c = 0; c < 8; ++c)
+  {
+    const float4 p = a_viewProj * boxCorner(a_box, c);
+    outside[0] += p.x < -p.w ? 1 : 0;
+    outside[1] += p.x >  p.w ? 1 : 0;
+    outside[2] += p.y < -p.w ? 1 : 0;
+    outside[3] += p.y >  p.w ? 1 : 0;
+    outside[4] += p.z <  0.0f ? 1 : 0;
+    outside[5] += p.z >  p.w ? 1 : 0;
+    if(p.w <= NEAR_W)
+    {
+      nearCrossed = true;
+      continue;
+    }
+    const float invW = 1.0f / p.w;
+    rectMin = min(rectMin, float2(p.x, p.y) * invW);
+    rectMax = max(rectMax, float2(p.x, p.y) * invW);
+    nearest = std::max(nearest, invW);
+  }
+  if(std::any_of(outside, outside + 6, [](uint32_t a_count) { return a_count == 8; }))
+  {
+    a_outside = true;
+    return false;
+  }
+  if(nearCrossed)
+    return true;
+
+  // pixels the screen rectangle touches, clamped to the buffer: the rest is outside of the view anyway
+  const float sx = 0.5f * float(m_width), sy = 0.5f * float(m_height);
+  const int px0 = std::max(int(std::floor((rectMin.x + 1.0f) * sx)), 0);
+  const int py0 = std::max(int(std::floor((rectMin.y + 1.0f) * sy)), 0);
+  const int px1 = std::min(int(std::floor((rectMax.x + 1.0f) * sx)), int(m_width) - 1);
+  const int py1 = std::min(int(std::floor((rectMax.y + 1.0f) * sy)), int(m_height) - 1);
+  if(px0 > px1 || py0 > py1)
+  {
+    a_outside = true;
+    return false;
+  }
+
+  // visible if any pixel under the rectangle is not nearer than the nearest point of the box
+  const vfloat ramp     = vramp();
+  const vfloat vnearest = vset(nearest);
+  const vfloat colMin   = vset(float(px0));
+  const vfloat colMax   = vset(float(px1));
+  const uint32_t blocksX = m_width / BLOCK;
+  for(uint32_t by = uint32_t(py0) / BLOCK; by <= uint32_t(py1) / BLOCK; ++by)
+  {
+    for(uint32_t bx = uint32_t(px0) / BLOCK; bx <= uint32_t(px1) / BLOCK; ++bx)
+    {
+      if(m_blockMin[by * blocksX + bx] > nearest)
+        continue;
+
+      const vfloat cols   = vadd(vset(float(bx * BLOCK)), ramp);
+      const vfloat inside = vand(vge(cols, colMin), vle(cols, colMax));
+      const uint32_t y0 = std::max(by * BLOCK, uint32_t(py0));
+      const uint32_t y1 = std::min(by * BLOCK + BLOCK - 1, uint32_t(py1));
+      for(uint32_t y = y0; y <= y1; ++y)
+      {
+        const vfloat depth = vload(m_depth.data() + size_t(y) * m_width + bx * BLOCK);
+        if(vany(vand(inside, vle(depth, vnearest))))
+          return true;
+      }
+    }
+  }
+  return false;
+}
+
+void CpuOcclusionCuller::DebugImage(uint8_t *a_dst) const
+{
+  const float nearest = *std::max_element(m_depth.begin(), m_depth.end());
+  const float scale   = nearest > 0.0f ? 255.0f / nearest : 0.0f;
+  for(size_t i = 0; i < m_depth.size(); ++i)
+    a_dst[i] = uint8_t(std::min(m_depth[i] * scale, 255.0f));
+}
+
+void CpuOcclusionCuller::ParallelFor(uint32_t a_count, const std::function<void(uint32_t)> &a_func)
+{
+  if(m_workers.empty() || a_count <= 1)
+  {
+    for(uint32_t i = 0; i < a_count; ++i)
+      a_func(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_job         = &a_func;
+    m_jobItems    = a_count;
+    m_nextItem    = 0;
+    m_busyWorkers = uint32_t(m_workers.size());
+    ++m_generation;
+  }
+  m_wake.notify_all();
+
+  RunItems();
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this]() { return m_busyWorkers == 0; });
+  m_job = nullptr;
+}
+
+void CpuOcclusionCuller::WorkerLoop()
+{
+  uint64_t generation = 0;
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [&]() { return m_quit || m_generation != generation; });
+      if(m_quit)
+        return;
+      generation = m_generation;
+    }
+
+    RunItems();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(--m_busyWorkers == 0)
+      m_done.notify_one();
+  }
+}
+
+void CpuOcclusionCuller::RunItems()
+{
+  for(uint32_t i = m_nextItem++; i < m_jobItems; i = m_nextItem++)
+    (*m_job)(i);
+}
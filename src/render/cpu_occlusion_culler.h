@@ -0,0 +1,133 @@
+#ifndef VK_GRAPHICS_BASIC_CPU_OCCLUSION_CULLER_H
+#define VK_GRAPHICS_BASIC_CPU_OCCLUSION_CULLER_H
+
+#include "scene_mgr.h"
+#include "LiteMath.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct CpuCullingParams
+{
+  uint32_t width           = 256;     ///!< of the occlusion buffer, height follows the aspect of the viewport
+  uint32_t maxOccluders    = 64;      ///!< rasterized per frame, the largest on screen are picked
+  uint32_t maxOccluderTris = 4096;    ///!< meshes with more triangles are never occluders
+  float    minOccluderSize = 0.01f;   ///!< instance bbox diagonal relative to the scene bbox diagonal
+  float    minCoverage     = 0.002f;  ///!< screen area of the instance bbox relative to the viewport
+  uint32_t threadsNum      = 0;       ///!< including the calling one, 0 - hardware concurrency
+};
+
+/**
+\brief Software occlusion culling: the largest occluders are rasterized on the CPU into a small depth buffer and
+       instance boxes are tested against it before the frame is recorded.
+
+  Instances of meshes with few triangles whose bboxes (mesh bboxes in world space) are large enough are occluder
+  candidates, positions of their meshes are copied once by SetScene(). Every frame, candidate instances with the
+  largest screen coverage are clipped, transformed and binned to screen tiles, then worker threads rasterize tiles
+  and test instances in chunks.
+
+  The buffer keeps 1/w, which is linear in screen space, and is cleared to 0, infinitely far. The rasterizer handles
+  8 pixels of a row at once and merges them with a per-lane coverage mask: AVX2, NEON (two 4-wide halves) or scalar
+  code, picked at compile time. Every 8x8 block keeps the farthest depth of its pixels, so a box is usually rejected
+  by a few block tests, pixel rows are read only where a block is not enough.
+
+  Occluder depth is conservative (the farthest depth of the triangle over a pixel), coverage is not: a pixel is covered
+  if its center is, so a box which peeks out past the silhouette of an occluder by less than a pixel of the buffer
+  can be culled.
+*/
+class CpuOcclusionCuller
+{
+public:
+  struct Stats
+  {
+    uint32_t occluders       = 0;
+    uint32_t occluderTris    = 0;     ///!< rasterized, after clipping
+    uint32_t culledFrustum   = 0;
+    uint32_t culledOcclusion = 0;
+    float    rasterMs        = 0.0f;  ///!< occluder selection, transform, binning and rasterization
+    float    testMs          = 0.0f;
+  };
+
+  explicit CpuOcclusionCuller(const CpuCullingParams &a_params = {});
+  ~CpuOcclusionCuller();
+
+  CpuOcclusionCuller(const CpuOcclusionCuller &) = delete;
+  CpuOcclusionCuller &operator=(const CpuOcclusionCuller &) = delete;
+
+  void SetScene(const SceneManager &a_scene);
+  void SetViewport(VkExtent2D a_extent);  // only its aspect is used
+
+  // fills visibility of all instances, a_viewProj maps to Vulkan clip space
+  void Cull(const LiteMath::float4x4 &a_viewProj);
+
+  bool         Visible(uint32_t a_instId) const { return m_visible[a_instId] != 0; }
+  const Stats &GetStats() const { return m_stats; }
+
+  uint32_t Width()  const { return m_width; }
+  uint32_t Height() const { return m_height; }
+  void     DebugImage(uint8_t *a_dst) const;  // Width() x Height() bytes, 255 is the nearest occluder
+
+private:
+  struct Mesh
+  {
+    std::vector<LiteMath::float4> positions;
+    std::vector<uint32_t>         indices;
+  };
+
+  struct Triangle  // screen space, pixels
+  {
+    float x[3];
+    float y[3];
+    float invW[3];
+  };
+
+  void SelectOccluders(const LiteMath::float4x4 &a_viewProj);
+  void TransformOccluder(uint32_t a_occluder, const LiteMath::float4x4 &a_viewProj);
+  void RasterizeTile(uint32_t a_tile);
+  bool TestBox(const LiteMath::Box4f &a_box, const LiteMath::float4x4 &a_viewProj, bool &a_outside) const;
+
+  // calls a_func(i) for i in [0, a_count) on the worker threads and the calling one
+  void ParallelFor(uint32_t a_count, const std::function<void(uint32_t)> &a_func);
+  void WorkerLoop();
+  void RunItems();
+
+  CpuCullingParams m_params;
+  Stats            m_stats;
+
+  // scene
+  std::vector<Mesh>            m_meshes;         ///!< per scene mesh, empty if it is not an occluder candidate
+  std::vector<uint32_t>        m_candidates;     ///!< instances of candidate meshes
+  std::vector<uint32_t>        m_instanceMeshes;
+  std::vector<LiteMath::float4x4> m_instanceMatrices;
+  std::vector<LiteMath::Box4f> m_instanceBoxes;
+  std::vector<uint8_t>         m_visible;
+
+  // occlusion buffer
+  uint32_t                           m_width  = 0;
+  uint32_t                           m_height = 0;
+  uint32_t                           m_tilesX = 0;
+  uint32_t                           m_tilesY = 0;
+  std::vector<float>                 m_depth;       ///!< 1/w, row by row
+  std::vector<float>                 m_blockMin;    ///!< farthest 1/w of every 8x8 block
+  std::vector<uint32_t>              m_occluders;   ///!< instances rasterized this frame
+  std::vector<std::vector<Triangle>> m_triangles;   ///!< per occluder
+  std::vector<std::vector<const Triangle *>> m_tileTriangles;
+
+  // worker threads, run items of one ParallelFor() at a time
+  std::vector<std::thread>                m_workers;
+  std::mutex                              m_mutex;
+  std::condition_variable                 m_wake;
+  std::condition_variable                 m_done;
+  const std::function<void(uint32_t)>    *m_job       = nullptr;
+  uint32_t                                m_jobItems  = 0;
+  std::atomic<uint32_t>                   m_nextItem {0};
+  uint32_t                                m_busyWorkers = 0;
+  uint64_t                                m_generation  = 0;
+  bool                                    m_quit        = false;
+};
+
+#endif// VK_GRAPHICS_BASIC_CPU_OCCLUSION_CULLER_H
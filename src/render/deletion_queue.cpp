@@ -0,0 +1,77 @@
+#include "deletion_queue.h"
+#include "../utils/profiler.h"
+
+#include <vector>
+
+void DeletionQueue::Push(Deleter a_deleter)
+{
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_entries.push_back({m_frame, std::move(a_deleter)});
+}
+
+void DeletionQueue::PushPipeline(VkDevice a_device, VkPipeline a_pipeline)
+{
+  if(a_pipeline != VK_NULL_HANDLE)
+    Push([a_device, a_pipeline]() { vkDestroyPipeline(a_device, a_pipeline, nullptr); });
+}
+
+void DeletionQueue::PushPipelineLayout(VkDevice a_device, VkPipelineLayout a_layout)
+{
+  if(a_layout != VK_NULL_HANDLE)
+    Push([a_device, a_layout]() { vkDestroyPipelineLayout(a_device, a_layout, nullptr); });
+}
+
+void DeletionQueue::PushRenderPass(VkDevice a_device, VkRenderPass a_renderPass)
+{
+  if(a_renderPass != VK_NULL_HANDLE)
+    Push([a_device, a_renderPass]() { vkDestroyRenderPass(a_device, a_renderPass, nullptr); });
+}
+
+void DeletionQueue::PushFramebuffer(VkDevice a_device, VkFramebuffer a_framebuffer)
+{
+  if(a_framebuffer != VK_NULL_HANDLE)
+    Push([a_device, a_framebuffer]() { vkDestroyFramebuffer(a_device, a_framebuffer, nullptr); });
+}
+
+void DeletionQueue::NextFrame()
+{
+  PROFILE_FUNCTION();
+  std::vector<Deleter> ready;
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_frame++;
+    while(!m_entries.empty() && m_entries.front().frame + m_framesInFlight < m_frame)
+    {
+      ready.push_back(std::move(m_entries.front().deleter));
+      m_entries.pop_front();
+    }
+  }
+
+  // deleters may push again (i.e. an object which owns other objects), so they run without the lock
+  for(auto &deleter : ready)
+    deleter();
+}
+
+void DeletionQueue::Flush()
+{
+  // repeated while deleters push more
+  while(true)
+  {
+    std::deque<Entry> entries;
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      entries.swap(m_entries);
+    }
+    if(entries.empty())
+      break;
+
+    for(auto &entry : entries)
+      entry.deleter();
+  }
+}
+
+size_t DeletionQueue::Pending() const
+{
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_entries.size();
+}
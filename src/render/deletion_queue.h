@@ -0,0 +1,61 @@
+#ifndef VK_GRAPHICS_BASIC_DELETION_QUEUE_H
+#define VK_GRAPHICS_BASIC_DELETION_QUEUE_H
+
+#include "volk.h"
+
+#include <deque>
+#include <functional>
+#include <mutex>
+
+/**
+\brief Destroys resources once frames which could reference them are finished, without waiting for the GPU.
+
+  Call NextFrame() once per frame right after the frame is submitted, frames which are skipped (i.e. the swapchain
+  is out of date) must not call it. Deleters pushed before submit N run in NextFrame() after submit
+  N + m_framesInFlight: that frame waited the fence of the same frame slot before it was submitted, so all frames
+  up to N have completed by then. Counting submits rather than fence waits keeps this true when a frame waits
+  the same fence again without submitting.
+
+  Push() is thread safe, deleters are run on the thread which calls NextFrame() / Flush().
+*/
+class DeletionQueue
+{
+public:
+  using Deleter = std::function<void()>;
+
+  explicit DeletionQueue(uint32_t a_framesInFlight) : m_framesInFlight(a_framesInFlight) {}
+  ~DeletionQueue() { Flush(); } // resources could still be used by GPU, so wait for device idle first
+
+  DeletionQueue(const DeletionQueue &) = delete;
+  DeletionQueue &operator=(const DeletionQueue &) = delete;
+
+  void Push(Deleter a_deleter);
+
+  // shortcuts for the most common handles
+  void PushPipeline(VkDevice a_device, VkPipeline a_pipeline);
+  void PushPipelineLayout(VkDevice a_device, VkPipelineLayout a_layout);
+  void PushRenderPass(VkDevice a_device, VkRenderPass a_renderPass);
+  void PushFramebuffer(VkDevice a_device, VkFramebuffer a_framebuffer);
+
+  void NextFrame();
+  // only when no frames are in flight, otherwise lowering the number would release resources too early
+  void SetFramesInFlight(uint32_t a_framesInFlight) { m_framesInFlight = a_framesInFlight; }
+  void Flush();  // runs everything now, i.e. after vkDeviceWaitIdle
+
+  size_t Pending() const;
+
+private:
+  struct Entry
+  {
+    uint64_t frame;
+    Deleter  deleter;
+  };
+
+  uint32_t m_framesInFlight = 1;
+  uint64_t m_frame          = 0;
+
+  mutable std::mutex m_lock;
+  std::deque<Entry>  m_entries;  ///!< ordered by frame
+};
+
+#endif// VK_GRAPHICS_BASIC_DELETION_QUEUE_H
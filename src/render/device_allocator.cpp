@@ -0,0 +1,619 @@
+#include "device_allocator.h"
+#include "../utils/profiler.h"
+#include <vk_utils.h>
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace
+{
+  // TLSF size classes: first level is the highest bit of the size, second level splits it into SL_COUNT ranges
+  constexpr uint32_t     SL_BITS  = 4;
+  constexpr uint32_t     SL_COUNT = 1u << SL_BITS;
+  constexpr uint32_t     FL_COUNT = 64;
+  constexpr VkDeviceSize GRANULARITY = VkDeviceSize(1) << SL_BITS;  ///!< sizes and offsets in blocks are multiples of it
+  constexpr uint32_t     NONE = UINT32_MAX;
+
+  uint32_t highestBit(uint64_t a_value)
+  {
+    uint32_t bit = 0;
+    while(a_value >>= 1)
+      ++bit;
+    return bit;
+  }
+
+  uint32_t lowestBit(uint64_t a_value)
+  {
+    uint32_t bit = 0;
+    while((a_value & 1) == 0)
+    {
+      a_value >>= 1;
+      ++bit;
+    }
+    return bit;
+  }
+
+  VkDeviceSize alignUp(VkDeviceSize a_value, VkDeviceSize a_alignment)
+  {
+    return (a_value + a_alignment - 1) / a_alignment * a_alignment;
+  }
+
+  double toMB(VkDeviceSize a_bytes)
+  {
+    return double(a_bytes) / (1024.0 * 1024.0);
+  }
+}
+
+struct DeviceAllocator::Block
+{
+  struct Node
+  {
+    VkDeviceSize offset    = 0;
+    VkDeviceSize size      = 0;
+    VkDeviceSize alignment = 0;  ///!< requested one, used when the allocation is moved
+    uint32_t     prevPhys = NONE;
+    uint32_t     nextPhys = NONE;
+    uint32_t     prevFree = NONE;
+    uint32_t     nextFree = NONE;
+    bool         free     = false;
+  };
+
+  VkDeviceMemory memory       = VK_NULL_HANDLE;
+  VkDeviceSize   size         = 0;
+  uint32_t       memoryType   = 0;
+  bool           optimalImage = false;
+  void*          mapped       = nullptr;
+  VkDeviceSize   used         = 0;
+  uint32_t       allocations  = 0;
+
+  std::vector<Node>     nodes;
+  std::vector<uint32_t> unusedNodes;
+
+  uint64_t flMap = 0;
+  uint32_t slMap[FL_COUNT] = {};
+  uint32_t heads[FL_COUNT][SL_COUNT];
+
+  Block(VkDeviceMemory a_memory, VkDeviceSize a_size, uint32_t a_memoryType, bool a_optimalImage, void* a_mapped)
+    : memory(a_memory), size(a_size / GRANULARITY * GRANULARITY), memoryType(a_memoryType),
+      optimalImage(a_optimalImage), mapped(a_mapped)
+  {
+    for(auto &fl : heads)
+      std::fill(std::begin(fl), std::end(fl), NONE);
+
+    const uint32_t root = NewNode();
+    nodes[root].offset  = 0;
+    nodes[root].size    = size;
+    InsertFree(root);
+  }
+
+  static void Mapping(VkDeviceSize a_size, uint32_t &a_fl, uint32_t &a_sl)
+  {
+    a_fl = highestBit(a_size);
+    a_sl = uint32_t(a_size >> (a_fl - SL_BITS)) & (SL_COUNT - 1);
+  }
+
+  uint32_t NewNode()
+  {
+    if(!unusedNodes.empty())
+    {
+      const uint32_t id = unusedNodes.back();
+      unusedNodes.pop_back();
+      nodes[id] = Node{};
+      return id;
+    }
+    nodes.emplace_back();
+    return static_cast<uint32_t>(nodes.size() - 1);
+  }
+
+  void InsertFree(uint32_t a_id)
+  {
+    uint32_t fl, sl;
+    Mapping(nodes[a_id].size, fl, sl);
+
+    nodes[a_id].free     = true;
+    nodes[a_id].prevFree = NONE;
+    nodes[a_id].nextFree = heads[fl][sl];
+    if(heads[fl][sl] != NONE)
+      nodes[heads[fl][sl]].prevFree = a_id;
+    heads[fl][sl] = a_id;
+
+    flMap     |= uint64_t(1) << fl;
+    slMap[fl] |= 1u << sl;
+  }
+
+  void RemoveFree(uint32_t a_id)
+  {
+    uint32_t fl, sl;
+    Mapping(nodes[a_id].size, fl, sl);
+
+    const auto &node = nodes[a_id];
+    if(node.prevFree != NONE)
+      nodes[node.prevFree].nextFree = node.nextFree;
+    else
+      heads[fl][sl] = node.nextFree;
+    if(node.nextFree != NONE)
+      nodes[node.nextFree].prevFree = node.prevFree;
+
+    if(heads[fl][sl] == NONE)
+    {
+      slMap[fl] &= ~(1u << sl);
+      if(slMap[fl] == 0)
+        flMap &= ~(uint64_t(1) << fl);
+    }
+    nodes[a_id].free = false;
+  }
+
+  // any free range of the returned class is not smaller than a_size
+  uint32_t FindFree(VkDeviceSize a_size) const
+  {
+    uint32_t fl = highestBit(a_size), sl;
+    Mapping(a_size + (VkDeviceSize(1) << (fl - SL_BITS)) - 1, fl, sl);
+
+    uint32_t slMask = slMap[fl] & (~0u << sl);
+    if(slMask == 0)
+    {
+      const uint64_t flMask = fl + 1 < FL_COUNT ? flMap & (~uint64_t(0) << (fl + 1)) : 0;
+      if(flMask == 0)
+        return NONE;
+      fl     = lowestBit(flMask);
+      slMask = slMap[fl];
+    }
+    return heads[fl][lowestBit(slMask)];
+  }
+
+  // splits a_size bytes from the front of a_id, the rest becomes a new free node
+  void SplitBack(uint32_t a_id, VkDeviceSize a_size)
+  {
+    if(nodes[a_id].size - a_size < GRANULARITY)
+      return;
+
+    const uint32_t rest = NewNode();
+    nodes[rest].offset   = nodes[a_id].offset + a_size;
+    nodes[rest].size     = nodes[a_id].size - a_size;
+    nodes[rest].prevPhys = a_id;
+    nodes[rest].nextPhys = nodes[a_id].nextPhys;
+    if(nodes[a_id].nextPhys != NONE)
+      nodes[nodes[a_id].nextPhys].prevPhys = rest;
+    nodes[a_id].nextPhys = rest;
+    nodes[a_id].size     = a_size;
+    InsertFree(rest);
+  }
+
+  bool Allocate(VkDeviceSize a_size, VkDeviceSize a_alignment, uint32_t &a_node, VkDeviceSize &a_offset)
+  {
+    const VkDeviceSize sizeAligned = alignUp(std::max(a_size, GRANULARITY), GRANULARITY);
+    const VkDeviceSize alignment   = std::max(a_alignment, GRANULARITY);
+
+    const uint32_t id = FindFree(sizeAligned + alignment - GRANULARITY);
+    if(id == NONE)
+      return false;
+    RemoveFree(id);
+
+    // front padding stays free as a separate node, it's a multiple of GRANULARITY since both offsets are
+    const VkDeviceSize padding = alignUp(nodes[id].offset, alignment) - nodes[id].offset;
+    if(padding > 0)
+    {
+      SplitBack(id, padding);
+      const uint32_t allocated = nodes[id].nextPhys;
+      RemoveFree(allocated);
+      InsertFree(id);
+      a_node = allocated;
+    }
+    else
+      a_node = id;
+
+    SplitBack(a_node, sizeAligned);
+    nodes[a_node].alignment = alignment;
+    a_offset = nodes[a_node].offset;
+    used += nodes[a_node].size;
+    allocations++;
+    return true;
+  }
+
+  void Free(uint32_t a_id)
+  {
+    assert(!nodes[a_id].free);
+    used -= nodes[a_id].size;
+    allocations--;
+
+    uint32_t id = a_id;
+    const uint32_t prev = nodes[id].prevPhys;
+    if(prev != NONE && nodes[prev].free)
+    {
+      RemoveFree(prev);
+      Merge(prev, id);
+      id = prev;
+    }
+
+    const uint32_t next = nodes[id].nextPhys;
+    if(next != NONE && nodes[next].free)
+    {
+      RemoveFree(next);
+      Merge(id, next);
+    }
+
+    InsertFree(id);
+  }
+
+  // a_second is appended to a_first and its node is released
+  void Merge(uint32_t a_first, uint32_t a_second)
+  {
+    nodes[a_first].size    += nodes[a_second].size;
+    nodes[a_first].nextPhys = nodes[a_second].nextPhys;
+    if(nodes[a_second].nextPhys != NONE)
+      nodes[nodes[a_second].nextPhys].prevPhys = a_first;
+    unusedNodes.push_back(a_second);
+  }
+
+  VkDeviceSize LargestFree() const
+  {
+    if(flMap == 0)
+      return 0;
+    const uint32_t fl = highestBit(flMap);
+    VkDeviceSize largest = 0;
+    for(uint32_t sl = 0; sl < SL_COUNT; ++sl)
+    {
+      for(uint32_t id = heads[fl][sl]; id != NONE; id = nodes[id].nextFree)
+        largest = std::max(largest, nodes[id].size);
+    }
+    return largest;
+  }
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+DeviceAllocator::DeviceAllocator(VkDevice a_device, VkPhysicalDevice a_physDevice, VkDeviceSize a_blockSize)
+  : m_device(a_device), m_physDevice(a_physDevice), m_blockSize(a_blockSize)
+{
+  vkGetPhysicalDeviceMemoryProperties(m_physDevice, &m_memProps);
+}
+
+DeviceAllocator::~DeviceAllocator()
+{
+  for(auto &block : m_blocks)
+  {
+    if(block == nullptr)
+      continue;
+    if(block->allocations != 0)
+      std::cout << "[DeviceAllocator] " << block->allocations << " allocations were not freed" << std::endl;
+    vkFreeMemory(m_device, block->memory, nullptr);
+  }
+  if(m_dedicatedCount != 0)
+    std::cout << "[DeviceAllocator] " << m_dedicatedCount << " dedicated allocations were not freed" << std::endl;
+}
+
+uint32_t DeviceAllocator::FindMemoryType(uint32_t a_typeBits, VkMemoryPropertyFlags a_props) const
+{
+  for(uint32_t i = 0; i < m_memProps.memoryTypeCount; ++i)
+  {
+    if((a_typeBits & (1u << i)) && (m_memProps.memoryTypes[i].propertyFlags & a_props) == a_props)
+      return i;
+  }
+  RUN_TIME_ERROR("[DeviceAllocator]: no suitable memory type");
+  return UINT32_MAX;
+}
+
+void* DeviceAllocator::MapMemory(VkDeviceMemory a_memory, uint32_t a_memoryType)
+{
+  void* mapped = nullptr;
+  if(m_memProps.memoryTypes[a_memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    VK_CHECK_RESULT(vkMapMemory(m_device, a_memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+  return mapped;
+}
+
+DeviceAllocation DeviceAllocator::AllocateDedicated(const VkMemoryRequirements &a_memReq, uint32_t a_memoryType,
+                                                    VkBuffer a_buffer, VkImage a_image)
+{
+  VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+  dedicatedInfo.sType  = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+  dedicatedInfo.buffer = a_buffer;
+  dedicatedInfo.image  = a_image;
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.pNext           = (a_buffer != VK_NULL_HANDLE || a_image != VK_NULL_HANDLE) ? &dedicatedInfo : nullptr;
+  allocateInfo.allocationSize  = a_memReq.size;
+  allocateInfo.memoryTypeIndex = a_memoryType;
+
+  DeviceAllocation alloc;
+  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &alloc.memory));
+  alloc.size   = a_memReq.size;
+  alloc.mapped = MapMemory(alloc.memory, a_memoryType);
+
+  m_driverAllocations++;
+  m_dedicatedCount++;
+  m_dedicatedBytes += a_memReq.size;
+  return alloc;
+}
+
+DeviceAllocation DeviceAllocator::AllocateInBlocks(const VkMemoryRequirements &a_memReq, uint32_t a_memoryType,
+                                                   bool a_optimalImage, uint32_t a_skipBlock)
+{
+  DeviceAllocation alloc;
+  alloc.size = a_memReq.size;
+
+  // fullest blocks first, so that sparse blocks have a chance to become empty
+  std::vector<uint32_t> candidates;
+  for(uint32_t i = 0; i < m_blocks.size(); ++i)
+  {
+    const auto &block = m_blocks[i];
+    if(block != nullptr && i != a_skipBlock && block->memoryType == a_memoryType && block->optimalImage == a_optimalImage)
+      candidates.push_back(i);
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [this](uint32_t a, uint32_t b) { return m_blocks[a]->used > m_blocks[b]->used; });
+
+  for(auto blockId : candidates)
+  {
+    auto &block = *m_blocks[blockId];
+    if(block.Allocate(a_memReq.size, a_memReq.alignment, alloc.node, alloc.offset))
+    {
+      alloc.block  = blockId;
+      alloc.memory = block.memory;
+      alloc.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + alloc.offset : nullptr;
+      return alloc;
+    }
+  }
+  if(a_skipBlock != NONE)
+    return DeviceAllocation{}; // defragmentation never grows the pool
+
+  // small heaps (i.e. 256 MB host visible device local memory) get smaller blocks
+  const VkDeviceSize heapSize  = m_memProps.memoryHeaps[m_memProps.memoryTypes[a_memoryType].heapIndex].size;
+  const VkDeviceSize blockSize = std::max(std::min(m_blockSize, heapSize / 8), alignUp(a_memReq.size, GRANULARITY));
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = blockSize;
+  allocateInfo.memoryTypeIndex = a_memoryType;
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &memory));
+  m_driverAllocations++;
+
+  auto newBlock = std::make_unique<Block>(memory, blockSize, a_memoryType, a_optimalImage, MapMemory(memory, a_memoryType));
+
+  uint32_t blockId = 0;
+  while(blockId < m_blocks.size() && m_blocks[blockId] != nullptr)
+    ++blockId;
+  if(blockId == m_blocks.size())
+    m_blocks.push_back(std::move(newBlock));
+  else
+    m_blocks[blockId] = std::move(newBlock);
+
+  auto &block = *m_blocks[blockId];
+  [[maybe_unused]] const bool allocated = block.Allocate(a_memReq.size, a_memReq.alignment, alloc.node, alloc.offset);
+  assert(allocated);
+  alloc.block  = blockId;
+  alloc.memory = block.memory;
+  alloc.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + alloc.offset : nullptr;
+  return alloc;
+}
+
+DeviceAllocation DeviceAllocator::AllocateImpl(const VkMemoryRequirements &a_memReq, VkMemoryPropertyFlags a_props,
+                                               bool a_optimalImage, bool a_dedicated, VkBuffer a_buffer, VkImage a_image)
+{
+  const uint32_t memoryType = FindMemoryType(a_memReq.memoryTypeBits, a_props);
+
+  std::lock_guard<std::mutex> lock(m_lock);
+  if(a_dedicated || a_memReq.size > m_blockSize / 2)
+    return AllocateDedicated(a_memReq, memoryType, a_buffer, a_image);
+  return AllocateInBlocks(a_memReq, memoryType, a_optimalImage, NONE);
+}
+
+DeviceAllocation DeviceAllocator::Allocate(const VkMemoryRequirements &a_memReq, VkMemoryPropertyFlags a_props,
+                                           bool a_optimalImage, bool a_dedicated)
+{
+  return AllocateImpl(a_memReq, a_props, a_optimalImage, a_dedicated, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+DeviceAllocation DeviceAllocator::AllocateForBuffer(VkBuffer a_buffer, VkMemoryPropertyFlags a_props)
+{
+  VkMemoryDedicatedRequirements dedicatedReq = {};
+  dedicatedReq.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+  VkMemoryRequirements2 memReq = {};
+  memReq.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+  memReq.pNext = &dedicatedReq;
+
+  VkBufferMemoryRequirementsInfo2 reqInfo = {};
+  reqInfo.sType  = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+  reqInfo.buffer = a_buffer;
+  vkGetBufferMemoryRequirements2(m_device, &reqInfo, &memReq);
+
+  const bool dedicated = dedicatedReq.prefersDedicatedAllocation || dedicatedReq.requiresDedicatedAllocation;
+  auto alloc = AllocateImpl(memReq.memoryRequirements, a_props, false, dedicated, a_buffer, VK_NULL_HANDLE);
+  VK_CHECK_RESULT(vkBindBufferMemory(m_device, a_buffer, alloc.memory, alloc.offset));
+  return alloc;
+}
+
+DeviceAllocation DeviceAllocator::AllocateForImage(VkImage a_image, VkMemoryPropertyFlags a_props, bool a_dedicated)
+{
+  VkMemoryDedicatedRequirements dedicatedReq = {};
+  dedicatedReq.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+  VkMemoryRequirements2 memReq = {};
+  memReq.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+  memReq.pNext = &dedicatedReq;
+
+  VkImageMemoryRequirementsInfo2 reqInfo = {};
+  reqInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+  reqInfo.image = a_image;
+  vkGetImageMemoryRequirements2(m_device, &reqInfo, &memReq);
+
+  const bool dedicated = a_dedicated || dedicatedReq.prefersDedicatedAllocation || dedicatedReq.requiresDedicatedAllocation;
+  auto alloc = AllocateImpl(memReq.memoryRequirements, a_props, true, dedicated, VK_NULL_HANDLE, a_image);
+  VK_CHECK_RESULT(vkBindImageMemory(m_device, a_image, alloc.memory, alloc.offset));
+  return alloc;
+}
+
+DeviceAllocation DeviceAllocator::AllocateForBuffers(const std::vector<VkBuffer> &a_buffers, VkMemoryPropertyFlags a_props)
+{
+  std::vector<VkDeviceSize> offsets(a_buffers.size());
+  VkMemoryRequirements total = {0, 1, ~0u};
+  for(size_t i = 0; i < a_buffers.size(); ++i)
+  {
+    VkMemoryRequirements memReq;
+    vkGetBufferMemoryRequirements(m_device, a_buffers[i], &memReq);
+
+    offsets[i]            = alignUp(total.size, memReq.alignment);
+    total.size            = offsets[i] + memReq.size;
+    total.alignment       = std::max(total.alignment, memReq.alignment);
+    total.memoryTypeBits &= memReq.memoryTypeBits;
+  }
+
+  auto alloc = Allocate(total, a_props, false);
+  for(size_t i = 0; i < a_buffers.size(); ++i)
+    VK_CHECK_RESULT(vkBindBufferMemory(m_device, a_buffers[i], alloc.memory, alloc.offset + offsets[i]));
+  return alloc;
+}
+
+void DeviceAllocator::Free(DeviceAllocation &a_alloc)
+{
+  if(!a_alloc.IsValid())
+    return;
+
+  std::lock_guard<std::mutex> lock(m_lock);
+  FreeImpl(a_alloc);
+}
+
+void DeviceAllocator::FreeImpl(DeviceAllocation &a_alloc)
+{
+  if(a_alloc.block == NONE)
+  {
+    vkFreeMemory(m_device, a_alloc.memory, nullptr);
+    m_dedicatedCount--;
+    m_dedicatedBytes -= a_alloc.size;
+  }
+  else
+  {
+    m_movable.erase(MovableKey(a_alloc));
+
+    auto &block = *m_blocks[a_alloc.block];
+    block.Free(a_alloc.node);
+    if(block.allocations == 0)
+      ReleaseEmptyBlocks(block.memoryType, block.optimalImage, 1);
+  }
+  a_alloc = DeviceAllocation{};
+}
+
+// one empty block of each kind is kept, so that allocate/free in a loop does not hit the driver every time
+void DeviceAllocator::ReleaseEmptyBlocks(uint32_t a_memoryType, bool a_optimalImage, uint32_t a_keep)
+{
+  uint32_t kept = 0;
+  for(auto &block : m_blocks)
+  {
+    if(block == nullptr || block->allocations != 0 || block->memoryType != a_memoryType ||
+       block->optimalImage != a_optimalImage)
+      continue;
+
+    if(kept < a_keep)
+    {
+      kept++;
+      continue;
+    }
+    vkFreeMemory(m_device, block->memory, nullptr);
+    block = nullptr;
+  }
+}
+
+void DeviceAllocator::SetMovable(const DeviceAllocation &a_alloc, MoveFunc a_onMove)
+{
+  if(a_alloc.block == NONE)
+    return; // dedicated memory is not compacted
+
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_movable[MovableKey(a_alloc)] = std::move(a_onMove);
+}
+
+VkDeviceSize DeviceAllocator::Defragment(VkDeviceSize a_maxBytes)
+{
+  PROFILE_FUNCTION();
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  // the sparsest blocks are emptied first
+  std::vector<uint32_t> sources;
+  for(uint32_t i = 0; i < m_blocks.size(); ++i)
+  {
+    if(m_blocks[i] != nullptr && m_blocks[i]->allocations != 0)
+      sources.push_back(i);
+  }
+  std::stable_sort(sources.begin(), sources.end(),
+                   [this](uint32_t a, uint32_t b) { return m_blocks[a]->used < m_blocks[b]->used; });
+
+  VkDeviceSize moved = 0;
+  for(auto blockId : sources)
+  {
+    std::vector<std::pair<DeviceAllocation, MoveFunc>> toMove;
+    for(const auto &[key, onMove] : m_movable)
+    {
+      if(uint32_t(key >> 32) != blockId)
+        continue;
+
+      const auto &block = *m_blocks[blockId];
+      const auto &node  = block.nodes[uint32_t(key)];
+
+      DeviceAllocation from;
+      from.memory = block.memory;
+      from.offset = node.offset;
+      from.size   = node.size;
+      from.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + node.offset : nullptr;
+      from.block  = blockId;
+      from.node   = uint32_t(key);
+      toMove.emplace_back(from, onMove);
+    }
+
+    for(auto &[from, onMove] : toMove)
+    {
+      if(moved >= a_maxBytes)
+        return moved;
+
+      const auto &block = *m_blocks[blockId];
+      VkMemoryRequirements memReq = {from.size, block.nodes[from.node].alignment, 1u << block.memoryType};
+      auto to = AllocateInBlocks(memReq, block.memoryType, block.optimalImage, blockId);
+      if(!to.IsValid())
+        continue;
+
+      onMove(from, to);
+      m_movable[MovableKey(to)] = onMove;
+      moved += from.size;
+      FreeImpl(from);
+    }
+  }
+
+  if(moved != 0)
+    std::cout << "[DeviceAllocator] defragmentation moved " << toMB(moved) << " MB" << std::endl;
+  return moved;
+}
+
+DeviceAllocator::Stats DeviceAllocator::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  Stats stats;
+  for(const auto &block : m_blocks)
+  {
+    if(block == nullptr)
+      continue;
+    stats.blocks++;
+    stats.allocations += block->allocations;
+    stats.reserved    += block->size;
+    stats.used        += block->used;
+    stats.largestFree  = std::max(stats.largestFree, block->LargestFree());
+  }
+  stats.dedicated     = m_dedicatedCount;
+  stats.allocations  += m_dedicatedCount;
+  stats.reserved     += m_dedicatedBytes;
+  stats.used         += m_dedicatedBytes;
+  stats.driverAllocs  = m_driverAllocations;
+  return stats;
+}
+
+void DeviceAllocator::PrintStats() const
+{
+  const auto stats = GetStats();
+  std::cout << "[DeviceAllocator] " << stats.allocations << " allocations in " << stats.blocks << " blocks + "
+            << stats.dedicated << " dedicated, used " << toMB(stats.used) << " MB of " << toMB(stats.reserved)
+            << " MB, largest free range " << toMB(stats.largestFree) << " MB, " << stats.driverAllocs
+            << " vkAllocateMemory calls" << std::endl;
+}
@@ -0,0 +1,120 @@
+#ifndef VK_GRAPHICS_BASIC_DEVICE_ALLOCATOR_H
+#define VK_GRAPHICS_BASIC_DEVICE_ALLOCATOR_H
+
+#include "volk.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+\brief Range of device memory returned by DeviceAllocator. Several allocations usually share one VkDeviceMemory.
+*/
+struct DeviceAllocation
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize   offset = 0;
+  VkDeviceSize   size   = 0;
+  void*          mapped = nullptr;  ///!< host visible memory is persistently mapped, this points to offset
+
+  bool IsValid() const { return memory != VK_NULL_HANDLE; }
+
+private:
+  friend class DeviceAllocator;
+  uint32_t block = UINT32_MAX;  ///!< UINT32_MAX for dedicated allocations
+  uint32_t node  = UINT32_MAX;
+};
+
+/**
+\brief Device memory sub-allocator.
+
+  Memory is taken from the driver in large blocks, one list of blocks per memory type. Buffers and optimal tiling
+  images never share a block, so bufferImageGranularity doesn't need to be taken into account. Inside a block
+  ranges are managed by TLSF (two-level segregated fit): allocation and free are O(1) and free neighbours are merged.
+
+  Dedicated VkDeviceMemory is used when the driver asks for it (VK_KHR_dedicated_allocation, core in 1.1),
+  when a resource takes more than half of a block, or when the caller requests it (i.e. for render targets recreated
+  on resize).
+
+  All methods are thread safe.
+*/
+class DeviceAllocator
+{
+public:
+  struct Stats
+  {
+    uint32_t     blocks        = 0;
+    uint32_t     dedicated     = 0;
+    uint32_t     allocations   = 0;
+    VkDeviceSize reserved      = 0;  ///!< taken from the driver
+    VkDeviceSize used          = 0;
+    VkDeviceSize largestFree   = 0;  ///!< largest free range in blocks
+    uint32_t     driverAllocs  = 0;  ///!< vkAllocateMemory calls over allocator lifetime
+  };
+
+  // called by Defragment() when allocation is relocated: the callee should create its resource again, bind it to
+  // a_to, copy content and wait for the copy. a_from is freed right after the call. Must not call the allocator.
+  using MoveFunc = std::function<void(const DeviceAllocation &a_from, const DeviceAllocation &a_to)>;
+
+  DeviceAllocator(VkDevice a_device, VkPhysicalDevice a_physDevice, VkDeviceSize a_blockSize = 64 * 1024 * 1024);
+  ~DeviceAllocator();
+
+  DeviceAllocator(const DeviceAllocator &) = delete;
+  DeviceAllocator &operator=(const DeviceAllocator &) = delete;
+
+  DeviceAllocation Allocate(const VkMemoryRequirements &a_memReq, VkMemoryPropertyFlags a_props, bool a_optimalImage,
+                            bool a_dedicated = false);
+
+  // allocate and bind
+  DeviceAllocation AllocateForBuffer(VkBuffer a_buffer, VkMemoryPropertyFlags a_props);
+  DeviceAllocation AllocateForImage(VkImage a_image, VkMemoryPropertyFlags a_props, bool a_dedicated = false);
+
+  // buffers are placed one after another in a single range which is freed at once,
+  // replacement for vk_utils::allocateAndBindWithPadding
+  DeviceAllocation AllocateForBuffers(const std::vector<VkBuffer> &a_buffers, VkMemoryPropertyFlags a_props);
+
+  void Free(DeviceAllocation &a_alloc);
+
+  // allocations marked as movable are compacted by Defragment() into fuller blocks so that sparse blocks
+  // can be returned to the driver, returns number of bytes moved
+  void         SetMovable(const DeviceAllocation &a_alloc, MoveFunc a_onMove);
+  VkDeviceSize Defragment(VkDeviceSize a_maxBytes = VK_WHOLE_SIZE);
+
+  Stats GetStats() const;
+  void  PrintStats() const;
+
+  VkDevice GetDevice() const { return m_device; }
+
+private:
+  struct Block;
+
+  uint32_t FindMemoryType(uint32_t a_typeBits, VkMemoryPropertyFlags a_props) const;
+  DeviceAllocation AllocateDedicated(const VkMemoryRequirements &a_memReq, uint32_t a_memoryType,
+                                     VkBuffer a_buffer, VkImage a_image);
+  DeviceAllocation AllocateInBlocks(const VkMemoryRequirements &a_memReq, uint32_t a_memoryType, bool a_optimalImage,
+                                    uint32_t a_skipBlock);
+  DeviceAllocation AllocateImpl(const VkMemoryRequirements &a_memReq, VkMemoryPropertyFlags a_props, bool a_optimalImage,
+                                bool a_dedicated, VkBuffer a_buffer, VkImage a_image);
+  void  FreeImpl(DeviceAllocation &a_alloc);
+  void* MapMemory(VkDeviceMemory a_memory, uint32_t a_memoryType);
+  void  ReleaseEmptyBlocks(uint32_t a_memoryType, bool a_optimalImage, uint32_t a_keep);
+
+  static uint64_t MovableKey(const DeviceAllocation &a_alloc) { return (uint64_t(a_alloc.block) << 32) | a_alloc.node; }
+
+  VkDevice                         m_device     = VK_NULL_HANDLE;
+  VkPhysicalDevice                 m_physDevice = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties m_memProps   = {};
+  VkDeviceSize                     m_blockSize  = 0;
+
+  mutable std::mutex                  m_lock;
+  std::vector<std::unique_ptr<Block>> m_blocks;  ///!< released blocks leave nullptr so indices stay valid
+  std::unordered_map<uint64_t, MoveFunc> m_movable;
+
+  uint32_t     m_dedicatedCount    = 0;
+  VkDeviceSize m_dedicatedBytes    = 0;
+  uint32_t     m_driverAllocations = 0;
+};
+
+#endif// VK_GRAPHICS_BASIC_DEVICE_ALLOCATOR_H
@@ -0,0 +1,58 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+DynamicResolution::DynamicResolution(VkExtent2D a_maxExtent, const DynamicResolutionParams &a_params) : m_maxExtent(a_maxExtent)
+{
+  SetParams(a_params);
+}
+
+void DynamicResolution::SetMaxExtent(VkExtent2D a_maxExtent)
+{
+  m_maxExtent = a_maxExtent;
+  UpdateExtent();
+}
+
+void DynamicResolution::SetParams(const DynamicResolutionParams &a_params)
+{
+  m_params          = a_params;
+  m_params.maxScale = std::clamp(m_params.maxScale, 0.1f, 1.0f); // the target is not larger than the maximal extent
+  m_params.minScale = std::clamp(m_params.minScale, 0.1f, m_params.maxScale);
+  m_scale           = m_params.enabled ? std::clamp(m_scale, m_params.minScale, m_params.maxScale) : m_params.maxScale;
+  m_filteredMs      = 0.0f;
+  UpdateExtent();
+}
+
+void DynamicResolution::Update(float a_gpuFrameMs)
+{
+  if(!m_params.enabled || a_gpuFrameMs <= 0.0f)
+    return;
+
+  m_filteredMs = m_filteredMs == 0.0f ? a_gpuFrameMs : m_filteredMs + (a_gpuFrameMs - m_filteredMs) * 0.25f;
+
+  // aim slightly below the budget, so that noise does not push frames over it
+  const float targetMs = m_params.frameBudgetMs * 0.9f;
+  const float error    = m_filteredMs / targetMs;
+  if(error > 0.95f && error < 1.05f)
+    return;
+
+  // time ~ pixels ~ scale^2; large steps down when over budget, small steps up when under it
+  const float step = std::clamp(std::sqrt(1.0f / error), 0.85f, 1.03f);
+  const float scale = std::clamp(m_scale * step, m_params.minScale, m_params.maxScale);
+  if(scale == m_scale)
+    return;
+
+  m_scale = scale;
+  UpdateExtent();
+}
+
+void DynamicResolution::UpdateExtent()
+{
+  // multiples of 8 keep the number of distinct resolutions small and tiles of the GPU fully covered
+  auto scaled = [this](uint32_t a_max) {
+    const uint32_t size = (uint32_t(std::lround(float(a_max) * m_scale)) + 4u) / 8u * 8u;
+    return std::clamp(size, std::min(8u, a_max), a_max);
+  };
+  m_extent = VkExtent2D{scaled(m_maxExtent.width), scaled(m_maxExtent.height)};
+}
@@ -0,0 +1,47 @@
+#ifndef VK_GRAPHICS_BASIC_DYNAMIC_RESOLUTION_H
+#define VK_GRAPHICS_BASIC_DYNAMIC_RESOLUTION_H
+
+#include "volk.h"
+
+struct DynamicResolutionParams
+{
+  bool  enabled       = true;
+  float frameBudgetMs = 1000.0f / 60.0f;
+  float minScale      = 0.5f;   ///!< of the maximal width and height
+  float maxScale      = 1.0f;
+};
+
+/**
+\brief Picks resolution of the main pass so that GPU frame time stays within a budget.
+
+  The main pass is rendered into the top left part of a target of the maximal size, only the viewport changes, so
+  nothing is reallocated when the resolution does. Update() is called with every new GPU frame time, which is
+  several frames old, so the controller reacts gradually: it assumes GPU time proportional to the number
+  of pixels, filters the measurements, ignores small deviations and lowers resolution faster than it raises it.
+*/
+class DynamicResolution
+{
+public:
+  explicit DynamicResolution(VkExtent2D a_maxExtent, const DynamicResolutionParams &a_params = {});
+
+  void SetMaxExtent(VkExtent2D a_maxExtent); // i.e. on window resize, keeps the scale
+  void SetParams(const DynamicResolutionParams &a_params);
+  const DynamicResolutionParams &GetParams() const { return m_params; }
+
+  void Update(float a_gpuFrameMs);
+
+  float      Scale()     const { return m_scale; }
+  VkExtent2D Extent()    const { return m_extent; }   ///!< main pass viewport, multiple of 8 pixels
+  VkExtent2D MaxExtent() const { return m_maxExtent; }
+
+private:
+  void UpdateExtent();
+
+  DynamicResolutionParams m_params;
+  VkExtent2D              m_maxExtent {};
+  VkExtent2D              m_extent {};
+  float                   m_scale      = 1.0f;
+  float                   m_filteredMs = 0.0f;
+};
+
+#endif// VK_GRAPHICS_BASIC_DYNAMIC_RESOLUTION_H
@@ -0,0 +1,141 @@
+#include "frame_pacer.h"
+#include "../utils/profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// exponential moving average, ~16 frames
+static float smoothMs(float a_prev, FramePacer::Clock::duration a_sample)
+{
+  const float sampleMs = std::chrono::duration<float, std::milli>(a_sample).count();
+  return a_prev == 0.0f ? sampleMs : a_prev + (sampleMs - a_prev) / 16.0f;
+}
+
+void FramePacer::SetParams(const FramePacingParams &a_params)
+{
+  m_params = a_params;
+  m_params.framesInFlight = std::clamp(m_params.framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT);
+  m_params.fpsLimit       = std::max(m_params.fpsLimit, 0.0f);
+}
+
+void FramePacer::QuerySupportedModes(VkPhysicalDevice a_physDevice, VkSurfaceKHR a_surface)
+{
+  uint32_t modesNum = 0;
+  VK_CHECK_RESULT(vkGetPhysicalDeviceSurfacePresentModesKHR(a_physDevice, a_surface, &modesNum, nullptr));
+  std::vector<VkPresentModeKHR> modes(modesNum);
+  VK_CHECK_RESULT(vkGetPhysicalDeviceSurfacePresentModesKHR(a_physDevice, a_surface, &modesNum, modes.data()));
+
+  m_supportedModes = {PresentMode::FIFO}; // always supported
+  for(auto mode : modes)
+  {
+    if(mode == VK_PRESENT_MODE_MAILBOX_KHR)
+      m_supportedModes.push_back(PresentMode::MAILBOX);
+    else if(mode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+      m_supportedModes.push_back(PresentMode::IMMEDIATE);
+  }
+}
+
+bool FramePacer::IsSupported(PresentMode a_mode) const
+{
+  return std::find(m_supportedModes.begin(), m_supportedModes.end(), a_mode) != m_supportedModes.end();
+}
+
+PresentMode FramePacer::EffectivePresentMode() const
+{
+  // VulkanSwapChain takes only a vsync flag: FIFO with vsync, otherwise MAILBOX if supported, then IMMEDIATE
+  if(VSync())
+    return PresentMode::FIFO;
+  if(IsSupported(PresentMode::MAILBOX))
+    return PresentMode::MAILBOX;
+  if(IsSupported(PresentMode::IMMEDIATE))
+    return PresentMode::IMMEDIATE;
+  return PresentMode::FIFO;
+}
+
+const char *FramePacer::ModeName(PresentMode a_mode)
+{
+  switch(a_mode)
+  {
+  case PresentMode::FIFO:      return "FIFO";
+  case PresentMode::MAILBOX:   return "MAILBOX";
+  case PresentMode::IMMEDIATE: return "IMMEDIATE";
+  }
+  return "unknown";
+}
+
+void FramePacer::Limit()
+{
+  PROFILE_FUNCTION();
+  m_limiterWaitMs = 0.0f;
+  if(m_params.fpsLimit <= 0.0f)
+  {
+    m_nextFrameStart = {};
+    return;
+  }
+
+  const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_params.fpsLimit));
+  const auto start  = Clock::now();
+
+  // first limited frame or the frame took longer than the period: start a new schedule from now instead of
+  // letting following frames run unlimited to catch up
+  if(m_nextFrameStart == Clock::time_point{} || start > m_nextFrameStart + period)
+    m_nextFrameStart = start;
+  else
+    SleepPrecise(m_nextFrameStart);
+
+  m_limiterWaitMs   = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+  m_nextFrameStart += period;
+}
+
+void FramePacer::SleepPrecise(Clock::time_point a_deadline)
+{
+  // OS sleep overshoots by up to a few ms, so sleep in 1 ms steps while the remaining time is larger than
+  // the estimated cost of such a step, and spin the rest
+  while(true)
+  {
+    const double remainingSec = std::chrono::duration<double>(a_deadline - Clock::now()).count();
+    if(remainingSec <= m_sleepEstimateSec)
+      break;
+
+    const auto sleepStart = Clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    const double observedSec = std::chrono::duration<double>(Clock::now() - sleepStart).count();
+
+    // Welford's online mean and variance
+    ++m_sleepCount;
+    const double delta = observedSec - m_sleepMeanSec;
+    m_sleepMeanSec    += delta / double(m_sleepCount);
+    m_sleepM2         += delta * (observedSec - m_sleepMeanSec);
+    m_sleepEstimateSec = m_sleepMeanSec + std::sqrt(m_sleepM2 / double(m_sleepCount - 1));
+  }
+
+  while(Clock::now() < a_deadline)
+    std::this_thread::yield();
+}
+
+void FramePacer::OnFrameCompleted(uint32_t a_frame)
+{
+  auto &slot = m_slots[a_frame % MAX_FRAMES_IN_FLIGHT];
+  if(slot.presented)
+    m_inputToGpuDoneMs = smoothMs(m_inputToGpuDoneMs, Clock::now() - slot.input);
+  slot.sampled   = false;
+  slot.presented = false;
+}
+
+void FramePacer::OnInputSampled(uint32_t a_frame)
+{
+  auto &slot = m_slots[a_frame % MAX_FRAMES_IN_FLIGHT];
+  slot.input     = Clock::now();
+  slot.sampled   = true;
+  slot.presented = false;
+}
+
+void FramePacer::OnPresented(uint32_t a_frame)
+{
+  auto &slot = m_slots[a_frame % MAX_FRAMES_IN_FLIGHT];
+  if(!slot.sampled)
+    return;
+  m_inputToPresentMs = smoothMs(m_inputToPresentMs, Clock::now() - slot.input);
+  slot.presented = true;
+}
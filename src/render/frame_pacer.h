@@ -0,0 +1,77 @@
+#ifndef VK_GRAPHICS_BASIC_FRAME_PACER_H
+#define VK_GRAPHICS_BASIC_FRAME_PACER_H
+
+#include "render_common.h"
+
+#include <array>
+#include <chrono>
+#include <vector>
+
+/**
+\brief Frame limiter and input latency measurement, shared by renders which present to a swapchain.
+
+  Frame start: Limit() waits for the next frame slot of the fps limit, then the render waits for the fence of
+  the frame it is going to reuse, calls OnFrameCompleted() and OnInputSampled() and input is polled right after.
+  Waiting before input is sampled rather than after it keeps the CPU from running ahead of the GPU with stale input.
+
+  Latency is measured on the CPU: "input to present" ends when vkQueuePresentKHR returns, "input to GPU done" ends
+  when the frame fence is seen signaled. The latter is exact when the CPU had to block on the fence and an upper
+  bound otherwise. Display scanout is not included, it would need VK_GOOGLE_display_timing.
+*/
+class FramePacer
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit FramePacer(const FramePacingParams &a_params = {}) { SetParams(a_params); }
+
+  const FramePacingParams &Params() const { return m_params; }
+  void SetParams(const FramePacingParams &a_params); // clamps frames in flight to 1 .. MAX_FRAMES_IN_FLIGHT
+
+  // present modes of the surface, also used to tell which one VulkanSwapChain actually picks
+  void        QuerySupportedModes(VkPhysicalDevice a_physDevice, VkSurfaceKHR a_surface);
+  bool        IsSupported(PresentMode a_mode) const;
+  PresentMode EffectivePresentMode() const;
+  bool        VSync() const { return m_params.presentMode == PresentMode::FIFO; }
+
+  static const char *ModeName(PresentMode a_mode);
+
+  // sleeps and then spins until the next frame slot, does nothing without fps limit
+  void Limit();
+
+  void OnFrameCompleted(uint32_t a_frame);  // frame fence of a_frame is signaled
+  void OnInputSampled(uint32_t a_frame);
+  void OnPresented(uint32_t a_frame);
+
+  float InputToPresentMs() const { return m_inputToPresentMs; }  ///!< smoothed over ~16 frames
+  float InputToGpuDoneMs() const { return m_inputToGpuDoneMs; }  ///!< smoothed over ~16 frames
+  float LimiterWaitMs()    const { return m_limiterWaitMs; }     ///!< time spent in Limit() by the last frame
+
+private:
+  void SleepPrecise(Clock::time_point a_deadline);
+
+  FramePacingParams        m_params;
+  std::vector<PresentMode> m_supportedModes = {PresentMode::FIFO};
+
+  Clock::time_point m_nextFrameStart {};
+  float             m_limiterWaitMs = 0.0f;
+
+  // estimate of how long sleep_for(1ms) really takes, mean + stddev, so that the rest is spun
+  double   m_sleepEstimateSec = 5e-3;
+  double   m_sleepMeanSec     = 5e-3;
+  double   m_sleepM2          = 0.0;
+  uint64_t m_sleepCount       = 1;
+
+  struct Slot
+  {
+    Clock::time_point input {};
+    bool              sampled   = false;
+    bool              presented = false;
+  };
+  std::array<Slot, MAX_FRAMES_IN_FLIGHT> m_slots {};
+
+  float m_inputToPresentMs = 0.0f;
+  float m_inputToGpuDoneMs = 0.0f;
+};
+
+#endif// VK_GRAPHICS_BASIC_FRAME_PACER_H
@@ -0,0 +1,78 @@
+#include "gpu_timer.h"
+#include <vk_utils.h>
+
+GpuFrameTimer::GpuFrameTimer(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_queueFID, uint32_t a_framesInFlight)
+  : m_device(a_device), m_recorded(a_framesInFlight, false), m_submitted(a_framesInFlight, false)
+{
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(a_physDevice, &props);
+
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physDevice, &queueFamilyCount, queueFamilies.data());
+
+  const uint32_t validBits = a_queueFID < queueFamilyCount ? queueFamilies[a_queueFID].timestampValidBits : 0;
+  if(validBits == 0 || props.limits.timestampPeriod == 0.0f)
+  {
+    vk_utils::logWarning("[GpuFrameTimer] timestamps are not supported by the queue, GPU time will not be measured");
+    return;
+  }
+
+  m_periodNs  = props.limits.timestampPeriod;
+  m_validMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1ull);
+
+  VkQueryPoolCreateInfo queryPoolInfo = {};
+  queryPoolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryPoolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+  queryPoolInfo.queryCount = 2 * a_framesInFlight;
+  VK_CHECK_RESULT(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &m_queryPool));
+}
+
+GpuFrameTimer::~GpuFrameTimer()
+{
+  if(m_queryPool != VK_NULL_HANDLE)
+  {
+    vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+    m_queryPool = VK_NULL_HANDLE;
+  }
+}
+
+void GpuFrameTimer::CmdBegin(VkCommandBuffer a_cmdBuff, uint32_t a_frame)
+{
+  if(!IsSupported())
+    return;
+  vkCmdResetQueryPool(a_cmdBuff, m_queryPool, 2 * a_frame, 2);
+  vkCmdWriteTimestamp(a_cmdBuff, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, 2 * a_frame);
+}
+
+void GpuFrameTimer::CmdEnd(VkCommandBuffer a_cmdBuff, uint32_t a_frame)
+{
+  if(!IsSupported())
+    return;
+  vkCmdWriteTimestamp(a_cmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 2 * a_frame + 1);
+  m_recorded[a_frame] = true;
+}
+
+void GpuFrameTimer::OnSubmit(uint32_t a_frame)
+{
+  m_submitted[a_frame] = m_recorded[a_frame];
+  m_recorded[a_frame]  = false;
+}
+
+bool GpuFrameTimer::CollectResult(uint32_t a_frame)
+{
+  if(!IsSupported() || !m_submitted[a_frame])
+    return false;
+  m_submitted[a_frame] = false;
+
+  uint64_t timestamps[2] = {};
+  VkResult res = vkGetQueryPoolResults(m_device, m_queryPool, 2 * a_frame, 2, sizeof(timestamps), timestamps,
+                                       sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if(res != VK_SUCCESS)
+    return false;
+
+  const uint64_t ticks = (timestamps[1] - timestamps[0]) & m_validMask;
+  m_lastFrameMs = float(double(ticks) * double(m_periodNs) * 1e-6);
+  return true;
+}
@@ -0,0 +1,43 @@
+#ifndef VK_GRAPHICS_BASIC_GPU_TIMER_H
+#define VK_GRAPHICS_BASIC_GPU_TIMER_H
+
+#include "volk.h"
+
+#include <vector>
+
+/**
+\brief Measures GPU time of whole frames with a pair of timestamp queries per frame in flight.
+
+  Usage: CmdBegin/CmdEnd around frame commands, OnSubmit after the frame is submitted and
+  CollectResult after the frame fence is waited. Results are therefore delayed by m_framesInFlight frames.
+*/
+class GpuFrameTimer
+{
+public:
+  GpuFrameTimer(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_queueFID, uint32_t a_framesInFlight);
+  ~GpuFrameTimer();
+
+  GpuFrameTimer(const GpuFrameTimer &) = delete;
+  GpuFrameTimer &operator=(const GpuFrameTimer &) = delete;
+
+  bool IsSupported() const { return m_queryPool != VK_NULL_HANDLE; }
+
+  void CmdBegin(VkCommandBuffer a_cmdBuff, uint32_t a_frame);
+  void CmdEnd(VkCommandBuffer a_cmdBuff, uint32_t a_frame);
+  void OnSubmit(uint32_t a_frame);
+
+  // returns true and updates LastFrameMs() if a_frame had timestamps written since the previous call
+  bool  CollectResult(uint32_t a_frame);
+  float LastFrameMs() const { return m_lastFrameMs; }
+
+private:
+  VkDevice          m_device    = VK_NULL_HANDLE;
+  VkQueryPool       m_queryPool = VK_NULL_HANDLE;
+  float             m_periodNs  = 1.0f;
+  uint64_t          m_validMask = ~0ull;
+  float             m_lastFrameMs = 0.0f;
+  std::vector<bool> m_recorded;
+  std::vector<bool> m_submitted;
+};
+
+#endif// VK_GRAPHICS_BASIC_GPU_TIMER_H
@@ -0,0 +1,252 @@
+#include "headless_target.h"
+#include <vk_utils.h>
+#include <vk_buffers.h>
+
+#include <array>
+#include <fstream>
+#include <iostream>
+
+HeadlessTarget::HeadlessTarget(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator, uint32_t a_queueFID,
+                               uint32_t a_width, uint32_t a_height, uint32_t a_imageCount, VkFormat a_colorFormat)
+  : m_device(a_device), m_pAllocator(std::move(a_pAllocator)), m_queueFID(a_queueFID), m_format(a_colorFormat),
+    m_extent{a_width, a_height}
+{
+  m_images.resize(a_imageCount);
+  m_imageAllocs.resize(a_imageCount);
+  CreateImages();
+  CreateReadbackResources();
+}
+
+HeadlessTarget::~HeadlessTarget()
+{
+  if(m_commandPool != VK_NULL_HANDLE)
+  {
+    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    m_commandPool = VK_NULL_HANDLE;
+  }
+
+  for(auto buf : m_readbackBuffers)
+    vkDestroyBuffer(m_device, buf, nullptr);
+  m_readbackBuffers.clear();
+  m_pAllocator->Free(m_readbackAlloc);
+
+  for(auto& img : m_images)
+  {
+    vkDestroyImageView(m_device, img.view, nullptr);
+    vkDestroyImage(m_device, img.image, nullptr);
+  }
+  m_images.clear();
+  for(auto& alloc : m_imageAllocs)
+    m_pAllocator->Free(alloc);
+  m_imageAllocs.clear();
+}
+
+void HeadlessTarget::CreateImages()
+{
+  for(size_t i = 0; i < m_images.size(); ++i)
+  {
+    auto& img = m_images[i];
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+    imageInfo.format        = m_format;
+    imageInfo.extent        = VkExtent3D{m_extent.width, m_extent.height, 1};
+    imageInfo.mipLevels     = 1;
+    imageInfo.arrayLayers   = 1;
+    imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage         = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK_RESULT(vkCreateImage(m_device, &imageInfo, nullptr, &img.image));
+    m_imageAllocs[i] = m_pAllocator->AllocateForImage(img.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image    = img.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format   = m_format;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    VK_CHECK_RESULT(vkCreateImageView(m_device, &viewInfo, nullptr, &img.view));
+
+    img.format     = m_format;
+    img.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+void HeadlessTarget::CreateReadbackResources()
+{
+  const VkDeviceSize imageSize = VkDeviceSize(m_extent.width) * m_extent.height * 4;
+
+  m_readbackBuffers.resize(m_images.size());
+  VkMemoryRequirements memReq = {};
+  for(auto& buf : m_readbackBuffers)
+    buf = vk_utils::createBuffer(m_device, imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, &memReq);
+
+  // buffers are identical, so AllocateForBuffers places them exactly m_readbackStride apart
+  m_readbackStride = vk_utils::getPaddedSize(memReq.size, memReq.alignment);
+  m_readbackAlloc  = m_pAllocator->AllocateForBuffers(m_readbackBuffers,
+                                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  m_commandPool  = vk_utils::createCommandPool(m_device, m_queueFID, 0);
+  m_readbackCmds = vk_utils::createCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_images.size()));
+
+  // images are always in FINAL_LAYOUT after the render pass, so readback commands never change and are recorded once
+  for(size_t i = 0; i < m_images.size(); ++i)
+  {
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_readbackCmds[i], &beginInfo));
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent      = VkExtent3D{m_extent.width, m_extent.height, 1};
+    vkCmdCopyImageToBuffer(m_readbackCmds[i], m_images[i].image, FINAL_LAYOUT, m_readbackBuffers[i], 1, &region);
+
+    VkBufferMemoryBarrier toHost = {};
+    toHost.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    toHost.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toHost.dstAccessMask       = VK_ACCESS_HOST_READ_BIT;
+    toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.buffer              = m_readbackBuffers[i];
+    toHost.size                = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(m_readbackCmds[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         0, nullptr, 1, &toHost, 0, nullptr);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(m_readbackCmds[i]));
+  }
+}
+
+VkRenderPass HeadlessTarget::CreateRenderPass(VkFormat a_depthFormat) const
+{
+  std::array<VkAttachmentDescription, 2> attachments = {};
+  attachments[0].format         = m_format;
+  attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+  attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[0].finalLayout    = FINAL_LAYOUT;
+
+  attachments[1].format         = a_depthFormat;
+  attachments[1].samples        = VK_SAMPLE_COUNT_1_BIT;
+  attachments[1].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].storeOp        = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[1].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference colorReference = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depthReference = {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpassDescription = {};
+  subpassDescription.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpassDescription.colorAttachmentCount    = 1;
+  subpassDescription.pColorAttachments       = &colorReference;
+  subpassDescription.pDepthStencilAttachment = &depthReference;
+
+  std::array<VkSubpassDependency, 2> dependencies = {};
+  dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass      = 0;
+  dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].srcAccessMask   = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  dependencies[1].srcSubpass      = 0;
+  dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstAccessMask   = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  VkRenderPassCreateInfo renderPassInfo = {};
+  renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments    = attachments.data();
+  renderPassInfo.subpassCount    = 1;
+  renderPassInfo.pSubpasses      = &subpassDescription;
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  renderPassInfo.pDependencies   = dependencies.data();
+
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &renderPass));
+  return renderPass;
+}
+
+std::vector<VkFramebuffer> HeadlessTarget::CreateFrameBuffers(VkRenderPass a_renderPass, VkImageView a_depthView) const
+{
+  std::vector<VkFramebuffer> frameBuffers(m_images.size());
+  for(size_t i = 0; i < m_images.size(); ++i)
+  {
+    std::array<VkImageView, 2> attachments = {m_images[i].view, a_depthView};
+
+    VkFramebufferCreateInfo frameBufferInfo = {};
+    frameBufferInfo.sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    frameBufferInfo.renderPass      = a_renderPass;
+    frameBufferInfo.attachmentCount = a_depthView != VK_NULL_HANDLE ? 2 : 1;
+    frameBufferInfo.pAttachments    = attachments.data();
+    frameBufferInfo.width           = m_extent.width;
+    frameBufferInfo.height          = m_extent.height;
+    frameBufferInfo.layers          = 1;
+    VK_CHECK_RESULT(vkCreateFramebuffer(m_device, &frameBufferInfo, nullptr, &frameBuffers[i]));
+  }
+  return frameBuffers;
+}
+
+uint32_t HeadlessTarget::AcquireNextImage()
+{
+  const uint32_t imageIdx = m_currentImage;
+  m_currentImage = (m_currentImage + 1) % GetImageCount();
+  return imageIdx;
+}
+
+bool HeadlessTarget::SaveImage(uint32_t a_imageIdx, const std::string &a_path) const
+{
+  if(m_format != VK_FORMAT_B8G8R8A8_UNORM && m_format != VK_FORMAT_B8G8R8A8_SRGB)
+  {
+    vk_utils::logWarning("[HeadlessTarget::SaveImage] only BGRA8 images can be saved");
+    return false;
+  }
+
+  std::ofstream out(a_path, std::ios::binary | std::ios::trunc);
+  if(!out.is_open())
+  {
+    vk_utils::logWarning("[HeadlessTarget::SaveImage] can't open " + a_path);
+    return false;
+  }
+
+  const uint32_t w = m_extent.width;
+  const uint32_t h = m_extent.height;
+  const auto* pixels = reinterpret_cast<const uint8_t*>(m_readbackAlloc.mapped) + a_imageIdx * m_readbackStride;
+
+  // 32 bit BMP with top-down rows (negative height), BGRA byte order matches the image format
+  const uint32_t dataSize   = w * h * 4;
+  const uint32_t headerSize = 14 + 40;
+  uint8_t header[headerSize] = {};
+  auto put32 = [&header](uint32_t a_offset, uint32_t a_value) {
+    for(uint32_t i = 0; i < 4; ++i)
+      header[a_offset + i] = uint8_t((a_value >> (8 * i)) & 0xFF);
+  };
+  header[0] = 'B';
+  header[1] = 'M';
+  put32(2,  headerSize + dataSize);
+  put32(10, headerSize);
+  put32(14, 40);
+  put32(18, w);
+  put32(22, uint32_t(-int32_t(h)));
+  header[26] = 1;  // planes
+  header[28] = 32; // bits per pixel
+  put32(34, dataSize);
+
+  out.write(reinterpret_cast<const char*>(header), headerSize);
+  out.write(reinterpret_cast<const char*>(pixels), dataSize);
+
+  return out.good();
+}
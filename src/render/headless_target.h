@@ -0,0 +1,74 @@
+#ifndef VK_GRAPHICS_BASIC_HEADLESS_TARGET_H
+#define VK_GRAPHICS_BASIC_HEADLESS_TARGET_H
+
+#include "volk.h"
+#include <vk_images.h>
+
+#include "device_allocator.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+\brief Offscreen replacement for VulkanSwapChain when there is no window (render farm nodes, CI, software Vulkan).
+
+  Owns a ring of color images which are rendered to in round-robin order. Frame completion is tracked by the
+  render's frame fences, there is nothing to present. Rendered images can optionally be read back to host memory
+  and saved to .bmp files.
+*/
+class HeadlessTarget
+{
+public:
+  HeadlessTarget(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator, uint32_t a_queueFID,
+                 uint32_t a_width, uint32_t a_height, uint32_t a_imageCount,
+                 VkFormat a_colorFormat = VK_FORMAT_B8G8R8A8_UNORM);
+  ~HeadlessTarget();
+
+  HeadlessTarget(const HeadlessTarget &) = delete;
+  HeadlessTarget &operator=(const HeadlessTarget &) = delete;
+
+  VkFormat   GetFormat()     const { return m_format; }
+  VkExtent2D GetExtent()     const { return m_extent; }
+  uint32_t   GetImageCount() const { return static_cast<uint32_t>(m_images.size()); }
+  const vk_utils::VulkanImageMem &GetAttachment(uint32_t a_idx) const { return m_images[a_idx]; }
+
+  // layout in which color attachments are left after rendering, use it instead of VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+  static constexpr VkImageLayout FINAL_LAYOUT = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+  // render pass compatible with the one created by vk_utils::createDefaultRenderPass,
+  // but leaving color attachment in FINAL_LAYOUT so it can be copied without extra transitions
+  VkRenderPass CreateRenderPass(VkFormat a_depthFormat) const;
+  std::vector<VkFramebuffer> CreateFrameBuffers(VkRenderPass a_renderPass, VkImageView a_depthView) const;
+
+  uint32_t AcquireNextImage();
+
+  // pre-recorded command buffer copying image to host visible memory, submit it right after the frame commands
+  VkCommandBuffer GetReadbackCmd(uint32_t a_imageIdx) const { return m_readbackCmds[a_imageIdx]; }
+
+  // must be called after the fence of the submit with GetReadbackCmd(a_imageIdx) has been signaled
+  bool SaveImage(uint32_t a_imageIdx, const std::string &a_path) const;
+
+private:
+  void CreateImages();
+  void CreateReadbackResources();
+
+  VkDevice                         m_device   = VK_NULL_HANDLE;
+  std::shared_ptr<DeviceAllocator> m_pAllocator;
+  uint32_t                         m_queueFID = UINT32_MAX;
+
+  VkFormat   m_format;
+  VkExtent2D m_extent;
+  uint32_t   m_currentImage = 0;
+
+  std::vector<vk_utils::VulkanImageMem> m_images;
+  std::vector<DeviceAllocation>         m_imageAllocs;
+
+  VkCommandPool                m_commandPool = VK_NULL_HANDLE;
+  std::vector<VkCommandBuffer> m_readbackCmds;
+  std::vector<VkBuffer>        m_readbackBuffers;
+  DeviceAllocation             m_readbackAlloc;       ///!< all readback buffers, persistently mapped
+  VkDeviceSize                 m_readbackStride = 0;
+};
+
+#endif// VK_GRAPHICS_BASIC_HEADLESS_TARGET_H
@@ -0,0 +1,392 @@
+#include "occlusion_culler.h"
+#include "pipeline_builder.h"
+#include "../utils/profiler.h"
+
+#include <vk_utils.h>
+#include <vk_buffers.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  constexpr uint32_t STATS_NUM  = 4;  // same order as OcclusionCuller::Stats and STAT_* in occlusion_cull.comp
+  constexpr uint32_t GROUP_SIZE = 64;
+  constexpr uint32_t TILE_SIZE  = 8;
+
+  // guaranteed maxDrawIndirectCount when multiDrawIndirect is supported
+  constexpr uint32_t MAX_DRAW_INDIRECT_COUNT = 65535;
+
+  struct CullPushConst
+  {
+    uint32_t phase;
+    uint32_t instancesNum;
+    uint32_t statsOffset;
+  };
+
+  struct PyramidPushConst
+  {
+    int32_t srcSize[2];
+    int32_t dstSize[2];
+  };
+
+  void memoryBarrier(VkCommandBuffer a_cmdBuff, VkPipelineStageFlags a_srcStages, VkAccessFlags a_srcAccess,
+                     VkPipelineStageFlags a_dstStages, VkAccessFlags a_dstAccess)
+  {
+    VkMemoryBarrier barrier = {};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = a_srcAccess;
+    barrier.dstAccessMask = a_dstAccess;
+    vkCmdPipelineBarrier(a_cmdBuff, a_srcStages, a_dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+}
+
+bool OcclusionCuller::EnableFeatures(VkPhysicalDevice a_physDevice, VkPhysicalDeviceFeatures &a_features)
+{
+  VkPhysicalDeviceFeatures supported = {};
+  vkGetPhysicalDeviceFeatures(a_physDevice, &supported);
+
+  // firstInstance carries the instance id; without multi draw every slot is drawn by its own indirect command
+  if(!supported.drawIndirectFirstInstance)
+    return false;
+  a_features.drawIndirectFirstInstance = VK_TRUE;
+  a_features.multiDrawIndirect         = supported.multiDrawIndirect;
+  return true;
+}
+
+OcclusionCuller::OcclusionCuller(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator, PipelineCache &a_cache,
+                                 const VkPhysicalDeviceFeatures &a_enabledFeatures) :
+  m_device(a_device), m_pAllocator(std::move(a_pAllocator)), m_cache(a_cache),
+  m_multiDrawIndirect(a_enabledFeatures.multiDrawIndirect == VK_TRUE)
+{
+  m_sampler = vk_utils::createSampler(m_device, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+  const VkDeviceSize statsSize = VkDeviceSize(STATS_NUM * MAX_FRAMES_IN_FLIGHT) * sizeof(uint32_t);
+  m_paramsBuf   = vk_utils::createBuffer(m_device, sizeof(CullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_statsBuf    = vk_utils::createBuffer(m_device, statsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_paramsAlloc = m_pAllocator->AllocateForBuffer(m_paramsBuf, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_statsAlloc  = m_pAllocator->AllocateForBuffer(m_statsBuf, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  std::memset(m_statsAlloc.mapped, 0, statsSize);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+  DestroyPipelines();
+  DestroyPyramid();
+  m_pBindings = nullptr;
+
+  for(auto buffer : {m_instancesBuf, m_earlyDrawsBuf, m_lateDrawsBuf, m_statesBuf, m_paramsBuf, m_statsBuf})
+  {
+    if(buffer != VK_NULL_HANDLE)
+      vkDestroyBuffer(m_device, buffer, nullptr);
+  }
+  m_pAllocator->Free(m_sceneAlloc);
+  m_pAllocator->Free(m_paramsAlloc);
+  m_pAllocator->Free(m_statsAlloc);
+
+  vkDestroySampler(m_device, m_sampler, nullptr);
+}
+
+void OcclusionCuller::SetScene(SceneManager &a_scene)
+{
+  PROFILE_FUNCTION();
+  for(auto buffer : {m_instancesBuf, m_earlyDrawsBuf, m_lateDrawsBuf, m_statesBuf})
+  {
+    if(buffer != VK_NULL_HANDLE)
+      vkDestroyBuffer(m_device, buffer, nullptr);
+  }
+  m_pAllocator->Free(m_sceneAlloc);
+
+  m_instancesNum = a_scene.InstancesNum();
+  std::vector<CullInstance> instances(m_instancesNum);
+  for(uint32_t i = 0; i < m_instancesNum; ++i)
+  {
+    const auto mesh = a_scene.GetMeshInfo(a_scene.GetInstanceInfo(i).mesh_id);
+    const auto box  = a_scene.GetInstanceBbox(i);
+
+    instances[i].boxMin       = box.boxMin;
+    instances[i].boxMax       = box.boxMax;
+    instances[i].indexCount   = mesh.m_indNum;
+    instances[i].firstIndex   = mesh.m_indexOffset;
+    instances[i].vertexOffset = int(mesh.m_vertexOffset);
+  }
+
+  const VkDeviceSize slotsNum = std::max(m_instancesNum, 1u);
+  const VkBufferUsageFlags drawsUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+  m_instancesBuf  = vk_utils::createBuffer(m_device, slotsNum * sizeof(CullInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_earlyDrawsBuf = vk_utils::createBuffer(m_device, slotsNum * sizeof(VkDrawIndexedIndirectCommand), drawsUsage);
+  m_lateDrawsBuf  = vk_utils::createBuffer(m_device, slotsNum * sizeof(VkDrawIndexedIndirectCommand), drawsUsage);
+  m_statesBuf     = vk_utils::createBuffer(m_device, slotsNum * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  m_sceneAlloc    = m_pAllocator->AllocateForBuffers({m_instancesBuf, m_earlyDrawsBuf, m_lateDrawsBuf, m_statesBuf},
+                                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  // draw buffers and states are fully written by culling every frame, only instances are uploaded
+  if(m_instancesNum > 0)
+  {
+    a_scene.GetUploader()->UploadBuffer(m_instancesBuf, 0, instances.data(), instances.size() * sizeof(instances[0]));
+    a_scene.GetUploader()->Flush();
+  }
+
+  m_pyramidValid = false;
+  SetupDescriptorsAndPipelines();
+}
+
+void OcclusionCuller::SetDepth(VkImageView a_depthView, VkExtent2D a_extent)
+{
+  PROFILE_FUNCTION();
+  DestroyPyramid();
+  m_depthView   = a_depthView;
+  m_depthExtent = a_extent;
+  CreatePyramid();
+  SetupDescriptorsAndPipelines();
+}
+
+void OcclusionCuller::CreatePyramid()
+{
+  // level 0 is half of the depth buffer rounded up, every next level is half of the previous one rounded up,
+  // so a texel of level L always covers 2^(L+1) pixels of the depth buffer
+  m_levelExtents.clear();
+  VkExtent2D extent = {(m_depthExtent.width + 1) / 2, (m_depthExtent.height + 1) / 2};
+  while(true)
+  {
+    m_levelExtents.push_back(extent);
+    if(extent.width <= 1 && extent.height <= 1)
+      break;
+    extent = {(extent.width + 1) / 2, (extent.height + 1) / 2};
+  }
+  const uint32_t levelsNum = static_cast<uint32_t>(m_levelExtents.size());
+
+  VkImageCreateInfo imageInfo = {};
+  imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imageInfo.format        = VK_FORMAT_R32_SFLOAT;
+  imageInfo.extent        = VkExtent3D{m_levelExtents[0].width, m_levelExtents[0].height, 1};
+  imageInfo.mipLevels     = levelsNum;
+  imageInfo.arrayLayers   = 1;
+  imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage         = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK_RESULT(vkCreateImage(m_device, &imageInfo, nullptr, &m_pyramid));
+  m_pyramidAlloc = m_pAllocator->AllocateForImage(m_pyramid, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  VkImageViewCreateInfo viewInfo = {};
+  viewInfo.sType            = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image            = m_pyramid;
+  viewInfo.viewType         = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format           = VK_FORMAT_R32_SFLOAT;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelsNum, 0, 1};
+  VK_CHECK_RESULT(vkCreateImageView(m_device, &viewInfo, nullptr, &m_pyramidView));
+
+  m_levelViews.resize(levelsNum);
+  for(uint32_t level = 0; level < levelsNum; ++level)
+  {
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+    VK_CHECK_RESULT(vkCreateImageView(m_device, &viewInfo, nullptr, &m_levelViews[level]));
+  }
+
+  m_pyramidInitialized = false;
+  m_pyramidValid       = false;
+}
+
+void OcclusionCuller::DestroyPyramid()
+{
+  for(auto view : m_levelViews)
+    vkDestroyImageView(m_device, view, nullptr);
+  m_levelViews.clear();
+
+  if(m_pyramidView != VK_NULL_HANDLE)
+  {
+    vkDestroyImageView(m_device, m_pyramidView, nullptr);
+    m_pyramidView = VK_NULL_HANDLE;
+  }
+  if(m_pyramid != VK_NULL_HANDLE)
+  {
+    vkDestroyImage(m_device, m_pyramid, nullptr);
+    m_pyramid = VK_NULL_HANDLE;
+  }
+  m_pAllocator->Free(m_pyramidAlloc);
+}
+
+void OcclusionCuller::SetupDescriptorsAndPipelines()
+{
+  if(m_instancesBuf == VK_NULL_HANDLE || m_pyramid == VK_NULL_HANDLE)
+    return;
+
+  DestroyPipelines();
+
+  const uint32_t levelsNum = static_cast<uint32_t>(m_levelViews.size());
+  std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         5},
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1},
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 + levelsNum},
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          levelsNum}
+  };
+  m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 1 + levelsNum);
+
+  m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+  m_pBindings->BindBuffer(0, m_instancesBuf,  VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(1, m_earlyDrawsBuf, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(2, m_lateDrawsBuf,  VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(3, m_statesBuf,     VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(4, m_statsBuf,      VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(5, m_paramsBuf,     VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  m_pBindings->BindImage (6, m_pyramidView, m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_IMAGE_LAYOUT_GENERAL);
+  m_pBindings->BindEnd(&m_cullDS, &m_cullDSLayout);
+
+  // every level is built from the previous one, level 0 from the depth buffer
+  m_pyramidDS.resize(levelsNum);
+  for(uint32_t level = 0; level < levelsNum; ++level)
+  {
+    m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+    if(level == 0)
+      m_pBindings->BindImage(0, m_depthView, m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    else
+      m_pBindings->BindImage(0, m_levelViews[level - 1], m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_IMAGE_LAYOUT_GENERAL);
+    m_pBindings->BindImage(1, m_levelViews[level], VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_IMAGE_LAYOUT_GENERAL);
+    m_pBindings->BindEnd(&m_pyramidDS[level], &m_pyramidDSLayout);
+  }
+
+  m_cullPipeline    = PipelineBuilder::BuildCompute(m_device, m_cache, "../resources/shaders/occlusion_cull.comp.spv",
+                                                    m_cullDSLayout, sizeof(CullPushConst), &m_cullLayout);
+  m_pyramidPipeline = PipelineBuilder::BuildCompute(m_device, m_cache, "../resources/shaders/depth_pyramid.comp.spv",
+                                                    m_pyramidDSLayout, sizeof(PyramidPushConst), &m_pyramidLayout);
+}
+
+void OcclusionCuller::DestroyPipelines()
+{
+  for(auto pipeline : {m_cullPipeline, m_pyramidPipeline})
+  {
+    if(pipeline != VK_NULL_HANDLE)
+      vkDestroyPipeline(m_device, pipeline, nullptr);
+  }
+  for(auto layout : {m_cullLayout, m_pyramidLayout})
+  {
+    if(layout != VK_NULL_HANDLE)
+      vkDestroyPipelineLayout(m_device, layout, nullptr);
+  }
+  m_cullPipeline    = VK_NULL_HANDLE;
+  m_pyramidPipeline = VK_NULL_HANDLE;
+  m_cullLayout      = VK_NULL_HANDLE;
+  m_pyramidLayout   = VK_NULL_HANDLE;
+}
+
+void OcclusionCuller::CmdCullEarly(VkCommandBuffer a_cmdBuff, uint32_t a_frame, const LiteMath::float4x4 &a_viewProj,
+                                   VkExtent2D a_viewport)
+{
+  PROFILE_FUNCTION();
+  // the pyramid holds depth of the previous frame, seen with its view
+  m_params.prevViewProj = m_params.viewProj;
+  m_params.viewProj     = a_viewProj;
+  m_params.viewport     = LiteMath::float4(float(a_viewport.width), float(a_viewport.height), m_params.viewport.x, m_params.viewport.y);
+  m_params.pyramid.x    = m_pyramidValid ? 1.0f : 0.0f;
+
+  // previous frame may still read parameters (culling) and draw buffers (indirect draws)
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+  vkCmdUpdateBuffer(a_cmdBuff, m_paramsBuf, 0, sizeof(m_params), &m_params);
+  vkCmdFillBuffer(a_cmdBuff, m_statsBuf, VkDeviceSize(a_frame * STATS_NUM) * sizeof(uint32_t), STATS_NUM * sizeof(uint32_t), 0);
+  memoryBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+  const CullPushConst pushConst = {0, m_instancesNum, a_frame * STATS_NUM};
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullLayout, 0, 1, &m_cullDS, 0, nullptr);
+  vkCmdPushConstants(a_cmdBuff, m_cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConst), &pushConst);
+  vkCmdDispatch(a_cmdBuff, (m_instancesNum + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+  // early draws, states for the late phase
+  memoryBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+  m_statsPending[a_frame] = true;
+}
+
+void OcclusionCuller::CmdBuildPyramid(VkCommandBuffer a_cmdBuff)
+{
+  PROFILE_FUNCTION();
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image               = m_pyramid;
+
+  // early culling has read the previous content
+  barrier.srcAccessMask    = m_pyramidInitialized ? VK_ACCESS_SHADER_READ_BIT : 0;
+  barrier.dstAccessMask    = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.oldLayout        = m_pyramidInitialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout        = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, static_cast<uint32_t>(m_levelViews.size()), 0, 1};
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       0, nullptr, 0, nullptr, 1, &barrier);
+  m_pyramidInitialized = true;
+
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_pyramidPipeline);
+  for(uint32_t level = 0; level < m_levelViews.size(); ++level)
+  {
+    const VkExtent2D src = level == 0 ? m_depthExtent : m_levelExtents[level - 1];
+    const VkExtent2D dst = m_levelExtents[level];
+    const PyramidPushConst pushConst = {{int32_t(src.width), int32_t(src.height)}, {int32_t(dst.width), int32_t(dst.height)}};
+
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_pyramidLayout, 0, 1, &m_pyramidDS[level], 0, nullptr);
+    vkCmdPushConstants(a_cmdBuff, m_pyramidLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConst), &pushConst);
+    vkCmdDispatch(a_cmdBuff, (dst.width + TILE_SIZE - 1) / TILE_SIZE, (dst.height + TILE_SIZE - 1) / TILE_SIZE, 1);
+
+    // read by the next level, late culling and early culling of the next frame
+    barrier.srcAccessMask    = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask    = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout        = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+    vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+  }
+}
+
+void OcclusionCuller::CmdCullLate(VkCommandBuffer a_cmdBuff, uint32_t a_frame)
+{
+  PROFILE_FUNCTION();
+  const CullPushConst pushConst = {1, m_instancesNum, a_frame * STATS_NUM};
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullLayout, 0, 1, &m_cullDS, 0, nullptr);
+  vkCmdPushConstants(a_cmdBuff, m_cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConst), &pushConst);
+  vkCmdDispatch(a_cmdBuff, (m_instancesNum + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+  // late draws; counters of both phases are read on the host after the frame fence
+  memoryBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+
+  m_pyramidValid = true;
+}
+
+uint32_t OcclusionCuller::CmdDraw(VkCommandBuffer a_cmdBuff, VkBuffer a_draws) const
+{
+  constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  const uint32_t     batch  = m_multiDrawIndirect ? MAX_DRAW_INDIRECT_COUNT : 1u;
+
+  uint32_t drawCalls = 0;
+  for(uint32_t first = 0; first < m_instancesNum; first += batch, ++drawCalls)
+  {
+    const uint32_t count = std::min(m_instancesNum - first, batch);
+    vkCmdDrawIndexedIndirect(a_cmdBuff, a_draws, VkDeviceSize(first) * stride, count, stride);
+  }
+  return drawCalls;
+}
+
+bool OcclusionCuller::CollectStats(uint32_t a_frame, Stats &a_stats)
+{
+  if(!m_statsPending[a_frame])
+    return false;
+  m_statsPending[a_frame] = false;
+
+  // host coherent memory, the frame fence is signaled
+  const auto *counters = static_cast<const uint32_t *>(m_statsAlloc.mapped) + a_frame * STATS_NUM;
+  a_stats.drawnEarly      = counters[0];
+  a_stats.drawnLate       = counters[1];
+  a_stats.culledFrustum   = counters[2];
+  a_stats.culledOcclusion = counters[3];
+  return true;
+}
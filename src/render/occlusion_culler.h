@@ -0,0 +1,128 @@
+#ifndef VK_GRAPHICS_BASIC_OCCLUSION_CULLER_H
+#define VK_GRAPHICS_BASIC_OCCLUSION_CULLER_H
+
+#include "volk.h"
+#include "device_allocator.h"
+#include "pipeline_cache.h"
+#include "render_common.h"
+#include "scene_mgr.h"
+#include "../../resources/shaders/common.h"
+#include <vk_descriptor_sets.h>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+/**
+\brief GPU frustum and hierarchical-Z occlusion culling of scene instances, two-phase.
+
+  Every instance has a fixed slot in two indirect draw buffers, culling only sets instanceCount of the slot to 0 or 1,
+  so draws need no count buffer (Vulkan 1.1) and firstInstance of a slot is the instance id.
+  Per frame, all commands are recorded outside of render passes except CmdDrawEarly() / CmdDrawLate():
+
+    1. CmdCullEarly(): instances inside the frustum are tested against the depth pyramid of the previous frame with
+       the previous view and viewport. Visible ones go to the early draw buffer;
+    2. main pass draws them with CmdDrawEarly();
+    3. CmdBuildPyramid() rebuilds the pyramid from the depth of the early draws, CmdCullLate() tests instances
+       rejected by the early phase against it with the current view: those which are visible now (disoccluded,
+       false negatives of the early phase) go to the late draw buffer;
+    4. second pass over the same attachments (LOAD_OP_LOAD) draws them with CmdDrawLate().
+
+  Pyramid level 0 is half of the depth buffer and every texel keeps the farthest depth of its 2x2 footprint, so a
+  box is occluded if its nearest depth is behind all of at most 4 texels covering its screen rectangle. Instances
+  are expected to be static: a moving one could be wrongly culled by the early phase for a frame, the late phase
+  would draw it again.
+*/
+class OcclusionCuller
+{
+public:
+  struct Stats
+  {
+    uint32_t drawnEarly      = 0;
+    uint32_t drawnLate       = 0;  ///!< disoccluded instances the early phase missed
+    uint32_t culledFrustum   = 0;
+    uint32_t culledOcclusion = 0;
+  };
+
+  // enables features used by the culler, returns false if GPU culling is not possible on the device
+  static bool EnableFeatures(VkPhysicalDevice a_physDevice, VkPhysicalDeviceFeatures &a_features);
+
+  OcclusionCuller(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator, PipelineCache &a_cache,
+                  const VkPhysicalDeviceFeatures &a_enabledFeatures);
+  ~OcclusionCuller();
+
+  OcclusionCuller(const OcclusionCuller &) = delete;
+  OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+  // both must be called before recording, frames which use the previous resources must be finished
+  void SetScene(SceneManager &a_scene);  // instances and their boxes are uploaded once
+  void SetDepth(VkImageView a_depthView, VkExtent2D a_extent);  // depth buffer is sampled, no stencil aspect
+
+  bool IsReady() const { return m_cullPipeline != VK_NULL_HANDLE; }
+
+  // a_viewport is the part of the depth buffer the main pass renders to
+  void CmdCullEarly(VkCommandBuffer a_cmdBuff, uint32_t a_frame, const LiteMath::float4x4 &a_viewProj, VkExtent2D a_viewport);
+  void CmdBuildPyramid(VkCommandBuffer a_cmdBuff); // depth is expected in SHADER_READ_ONLY_OPTIMAL
+  void CmdCullLate(VkCommandBuffer a_cmdBuff, uint32_t a_frame);
+
+  // vertex and index buffers of the scene and a pipeline with instance matrices in a storage buffer must be bound;
+  // return the number of recorded indirect draw commands
+  uint32_t CmdDrawEarly(VkCommandBuffer a_cmdBuff) const { return CmdDraw(a_cmdBuff, m_earlyDrawsBuf); }
+  uint32_t CmdDrawLate(VkCommandBuffer a_cmdBuff)  const { return CmdDraw(a_cmdBuff, m_lateDrawsBuf); }
+
+  // counters of a_frame, valid after its fence is signaled; false if the frame did not cull
+  bool CollectStats(uint32_t a_frame, Stats &a_stats);
+
+private:
+  uint32_t CmdDraw(VkCommandBuffer a_cmdBuff, VkBuffer a_draws) const;
+  void CreatePyramid();
+  void DestroyPyramid();
+  void SetupDescriptorsAndPipelines();
+  void DestroyPipelines();
+
+  VkDevice                         m_device = VK_NULL_HANDLE;
+  std::shared_ptr<DeviceAllocator> m_pAllocator;
+  PipelineCache                   &m_cache;
+  bool                             m_multiDrawIndirect = false;
+
+  VkSampler        m_sampler   = VK_NULL_HANDLE;  ///!< nearest, pyramid and depth are only read with texelFetch
+  VkBuffer         m_paramsBuf = VK_NULL_HANDLE;
+  VkBuffer         m_statsBuf  = VK_NULL_HANDLE;  ///!< host visible, counters per frame in flight
+  DeviceAllocation m_paramsAlloc;
+  DeviceAllocation m_statsAlloc;
+  std::array<bool, MAX_FRAMES_IN_FLIGHT> m_statsPending {};
+
+  // scene
+  uint32_t         m_instancesNum  = 0;
+  VkBuffer         m_instancesBuf  = VK_NULL_HANDLE;
+  VkBuffer         m_earlyDrawsBuf = VK_NULL_HANDLE;
+  VkBuffer         m_lateDrawsBuf  = VK_NULL_HANDLE;
+  VkBuffer         m_statesBuf     = VK_NULL_HANDLE;
+  DeviceAllocation m_sceneAlloc;
+
+  // depth pyramid, always in GENERAL layout once initialized
+  VkImageView              m_depthView   = VK_NULL_HANDLE;
+  VkExtent2D               m_depthExtent = {};
+  VkImage                  m_pyramid     = VK_NULL_HANDLE;
+  VkImageView              m_pyramidView = VK_NULL_HANDLE;  ///!< all levels, for culling
+  std::vector<VkImageView> m_levelViews;                     ///!< one level each, for pyramid build
+  std::vector<VkExtent2D>  m_levelExtents;
+  DeviceAllocation         m_pyramidAlloc;
+  bool                     m_pyramidInitialized = false;  ///!< layout is GENERAL
+  bool                     m_pyramidValid       = false;  ///!< holds depth of the previous frame
+
+  CullParams m_params {};
+
+  std::shared_ptr<vk_utils::DescriptorMaker> m_pBindings;
+  VkDescriptorSet              m_cullDS       = VK_NULL_HANDLE;
+  VkDescriptorSetLayout        m_cullDSLayout = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> m_pyramidDS;  ///!< per level: previous level (or depth) and the level itself
+  VkDescriptorSetLayout        m_pyramidDSLayout = VK_NULL_HANDLE;
+
+  VkPipelineLayout m_cullLayout      = VK_NULL_HANDLE;
+  VkPipeline       m_cullPipeline    = VK_NULL_HANDLE;
+  VkPipelineLayout m_pyramidLayout   = VK_NULL_HANDLE;
+  VkPipeline       m_pyramidPipeline = VK_NULL_HANDLE;
+};
+
+#endif// VK_GRAPHICS_BASIC_OCCLUSION_CULLER_H
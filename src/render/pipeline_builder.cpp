@@ -0,0 +1,190 @@
+#include "pipeline_builder.h"
+#include "../utils/profiler.h"
+#include <vk_utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+  // calls a_func(i) for i in [0, a_count) on up to a_threadsNum threads including the calling one
+  template<typename Func>
+  void parallelFor(size_t a_count, uint32_t a_threadsNum, Func a_func)
+  {
+    std::atomic<size_t> next {0};
+    auto worker = [&]() {
+      for(size_t i = next++; i < a_count; i = next++)
+        a_func(i);
+    };
+
+    std::vector<std::thread> threads;
+    const size_t threadsNum = std::min<size_t>(a_threadsNum, a_count);
+    for(size_t t = 1; t < threadsNum; ++t)
+      threads.emplace_back(worker);
+    worker();
+    for(auto &thread : threads)
+      thread.join();
+  }
+
+  bool readSpirv(const std::string &a_path, std::vector<uint32_t> &a_code)
+  {
+    std::ifstream in(a_path, std::ios::binary | std::ios::ate);
+    if(!in.is_open())
+      return false;
+
+    const auto size = static_cast<size_t>(in.tellg());
+    if(size == 0 || size % sizeof(uint32_t) != 0)
+      return false;
+
+    a_code.resize(size / sizeof(uint32_t));
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(a_code.data()), std::streamsize(size));
+    return in.good();
+  }
+}
+
+PipelineBuilder::PipelineBuilder(VkDevice a_device, PipelineCache &a_cache, uint32_t a_threadsNum)
+  : m_device(a_device), m_cache(a_cache), m_threadsNum(a_threadsNum)
+{
+  if(m_threadsNum == 0)
+    m_threadsNum = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void PipelineBuilder::AddGraphics(VkPipeline* a_target, GraphicsPipelineDesc a_desc)
+{
+  m_graphics.push_back({a_target, std::move(a_desc)});
+}
+
+void PipelineBuilder::Build()
+{
+  PROFILE_FUNCTION();
+  const auto start = std::chrono::steady_clock::now();
+
+  // every SPIR-V file is loaded once for the whole batch
+  //
+  std::vector<std::string> spirvPaths;
+  for(const auto &request : m_graphics)
+  {
+    for(const auto &[stage, path] : request.desc.shaderPaths)
+    {
+      if(std::find(spirvPaths.begin(), spirvPaths.end(), path) == spirvPaths.end())
+        spirvPaths.push_back(path);
+    }
+  }
+
+  std::vector<VkShaderModule> modules(spirvPaths.size(), VK_NULL_HANDLE);
+  parallelFor(spirvPaths.size(), m_threadsNum, [&](size_t i) {
+    std::vector<uint32_t> code;
+    if(!readSpirv(spirvPaths[i], code))
+      return;
+
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = code.size() * sizeof(uint32_t);
+    moduleInfo.pCode    = code.data();
+    VK_CHECK_RESULT(vkCreateShaderModule(m_device, &moduleInfo, nullptr, &modules[i]));
+  });
+
+  for(size_t i = 0; i < spirvPaths.size(); ++i)
+  {
+    if(modules[i] == VK_NULL_HANDLE)
+    {
+      for(auto module : modules)
+        vkDestroyShaderModule(m_device, module, nullptr);
+      RUN_TIME_ERROR(("can't load SPIR-V from " + spirvPaths[i]).c_str());
+    }
+  }
+
+  // pipelines are independent, vkCreateGraphicsPipelines and the pipeline cache are thread safe
+  //
+  parallelFor(m_graphics.size(), m_threadsNum, [&](size_t i) {
+    const auto &desc = m_graphics[i].desc;
+
+    vk_utils::GraphicsPipelineMaker maker;
+    maker.SetDefaultState(desc.extent.width, desc.extent.height);
+    if(desc.depthEqual)
+    {
+      maker.depthStencilTest.depthCompareOp   = VK_COMPARE_OP_EQUAL;
+      maker.depthStencilTest.depthWriteEnable = VK_FALSE;
+    }
+
+    maker.stagesNum = 0;
+    for(const auto &[stage, path] : desc.shaderPaths)
+    {
+      const size_t moduleId = std::find(spirvPaths.begin(), spirvPaths.end(), path) - spirvPaths.begin();
+
+      auto &stageInfo  = maker.shaderStageInfos[maker.stagesNum++];
+      stageInfo        = {};
+      stageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+      stageInfo.stage  = stage;
+      stageInfo.module = modules[moduleId];
+      stageInfo.pName  = "main";
+    }
+
+    *m_graphics[i].target = m_cache.MakeGraphicsPipeline(maker, desc.layout, desc.vertexInput, desc.renderPass,
+                                                         desc.dynamicStates, false);
+  });
+
+  for(auto module : modules)
+    vkDestroyShaderModule(m_device, module, nullptr);
+
+  const double timeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "[PipelineBuilder] " << m_graphics.size() << " pipelines from " << spirvPaths.size()
+            << " SPIR-V files in " << timeMs << " ms on " << std::min<size_t>(m_threadsNum, m_graphics.size())
+            << " threads" << std::endl;
+
+  m_graphics.clear();
+}
+
+VkPipeline PipelineBuilder::BuildGraphics(VkDevice a_device, PipelineCache &a_cache, GraphicsPipelineDesc a_desc)
+{
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  PipelineBuilder builder(a_device, a_cache, 1);
+  builder.AddGraphics(&pipeline, std::move(a_desc));
+  builder.Build();
+  return pipeline;
+}
+
+VkPipeline PipelineBuilder::BuildCompute(VkDevice a_device, PipelineCache &a_cache, const std::string &a_spirvPath,
+                                         VkDescriptorSetLayout a_dsLayout, uint32_t a_pushConstSize, VkPipelineLayout *a_pLayout)
+{
+  std::vector<uint32_t> code;
+  if(!readSpirv(a_spirvPath, code))
+    RUN_TIME_ERROR(("can't load SPIR-V from " + a_spirvPath).c_str());
+
+  VkShaderModuleCreateInfo moduleInfo = {};
+  moduleInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  moduleInfo.pCode    = code.data();
+  moduleInfo.codeSize = code.size() * sizeof(uint32_t);
+
+  VkShaderModule shaderModule = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateShaderModule(a_device, &moduleInfo, nullptr, &shaderModule));
+
+  VkPushConstantRange pcRange = {};
+  pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pcRange.size       = a_pushConstSize;
+
+  VkPipelineLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layoutInfo.setLayoutCount         = 1;
+  layoutInfo.pSetLayouts            = &a_dsLayout;
+  layoutInfo.pushConstantRangeCount = a_pushConstSize != 0 ? 1 : 0;
+  layoutInfo.pPushConstantRanges    = a_pushConstSize != 0 ? &pcRange : nullptr;
+  VK_CHECK_RESULT(vkCreatePipelineLayout(a_device, &layoutInfo, nullptr, a_pLayout));
+
+  VkComputePipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = shaderModule;
+  pipelineInfo.stage.pName  = "main";
+  pipelineInfo.layout       = *a_pLayout;
+  VkPipeline pipeline = a_cache.MakeComputePipeline(pipelineInfo);
+
+  vkDestroyShaderModule(a_device, shaderModule, nullptr);
+  return pipeline;
+}
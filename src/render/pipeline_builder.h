@@ -0,0 +1,61 @@
+#ifndef VK_GRAPHICS_BASIC_PIPELINE_BUILDER_H
+#define VK_GRAPHICS_BASIC_PIPELINE_BUILDER_H
+
+#include "volk.h"
+#include "pipeline_cache.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// everything needed to create graphics pipeline with GraphicsPipelineMaker default state
+struct GraphicsPipelineDesc
+{
+  std::unordered_map<VkShaderStageFlagBits, std::string> shaderPaths;  ///!< paths to SPIR-V files
+  VkPipelineLayout                     layout      = VK_NULL_HANDLE;
+  VkRenderPass                         renderPass  = VK_NULL_HANDLE;
+  VkPipelineVertexInputStateCreateInfo vertexInput = {};
+  VkExtent2D                           extent      = {};               ///!< viewport and scissor size
+  std::vector<VkDynamicState>          dynamicStates;
+  bool                                 depthEqual  = false;            ///!< EQUAL depth test without writes, after a depth pre-pass
+};
+
+/**
+\brief Creates a batch of pipelines declared up front in parallel.
+
+  Every SPIR-V file used by the batch is read and turned into a shader module only once, even if several
+  pipelines (or shader permutations) share it. Shader modules are created and then pipelines are created
+  through PipelineCache on worker threads, the calling thread takes part in the work too.
+*/
+class PipelineBuilder
+{
+public:
+  PipelineBuilder(VkDevice a_device, PipelineCache &a_cache, uint32_t a_threadsNum = 0); // 0 - hardware concurrency
+
+  // a_target is written by Build()
+  void AddGraphics(VkPipeline* a_target, GraphicsPipelineDesc a_desc);
+  void Build();
+
+  // creates single pipeline on the calling thread, i.e. for shader reload
+  static VkPipeline BuildGraphics(VkDevice a_device, PipelineCache &a_cache, GraphicsPipelineDesc a_desc);
+
+  // compute pipeline with one descriptor set and compute stage push constants (none if a_pushConstSize is 0),
+  // its layout is created and written to a_pLayout
+  static VkPipeline BuildCompute(VkDevice a_device, PipelineCache &a_cache, const std::string &a_spirvPath,
+                                 VkDescriptorSetLayout a_dsLayout, uint32_t a_pushConstSize, VkPipelineLayout *a_pLayout);
+
+private:
+  struct GraphicsRequest
+  {
+    VkPipeline*          target;
+    GraphicsPipelineDesc desc;
+  };
+
+  VkDevice       m_device = VK_NULL_HANDLE;
+  PipelineCache &m_cache;
+  uint32_t       m_threadsNum = 1;
+
+  std::vector<GraphicsRequest> m_graphics;
+};
+
+#endif// VK_GRAPHICS_BASIC_PIPELINE_BUILDER_H
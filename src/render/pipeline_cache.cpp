@@ -0,0 +1,219 @@
+#include "pipeline_cache.h"
+#include <vk_utils.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+  // our own header in front of the driver blob, protects from truncated or partially written files
+  struct CacheFileHeader
+  {
+    char     magic[4];
+    uint32_t version;
+    uint64_t dataSize;
+    uint64_t dataHash;
+  };
+
+  constexpr char     CACHE_FILE_MAGIC[4] = {'V', 'K', 'P', 'C'};
+  constexpr uint32_t CACHE_FILE_VERSION  = 1;
+
+  uint64_t fnv1a(const uint8_t* a_data, size_t a_size)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for(size_t i = 0; i < a_size; ++i)
+    {
+      hash ^= a_data[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  double elapsedMs(std::chrono::steady_clock::time_point a_start)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - a_start).count();
+  }
+}
+
+PipelineCache::PipelineCache(VkDevice a_device, VkPhysicalDevice a_physDevice, std::string a_path)
+  : m_device(a_device), m_physDevice(a_physDevice), m_path(std::move(a_path))
+{
+  const auto data = LoadValidatedData();
+  m_loadedBytes   = data.size();
+
+  VkPipelineCacheCreateInfo cacheInfo = {};
+  cacheInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = data.size();
+  cacheInfo.pInitialData    = data.empty() ? nullptr : data.data();
+  VK_CHECK_RESULT(vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_cache));
+
+  std::cout << "[PipelineCache] " << (IsWarm() ? "warm start, loaded " : "cold start")
+            << (IsWarm() ? std::to_string(m_loadedBytes) + " bytes from " + m_path : std::string()) << std::endl;
+}
+
+PipelineCache::~PipelineCache()
+{
+  if(m_cache == VK_NULL_HANDLE)
+    return;
+
+  PrintStats();
+  Save();
+  vkDestroyPipelineCache(m_device, m_cache, nullptr);
+  m_cache = VK_NULL_HANDLE;
+}
+
+std::vector<uint8_t> PipelineCache::LoadValidatedData() const
+{
+  std::ifstream in(m_path, std::ios::binary);
+  if(!in.is_open())
+    return {};
+
+  auto reject = [this](const char* a_reason) {
+    std::cout << "[PipelineCache] ignoring " << m_path << ": " << a_reason << std::endl;
+    return std::vector<uint8_t>();
+  };
+
+  CacheFileHeader fileHeader = {};
+  in.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
+  if(!in.good() || std::memcmp(fileHeader.magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC)) != 0 ||
+     fileHeader.version != CACHE_FILE_VERSION)
+    return reject("unknown file format");
+
+  std::vector<uint8_t> data(fileHeader.dataSize);
+  in.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()));
+  if(!in.good() || fnv1a(data.data(), data.size()) != fileHeader.dataHash)
+    return reject("file is truncated or corrupted");
+
+  // VkPipelineCacheHeaderVersionOne, see "Pipeline Cache Header" in the Vulkan spec
+  if(data.size() < 16 + VK_UUID_SIZE)
+    return reject("no pipeline cache header");
+
+  uint32_t headerSize, headerVersion, vendorID, deviceID;
+  std::memcpy(&headerSize,    data.data() + 0,  4);
+  std::memcpy(&headerVersion, data.data() + 4,  4);
+  std::memcpy(&vendorID,      data.data() + 8,  4);
+  std::memcpy(&deviceID,      data.data() + 12, 4);
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(m_physDevice, &props);
+
+  if(headerSize < 16 + VK_UUID_SIZE || headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+    return reject("unsupported pipeline cache header");
+  if(vendorID != props.vendorID || deviceID != props.deviceID)
+    return reject("cache was created on another device");
+  if(std::memcmp(data.data() + 16, props.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    return reject("cache was created by another driver version");
+
+  return data;
+}
+
+bool PipelineCache::Save() const
+{
+  size_t dataSize = 0;
+  VK_CHECK_RESULT(vkGetPipelineCacheData(m_device, m_cache, &dataSize, nullptr));
+  std::vector<uint8_t> data(dataSize);
+  VK_CHECK_RESULT(vkGetPipelineCacheData(m_device, m_cache, &dataSize, data.data()));
+  data.resize(dataSize);
+
+  CacheFileHeader fileHeader = {};
+  std::memcpy(fileHeader.magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC));
+  fileHeader.version  = CACHE_FILE_VERSION;
+  fileHeader.dataSize = data.size();
+  fileHeader.dataHash = fnv1a(data.data(), data.size());
+
+  const std::string tmpPath = m_path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+    out.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+    out.flush();
+    if(!out.good())
+    {
+      std::cout << "[PipelineCache] can't write " << tmpPath << std::endl;
+      return false;
+    }
+  }
+
+  std::error_code err;
+  std::filesystem::rename(tmpPath, m_path, err);
+  if(err)
+  {
+    std::cout << "[PipelineCache] can't replace " << m_path << ": " << err.message() << std::endl;
+    std::filesystem::remove(tmpPath, err);
+    return false;
+  }
+  return true;
+}
+
+void PipelineCache::PrintStats() const
+{
+  std::lock_guard<std::mutex> lock(m_statsLock);
+  std::cout << "[PipelineCache] " << (IsWarm() ? "warm" : "cold") << " cache: " << m_pipelinesCreated
+            << " pipelines created in " << m_creationTimeMs << " ms" << std::endl;
+}
+
+VkPipeline PipelineCache::MakeGraphicsPipeline(vk_utils::GraphicsPipelineMaker &a_maker, VkPipelineLayout a_layout,
+                                               VkPipelineVertexInputStateCreateInfo a_vertexInput, VkRenderPass a_renderPass,
+                                               const std::vector<VkDynamicState> &a_dynamicStates,
+                                               bool a_destroyShaderModules, uint32_t a_subpass)
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  VkPipelineViewportStateCreateInfo viewportState = {};
+  viewportState.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.pViewports    = &a_maker.viewport;
+  viewportState.scissorCount  = 1;
+  viewportState.pScissors     = &a_maker.scissor;
+
+  VkPipelineDynamicStateCreateInfo dynamicState = {};
+  dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(a_dynamicStates.size());
+  dynamicState.pDynamicStates    = a_dynamicStates.data();
+
+  VkGraphicsPipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount          = static_cast<uint32_t>(a_maker.stagesNum);
+  pipelineInfo.pStages             = a_maker.shaderStageInfos;
+  pipelineInfo.pVertexInputState   = &a_vertexInput;
+  pipelineInfo.pInputAssemblyState = &a_maker.inputAssembly;
+  pipelineInfo.pViewportState      = &viewportState;
+  pipelineInfo.pRasterizationState = &a_maker.rasterizer;
+  pipelineInfo.pMultisampleState   = &a_maker.multisampling;
+  pipelineInfo.pDepthStencilState  = &a_maker.depthStencilTest;
+  pipelineInfo.pColorBlendState    = &a_maker.colorBlending;
+  pipelineInfo.pDynamicState       = a_dynamicStates.empty() ? nullptr : &dynamicState;
+  pipelineInfo.layout              = a_layout;
+  pipelineInfo.renderPass          = a_renderPass;
+  pipelineInfo.subpass             = a_subpass;
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, m_cache, 1, &pipelineInfo, nullptr, &pipeline));
+
+  for(int i = 0; i < a_maker.stagesNum && a_destroyShaderModules; ++i)
+  {
+    vkDestroyShaderModule(m_device, a_maker.shaderStageInfos[i].module, nullptr);
+    a_maker.shaderStageInfos[i].module = VK_NULL_HANDLE;
+  }
+
+  std::lock_guard<std::mutex> lock(m_statsLock);
+  m_pipelinesCreated++;
+  m_creationTimeMs += elapsedMs(start);
+  return pipeline;
+}
+
+VkPipeline PipelineCache::MakeComputePipeline(const VkComputePipelineCreateInfo &a_createInfo)
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateComputePipelines(m_device, m_cache, 1, &a_createInfo, nullptr, &pipeline));
+
+  std::lock_guard<std::mutex> lock(m_statsLock);
+  m_pipelinesCreated++;
+  m_creationTimeMs += elapsedMs(start);
+  return pipeline;
+}
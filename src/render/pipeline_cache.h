@@ -0,0 +1,61 @@
+#ifndef VK_GRAPHICS_BASIC_PIPELINE_CACHE_H
+#define VK_GRAPHICS_BASIC_PIPELINE_CACHE_H
+
+#include "volk.h"
+#include <vk_pipeline.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+\brief VkPipelineCache which is loaded from disk at device creation and saved back on destruction.
+
+  The file is rejected (and the cache starts cold) if it is truncated, corrupted or was produced by another
+  driver/device: Vulkan cache header is checked against vendorID, deviceID and pipelineCacheUUID.
+  Saving writes a temporary file and renames it over the old one, so an interrupted run never leaves a broken cache.
+  Since the loaded data stays in the cache, several applications can share one file.
+  Pipelines may be created from several threads at once.
+*/
+class PipelineCache
+{
+public:
+  static constexpr const char* DEFAULT_PATH = "pipeline_cache.bin";
+
+  PipelineCache(VkDevice a_device, VkPhysicalDevice a_physDevice, std::string a_path = DEFAULT_PATH);
+  ~PipelineCache();
+
+  PipelineCache(const PipelineCache &) = delete;
+  PipelineCache &operator=(const PipelineCache &) = delete;
+
+  VkPipelineCache Get() const { return m_cache; }
+  bool IsWarm() const { return m_loadedBytes != 0; }
+
+  // same as GraphicsPipelineMaker::MakePipeline, but uses this cache;
+  // takes shader stages and fixed function state from a_maker after LoadShaders and SetDefaultState,
+  // shader modules loaded by a_maker are destroyed afterwards just like MakePipeline does,
+  // unless they are owned by the caller (i.e. shared between several pipelines)
+  VkPipeline MakeGraphicsPipeline(vk_utils::GraphicsPipelineMaker &a_maker, VkPipelineLayout a_layout,
+                                  VkPipelineVertexInputStateCreateInfo a_vertexInput, VkRenderPass a_renderPass,
+                                  const std::vector<VkDynamicState> &a_dynamicStates = {},
+                                  bool a_destroyShaderModules = true, uint32_t a_subpass = 0);
+  VkPipeline MakeComputePipeline(const VkComputePipelineCreateInfo &a_createInfo);
+
+  bool Save() const;
+  void PrintStats() const;
+
+private:
+  std::vector<uint8_t> LoadValidatedData() const;
+
+  VkDevice         m_device     = VK_NULL_HANDLE;
+  VkPhysicalDevice m_physDevice = VK_NULL_HANDLE;
+  VkPipelineCache  m_cache      = VK_NULL_HANDLE;
+  std::string      m_path;
+
+  size_t   m_loadedBytes      = 0;
+  uint32_t m_pipelinesCreated = 0;
+  double   m_creationTimeMs   = 0.0;
+  mutable std::mutex m_statsLock;
+};
+
+#endif// VK_GRAPHICS_BASIC_PIPELINE_CACHE_H
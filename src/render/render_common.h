@@ -6,6 +6,7 @@
 #include "utils/Camera.h"
 #include <cstring>
 #include <memory>
+#include <string>
 
 struct AppInput
 {
@@ -34,6 +35,45 @@ enum class DrawMode
   NO_GUI
 };
 
+struct HeadlessParams
+{
+  uint32_t    saveEveryNthFrame = 0;   ///!< 0 - never read rendered images back to host
+  std::string outputDir         = "."; ///!< where frame_XXXXX.bmp files are written
+};
+
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+// VulkanSwapChain only takes a vsync flag, so FIFO and MAILBOX (no vsync) can be requested. IMMEDIATE is only
+// reported by FramePacer::EffectivePresentMode when MAILBOX is requested but the surface doesn't support it.
+enum class PresentMode
+{
+  FIFO,      ///!< vsync, never tears, frames queue up behind the display
+  MAILBOX,   ///!< no tearing, newest frame replaces the queued one
+  IMMEDIATE  ///!< tearing, lowest latency
+};
+
+struct FramePacingParams
+{
+  uint32_t    framesInFlight = 2;                    ///!< 1 .. MAX_FRAMES_IN_FLIGHT, fewer frames - lower latency, less throughput
+  PresentMode presentMode    = PresentMode::MAILBOX;
+  float       fpsLimit       = 0.0f;                 ///!< 0 - no limit
+};
+
+struct FrameStats
+{
+  float    cpuTimeMs  = 0.0f; ///!< time spent recording and submitting the frame, without waiting for the GPU
+  float    gpuTimeMs  = 0.0f; ///!< GPU time of the last completed frame, 0 if timestamps are not supported
+  uint32_t drawCalls  = 0;
+  uint64_t triangles  = 0;
+  float    inputToPresentMs = 0.0f; ///!< from input sampling to vkQueuePresentKHR of the frame, 0 if not measured
+  float    inputToGpuDoneMs = 0.0f; ///!< from input sampling to the frame fence being seen signaled (upper bound)
+  float    renderScale      = 1.0f; ///!< main pass resolution relative to the window, for dynamic resolution
+  uint32_t culledFrustum    = 0;    ///!< instances rejected by GPU culling, several frames old
+  uint32_t culledOcclusion  = 0;
+  uint32_t shadowDraws      = 0;    ///!< draw calls of shadow passes, included in drawCalls
+  uint32_t culledShadowCasters = 0; ///!< instances outside of the light volumes, summed over shadow passes
+};
+
 class IRender
 {
 public:
@@ -43,11 +83,20 @@ public:
 
   virtual void InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId) = 0;
   virtual void InitPresentation(VkSurfaceKHR& a_surface, bool initGUI) = 0;
+  // render to offscreen images instead of a swapchain, no window or surface required
+  virtual void InitPresentationHeadless(const HeadlessParams&) { RUN_TIME_ERROR("Headless mode is not supported by this render"); }
+  // may be called before InitVulkan or at any time later, the change is applied at the start of the next frame
+  virtual void SetFramePacing(const FramePacingParams&) { }
+  // depth-only pass before the main one, so the main pass shades only visible fragments; renders without it ignore this
+  virtual void SetDepthPrepass(bool) { }
+  // called by the main loop right before input is polled, so renders can wait here instead of after input sampling
+  virtual void WaitForFrameStart() { }
   virtual void ProcessInput(const AppInput& input) = 0;
   virtual void UpdateCamera(const Camera* cams, uint32_t a_camsCount) = 0;
   virtual Camera GetCurrentCamera() { return { };};
   virtual void LoadScene(const char* path, bool transpose_inst_matrices) = 0;
   virtual void DrawFrame(float a_time, DrawMode a_mode) = 0;
+  virtual FrameStats GetFrameStats() const { return { }; }
 
   virtual ~IRender() = default;
 
@@ -0,0 +1,695 @@
+#include "render_graph.h"
+#include "../utils/profiler.h"
+#include <vk_utils.h>
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace
+{
+  bool isDepthFormat(VkFormat a_format)
+  {
+    switch(a_format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  bool hasStencil(VkFormat a_format)
+  {
+    return a_format == VK_FORMAT_D16_UNORM_S8_UINT || a_format == VK_FORMAT_D24_UNORM_S8_UINT ||
+           a_format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+  }
+
+  VkImageAspectFlags aspectMask(VkFormat a_format)
+  {
+    if(!isDepthFormat(a_format))
+      return VK_IMAGE_ASPECT_COLOR_BIT;
+    return hasStencil(a_format) ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+  }
+
+  constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                         VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::WriteColor(ResourceId a_image, VkAttachmentLoadOp a_loadOp,
+                                                               VkClearValue a_clear)
+{
+  RenderGraph::Access access = {};
+  access.resource   = a_image;
+  access.layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  access.stages     = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  access.access     = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  access.write      = true;
+  access.read       = a_loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+  access.attachment = true;
+  access.loadOp     = a_loadOp;
+  access.clear      = a_clear;
+  access.layer      = ALL_LAYERS;
+  if(access.read)
+    access.access |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+
+  m_graph.m_passes[m_pass].accesses.push_back(access);
+  return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::WriteDepth(ResourceId a_image, VkAttachmentLoadOp a_loadOp,
+                                                               VkClearValue a_clear, uint32_t a_layer)
+{
+  assert(a_layer == ALL_LAYERS || a_layer < m_graph.m_resources[a_image].desc.layers);
+  RenderGraph::Access access = {};
+  access.resource   = a_image;
+  access.layout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  access.stages     = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  access.access     = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  access.write      = true;
+  access.read       = a_loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+  access.attachment = true;
+  access.loadOp     = a_loadOp;
+  access.clear      = a_clear;
+  access.layer      = a_layer;
+
+  m_graph.m_passes[m_pass].accesses.push_back(access);
+  return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::ReadTexture(ResourceId a_image, VkPipelineStageFlags a_stages)
+{
+  return Access(a_image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, a_stages, VK_ACCESS_SHADER_READ_BIT, false);
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::Access(ResourceId a_image, VkImageLayout a_layout,
+                                                           VkPipelineStageFlags a_stages, VkAccessFlags a_access,
+                                                           bool a_write)
+{
+  RenderGraph::Access access = {};
+  access.resource   = a_image;
+  access.layout     = a_layout;
+  access.stages     = a_stages;
+  access.access     = a_access;
+  access.write      = a_write;
+  access.read       = true; // we don't know what the pass does with the image, so assume it needs previous content
+  access.attachment = false;
+  access.layer      = ALL_LAYERS;
+
+  m_graph.m_passes[m_pass].accesses.push_back(access);
+  return *this;
+}
+
+RenderGraph::PassBuilder &RenderGraph::PassBuilder::SideEffects()
+{
+  m_graph.m_passes[m_pass].sideEffects = true;
+  return *this;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RenderGraph::RenderGraph(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator)
+  : m_device(a_device), m_pAllocator(std::move(a_pAllocator))
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+  Reset();
+}
+
+RenderGraph::ResourceId RenderGraph::CreateImage(const std::string &a_name, const ImageDesc &a_desc)
+{
+  assert(!m_compiled);
+  Resource res;
+  res.name = a_name;
+  res.desc = a_desc;
+  m_resources.push_back(res);
+  return static_cast<ResourceId>(m_resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::ImportImage(const std::string &a_name, VkFormat a_format, VkExtent2D a_extent,
+                                                 VkImageLayout a_initialLayout, VkImageLayout a_finalLayout)
+{
+  assert(!m_compiled);
+  Resource res;
+  res.name          = a_name;
+  res.desc          = {a_extent, a_format, 0};
+  res.imported      = true;
+  res.initialLayout = a_initialLayout;
+  res.finalLayout   = a_finalLayout;
+  m_resources.push_back(res);
+  return static_cast<ResourceId>(m_resources.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const std::string &a_name, ExecuteFunc a_execute)
+{
+  assert(!m_compiled);
+  Pass pass;
+  pass.name    = a_name;
+  pass.execute = std::move(a_execute);
+  m_passes.push_back(std::move(pass));
+  return PassBuilder(*this, static_cast<PassId>(m_passes.size() - 1));
+}
+
+void RenderGraph::SetImportedImage(ResourceId a_image, VkImage a_vkImage, VkImageView a_view)
+{
+  assert(m_resources[a_image].imported);
+  m_resources[a_image].image = a_vkImage;
+  m_resources[a_image].view  = a_view;
+}
+
+void RenderGraph::Compile()
+{
+  PROFILE_FUNCTION();
+  assert(!m_compiled);
+  CullPasses();
+  ComputeLifetimes();
+  CreateTransientImages();
+  AllocateAliasedMemory();
+  CreateRenderPasses();
+  ComputeBarriers();
+  m_compiled = true;
+}
+
+void RenderGraph::Reset()
+{
+  for(auto &pass : m_passes)
+  {
+    for(auto &[views, framebuffer] : pass.framebuffers)
+      vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+    if(pass.renderPass != VK_NULL_HANDLE)
+      vkDestroyRenderPass(m_device, pass.renderPass, nullptr);
+  }
+
+  for(auto &res : m_resources)
+  {
+    if(res.imported)
+      continue;
+    for(auto view : res.layerViews)
+      vkDestroyImageView(m_device, view, nullptr);
+    if(res.view != VK_NULL_HANDLE)
+      vkDestroyImageView(m_device, res.view, nullptr);
+    if(res.image != VK_NULL_HANDLE)
+      vkDestroyImage(m_device, res.image, nullptr);
+  }
+
+  for(auto &block : m_blocks)
+    m_pAllocator->Free(block.alloc);
+
+  m_passes.clear();
+  m_resources.clear();
+  m_blocks.clear();
+  m_finalBarriers = {};
+  m_initBarriers  = {};
+  m_initialized   = false;
+  m_compiled      = false;
+}
+
+// a pass is alive if it writes an imported image or something which is read by a pass alive after it
+void RenderGraph::CullPasses()
+{
+  std::vector<bool> needed(m_resources.size(), false);
+  for(auto pass = m_passes.rbegin(); pass != m_passes.rend(); ++pass)
+  {
+    pass->alive = pass->sideEffects;
+    for(const auto &access : pass->accesses)
+      pass->alive = pass->alive || (access.write && (m_resources[access.resource].imported || needed[access.resource]));
+
+    if(!pass->alive)
+      continue;
+
+    // content written without reading is not needed from earlier passes, unless they write other layers
+    for(const auto &access : pass->accesses)
+    {
+      if(access.write && !access.read && (access.layer == ALL_LAYERS || m_resources[access.resource].desc.layers == 1))
+        needed[access.resource] = false;
+    }
+    for(const auto &access : pass->accesses)
+    {
+      if(access.read)
+        needed[access.resource] = true;
+    }
+  }
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+  for(uint32_t passId = 0; passId < m_passes.size(); ++passId)
+  {
+    if(!m_passes[passId].alive)
+      continue;
+
+    for(const auto &access : m_passes[passId].accesses)
+    {
+      auto &res     = m_resources[access.resource];
+      res.firstPass = std::min(res.firstPass, passId);
+      res.lastPass  = std::max(res.lastPass, passId);
+    }
+  }
+}
+
+void RenderGraph::CreateTransientImages()
+{
+  for(ResourceId resId = 0; resId < m_resources.size(); ++resId)
+  {
+    auto &res = m_resources[resId];
+    if(res.imported || res.firstPass == UINT32_MAX)
+      continue;
+
+    VkImageUsageFlags usage = res.desc.usage;
+    for(const auto &pass : m_passes)
+    {
+      for(const auto &access : pass.accesses)
+      {
+        if(access.resource != resId || !pass.alive)
+          continue;
+        if(access.attachment)
+          usage |= isDepthFormat(res.desc.format) ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        else if(access.layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+          usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+      }
+    }
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+    imageInfo.format        = res.desc.format;
+    imageInfo.extent        = VkExtent3D{res.desc.extent.width, res.desc.extent.height, 1};
+    imageInfo.mipLevels     = 1;
+    imageInfo.arrayLayers   = res.desc.layers;
+    imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage         = usage;
+    imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK_RESULT(vkCreateImage(m_device, &imageInfo, nullptr, &res.image));
+
+    vkGetImageMemoryRequirements(m_device, res.image, &res.memReq);
+  }
+}
+
+// greedy interval packing: the largest images are placed first, every image goes to the first block
+// with compatible memory type which has no images alive at the same time
+void RenderGraph::AllocateAliasedMemory()
+{
+  std::vector<ResourceId> order;
+  for(ResourceId resId = 0; resId < m_resources.size(); ++resId)
+  {
+    if(m_resources[resId].image != VK_NULL_HANDLE && !m_resources[resId].imported)
+      order.push_back(resId);
+  }
+  std::stable_sort(order.begin(), order.end(), [this](ResourceId a, ResourceId b) {
+    return m_resources[a].memReq.size > m_resources[b].memReq.size;
+  });
+
+  for(auto resId : order)
+  {
+    auto &res = m_resources[resId];
+
+    uint32_t blockId = 0;
+    for(; blockId < m_blocks.size(); ++blockId)
+    {
+      const auto &block = m_blocks[blockId];
+      if((block.memoryTypeBits & res.memReq.memoryTypeBits) == 0)
+        continue;
+
+      // content of persistent images outlives the frame, so they don't share memory
+      const bool overlaps = res.desc.persistent ||
+        std::any_of(block.resources.begin(), block.resources.end(), [&](uint32_t other) {
+          return m_resources[other].desc.persistent ||
+                 !(m_resources[other].lastPass < res.firstPass || res.lastPass < m_resources[other].firstPass);
+        });
+      if(!overlaps)
+        break;
+    }
+
+    if(blockId == m_blocks.size())
+      m_blocks.emplace_back();
+
+    auto &block = m_blocks[blockId];
+    block.size            = std::max(block.size, res.memReq.size);
+    block.memoryTypeBits &= res.memReq.memoryTypeBits;
+    block.resources.push_back(resId);
+    res.block = blockId;
+  }
+
+  for(auto &block : m_blocks)
+  {
+    // alignment is the largest of aliased images, they are recreated on resize so memory is dedicated
+    VkMemoryRequirements memReq = {block.size, 1, block.memoryTypeBits};
+    for(auto resId : block.resources)
+      memReq.alignment = std::max(memReq.alignment, m_resources[resId].memReq.alignment);
+    block.alloc = m_pAllocator->Allocate(memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, true);
+
+    for(auto resId : block.resources)
+    {
+      auto &res = m_resources[resId];
+      VK_CHECK_RESULT(vkBindImageMemory(m_device, res.image, block.alloc.memory, block.alloc.offset));
+
+      VkImageViewCreateInfo viewInfo = {};
+      viewInfo.sType            = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.image            = res.image;
+      viewInfo.viewType         = res.desc.layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format           = res.desc.format;
+      viewInfo.subresourceRange = {aspectMask(res.desc.format), 0, 1, 0, res.desc.layers};
+      VK_CHECK_RESULT(vkCreateImageView(m_device, &viewInfo, nullptr, &res.view));
+
+      if(res.desc.layers == 1)
+        continue;
+      res.layerViews.resize(res.desc.layers);
+      for(uint32_t layer = 0; layer < res.desc.layers; ++layer)
+      {
+        viewInfo.viewType         = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.subresourceRange = {aspectMask(res.desc.format), 0, 1, layer, 1};
+        VK_CHECK_RESULT(vkCreateImageView(m_device, &viewInfo, nullptr, &res.layerViews[layer]));
+      }
+    }
+  }
+}
+
+void RenderGraph::CreateRenderPasses()
+{
+  for(uint32_t passId = 0; passId < m_passes.size(); ++passId)
+  {
+    auto &pass = m_passes[passId];
+    if(!pass.alive)
+      continue;
+
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference>   colorRefs;
+    VkAttachmentReference                depthRef = {};
+    bool                                 hasDepth = false;
+
+    for(const auto &access : pass.accesses)
+    {
+      if(!access.attachment)
+        continue;
+
+      const auto &res = m_resources[access.resource];
+
+      // content is stored only if somebody reads it later, persistent images are read by the next frame
+      bool readLater = res.imported || res.desc.persistent;
+      for(uint32_t next = passId + 1; next < m_passes.size() && !readLater; ++next)
+      {
+        if(!m_passes[next].alive)
+          continue;
+        for(const auto &nextAccess : m_passes[next].accesses)
+          readLater = readLater || (nextAccess.resource == access.resource && nextAccess.read);
+      }
+
+      VkAttachmentDescription desc = {};
+      desc.format         = res.desc.format;
+      desc.samples        = VK_SAMPLE_COUNT_1_BIT;
+      desc.loadOp         = access.loadOp;
+      desc.storeOp        = readLater ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      desc.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+      desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      desc.initialLayout  = access.layout; // transitions are done by barriers recorded before the render pass
+      desc.finalLayout    = access.layout;
+
+      const VkAttachmentReference ref = {static_cast<uint32_t>(attachments.size()), access.layout};
+      if(isDepthFormat(res.desc.format))
+      {
+        depthRef = ref;
+        hasDepth = true;
+      }
+      else
+        colorRefs.push_back(ref);
+
+      attachments.push_back(desc);
+      pass.clearValues.push_back(access.clear);
+      pass.extent = res.desc.extent;
+    }
+
+    if(attachments.empty())
+      continue;
+
+    VkSubpassDescription subpass    = {};
+    subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount    = static_cast<uint32_t>(colorRefs.size());
+    subpass.pColorAttachments       = colorRefs.data();
+    subpass.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+
+    VkRenderPassCreateInfo renderPassInfo = {};
+    renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments    = attachments.data();
+    renderPassInfo.subpassCount    = 1;
+    renderPassInfo.pSubpasses      = &subpass;
+    VK_CHECK_RESULT(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &pass.renderPass));
+  }
+}
+
+void RenderGraph::ComputeBarriers()
+{
+  struct State
+  {
+    VkImageLayout        layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags stages = 0;
+    VkAccessFlags        writes = 0;  ///!< writes which must be made available before the next access
+    bool                 touched = false;
+  };
+
+  // the last access of every image in the frame
+  std::vector<const Access*> lastAccess(m_resources.size(), nullptr);
+  for(const auto &pass : m_passes)
+  {
+    for(const auto &access : pass.accesses)
+    {
+      if(pass.alive)
+        lastAccess[access.resource] = &access;
+    }
+  }
+
+  std::vector<State> states(m_resources.size());
+  for(ResourceId resId = 0; resId < m_resources.size(); ++resId)
+  {
+    const auto &res = m_resources[resId];
+    if(res.imported)
+    {
+      // swapchain images are acquired with semaphore waited at this stage
+      states[resId].layout = res.initialLayout;
+      states[resId].stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+      continue;
+    }
+    if(res.block == UINT32_MAX)
+      continue;
+
+    // the previous frame left the image as its last access did; the first frame transitions it there once
+    if(res.desc.persistent)
+    {
+      const Access* last = lastAccess[resId];
+      states[resId].layout = last->layout;
+      states[resId].stages = last->stages;
+      states[resId].writes = last->access & WRITE_ACCESS;
+      m_initBarriers.barriers.push_back({resId, VK_IMAGE_LAYOUT_UNDEFINED, last->layout, 0, last->access});
+      m_initBarriers.dstStages |= last->stages;
+      continue;
+    }
+
+    // memory of transient image was used last by its previous alias in this frame or by the last alias in the
+    // previous frame, content is discarded so we only wait for that work to finish
+    const auto &block = m_blocks[res.block];
+    ResourceId previous = UINT32_MAX;
+    for(auto other : block.resources)
+    {
+      const bool before = m_resources[other].lastPass < res.firstPass;
+      if(before && (previous == UINT32_MAX || m_resources[other].lastPass > m_resources[previous].lastPass))
+        previous = other;
+    }
+    if(previous == UINT32_MAX)
+    {
+      for(auto other : block.resources)
+      {
+        if(previous == UINT32_MAX || m_resources[other].lastPass > m_resources[previous].lastPass)
+          previous = other;
+      }
+    }
+
+    const Access* prevAccess = lastAccess[previous];
+    states[resId].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    states[resId].stages = prevAccess->stages;
+    states[resId].writes = prevAccess->access & WRITE_ACCESS;
+  }
+
+  auto addBarrier = [](BarrierBatch &a_batch, ResourceId a_res, const State &a_from, VkImageLayout a_newLayout,
+                           VkPipelineStageFlags a_dstStages, VkAccessFlags a_dstAccess) {
+    a_batch.barriers.push_back({a_res, a_from.layout, a_newLayout, a_from.writes, a_dstAccess});
+    a_batch.srcStages |= a_from.stages;
+    a_batch.dstStages |= a_dstStages;
+  };
+
+  for(auto &pass : m_passes)
+  {
+    if(!pass.alive)
+      continue;
+
+    for(const auto &access : pass.accesses)
+    {
+      auto &state = states[access.resource];
+      const auto &res              = m_resources[access.resource];
+      const bool transientFirstUse = !res.imported && !res.desc.persistent && !state.touched;
+      const bool hazard = state.writes != 0 || (access.write && state.stages != 0);
+
+      if(transientFirstUse || state.layout != access.layout || hazard)
+        addBarrier(pass.barriersBefore, access.resource, state, access.layout, access.stages, access.access);
+
+      // read after read in the same layout does not need a barrier, but a write after them must wait for all readers
+      const bool readOnly = (access.access & WRITE_ACCESS) == 0;
+      state.stages  = readOnly && !hazard && state.layout == access.layout ? state.stages | access.stages : access.stages;
+      state.layout  = access.layout;
+      state.writes  = access.access & WRITE_ACCESS;
+      state.touched = true;
+    }
+  }
+
+  for(ResourceId resId = 0; resId < m_resources.size(); ++resId)
+  {
+    const auto &res = m_resources[resId];
+    if(res.imported && states[resId].layout != res.finalLayout)
+      addBarrier(m_finalBarriers, resId, states[resId], res.finalLayout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+  }
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer a_cmdBuff, const BarrierBatch &a_batch) const
+{
+  if(a_batch.barriers.empty())
+    return;
+
+  std::vector<VkImageMemoryBarrier> barriers;
+  barriers.reserve(a_batch.barriers.size());
+  for(const auto &b : a_batch.barriers)
+  {
+    const auto &res = m_resources[b.resource];
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask       = b.srcAccess;
+    barrier.dstAccessMask       = b.dstAccess;
+    barrier.oldLayout           = b.oldLayout;
+    barrier.newLayout           = b.newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image               = res.image;
+    barrier.subresourceRange    = {aspectMask(res.desc.format), 0, 1, 0, res.desc.layers};
+    barriers.push_back(barrier);
+  }
+
+  const VkPipelineStageFlags srcStages = a_batch.srcStages != 0 ? a_batch.srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  const VkPipelineStageFlags dstStages = a_batch.dstStages != 0 ? a_batch.dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, srcStages, dstStages, 0, 0, nullptr, 0, nullptr,
+                       static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+VkImageView RenderGraph::GetLayerView(ResourceId a_image, uint32_t a_layer) const
+{
+  const auto &res = m_resources[a_image];
+  assert(a_layer < res.desc.layers);
+  return res.desc.layers == 1 ? res.view : res.layerViews[a_layer];
+}
+
+VkFramebuffer RenderGraph::GetFramebuffer(Pass &a_pass)
+{
+  std::vector<VkImageView> views;
+  for(const auto &access : a_pass.accesses)
+  {
+    if(!access.attachment)
+      continue;
+    const auto &res = m_resources[access.resource];
+    assert(res.desc.layers == 1 || access.layer != ALL_LAYERS); // framebuffers have one layer
+    views.push_back(access.layer == ALL_LAYERS ? res.view : res.layerViews[access.layer]);
+  }
+
+  auto it = a_pass.framebuffers.find(views);
+  if(it != a_pass.framebuffers.end())
+    return it->second;
+
+  VkFramebufferCreateInfo framebufferInfo = {};
+  framebufferInfo.sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebufferInfo.renderPass      = a_pass.renderPass;
+  framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+  framebufferInfo.pAttachments    = views.data();
+  framebufferInfo.width           = a_pass.extent.width;
+  framebufferInfo.height          = a_pass.extent.height;
+  framebufferInfo.layers          = 1;
+
+  VkFramebuffer framebuffer = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &framebuffer));
+  a_pass.framebuffers[views] = framebuffer;
+  return framebuffer;
+}
+
+void RenderGraph::Execute(VkCommandBuffer a_cmdBuff)
+{
+  PROFILE_FUNCTION();
+  assert(m_compiled);
+
+  if(!m_initialized)
+  {
+    RecordBarriers(a_cmdBuff, m_initBarriers);
+    m_initialized = true;
+  }
+
+  for(auto &pass : m_passes)
+  {
+    if(!pass.alive)
+      continue;
+
+    RecordBarriers(a_cmdBuff, pass.barriersBefore);
+
+    if(pass.renderPass == VK_NULL_HANDLE)
+    {
+      pass.execute(a_cmdBuff);
+      continue;
+    }
+
+    VkRenderPassBeginInfo beginInfo = {};
+    beginInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    beginInfo.renderPass        = pass.renderPass;
+    beginInfo.framebuffer       = GetFramebuffer(pass);
+    beginInfo.renderArea.offset = {0, 0};
+    beginInfo.renderArea.extent = pass.extent;
+    beginInfo.clearValueCount   = static_cast<uint32_t>(pass.clearValues.size());
+    beginInfo.pClearValues      = pass.clearValues.data();
+
+    vkCmdBeginRenderPass(a_cmdBuff, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    pass.execute(a_cmdBuff);
+    vkCmdEndRenderPass(a_cmdBuff);
+  }
+
+  RecordBarriers(a_cmdBuff, m_finalBarriers);
+}
+
+void RenderGraph::PrintStats() const
+{
+  size_t culled = 0, barriers = m_finalBarriers.barriers.size();
+  for(const auto &pass : m_passes)
+  {
+    barriers += pass.barriersBefore.barriers.size();
+    if(!pass.alive)
+    {
+      culled++;
+      std::cout << "[RenderGraph] pass '" << pass.name << "' is culled, its results are not used" << std::endl;
+    }
+  }
+
+  VkDeviceSize aliased = 0, separate = 0;
+  for(const auto &block : m_blocks)
+  {
+    aliased += block.size;
+    for(auto resId : block.resources)
+      separate += m_resources[resId].memReq.size;
+  }
+
+  std::cout << "[RenderGraph] " << m_passes.size() << " passes (" << culled << " culled), " << barriers << " barriers, "
+            << "transient memory " << double(aliased) / (1024.0 * 1024.0) << " MB in " << m_blocks.size()
+            << " blocks (" << double(separate) / (1024.0 * 1024.0) << " MB without aliasing)" << std::endl;
+}
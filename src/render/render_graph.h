@@ -0,0 +1,195 @@
+#ifndef VK_GRAPHICS_BASIC_RENDER_GRAPH_H
+#define VK_GRAPHICS_BASIC_RENDER_GRAPH_H
+
+#include "volk.h"
+#include "device_allocator.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+\brief Frame graph: passes declare images they read and write, the graph takes care of everything in between.
+
+  Usage:
+    1. declare resources (CreateImage for transient images owned by the graph, ImportImage for external ones,
+       i.e. swapchain) and passes (AddPass) with their accesses;
+    2. Compile() once: passes which do not contribute to imported images are culled, render passes are created
+       for passes with attachments, barriers are computed and transient images which are never alive at the same
+       time share memory;
+    3. every frame set imported images (SetImportedImage) and record the frame with Execute().
+
+  Declaration is fixed after Compile(), call Reset() and declare the graph again when it changes (i.e. on resize).
+  Persistent images keep content from the previous frame, it is undefined after Compile() until passes write it.
+*/
+class RenderGraph
+{
+public:
+  using ResourceId  = uint32_t;
+  using PassId      = uint32_t;
+  using ExecuteFunc = std::function<void(VkCommandBuffer)>;
+
+  static constexpr uint32_t ALL_LAYERS = UINT32_MAX;
+
+  struct ImageDesc
+  {
+    VkExtent2D        extent;
+    VkFormat          format;
+    VkImageUsageFlags usage;       ///!< attachment usage is added automatically
+    uint32_t          layers = 1;  ///!< image with several layers is sampled as 2D array, attached one layer at a time
+    bool              persistent = false;  ///!< content is kept between frames, the image has its own memory
+  };
+
+  class PassBuilder
+  {
+  public:
+    PassBuilder &WriteColor(ResourceId a_image, VkAttachmentLoadOp a_loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                            VkClearValue a_clear = {});
+    PassBuilder &WriteDepth(ResourceId a_image, VkAttachmentLoadOp a_loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                            VkClearValue a_clear = {}, uint32_t a_layer = ALL_LAYERS);
+    PassBuilder &ReadTexture(ResourceId a_image, VkPipelineStageFlags a_stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+    // for passes which record their own render passes (i.e. vk_utils::QuadRenderer) and expect the image in a_layout
+    PassBuilder &Access(ResourceId a_image, VkImageLayout a_layout, VkPipelineStageFlags a_stages,
+                        VkAccessFlags a_access, bool a_write);
+
+    // the pass is never culled
+    PassBuilder &SideEffects();
+
+    PassId Id() const { return m_pass; }
+
+  private:
+    friend class RenderGraph;
+    PassBuilder(RenderGraph &a_graph, PassId a_pass) : m_graph(a_graph), m_pass(a_pass) {}
+
+    RenderGraph &m_graph;
+    PassId       m_pass;
+  };
+
+  RenderGraph(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator);
+  ~RenderGraph();
+
+  RenderGraph(const RenderGraph &) = delete;
+  RenderGraph &operator=(const RenderGraph &) = delete;
+
+  ResourceId CreateImage(const std::string &a_name, const ImageDesc &a_desc);
+  // image is expected in a_initialLayout when the frame starts and is left in a_finalLayout
+  ResourceId ImportImage(const std::string &a_name, VkFormat a_format, VkExtent2D a_extent,
+                         VkImageLayout a_initialLayout, VkImageLayout a_finalLayout);
+
+  // passes are executed in the order they are added, a_execute is called inside the render pass
+  // if the pass has color or depth attachments
+  PassBuilder AddPass(const std::string &a_name, ExecuteFunc a_execute);
+
+  void Compile();
+  void Reset();
+
+  void SetImportedImage(ResourceId a_image, VkImage a_vkImage, VkImageView a_view);
+  void Execute(VkCommandBuffer a_cmdBuff);
+
+  // valid after Compile()
+  VkRenderPass GetRenderPass(PassId a_pass) const { return m_passes[a_pass].renderPass; }
+  VkImage      GetImage(ResourceId a_image) const { return m_resources[a_image].image; }
+  VkImageView  GetImageView(ResourceId a_image) const { return m_resources[a_image].view; }
+  VkImageView  GetLayerView(ResourceId a_image, uint32_t a_layer) const;
+  bool         IsCulled(PassId a_pass) const { return !m_passes[a_pass].alive; }
+
+  void PrintStats() const;
+
+private:
+  struct Resource
+  {
+    std::string   name;
+    ImageDesc     desc;
+    bool          imported      = false;
+    VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout finalLayout   = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImage     image = VK_NULL_HANDLE;
+    VkImageView view  = VK_NULL_HANDLE;   ///!< all layers
+    std::vector<VkImageView> layerViews;  ///!< 2D view of every layer of layered images
+
+    // lifetime in live passes, memory block for transient images
+    uint32_t firstPass = UINT32_MAX;
+    uint32_t lastPass  = 0;
+    uint32_t block     = UINT32_MAX;
+    VkMemoryRequirements memReq = {};
+  };
+
+  struct Access
+  {
+    ResourceId           resource;
+    VkImageLayout        layout;
+    VkPipelineStageFlags stages;
+    VkAccessFlags        access;
+    bool                 write;
+    bool                 read;      ///!< attachments with LOAD_OP_LOAD read previous content too
+    bool                 attachment;
+    VkAttachmentLoadOp   loadOp;
+    VkClearValue         clear;
+    uint32_t             layer;     ///!< attached layer, barriers still cover the whole image
+  };
+
+  struct Barrier
+  {
+    ResourceId    resource;
+    VkImageLayout oldLayout;
+    VkImageLayout newLayout;
+    VkAccessFlags srcAccess;
+    VkAccessFlags dstAccess;
+  };
+
+  struct BarrierBatch
+  {
+    std::vector<Barrier> barriers;
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+  };
+
+  struct Pass
+  {
+    std::string         name;
+    ExecuteFunc         execute;
+    std::vector<Access> accesses;
+    bool                sideEffects = false;
+    bool                alive       = false;
+
+    BarrierBatch              barriersBefore;
+    VkRenderPass              renderPass = VK_NULL_HANDLE;
+    VkExtent2D                extent     = {};
+    std::vector<VkClearValue> clearValues;
+    std::map<std::vector<VkImageView>, VkFramebuffer> framebuffers; // imported views change from frame to frame
+  };
+
+  struct MemoryBlock
+  {
+    DeviceAllocation      alloc;
+    VkDeviceSize          size           = 0;
+    uint32_t              memoryTypeBits = ~0u;
+    std::vector<uint32_t> resources;
+  };
+
+  void CullPasses();
+  void ComputeLifetimes();
+  void CreateTransientImages();
+  void AllocateAliasedMemory();
+  void CreateRenderPasses();
+  void ComputeBarriers();
+  void RecordBarriers(VkCommandBuffer a_cmdBuff, const BarrierBatch &a_batch) const;
+  VkFramebuffer GetFramebuffer(Pass &a_pass);
+
+  VkDevice                         m_device   = VK_NULL_HANDLE;
+  std::shared_ptr<DeviceAllocator> m_pAllocator;
+  bool                             m_compiled = false;
+
+  std::vector<Resource>    m_resources;
+  std::vector<Pass>        m_passes;
+  std::vector<MemoryBlock> m_blocks;
+  BarrierBatch             m_finalBarriers;  ///!< imported images to their final layouts
+  BarrierBatch             m_initBarriers;   ///!< persistent images to the layout they have at the end of a frame
+  bool                     m_initialized = false;  ///!< m_initBarriers were recorded
+};
+
+#endif// VK_GRAPHICS_BASIC_RENDER_GRAPH_H
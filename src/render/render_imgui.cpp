@@ -1,11 +1,14 @@
 #include "render_gui.h"
+#include "render_common.h"
 #include <vk_utils.h>
 #include <vk_descriptor_sets.h>
 
+#include <algorithm>
+
 
 ImGuiRender::ImGuiRender(VkInstance a_instance, VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_queueFID, VkQueue a_queue,
-  const VulkanSwapChain &a_swapchain) : m_instance(a_instance), m_device(a_device), m_physDevice(a_physDevice),
-                                        m_queue_FID(a_queueFID), m_queue(a_queue), m_swapchain(&a_swapchain)
+  const VulkanSwapChain &a_swapchain, VkPipelineCache a_pipelineCache) : m_instance(a_instance), m_device(a_device), m_physDevice(a_physDevice),
+                                        m_queue_FID(a_queueFID), m_queue(a_queue), m_swapchain(&a_swapchain), m_pipelineCache(a_pipelineCache)
 {
   InitImGui();
 }
@@ -49,12 +52,14 @@ void ImGuiRender::InitImGui()
   init_info.Device         = m_device;
   init_info.QueueFamily    = m_queue_FID;
   init_info.Queue          = m_queue;
-  init_info.PipelineCache  = VK_NULL_HANDLE;
+  init_info.PipelineCache  = m_pipelineCache;
   init_info.DescriptorPool = m_descriptorPool;
   init_info.RenderPass     = m_renderpass;
   init_info.Allocator      = VK_NULL_HANDLE;
   init_info.MinImageCount  = m_swapchain->GetMinImageCount() > 1 ? m_swapchain->GetMinImageCount() : m_swapchain->GetMinImageCount() + 1;
-  init_info.ImageCount     = m_swapchain->GetImageCount();
+  // vertex and index buffers of the GUI are rotated over ImageCount frames, so there must be at least one per frame
+  // in flight even if the swapchain is recreated with more frames in flight later
+  init_info.ImageCount     = std::max<uint32_t>(m_swapchain->GetImageCount(), MAX_FRAMES_IN_FLIGHT);
   init_info.CheckVkResultFn = nullptr;
 
   ImGui_ImplVulkan_LoadFunctions(vulkanLoaderFunction);
@@ -91,11 +96,18 @@ VkCommandBuffer ImGuiRender::BuildGUIRenderCommand(uint32_t a_swapchainFrameIdx,
 
 void ImGuiRender::OnSwapchainChanged(const VulkanSwapChain &a_swapchain)
 {
-  // If swapchain size changed, we are doomed, but that generaly does not happen. I think.
+  // If swapchain format changed, we are doomed, but that generaly does not happen. I think.
   m_swapchain = &a_swapchain;
 
   ClearFrameBuffers();
   m_framebuffers = vk_utils::createFrameBuffers(m_device, *m_swapchain, m_renderpass);
+
+  // image count follows the number of frames in flight
+  if(m_drawGUICmdBuffers.size() != m_swapchain->GetImageCount())
+  {
+    vkFreeCommandBuffers(m_device, m_commandPool, uint32_t(m_drawGUICmdBuffers.size()), m_drawGUICmdBuffers.data());
+    m_drawGUICmdBuffers = vk_utils::createCommandBuffers(m_device, m_commandPool, m_swapchain->GetImageCount());
+  }
 }
 
 void ImGuiRender::CleanupImGui()
@@ -1,9 +1,12 @@
 #include <map>
 #include <array>
+#include <random>
+#include <algorithm>
 #include "scene_mgr.h"
 #include "vk_utils.h"
 #include "vk_buffers.h"
 #include "../loader_utils/hydraxml.h"
+#include "../utils/profiler.h"
 
 
 VkTransformMatrixKHR transformMatrixFromFloat4x4(const LiteMath::float4x4 &m)
@@ -21,19 +24,46 @@ VkTransformMatrixKHR transformMatrixFromFloat4x4(const LiteMath::float4x4 &m)
 }
 
 SceneManager::SceneManager(VkDevice a_device, VkPhysicalDevice a_physDevice,
-  uint32_t a_transferQId, uint32_t a_graphicsQId, bool debug) : m_device(a_device), m_physDevice(a_physDevice),
-                 m_transferQId(a_transferQId), m_graphicsQId(a_graphicsQId), m_debug(debug)
+  uint32_t a_transferQId, uint32_t a_graphicsQId, bool debug, std::shared_ptr<DeviceAllocator> a_pAllocator) :
+                 m_device(a_device), m_physDevice(a_physDevice),
+                 m_transferQId(a_transferQId), m_graphicsQId(a_graphicsQId), m_pAllocator(std::move(a_pAllocator)), m_debug(debug)
 {
+  if(m_pAllocator == nullptr)
+    m_pAllocator = std::make_shared<DeviceAllocator>(m_device, m_physDevice);
+
   vkGetDeviceQueue(m_device, m_transferQId, 0, &m_transferQ);
   vkGetDeviceQueue(m_device, m_graphicsQId, 0, &m_graphicsQ);
-  VkDeviceSize scratchMemSize = 64 * 1024 * 1024;
-  m_pCopyHelper = std::make_shared<vk_utils::PingPongCopyHelper>(m_physDevice, m_device, m_transferQ, m_transferQId, scratchMemSize);
+  m_pUploader = std::make_shared<AsyncUploader>(m_device, m_pAllocator, m_transferQ, m_transferQId, m_graphicsQ, m_graphicsQId);
   m_pMeshData   = std::make_shared<Mesh8F>();
 
 }
 
+// hydra light as a point light of the same power: area lights with radiance L and area A become L * A / 4,
+// sky and directional lights are skipped
+static bool pointLightFromHydra(const hydra_xml::LightInstance &a_light, LiteMath::float3 &a_intensity)
+{
+  const std::wstring type  = a_light.lightNode.attribute(L"type").as_string();
+  const std::wstring shape = a_light.lightNode.attribute(L"shape").as_string();
+  if(type == L"sky" || type == L"directional")
+    return false;
+
+  auto intensityNode = a_light.lightNode.child(L"intensity");
+  const float multiplier = intensityNode.child(L"multiplier").attribute(L"val").as_float(1.0f);
+  a_intensity = hydra_xml::readval3f(intensityNode.child(L"color")) * multiplier;
+
+  auto sizeNode = a_light.lightNode.child(L"size");
+  if(type == L"area" && shape == L"rect")
+    a_intensity *= sizeNode.attribute(L"half_length").as_float() * sizeNode.attribute(L"half_width").as_float();
+  else if(type == L"area" && shape == L"disk")
+    a_intensity *= 0.25f * LiteMath::M_PI * sizeNode.attribute(L"radius").as_float() * sizeNode.attribute(L"radius").as_float();
+  else if(shape == L"sphere")
+    a_intensity *= LiteMath::M_PI * sizeNode.attribute(L"radius").as_float() * sizeNode.attribute(L"radius").as_float();
+  return true;
+}
+
 bool SceneManager::LoadSceneXML(const std::string &scenePath, bool transpose)
 {
+  PROFILE_FUNCTION();
   auto hscene_main = std::make_shared<hydra_xml::HydraScene>();
   auto res         = hscene_main->LoadState(scenePath);
 
@@ -61,6 +91,16 @@ bool SceneManager::LoadSceneXML(const std::string &scenePath, bool transpose)
     m_sceneCameras.push_back(cam);
   }
 
+  for(const auto &light : hscene_main->InstancesLights())
+  {
+    LiteMath::float3 intensity;
+    if(!pointLightFromHydra(light, intensity))
+      continue;
+    const auto matrix = transpose ? LiteMath::transpose(light.matrix) : light.matrix;
+    const auto pos    = matrix * LiteMath::float4(0.0f, 0.0f, 0.0f, 1.0f);
+    AddPointLight(LiteMath::float3(pos.x, pos.y, pos.z), intensity);
+  }
+
   LoadGeoDataOnGPU();
   hscene_main = nullptr;
 
@@ -104,31 +144,111 @@ void SceneManager::LoadSingleTriangle()
   VkDeviceSize vertexBufSize = sizeof(Vertex) * vertices.size();
   VkDeviceSize indexBufSize  = sizeof(uint32_t) * indices.size();
   
-  VkMemoryRequirements vertMemReq, idxMemReq; 
-  m_geoVertBuf = vk_utils::createBuffer(m_device, vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &vertMemReq);
-  m_geoIdxBuf  = vk_utils::createBuffer(m_device, indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &idxMemReq);
-
-  size_t pad = vk_utils::getPaddedSize(vertMemReq.size, idxMemReq.alignment);
+  m_geoVertBuf = vk_utils::createBuffer(m_device, vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_geoIdxBuf  = vk_utils::createBuffer(m_device, indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
 
-  VkMemoryAllocateInfo allocateInfo = {};
-  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocateInfo.pNext           = nullptr;
-  allocateInfo.allocationSize  = pad + idxMemReq.size;
-  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(vertMemReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physDevice);
+  m_geoAlloc = m_pAllocator->AllocateForBuffers({m_geoVertBuf, m_geoIdxBuf}, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_pUploader->UploadBuffer(m_geoVertBuf, 0, vertices.data(), vertexBufSize);
+  m_pUploader->UploadBuffer(m_geoIdxBuf,  0, indices.data(),  indexBufSize);
+  m_geoUploadToken = m_pUploader->Flush();
+}
 
+// box with the bottom face centered at the origin, 1 unit in size, 4 vertices per face for flat normals
+static cmesh::SimpleMesh makeBoxMesh()
+{
+  const LiteMath::float3 normals[6]  = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+  const LiteMath::float3 tangents[6] = {{0, 0, -1}, {0, 0, 1}, {1, 0, 0}, {1, 0, 0}, {1, 0, 0}, {-1, 0, 0}};
 
-  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_geoMemAlloc));
+  cmesh::SimpleMesh mesh(24, 36);
+  for(uint32_t face = 0; face < 6; ++face)
+  {
+    const LiteMath::float3 n = normals[face];
+    const LiteMath::float3 t = tangents[face];
+    const LiteMath::float3 b = LiteMath::cross(n, t);
+    for(uint32_t corner = 0; corner < 4; ++corner)
+    {
+      const float u = (corner == 1 || corner == 2) ? 1.0f : 0.0f;
+      const float v = (corner >= 2) ? 1.0f : 0.0f;
+      const LiteMath::float3 p = 0.5f * n + (u - 0.5f) * t + (v - 0.5f) * b + LiteMath::float3(0.0f, 0.5f, 0.0f);
+
+      const uint32_t vert = face * 4 + corner;
+      for(uint32_t k = 0; k < 3; ++k)
+      {
+        mesh.vPos4f[vert * 4 + k]  = p[k];
+        mesh.vNorm4f[vert * 4 + k] = n[k];
+        mesh.vTang4f[vert * 4 + k] = t[k];
+      }
+      mesh.vPos4f[vert * 4 + 3]  = 1.0f;
+      mesh.vNorm4f[vert * 4 + 3] = 0.0f;
+      mesh.vTang4f[vert * 4 + 3] = 0.0f;
+      mesh.vTexCoord2f[vert * 2 + 0] = u;
+      mesh.vTexCoord2f[vert * 2 + 1] = v;
+    }
 
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_geoVertBuf, m_geoMemAlloc, 0));
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_geoIdxBuf,  m_geoMemAlloc, pad));
-  m_pCopyHelper->UpdateBuffer(m_geoVertBuf, 0, vertices.data(),  vertexBufSize);
-  m_pCopyHelper->UpdateBuffer(m_geoIdxBuf,  0, indices.data(), indexBufSize);
+    const uint32_t quad[6] = {0, 1, 2, 0, 2, 3};
+    for(uint32_t k = 0; k < 6; ++k)
+      mesh.indices[face * 6 + k] = face * 4 + quad[k];
+    mesh.matIndices[face * 2 + 0] = 0;
+    mesh.matIndices[face * 2 + 1] = 0;
+  }
+  return mesh;
 }
 
+void SceneManager::GenerateCity(uint32_t a_blocksPerSide, uint32_t a_seed)
+{
+  PROFILE_FUNCTION();
+  auto box = makeBoxMesh();
+  const uint32_t boxId = AddMeshFromData(box);
+
+  // 2x2 buildings separated by 1 unit wide streets, city is centered at the origin
+  constexpr float cellSize  = 3.0f;
+  constexpr float buildSize = 2.0f;
+  const float     citySize  = cellSize * float(a_blocksPerSide);
+
+  InstanceMesh(boxId, LiteMath::translate4x4(LiteMath::float3(0.0f, -0.1f, 0.0f)) *
+                      LiteMath::scale4x4(LiteMath::float3(citySize + 2.0f * cellSize, 0.1f, citySize + 2.0f * cellSize)));
+
+  // mostly mid-rise with a few towers
+  std::mt19937 rng(a_seed);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  for(uint32_t z = 0; z < a_blocksPerSide; ++z)
+  {
+    for(uint32_t x = 0; x < a_blocksPerSide; ++x)
+    {
+      const float u      = uniform(rng);
+      const float height = 2.0f + 10.0f * u * u;
+      const LiteMath::float3 pos((float(x) + 0.5f) * cellSize - 0.5f * citySize, 0.0f,
+                                 (float(z) + 0.5f) * cellSize - 0.5f * citySize);
+      InstanceMesh(boxId, LiteMath::translate4x4(pos) * LiteMath::scale4x4(LiteMath::float3(buildSize, height, buildSize)));
+    }
+  }
 
+  // street lights at every crossing, thousands of them for clustered lighting
+  for(uint32_t z = 0; z <= a_blocksPerSide; ++z)
+  {
+    for(uint32_t x = 0; x <= a_blocksPerSide; ++x)
+    {
+      const LiteMath::float3 pos(float(x) * cellSize - 0.5f * citySize, 1.0f, float(z) * cellSize - 0.5f * citySize);
+      const LiteMath::float3 color(0.5f + 0.5f * uniform(rng), 0.5f + 0.5f * uniform(rng), 0.5f + 0.5f * uniform(rng));
+      AddPointLight(pos, color);
+    }
+  }
+
+  hydra_xml::Camera cam = {};
+  cam.pos[0]    = 0.0f;            cam.pos[1]    = 1.7f; cam.pos[2]    = 0.5f * citySize + 1.0f;
+  cam.lookAt[0] = 0.5f * citySize; cam.lookAt[1] = 1.7f; cam.lookAt[2] = 0.0f;
+  cam.up[1]     = 1.0f;
+  cam.fov       = 60.0f;
+  cam.nearPlane = 0.1f;
+  cam.farPlane  = 2.0f * citySize;
+  m_sceneCameras.push_back(cam);
+
+  LoadGeoDataOnGPU();
+}
 
 uint32_t SceneManager::AddMeshFromFile(const std::string& meshPath)
 {
+  PROFILE_FUNCTION();
   //@TODO: other file formats
   auto data = cmesh::LoadMeshFromVSGF(meshPath.c_str());
 
@@ -183,20 +303,92 @@ uint32_t SceneManager::InstanceMesh(const uint32_t meshId, const LiteMath::float
 
   m_instanceInfos.push_back(info);
 
-  Box4f instBox;
+  const Box4f instBox = TransformBox(m_meshBboxes[meshId], matrix);
+  sceneBbox.include(instBox);
+  m_instanceBboxes.push_back(instBox);
+
+  return info.inst_id;
+}
+
+void SceneManager::SetInstanceMatrix(uint32_t instId, const LiteMath::float4x4 &matrix)
+{
+  assert(instId < m_instanceInfos.size());
+  m_instanceMatrices[instId]    = matrix;
+  m_instanceBboxes[instId]      = TransformBox(m_meshBboxes[m_instanceInfos[instId].mesh_id], matrix);
+  m_instanceInfos[instId].dirty = true;
+  sceneBbox.include(m_instanceBboxes[instId]);
+}
+
+void SceneManager::ClearDirtyFlags()
+{
+  for(auto &info : m_instanceInfos)
+    info.dirty = false;
+}
+
+Box4f SceneManager::TransformBox(const Box4f &a_box, const LiteMath::float4x4 &a_matrix)
+{
+  Box4f res;
   for (uint32_t i = 0; i < 8; ++i) {
     float4 corner = float4(
-      (i & 1) == 0 ? m_meshBboxes[meshId].boxMin.x : m_meshBboxes[meshId].boxMax.x,
-      (i & 2) == 0 ? m_meshBboxes[meshId].boxMin.y : m_meshBboxes[meshId].boxMax.y,
-      (i & 4) == 0 ? m_meshBboxes[meshId].boxMin.z : m_meshBboxes[meshId].boxMax.z,
+      (i & 1) == 0 ? a_box.boxMin.x : a_box.boxMax.x,
+      (i & 2) == 0 ? a_box.boxMin.y : a_box.boxMax.y,
+      (i & 4) == 0 ? a_box.boxMin.z : a_box.boxMax.z,
       1
     );
-    instBox.include(matrix * corner);
+    res.include(a_matrix * corner);
   }
-  sceneBbox.include(instBox);
-  m_instanceBboxes.push_back(instBox);
+  return res;
+}
 
-  return info.inst_id;
+uint32_t SceneManager::AddPointLight(const LiteMath::float3 &a_pos, const LiteMath::float3 &a_intensity)
+{
+  // intensity / (d^2 + 1) == LIGHT_CUTOFF
+  const float maxIntensity = std::max(a_intensity.x, std::max(a_intensity.y, a_intensity.z));
+  const float radius       = std::sqrt(std::max(maxIntensity / LIGHT_CUTOFF - 1.0f, 0.0f));
+
+  PointLight light;
+  light.posAndRadius = LiteMath::float4(a_pos.x, a_pos.y, a_pos.z, radius);
+  light.color        = LiteMath::float4(a_intensity.x, a_intensity.y, a_intensity.z, 0.0f);
+  m_lights.push_back(light);
+
+  return (uint32_t)m_lights.size() - 1;
+}
+
+void SceneManager::SortInstancesFrontToBack(const LiteMath::float3 &a_eye, std::vector<uint32_t> &a_order) const
+{
+  std::vector<float> dist(m_instanceBboxes.size());
+  for(size_t i = 0; i < m_instanceBboxes.size(); ++i)
+  {
+    const float4 center = 0.5f * (m_instanceBboxes[i].boxMin + m_instanceBboxes[i].boxMax);
+    const float3 toEye  = float3(center.x, center.y, center.z) - a_eye;
+    dist[i] = dot(toEye, toEye);
+  }
+
+  a_order.resize(m_instanceBboxes.size());
+  for(uint32_t i = 0; i < a_order.size(); ++i)
+    a_order[i] = i;
+  std::sort(a_order.begin(), a_order.end(), [&dist](uint32_t a, uint32_t b) { return dist[a] < dist[b]; });
+}
+
+VkPipelineVertexInputStateCreateInfo SceneManager::GetPositionOnlyVertexInputStateCreateInfo()
+{
+  m_positionBinding.binding   = 0;
+  m_positionBinding.stride    = m_geoPosBuf != VK_NULL_HANDLE ? static_cast<uint32_t>(3 * sizeof(float))
+                                                              : static_cast<uint32_t>(m_pMeshData->SingleVertexSize());
+  m_positionBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+  m_positionAttribute.location = 0;
+  m_positionAttribute.binding  = 0;
+  m_positionAttribute.format   = VK_FORMAT_R32G32B32_SFLOAT;
+  m_positionAttribute.offset   = 0;
+
+  VkPipelineVertexInputStateCreateInfo vertexInput = {};
+  vertexInput.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInput.vertexBindingDescriptionCount   = 1;
+  vertexInput.pVertexBindingDescriptions      = &m_positionBinding;
+  vertexInput.vertexAttributeDescriptionCount = 1;
+  vertexInput.pVertexAttributeDescriptions    = &m_positionAttribute;
+  return vertexInput;
 }
 
 void SceneManager::MarkInstance(const uint32_t instId)
@@ -213,17 +405,36 @@ void SceneManager::UnmarkInstance(const uint32_t instId)
 
 void SceneManager::LoadGeoDataOnGPU()
 {
+  PROFILE_FUNCTION();
   VkDeviceSize vertexBufSize = m_pMeshData->VertexDataSize();
   VkDeviceSize indexBufSize  = m_pMeshData->IndexDataSize();
   VkDeviceSize infoBufSize   = m_meshInfos.size() * sizeof(uint32_t) * 2;
+  VkDeviceSize matricesSize  = std::max<size_t>(m_instanceMatrices.size(), 1) * sizeof(LiteMath::float4x4);
+  VkDeviceSize lightsSize    = std::max<size_t>(m_lights.size(), 1) * sizeof(PointLight);
 
   m_geoVertBuf  = vk_utils::createBuffer(m_device, vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
   m_geoIdxBuf   = vk_utils::createBuffer(m_device, indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
   m_meshInfoBuf = vk_utils::createBuffer(m_device, infoBufSize,   VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_instanceMatricesBuffer = vk_utils::createBuffer(m_device, matricesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_lightsBuffer = vk_utils::createBuffer(m_device, lightsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+
+  std::vector<VkBuffer> buffers = {m_geoVertBuf, m_geoIdxBuf, m_meshInfoBuf, m_instanceMatricesBuffer, m_lightsBuffer};
 
-  VkMemoryAllocateFlags allocFlags {};
+  // first 3 floats of every interleaved vertex, packed
+  std::vector<float> positions;
+  if(m_positionStream && m_totalVertices != 0)
+  {
+    const uint32_t stride = GetVertexStride();
+    const float   *vertex = m_pMeshData->VertexData();
+    positions.resize(size_t(m_totalVertices) * 3);
+    for(size_t i = 0; i < m_totalVertices; ++i, vertex += stride)
+      std::copy(vertex, vertex + 3, positions.data() + i * 3);
+
+    m_geoPosBuf = vk_utils::createBuffer(m_device, positions.size() * sizeof(float), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    buffers.push_back(m_geoPosBuf);
+  }
 
-  m_geoMemAlloc = vk_utils::allocateAndBindWithPadding(m_device, m_physDevice, {m_geoVertBuf, m_geoIdxBuf, m_meshInfoBuf}, allocFlags);
+  m_geoAlloc = m_pAllocator->AllocateForBuffers(buffers, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
   std::vector<LiteMath::uint2> mesh_info_tmp;
   for(const auto& m : m_meshInfos)
@@ -231,10 +442,18 @@ void SceneManager::LoadGeoDataOnGPU()
     mesh_info_tmp.emplace_back(m.m_indexOffset, m.m_vertexOffset);
   }
 
-  m_pCopyHelper->UpdateBuffer(m_geoVertBuf, 0, m_pMeshData->VertexData(), vertexBufSize);
-  m_pCopyHelper->UpdateBuffer(m_geoIdxBuf,  0, m_pMeshData->IndexData(), indexBufSize);
+  // one submission for all geometry, commands submitted to the graphics queue after Flush() see the data
+  m_pUploader->UploadBuffer(m_geoVertBuf, 0, m_pMeshData->VertexData(), vertexBufSize);
+  m_pUploader->UploadBuffer(m_geoIdxBuf,  0, m_pMeshData->IndexData(), indexBufSize);
+  if(!positions.empty())
+    m_pUploader->UploadBuffer(m_geoPosBuf, 0, positions.data(), positions.size() * sizeof(float));
   if(!mesh_info_tmp.empty())
-    m_pCopyHelper->UpdateBuffer(m_meshInfoBuf,  0, mesh_info_tmp.data(), mesh_info_tmp.size() * sizeof(mesh_info_tmp[0]));
+    m_pUploader->UploadBuffer(m_meshInfoBuf, 0, mesh_info_tmp.data(), mesh_info_tmp.size() * sizeof(mesh_info_tmp[0]));
+  if(!m_instanceMatrices.empty())
+    m_pUploader->UploadBuffer(m_instanceMatricesBuffer, 0, m_instanceMatrices.data(), m_instanceMatrices.size() * sizeof(m_instanceMatrices[0]));
+  if(!m_lights.empty())
+    m_pUploader->UploadBuffer(m_lightsBuffer, 0, m_lights.data(), m_lights.size() * sizeof(m_lights[0]));
+  m_geoUploadToken = m_pUploader->Flush();
 }
 
 void SceneManager::DrawMarkedInstances()
@@ -244,12 +463,21 @@ void SceneManager::DrawMarkedInstances()
 
 void SceneManager::DestroyScene()
 {
+  // copies into the buffers may still be running if the scene is destroyed right after loading
+  m_pUploader->Wait(m_geoUploadToken);
+
   if(m_geoVertBuf != VK_NULL_HANDLE)
   {
     vkDestroyBuffer(m_device, m_geoVertBuf, nullptr);
     m_geoVertBuf = VK_NULL_HANDLE;
   }
 
+  if(m_geoPosBuf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_geoPosBuf, nullptr);
+    m_geoPosBuf = VK_NULL_HANDLE;
+  }
+
   if(m_geoIdxBuf != VK_NULL_HANDLE)
   {
     vkDestroyBuffer(m_device, m_geoIdxBuf, nullptr);
@@ -268,16 +496,17 @@ void SceneManager::DestroyScene()
     m_instanceMatricesBuffer = VK_NULL_HANDLE;
   }
 
-  if(m_geoMemAlloc != VK_NULL_HANDLE)
+  if(m_lightsBuffer != VK_NULL_HANDLE)
   {
-    vkFreeMemory(m_device, m_geoMemAlloc, nullptr);
-    m_geoMemAlloc = VK_NULL_HANDLE;
+    vkDestroyBuffer(m_device, m_lightsBuffer, nullptr);
+    m_lightsBuffer = VK_NULL_HANDLE;
   }
 
-  m_pCopyHelper = nullptr;
+  m_pAllocator->Free(m_geoAlloc);
 
   m_meshInfos.clear();
   m_pMeshData = nullptr;
   m_instanceInfos.clear();
   m_instanceMatrices.clear();
+  m_lights.clear();
 }
\ No newline at end of file
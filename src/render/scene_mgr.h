@@ -5,9 +5,10 @@
 
 #include <geom/vk_mesh.h>
 #include "LiteMath.h"
-#include <vk_copy.h>
 
 #include "../loader_utils/hydraxml.h"
+#include "device_allocator.h"
+#include "async_uploader.h"
 #include "../resources/shaders/common.h"
 
 struct InstanceInfo
@@ -16,22 +17,36 @@ struct InstanceInfo
   uint32_t mesh_id = 0u;
   VkDeviceSize instBufOffset = 0u;
   bool renderMark = false;
+  bool dirty = false;  ///!< moved by SetInstanceMatrix() since the last ClearDirtyFlags()
 };
 
 struct SceneManager
 {
   SceneManager(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_transferQId, uint32_t a_graphicsQId,
-    bool debug = false);
+    bool debug = false, std::shared_ptr<DeviceAllocator> a_pAllocator = nullptr);
   ~SceneManager() { DestroyScene(); }
 
   bool LoadSceneXML(const std::string &scenePath, bool transpose = true);
   void LoadSingleTriangle();
+  // grid of box buildings of random height on a ground plane, a dense scene for occlusion culling;
+  // camera 0 looks across the blocks from the street level
+  void GenerateCity(uint32_t a_blocksPerSide = 48, uint32_t a_seed = 1);
 
   uint32_t AddMeshFromFile(const std::string& meshPath);
   uint32_t AddMeshFromData(cmesh::SimpleMesh &meshData);
 
   uint32_t InstanceMesh(uint32_t meshId, const LiteMath::float4x4 &matrix, bool markForRender = true);
 
+  // moves the instance and marks it dirty, caches built from instance transforms (i.e. shadow maps) check the flags;
+  // only the CPU copy is changed, the render updates GetInstanceMatricesBuffer() in its command buffer if it uses it;
+  // scene bbox grows to include the new instance bbox but never shrinks
+  void SetInstanceMatrix(uint32_t instId, const LiteMath::float4x4 &matrix);
+  void ClearDirtyFlags();
+
+  // radius of influence of the light is where its inverse square falloff drops below LIGHT_CUTOFF
+  uint32_t AddPointLight(const LiteMath::float3 &a_pos, const LiteMath::float3 &a_intensity);
+  static constexpr float LIGHT_CUTOFF = 0.05f;
+
   void MarkInstance(uint32_t instId);
   void UnmarkInstance(uint32_t instId);
 
@@ -40,14 +55,34 @@ struct SceneManager
   void DestroyScene();
 
   VkPipelineVertexInputStateCreateInfo GetPipelineVertexInputStateCreateInfo() { return m_pMeshData->VertexInputLayout();}
+  // position (location 0, vec3) is the only attribute, for depth-only passes drawn from GetPositionBuffer();
+  // the layout depends on the position stream of the loaded scene, so pipelines are made after loading
+  VkPipelineVertexInputStateCreateInfo GetPositionOnlyVertexInputStateCreateInfo();
+
+  // positions are also uploaded as a separate tightly packed stream (12 bytes per vertex instead of the whole vertex),
+  // so depth-only passes fetch less; applies to scenes loaded after the call
+  void SetPositionStream(bool a_enable) { m_positionStream = a_enable; }
 
   VkBuffer GetVertexBuffer() const { return m_geoVertBuf; }
+  VkBuffer GetPositionBuffer() const { return m_geoPosBuf != VK_NULL_HANDLE ? m_geoPosBuf : m_geoVertBuf; } ///!< for the position-only layout
   VkBuffer GetIndexBuffer()  const { return m_geoIdxBuf; }
   VkBuffer GetMeshInfoBuffer()  const { return m_meshInfoBuf; }
-  std::shared_ptr<vk_utils::ICopyEngine> GetCopyHelper() { return  m_pCopyHelper; }
+  VkBuffer GetInstanceMatricesBuffer() const { return m_instanceMatricesBuffer; } ///!< storage buffer, float4x4 per instance
+  VkBuffer GetLightsBuffer() const { return m_lightsBuffer; } ///!< storage buffer, PointLight per light
+  std::shared_ptr<AsyncUploader> GetUploader() { return m_pUploader; }
+
+  // CPU copy of the geometry which is on the GPU, i.e. for software rasterization; vertices are interleaved,
+  // the first 3 floats of a vertex are its position, indices of a mesh are relative to its m_vertexOffset
+  const float*    GetVertexData()   const { return m_pMeshData->VertexData(); }
+  const uint32_t* GetIndexData()    const { return m_pMeshData->IndexData(); }
+  uint32_t        GetVertexStride() const { return uint32_t(m_pMeshData->SingleVertexSize() / sizeof(float)); } ///!< in floats
+  std::shared_ptr<DeviceAllocator> GetAllocator() { return m_pAllocator; }
 
   uint32_t MeshesNum() const {return (uint32_t)m_meshInfos.size();}
   uint32_t InstancesNum() const {return (uint32_t)m_instanceInfos.size();}
+  uint32_t LightsNum() const {return (uint32_t)m_lights.size();}
+
+  static constexpr const char* GENERATED_CITY = "generated:city"; ///!< scene "path" the samples replace with GenerateCity()
 
   hydra_xml::Camera GetCamera(uint32_t camId) const;
   MeshInfo GetMeshInfo(uint32_t meshId) const {assert(meshId < m_meshInfos.size()); return m_meshInfos[meshId];}
@@ -56,18 +91,27 @@ struct SceneManager
   LiteMath::Box4f GetInstanceBbox(uint32_t instId) const {assert(instId < m_instanceBboxes.size()); return m_instanceBboxes[instId];}
   LiteMath::float4x4 GetInstanceMatrix(uint32_t instId) const {assert(instId < m_instanceMatrices.size()); return m_instanceMatrices[instId];}
   LiteMath::Box4f GetSceneBbox() const {return sceneBbox;}
+  PointLight GetLight(uint32_t lightId) const {assert(lightId < m_lights.size()); return m_lights[lightId];}
+
+  // ids of all instances by distance from a_eye to their bbox centers, nearest first
+  void SortInstancesFrontToBack(const LiteMath::float3 &a_eye, std::vector<uint32_t> &a_order) const;
 
 private:
   void LoadGeoDataOnGPU();
+  static LiteMath::Box4f TransformBox(const LiteMath::Box4f &a_box, const LiteMath::float4x4 &a_matrix);
 
   std::vector<MeshInfo> m_meshInfos = {};
   std::vector<LiteMath::Box4f> m_meshBboxes = {};
   std::shared_ptr<IMeshData> m_pMeshData = nullptr;
+  VkVertexInputBindingDescription   m_positionBinding   = {}; ///!< referenced by GetPositionOnlyVertexInputStateCreateInfo()
+  VkVertexInputAttributeDescription m_positionAttribute = {};
 
   std::vector<InstanceInfo> m_instanceInfos = {};
   std::vector<LiteMath::Box4f> m_instanceBboxes = {};
   std::vector<LiteMath::float4x4> m_instanceMatrices = {};
 
+  std::vector<PointLight> m_lights = {};
+
   std::vector<hydra_xml::Camera> m_sceneCameras = {};
   LiteMath::Box4f sceneBbox;
 
@@ -75,10 +119,12 @@ private:
   uint32_t m_totalIndices  = 0u;
 
   VkBuffer m_geoVertBuf = VK_NULL_HANDLE;
+  VkBuffer m_geoPosBuf  = VK_NULL_HANDLE;  ///!< float3 per vertex, only with the position stream
   VkBuffer m_geoIdxBuf  = VK_NULL_HANDLE;
   VkBuffer m_meshInfoBuf  = VK_NULL_HANDLE;
   VkBuffer m_instanceMatricesBuffer = VK_NULL_HANDLE;
-  VkDeviceMemory m_geoMemAlloc = VK_NULL_HANDLE;
+  VkBuffer m_lightsBuffer = VK_NULL_HANDLE;
+  DeviceAllocation m_geoAlloc;
 
   VkDevice m_device = VK_NULL_HANDLE;
   VkPhysicalDevice m_physDevice = VK_NULL_HANDLE;
@@ -87,8 +133,11 @@ private:
 
   uint32_t m_graphicsQId = UINT32_MAX;
   VkQueue m_graphicsQ = VK_NULL_HANDLE;
-  std::shared_ptr<vk_utils::ICopyEngine> m_pCopyHelper;
+  std::shared_ptr<DeviceAllocator> m_pAllocator; ///!< shared with the render if it passes one
+  std::shared_ptr<AsyncUploader> m_pUploader;
+  AsyncUploader::Token m_geoUploadToken = 0;
 
+  bool m_positionStream = false;
   bool m_debug = false;
   // for debugging
   struct Vertex
@@ -0,0 +1,388 @@
+#include "shader_reloader.h"
+#include "../utils/profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+
+#ifdef USE_SHADERC
+#include <shaderc/shaderc.hpp>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+  constexpr auto WATCH_PERIOD = std::chrono::milliseconds(250);
+
+#ifdef USE_SHADERC
+  std::string readText(const fs::path &a_path)
+  {
+    std::ifstream in(a_path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+  }
+
+  // resolves #include "file" relative to the including file, like glslangValidator does
+  class FileIncluder : public shaderc::CompileOptions::IncluderInterface
+  {
+    struct IncludeData
+    {
+      std::string name;
+      std::string content;
+    };
+
+  public:
+    shaderc_include_result* GetInclude(const char* a_requested, shaderc_include_type a_type,
+                                       const char* a_requesting, size_t) override
+    {
+      const fs::path path = a_type == shaderc_include_type_relative ? fs::path(a_requesting).parent_path() / a_requested
+                                                                    : fs::path(a_requested);
+      auto* data = new IncludeData;
+      std::error_code err;
+      if(fs::exists(path, err))
+      {
+        data->name    = path.string();
+        data->content = readText(path);
+      }
+      else
+        data->content = "can't open include file " + path.string(); // empty name reports an error to shaderc
+
+      auto* result = new shaderc_include_result;
+      result->source_name        = data->name.c_str();
+      result->source_name_length = data->name.size();
+      result->content            = data->content.c_str();
+      result->content_length     = data->content.size();
+      result->user_data          = data;
+      return result;
+    }
+
+    void ReleaseInclude(shaderc_include_result* a_result) override
+    {
+      delete static_cast<IncludeData*>(a_result->user_data);
+      delete a_result;
+    }
+  };
+
+  bool shaderKindFromExtension(const fs::path &a_path, shaderc_shader_kind &a_kind)
+  {
+    static const std::unordered_map<std::string, shaderc_shader_kind> kinds = {
+      {".vert", shaderc_vertex_shader},          {".frag", shaderc_fragment_shader},
+      {".comp", shaderc_compute_shader},         {".geom", shaderc_geometry_shader},
+      {".tesc", shaderc_tess_control_shader},    {".tese", shaderc_tess_evaluation_shader}};
+
+    auto it = kinds.find(a_path.extension().string());
+    if(it == kinds.end())
+      return false;
+    a_kind = it->second;
+    return true;
+  }
+#endif
+}
+
+ShaderReloader::ShaderReloader(VkDevice a_device, std::shared_ptr<DeletionQueue> a_pDeletionQueue)
+  : m_device(a_device), m_pDeletionQueue(std::move(a_pDeletionQueue))
+{
+  m_worker = std::thread(&ShaderReloader::WorkerLoop, this);
+}
+
+ShaderReloader::~ShaderReloader()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stop = true;
+  }
+  m_wake.notify_one();
+  if(m_worker.joinable())
+    m_worker.join();
+
+  // never used by GPU
+  for(const auto &ready : m_ready)
+    vkDestroyPipeline(m_device, ready.pipeline, nullptr);
+}
+
+void ShaderReloader::WatchPipeline(VkPipeline* a_target, std::vector<std::string> a_sources, BuildFunc a_build)
+{
+  WatchedPipeline watched;
+  watched.target    = a_target;
+  watched.sources   = std::move(a_sources);
+  watched.build     = std::move(a_build);
+  watched.builtFrom = NewestSpirv(watched.sources);
+
+  std::lock_guard<std::mutex> lock(m_lock);
+  watched.generation = ++m_generation;
+
+  auto it = std::find_if(m_watched.begin(), m_watched.end(),
+                         [a_target](const WatchedPipeline &w) { return w.target == a_target; });
+  if(it != m_watched.end())
+    *it = std::move(watched);
+  else
+    m_watched.push_back(std::move(watched));
+}
+
+void ShaderReloader::RequestReload()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_reloadRequested = true;
+  }
+  m_wake.notify_one();
+}
+
+void ShaderReloader::SetWatchFiles(bool a_watch)
+{
+  m_watchFiles = a_watch;
+  m_wake.notify_one();
+}
+
+std::string ShaderReloader::Status() const
+{
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_status;
+}
+
+void ShaderReloader::SetStatus(std::string a_status)
+{
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_status = std::move(a_status);
+}
+
+void ShaderReloader::ApplyReloaded()
+{
+  PROFILE_FUNCTION();
+  std::lock_guard<std::mutex> lock(m_lock);
+  for(const auto &ready : m_ready)
+  {
+    auto it = std::find_if(m_watched.begin(), m_watched.end(), [&ready](const WatchedPipeline &w) {
+      return w.target == ready.target && w.generation == ready.generation;
+    });
+
+    // pipeline was registered again (i.e. recreated by the render) while this one was being built
+    if(it == m_watched.end())
+    {
+      vkDestroyPipeline(m_device, ready.pipeline, nullptr);
+      continue;
+    }
+
+    // submitted command buffers may still reference the old pipeline
+    m_pDeletionQueue->PushPipeline(m_device, *ready.target);
+    *ready.target = ready.pipeline;
+  }
+  m_ready.clear();
+}
+
+void ShaderReloader::WorkerLoop()
+{
+  PROFILE_THREAD_NAME("ShaderReloader");
+  std::unique_lock<std::mutex> lock(m_lock);
+  while(!m_stop)
+  {
+    m_wake.wait_for(lock, WATCH_PERIOD, [this] { return m_stop || m_reloadRequested; });
+    if(m_stop)
+      break;
+    if(!m_reloadRequested && !m_watchFiles)
+      continue;
+
+    m_reloadRequested = false;
+    lock.unlock();
+    CheckSources();
+    lock.lock();
+  }
+}
+
+void ShaderReloader::CheckSources()
+{
+  PROFILE_FUNCTION();
+  std::vector<WatchedPipeline> watched;
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    watched = m_watched;
+  }
+
+  std::vector<std::string> sources;
+  for(const auto &w : watched)
+  {
+    for(const auto &source : w.sources)
+    {
+      if(std::find(sources.begin(), sources.end(), source) == sources.end())
+        sources.push_back(source);
+    }
+  }
+
+  // recompile sources which are older than any of their dependencies
+  //
+  for(const auto &source : sources)
+  {
+    std::vector<fs::path> deps = {source};
+    CollectIncludes(source, deps);
+
+    std::error_code err;
+    FileTime newest = FileTime::min();
+    for(const auto &dep : deps)
+    {
+      const auto time = fs::last_write_time(dep, err);
+      if(!err)
+        newest = std::max(newest, time);
+    }
+
+    const auto spvTime = fs::last_write_time(source + ".spv", err);
+    if(!err && spvTime >= newest)
+      continue;
+
+    auto failed = m_failed.find(source);
+    if(failed != m_failed.end() && failed->second == newest)
+      continue;
+
+    std::string log;
+    if(Compile(source, log))
+    {
+      m_failed.erase(source);
+      std::cout << "[ShaderReloader] compiled " << source << std::endl;
+    }
+    else
+    {
+      m_failed[source] = newest;
+      std::cout << "[ShaderReloader] failed to compile " << source << ":\n" << log << std::endl;
+      SetStatus("failed to compile " + source + ", old pipeline is kept");
+    }
+  }
+
+  // rebuild pipelines which use updated SPIR-V
+  //
+  uint32_t rebuilt = 0;
+  for(const auto &w : watched)
+  {
+    const FileTime spvTime = NewestSpirv(w.sources);
+    if(spvTime <= w.builtFrom)
+      continue;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    {
+      PROFILE_SCOPE("BuildPipeline");
+      std::lock_guard<std::mutex> pause(m_buildLock);
+      pipeline = w.build();
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = std::find_if(m_watched.begin(), m_watched.end(), [&w](const WatchedPipeline &current) {
+      return current.target == w.target && current.generation == w.generation;
+    });
+
+    // registered again meanwhile, new registration was created from the current SPIR-V anyway
+    if(it == m_watched.end())
+    {
+      vkDestroyPipeline(m_device, pipeline, nullptr);
+      continue;
+    }
+
+    it->builtFrom = spvTime;
+    if(pipeline != VK_NULL_HANDLE)
+    {
+      m_ready.push_back({w.target, pipeline, w.generation});
+      rebuilt++;
+    }
+  }
+
+  if(rebuilt != 0)
+    SetStatus("reloaded " + std::to_string(rebuilt) + " pipeline(s)");
+}
+
+bool ShaderReloader::Compile(const std::string &a_source, std::string &a_log) const
+{
+  PROFILE_FUNCTION();
+  const std::string spvPath = a_source + ".spv";
+  const std::string tmpPath = spvPath + ".tmp";
+
+#ifdef USE_SHADERC
+  shaderc_shader_kind kind;
+  if(!shaderKindFromExtension(a_source, kind))
+  {
+    a_log = "unknown shader stage";
+    return false;
+  }
+
+  shaderc::CompileOptions options;
+  options.SetIncluder(std::make_unique<FileIncluder>());
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_1);
+
+  shaderc::Compiler compiler;
+  const auto result = compiler.CompileGlslToSpv(readText(a_source), kind, a_source.c_str(), options);
+  if(result.GetCompilationStatus() != shaderc_compilation_status_success)
+  {
+    a_log = result.GetErrorMessage();
+    return false;
+  }
+
+  {
+    const std::vector<uint32_t> spirv(result.cbegin(), result.cend());
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(spirv.data()), std::streamsize(spirv.size() * sizeof(uint32_t)));
+    if(!out.good())
+    {
+      a_log = "can't write " + tmpPath;
+      return false;
+    }
+  }
+#else
+  const std::string cmd = "glslangValidator -V \"" + a_source + "\" -o \"" + tmpPath + "\"";
+  const int ret = std::system(cmd.c_str());
+  if(ret != 0)
+  {
+    std::error_code err;
+    fs::remove(tmpPath, err);
+    a_log = "glslangValidator returned " + std::to_string(ret) + ", see its output above";
+    return false;
+  }
+#endif
+
+  // the render thread may load .spv at any moment (i.e. on texture reload), so it is replaced at once
+  std::error_code err;
+  fs::rename(tmpPath, spvPath, err);
+  if(err)
+  {
+    a_log = "can't replace " + spvPath + ": " + err.message();
+    return false;
+  }
+  return true;
+}
+
+void ShaderReloader::CollectIncludes(const fs::path &a_file, std::vector<fs::path> &a_deps) const
+{
+  static const std::regex includeRegex(R"(^\s*#\s*include\s*["<]([^">]+)[">])");
+
+  std::ifstream in(a_file);
+  std::string line;
+  while(std::getline(in, line))
+  {
+    std::smatch match;
+    if(!std::regex_search(line, match, includeRegex))
+      continue;
+
+    // files which are not found near the shader (like <LiteMath.h> in common.h) are only seen by C++ code
+    const fs::path dep = a_file.parent_path() / match[1].str();
+    std::error_code err;
+    if(!fs::exists(dep, err) || std::find(a_deps.begin(), a_deps.end(), dep) != a_deps.end())
+      continue;
+
+    a_deps.push_back(dep);
+    CollectIncludes(dep, a_deps);
+  }
+}
+
+ShaderReloader::FileTime ShaderReloader::NewestSpirv(const std::vector<std::string> &a_sources) const
+{
+  FileTime newest = FileTime::min();
+  for(const auto &source : a_sources)
+  {
+    std::error_code err;
+    const auto time = fs::last_write_time(source + ".spv", err);
+    if(!err)
+      newest = std::max(newest, time);
+  }
+  return newest;
+}
@@ -0,0 +1,104 @@
+#ifndef VK_GRAPHICS_BASIC_SHADER_RELOADER_H
+#define VK_GRAPHICS_BASIC_SHADER_RELOADER_H
+
+#include "volk.h"
+#include "deletion_queue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+\brief Recompiles changed GLSL shaders on a background thread and rebuilds only the pipelines which use them.
+
+  Every pipeline is registered with GLSL sources it is made of and a function which creates it from their SPIR-V.
+  A source is out of date when it or any file it #includes (recursively, i.e. common.h and unpack_attributes.h)
+  is newer than its .spv. Both compilation and pipeline creation happen on the worker thread, so rendering goes on
+  meanwhile; new pipelines are swapped in by ApplyReloaded() at the frame boundary and old ones go to the render's
+  deletion queue.
+
+  With USE_SHADERC shaders are compiled in-process by shaderc, otherwise the worker runs glslangValidator.
+*/
+class ShaderReloader
+{
+public:
+  using BuildFunc = std::function<VkPipeline()>;
+
+  ShaderReloader(VkDevice a_device, std::shared_ptr<DeletionQueue> a_pDeletionQueue);
+  ~ShaderReloader();
+
+  ShaderReloader(const ShaderReloader &) = delete;
+  ShaderReloader &operator=(const ShaderReloader &) = delete;
+
+  // a_target is the pipeline handle which is replaced on reload, a_sources are paths to GLSL files (without .spv);
+  // registering the same a_target again replaces the old registration and drops pipelines built by it;
+  // a_build is called on the worker thread, so state it reads must be changed only under PauseBuilds()
+  void WatchPipeline(VkPipeline* a_target, std::vector<std::string> a_sources, BuildFunc a_build);
+
+  void RequestReload();                 // check sources once, i.e. on key press
+  void SetWatchFiles(bool a_watch);     // check sources periodically
+  bool IsWatchingFiles() const { return m_watchFiles; }
+
+  // call on the render thread once per frame before command buffer is recorded
+  void ApplyReloaded();
+
+  // the worker does not build pipelines while returned lock is held
+  std::unique_lock<std::mutex> PauseBuilds() { return std::unique_lock<std::mutex>(m_buildLock); }
+
+  std::string Status() const;
+
+private:
+  using FileTime = std::filesystem::file_time_type;
+
+  struct WatchedPipeline
+  {
+    VkPipeline*              target = nullptr;
+    std::vector<std::string> sources;
+    BuildFunc                build;
+    uint32_t                 generation = 0;
+    FileTime                 builtFrom;  // the newest .spv the pipeline was created from
+  };
+
+  struct ReadyPipeline
+  {
+    VkPipeline* target;
+    VkPipeline  pipeline;
+    uint32_t    generation;
+  };
+
+  void WorkerLoop();
+  void CheckSources();
+  bool Compile(const std::string &a_source, std::string &a_log) const;
+  void CollectIncludes(const std::filesystem::path &a_file, std::vector<std::filesystem::path> &a_deps) const;
+  FileTime NewestSpirv(const std::vector<std::string> &a_sources) const;
+  void SetStatus(std::string a_status);
+
+  VkDevice                       m_device = VK_NULL_HANDLE;
+  std::shared_ptr<DeletionQueue> m_pDeletionQueue;
+
+  // worker thread only: the newest dependency time of sources which failed to compile, not to repeat the same errors
+  std::unordered_map<std::string, FileTime> m_failed;
+
+  // guarded by m_lock
+  std::vector<WatchedPipeline> m_watched;
+  std::vector<ReadyPipeline>   m_ready;
+  uint32_t    m_generation      = 0;
+  bool        m_reloadRequested = false;
+  bool        m_stop            = false;
+  std::string m_status;
+
+  mutable std::mutex      m_lock;
+  std::mutex              m_buildLock;
+  std::condition_variable m_wake;
+  std::atomic<bool>       m_watchFiles {false};
+  std::thread             m_worker;
+};
+
+#endif// VK_GRAPHICS_BASIC_SHADER_RELOADER_H
@@ -0,0 +1,321 @@
+#include "shadow_atlas.h"
+#include "../utils/profiler.h"
+#include "utils/Camera.h"
+
+#include <vk_utils.h>
+#include <vk_buffers.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static_assert((SHADOW_ATLAS_SIZE >> 5) == SHADOW_TILE_MIN, "ShadowAtlas::LEVELS must reach SHADOW_TILE_MIN");
+
+// faces in the order shaders select them by the major axis of the direction from the light: +X, -X, +Y, -Y, +Z, -Z
+static const LiteMath::float3 FACE_DIRS[6] = {{+1, 0, 0}, {-1, 0, 0}, {0, +1, 0}, {0, -1, 0}, {0, 0, +1}, {0, 0, -1}};
+static const LiteMath::float3 FACE_UPS [6] = {{0, 1, 0}, {0, 1, 0}, {0, 0, 1}, {0, 0, -1}, {0, 1, 0}, {0, 1, 0}};
+
+static bool sphereIntersectsBox(const LiteMath::float4 &a_sphere, const LiteMath::Box4f &a_box)
+{
+  const LiteMath::float3 center  = LiteMath::to_float3(a_sphere);
+  const LiteMath::float3 closest = LiteMath::clamp(center, LiteMath::to_float3(a_box.boxMin), LiteMath::to_float3(a_box.boxMax));
+  const LiteMath::float3 d       = closest - center;
+  return dot(d, d) <= a_sphere.w * a_sphere.w;
+}
+
+ShadowAtlas::ShadowAtlas(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator) :
+  m_device(a_device), m_pAllocator(std::move(a_pAllocator))
+{
+  m_viewsBuf   = vk_utils::createBuffer(m_device, VkDeviceSize(6 * MAX_SHADOWED_LIGHTS) * sizeof(ShadowView),
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_viewsAlloc = m_pAllocator->AllocateForBuffers({m_viewsBuf}, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  ResetAllocator();
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+  for(auto buffer : {m_viewsBuf, m_lightViewsBuf})
+  {
+    if(buffer != VK_NULL_HANDLE)
+      vkDestroyBuffer(m_device, buffer, nullptr);
+  }
+  m_pAllocator->Free(m_viewsAlloc);
+  m_pAllocator->Free(m_lightViewsAlloc);
+}
+
+void ShadowAtlas::SetScene(const SceneManager &a_scene)
+{
+  PROFILE_FUNCTION();
+  m_lights.resize(a_scene.LightsNum());
+  for(uint32_t i = 0; i < a_scene.LightsNum(); ++i)
+    m_lights[i] = a_scene.GetLight(i);
+  m_lightViews.assign(m_lights.size(), NO_SHADOW);
+  m_renderViews.clear();
+  m_views.clear();
+  m_prevDynamicCasters.clear();
+  ResetAllocator();
+
+  if(m_lightViewsBuf != VK_NULL_HANDLE)
+    vkDestroyBuffer(m_device, m_lightViewsBuf, nullptr);
+  m_pAllocator->Free(m_lightViewsAlloc);
+  const VkDeviceSize size = VkDeviceSize(std::max<size_t>(m_lights.size(), 1)) * sizeof(uint32_t);
+  m_lightViewsBuf   = vk_utils::createBuffer(m_device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_lightViewsAlloc = m_pAllocator->AllocateForBuffers({m_lightViewsBuf}, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  std::cout << "[ShadowAtlas] " << SHADOW_ATLAS_SIZE << "x" << SHADOW_ATLAS_SIZE << " atlas, up to "
+            << MAX_SHADOWED_LIGHTS << " of " << m_lights.size() << " point lights are shadowed" << std::endl;
+}
+
+void ShadowAtlas::Invalidate()
+{
+  for(auto &tiles : m_tiles)
+    tiles.second.valid = false;
+}
+
+void ShadowAtlas::ResetAllocator()
+{
+  m_tiles.clear();
+  m_freeBlocks.assign(LEVELS, {});
+  m_freeBlocks[0].push_back(LiteMath::uint2(0, 0));
+}
+
+// a block of the level is taken from its free list or made by splitting a block of the level above into four
+bool ShadowAtlas::AllocateBlock(uint32_t a_level, LiteMath::uint2 &a_origin)
+{
+  auto &freeBlocks = m_freeBlocks[a_level];
+  if(!freeBlocks.empty())
+  {
+    a_origin = freeBlocks.back();
+    freeBlocks.pop_back();
+    return true;
+  }
+
+  LiteMath::uint2 parent;
+  if(a_level == 0 || !AllocateBlock(a_level - 1, parent))
+    return false;
+  const uint32_t size = SHADOW_ATLAS_SIZE >> a_level;
+  freeBlocks.push_back(parent + LiteMath::uint2(size, 0));
+  freeBlocks.push_back(parent + LiteMath::uint2(0, size));
+  freeBlocks.push_back(parent + LiteMath::uint2(size, size));
+  a_origin = parent;
+  return true;
+}
+
+// a freed block whose three siblings are free is merged with them back into the parent block
+void ShadowAtlas::FreeBlock(uint32_t a_level, LiteMath::uint2 a_origin)
+{
+  auto &freeBlocks = m_freeBlocks[a_level];
+  if(a_level == 0)
+  {
+    freeBlocks.push_back(a_origin);
+    return;
+  }
+
+  const uint32_t        size   = SHADOW_ATLAS_SIZE >> a_level;
+  const LiteMath::uint2 parent = LiteMath::uint2(a_origin.x & ~(2 * size - 1), a_origin.y & ~(2 * size - 1));
+  uint32_t siblings = 0;
+  for(const auto &block : freeBlocks)
+    siblings += (block.x & ~(2 * size - 1)) == parent.x && (block.y & ~(2 * size - 1)) == parent.y ? 1 : 0;
+  if(siblings < 3)
+  {
+    freeBlocks.push_back(a_origin);
+    return;
+  }
+
+  freeBlocks.erase(std::remove_if(freeBlocks.begin(), freeBlocks.end(), [parent, size](const LiteMath::uint2 &block) {
+    return (block.x & ~(2 * size - 1)) == parent.x && (block.y & ~(2 * size - 1)) == parent.y;
+  }), freeBlocks.end());
+  FreeBlock(a_level - 1, parent);
+}
+
+bool ShadowAtlas::AllocateTiles(uint32_t a_level, Tiles &a_tiles)
+{
+  for(uint32_t face = 0; face < 6; ++face)
+  {
+    if(AllocateBlock(a_level, a_tiles.origins[face]))
+      continue;
+    for(uint32_t allocated = 0; allocated < face; ++allocated)
+      FreeBlock(a_level, a_tiles.origins[allocated]);
+    return false;
+  }
+  a_tiles.level = a_level;
+  a_tiles.valid = false;
+  return true;
+}
+
+void ShadowAtlas::FreeTiles(const Tiles &a_tiles)
+{
+  for(const auto &origin : a_tiles.origins)
+    FreeBlock(a_tiles.level, origin);
+}
+
+// only lights which are not shadowed in the current frame are evicted
+bool ShadowAtlas::EvictLeastRecent()
+{
+  auto oldest = m_tiles.end();
+  for(auto it = m_tiles.begin(); it != m_tiles.end(); ++it)
+  {
+    if(it->second.lastUsed != m_frame && (oldest == m_tiles.end() || it->second.lastUsed < oldest->second.lastUsed))
+      oldest = it;
+  }
+  if(oldest == m_tiles.end())
+    return false;
+  FreeTiles(oldest->second);
+  m_tiles.erase(oldest);
+  return true;
+}
+
+void ShadowAtlas::Update(const LiteMath::float3 &a_camPos, const LiteMath::float4x4 &a_viewProj, uint32_t a_screenHeight,
+                         const std::vector<LiteMath::Box4f> &a_dynamicCasters)
+{
+  PROFILE_FUNCTION();
+  m_frame++;
+  m_views.clear();
+  m_renderViews.clear();
+  m_lightViews.assign(m_lights.size(), NO_SHADOW);
+  m_shadowedLights = 0;
+  if(!m_enabled)
+  {
+    Invalidate(); // casters may move while nothing is drawn
+    m_prevDynamicCasters = a_dynamicCasters;
+    return;
+  }
+
+  //// tiles of every light reached by dynamic casters are stale, also of lights which are not shadowed in this
+  //// frame: a caster may leave the light while it is out of view and the tiles must not keep its shadow
+  //
+  for(auto &[light, tiles] : m_tiles)
+  {
+    const LiteMath::float4 sphere = m_lights[light].posAndRadius;
+    auto reaches = [&sphere](const LiteMath::Box4f &box) { return sphereIntersectsBox(sphere, box); };
+    tiles.valid  = tiles.valid && std::none_of(a_dynamicCasters.begin(), a_dynamicCasters.end(), reaches) &&
+                   std::none_of(m_prevDynamicCasters.begin(), m_prevDynamicCasters.end(), reaches);
+  }
+
+  //// lights which intersect the view frustum, the larger they are on screen the more important
+  //
+  LiteMath::float4 rows[4];
+  for(uint32_t i = 0; i < 4; ++i)
+    rows[i] = LiteMath::float4(a_viewProj(i, 0), a_viewProj(i, 1), a_viewProj(i, 2), a_viewProj(i, 3));
+  const LiteMath::float4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1],
+                                      rows[2], rows[3] - rows[2]};
+
+  std::vector<std::pair<float, uint32_t> > candidates;
+  for(uint32_t i = 0; i < m_lights.size(); ++i)
+  {
+    const LiteMath::float4 sphere = m_lights[i].posAndRadius;
+    const LiteMath::float3 center = LiteMath::to_float3(sphere);
+    const bool visible = std::all_of(planes, planes + 6, [&](const LiteMath::float4 &plane) {
+      return dot(LiteMath::to_float3(plane), center) + plane.w >= -sphere.w * length(LiteMath::to_float3(plane));
+    });
+    if(!visible || sphere.w <= 0.0f)
+      continue;
+    const float dist = length(center - a_camPos);
+    candidates.emplace_back(dist > sphere.w ? sphere.w / dist : 1.0f, i);
+  }
+  const size_t shadowed = std::min<size_t>(candidates.size(), MAX_SHADOWED_LIGHTS);
+  std::partial_sort(candidates.begin(), candidates.begin() + shadowed, candidates.end(),
+                    [](const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) { return a.first > b.first; });
+  candidates.resize(shadowed);
+
+  // tiles of the chosen lights are not evicted while others are allocated
+  for(const auto &candidate : candidates)
+  {
+    auto it = m_tiles.find(candidate.second);
+    if(it != m_tiles.end())
+      it->second.lastUsed = m_frame;
+  }
+
+  //// a tile should have about as many texels as the light sphere covers pixels on screen
+  //
+  for(const auto &candidate : candidates)
+  {
+    const float    wanted = std::clamp(candidate.first * float(a_screenHeight), float(SHADOW_TILE_MIN), float(SHADOW_TILE_MAX));
+    const uint32_t level  = std::min(uint32_t(std::floor(std::log2(float(SHADOW_ATLAS_SIZE) / wanted))), LEVELS - 1);
+
+    auto it = m_tiles.find(candidate.second);
+    if(it != m_tiles.end() && it->second.level + 1 >= level && it->second.level <= level + 1)
+      continue;
+    if(it != m_tiles.end())
+    {
+      FreeTiles(it->second);
+      m_tiles.erase(it);
+    }
+
+    Tiles tiles;
+    bool  allocated = false;
+    for(uint32_t l = level; l < LEVELS && !allocated; ++l)
+    {
+      while(!(allocated = AllocateTiles(l, tiles)) && EvictLeastRecent()) {}
+    }
+    if(!allocated)
+      continue;
+    tiles.lastUsed = m_frame;
+    m_tiles[candidate.second] = tiles;
+  }
+
+  //// views of the shadowed lights, faces of invalid tiles are drawn
+  //
+  for(const auto &candidate : candidates)
+  {
+    auto it = m_tiles.find(candidate.second);
+    if(it == m_tiles.end())
+      continue;
+    Tiles &tiles = it->second;
+
+    const LiteMath::float4 sphere = m_lights[candidate.second].posAndRadius;
+    const LiteMath::float3 center = LiteMath::to_float3(sphere);
+
+    const float    zNear = std::max(sphere.w * 0.01f, 0.01f);
+    const auto     proj  = OpenglToVulkanProjectionMatrixFix() * projectionMatrix(90.0f, 1.0f, zNear, sphere.w);
+    const uint32_t size  = SHADOW_ATLAS_SIZE >> tiles.level;
+
+    m_lightViews[candidate.second] = uint32_t(m_views.size());
+    for(uint32_t face = 0; face < 6; ++face)
+    {
+      ShadowView view;
+      view.viewProj = proj * LiteMath::lookAt(center, center + FACE_DIRS[face], FACE_UPS[face]);
+      view.rect     = LiteMath::float4(float(tiles.origins[face].x), float(tiles.origins[face].y), float(size), float(size)) /
+                      float(SHADOW_ATLAS_SIZE);
+      m_views.push_back(view);
+
+      if(tiles.valid)
+        continue;
+      RenderView render;
+      render.viewProj = view.viewProj;
+      render.rect     = VkRect2D{VkOffset2D{int32_t(tiles.origins[face].x), int32_t(tiles.origins[face].y)}, VkExtent2D{size, size}};
+      m_renderViews.push_back(render);
+    }
+    tiles.valid = true;
+    m_shadowedLights++;
+  }
+  m_prevDynamicCasters = a_dynamicCasters;
+}
+
+void ShadowAtlas::CmdUpdateBuffers(VkCommandBuffer a_cmdBuff)
+{
+  PROFILE_FUNCTION();
+  if(m_lightViewsBuf == VK_NULL_HANDLE)
+    return;
+
+  // the previous frame may still shade with the buffers
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                       0, nullptr, 0, nullptr, 0, nullptr);
+  if(!m_views.empty())
+    vkCmdUpdateBuffer(a_cmdBuff, m_viewsBuf, 0, m_views.size() * sizeof(ShadowView), m_views.data());
+
+  // vkCmdUpdateBuffer is limited to 64 KB
+  constexpr size_t CHUNK = 65536 / sizeof(uint32_t);
+  for(size_t first = 0; first < m_lightViews.size(); first += CHUNK)
+  {
+    const size_t count = std::min(CHUNK, m_lightViews.size() - first);
+    vkCmdUpdateBuffer(a_cmdBuff, m_lightViewsBuf, first * sizeof(uint32_t), count * sizeof(uint32_t), m_lightViews.data() + first);
+  }
+
+  VkMemoryBarrier barrier = {};
+  barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
@@ -0,0 +1,109 @@
+#ifndef VK_GRAPHICS_BASIC_SHADOW_ATLAS_H
+#define VK_GRAPHICS_BASIC_SHADOW_ATLAS_H
+
+#include "volk.h"
+#include "device_allocator.h"
+#include "scene_mgr.h"
+#include "../../resources/shaders/common.h"
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+/**
+\brief Shadows of scene point lights: cube faces of the most important lights are tiles of one SHADOW_ATLAS_SIZE depth texture.
+
+  Every frame Update() rates the lights which intersect the view frustum by their projected size on screen and gives
+  up to MAX_SHADOWED_LIGHTS of them six square tiles (a tile per cube face) of a power of two size between
+  SHADOW_TILE_MIN and SHADOW_TILE_MAX. Tiles are allocated from a quadtree of free blocks, freed blocks merge back
+  with their siblings. A light keeps its tiles while the size it needs stays within a factor of two of them; if the
+  atlas is full, lights which were not shadowed in this frame are evicted, least recently used first, and only then
+  the light gets smaller tiles.
+
+  Tile content stays valid between frames: GetRenderViews() lists only the faces which must be drawn in this frame,
+  those of new tiles, of lights reached by dynamic casters and all of them after Invalidate(). They are meant to be
+  drawn in one render pass with a viewport and scissor per view.
+
+  Shaders read GetViewsBuffer() (ShadowView per face of the shadowed lights, six faces of a light go in a row) and
+  GetLightViewsBuffer() (index of the first face per scene light, NO_SHADOW if the light is not shadowed).
+*/
+class ShadowAtlas
+{
+public:
+  struct RenderView
+  {
+    LiteMath::float4x4 viewProj;
+    VkRect2D           rect;   ///!< tile in the atlas, in texels
+  };
+
+  ShadowAtlas(VkDevice a_device, std::shared_ptr<DeviceAllocator> a_pAllocator);
+  ~ShadowAtlas();
+
+  ShadowAtlas(const ShadowAtlas &) = delete;
+  ShadowAtlas &operator=(const ShadowAtlas &) = delete;
+
+  // lights of the scene are copied, frames which use the previous light views buffer must be finished
+  void SetScene(const SceneManager &a_scene);
+
+  // if disabled, no light is shadowed and nothing is drawn
+  void SetEnabled(bool a_enabled) { m_enabled = a_enabled; }
+  bool Enabled() const { return m_enabled; }
+
+  // content of all tiles is lost, for example the atlas image was recreated or a static caster moved
+  void Invalidate();
+
+  // picks shadowed lights and their tiles for the main view a_viewProj, a_screenHeight is in pixels;
+  // tiles of lights which reach any of a_dynamicCasters (world space boxes) in this or the previous frame are redrawn,
+  // lights which are not shadowed in this frame get them redrawn when they are shadowed again
+  void Update(const LiteMath::float3 &a_camPos, const LiteMath::float4x4 &a_viewProj, uint32_t a_screenHeight,
+              const std::vector<LiteMath::Box4f> &a_dynamicCasters);
+
+  // outside of a render pass, results of the last Update() are visible to fragment shaders afterwards
+  void CmdUpdateBuffers(VkCommandBuffer a_cmdBuff);
+
+  const std::vector<RenderView> &GetRenderViews() const { return m_renderViews; }
+  uint32_t ShadowedLights() const { return m_shadowedLights; }
+
+  VkBuffer GetViewsBuffer()      const { return m_viewsBuf; }       ///!< ShadowView per face, 6 * MAX_SHADOWED_LIGHTS
+  VkBuffer GetLightViewsBuffer() const { return m_lightViewsBuf; }  ///!< uint per scene light
+
+private:
+  static constexpr uint32_t LEVELS = 6;  ///!< blocks of level l are SHADOW_ATLAS_SIZE >> l texels, down to SHADOW_TILE_MIN
+
+  struct Tiles
+  {
+    uint32_t        level    = 0;
+    LiteMath::uint2 origins[6];
+    uint64_t        lastUsed = 0;
+    bool            valid    = false; ///!< drawn since allocated or invalidated
+  };
+
+  bool AllocateBlock(uint32_t a_level, LiteMath::uint2 &a_origin);
+  void FreeBlock(uint32_t a_level, LiteMath::uint2 a_origin);
+  bool AllocateTiles(uint32_t a_level, Tiles &a_tiles);
+  void FreeTiles(const Tiles &a_tiles);
+  bool EvictLeastRecent();
+  void ResetAllocator();
+
+  VkDevice                         m_device = VK_NULL_HANDLE;
+  std::shared_ptr<DeviceAllocator> m_pAllocator;
+  bool                             m_enabled = true;
+
+  std::vector<PointLight>                   m_lights;
+  std::vector<std::vector<LiteMath::uint2>> m_freeBlocks;  ///!< origins of free blocks per level
+  std::unordered_map<uint32_t, Tiles>       m_tiles;       ///!< by light index
+  uint64_t                                  m_frame = 0;
+  std::vector<LiteMath::Box4f>              m_prevDynamicCasters;
+
+  std::vector<ShadowView> m_views;            ///!< of the shadowed lights of the frame
+  std::vector<uint32_t>   m_lightViews;
+  std::vector<RenderView> m_renderViews;
+  uint32_t                m_shadowedLights = 0;
+
+  VkBuffer         m_viewsBuf      = VK_NULL_HANDLE;
+  VkBuffer         m_lightViewsBuf = VK_NULL_HANDLE;
+  DeviceAllocation m_viewsAlloc;
+  DeviceAllocation m_lightViewsAlloc;
+};
+
+#endif// VK_GRAPHICS_BASIC_SHADOW_ATLAS_H
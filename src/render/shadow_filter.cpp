@@ -0,0 +1,106 @@
+#include "shadow_filter.h"
+#include "pipeline_builder.h"
+#include "../utils/profiler.h"
+
+#include <vk_utils.h>
+
+bool ShadowFilter::EnableFeatures(VkPhysicalDevice a_physDevice, VkPhysicalDeviceFeatures &a_features)
+{
+  VkPhysicalDeviceFeatures supported = {};
+  vkGetPhysicalDeviceFeatures(a_physDevice, &supported);
+
+  if(!supported.shaderStorageImageExtendedFormats)
+    return false;
+
+  // linear filtering of 32 bit float formats is optional
+  VkFormatProperties props = {};
+  vkGetPhysicalDeviceFormatProperties(a_physDevice, MOMENTS_FORMAT, &props);
+  const VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  if((props.optimalTilingFeatures & needed) != needed)
+    return false;
+  a_features.shaderStorageImageExtendedFormats = VK_TRUE;
+  return true;
+}
+
+ShadowFilter::ShadowFilter(VkDevice a_device, PipelineCache &a_cache) : m_device(a_device), m_cache(a_cache)
+{
+  m_sampler = vk_utils::createSampler(m_device, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+}
+
+ShadowFilter::~ShadowFilter()
+{
+  DestroyPipeline();
+  m_pBindings = nullptr;
+  vkDestroySampler(m_device, m_sampler, nullptr);
+}
+
+void ShadowFilter::SetImages(VkImageView a_depth, VkImageView a_rows, VkImageView a_moments, VkExtent2D a_extent)
+{
+  PROFILE_FUNCTION();
+  DestroyPipeline();
+  m_extent = a_extent;
+
+  std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2},
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          2}
+  };
+  m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 2);
+
+  m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+  m_pBindings->BindImage(0, a_depth, m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  m_pBindings->BindImage(1, a_rows, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_IMAGE_LAYOUT_GENERAL);
+  m_pBindings->BindEnd(&m_rowsDS, &m_dsLayout);
+
+  m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+  m_pBindings->BindImage(0, a_rows, m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  m_pBindings->BindImage(1, a_moments, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_IMAGE_LAYOUT_GENERAL);
+  m_pBindings->BindEnd(&m_columnsDS, &m_dsLayout);
+
+  m_pipeline = PipelineBuilder::BuildCompute(m_device, m_cache, "../resources/shaders/shadow_blur.comp.spv",
+                                             m_dsLayout, sizeof(BlurPushConst), &m_layout);
+}
+
+void ShadowFilter::DestroyPipeline()
+{
+  if(m_pipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+  if(m_layout != VK_NULL_HANDLE)
+    vkDestroyPipelineLayout(m_device, m_layout, nullptr);
+  m_pipeline = VK_NULL_HANDLE;
+  m_layout   = VK_NULL_HANDLE;
+}
+
+void ShadowFilter::CmdBlurRows(VkCommandBuffer a_cmdBuff, uint32_t a_layers)
+{
+  PROFILE_FUNCTION();
+  CmdBlur(a_cmdBuff, m_rowsDS, true, a_layers);
+}
+
+void ShadowFilter::CmdBlurColumns(VkCommandBuffer a_cmdBuff, uint32_t a_layers)
+{
+  PROFILE_FUNCTION();
+  CmdBlur(a_cmdBuff, m_columnsDS, false, a_layers);
+}
+
+// a workgroup per SHADOW_BLUR_GROUP texels of a row (or a column) of a layer
+void ShadowFilter::CmdBlur(VkCommandBuffer a_cmdBuff, VkDescriptorSet a_set, bool a_rows, uint32_t a_layers)
+{
+  if(m_pipeline == VK_NULL_HANDLE || a_layers == 0)
+    return;
+
+  BlurPushConst pushConst = {};
+  pushConst.size[0]   = int32_t(m_extent.width);
+  pushConst.size[1]   = int32_t(m_extent.height);
+  pushConst.axis[0]   = a_rows ? 1 : 0;
+  pushConst.axis[1]   = a_rows ? 0 : 1;
+  pushConst.fromDepth = a_rows ? 1u : 0u;
+
+  const uint32_t along  = a_rows ? m_extent.width : m_extent.height;
+  const uint32_t across = a_rows ? m_extent.height : m_extent.width;
+
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_layout, 0, 1, &a_set, 0, nullptr);
+  vkCmdPushConstants(a_cmdBuff, m_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConst), &pushConst);
+  vkCmdDispatch(a_cmdBuff, (along + SHADOW_BLUR_GROUP - 1) / SHADOW_BLUR_GROUP, across, a_layers);
+}
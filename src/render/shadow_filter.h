@@ -0,0 +1,69 @@
+#ifndef VK_GRAPHICS_BASIC_SHADOW_FILTER_H
+#define VK_GRAPHICS_BASIC_SHADOW_FILTER_H
+
+#include "volk.h"
+#include "pipeline_cache.h"
+#include "../../resources/shaders/common.h"
+#include <vk_descriptor_sets.h>
+
+#include <memory>
+
+/**
+\brief Variance shadow maps: moments of a layered depth shadow map are blurred by a separable gaussian in compute.
+
+  CmdBlurRows() reads depth d of the shadow map and writes (d, d^2) blurred along rows to the rows image,
+  CmdBlurColumns() blurs it along columns to the moments image. A workgroup loads SHADOW_BLUR_GROUP texels of a row
+  (or a column) and SHADOW_BLUR_RADIUS more on both sides to shared memory once and every invocation sums its taps
+  from there, so the cost depends on the shadow map size only. Shaders then get a soft shadow from one filtered
+  fetch of the moments with Chebyshev's inequality.
+
+  Images are expected in the layouts the render graph gives them: depth and the rows image are sampled
+  (SHADER_READ_ONLY_OPTIMAL) by the pass which reads them, the written image is in GENERAL.
+*/
+class ShadowFilter
+{
+public:
+  static constexpr VkFormat MOMENTS_FORMAT = VK_FORMAT_R32G32_SFLOAT;
+
+  // rg32f storage images need shaderStorageImageExtendedFormats, shaders fetch the moments with a linear filter;
+  // returns false if the device has no such feature or the format can't be written or filtered
+  static bool EnableFeatures(VkPhysicalDevice a_physDevice, VkPhysicalDeviceFeatures &a_features);
+
+  ShadowFilter(VkDevice a_device, PipelineCache &a_cache);
+  ~ShadowFilter();
+
+  ShadowFilter(const ShadowFilter &) = delete;
+  ShadowFilter &operator=(const ShadowFilter &) = delete;
+
+  // layered views of the same extent, frames which use the previous ones must be finished
+  void SetImages(VkImageView a_depth, VkImageView a_rows, VkImageView a_moments, VkExtent2D a_extent);
+
+  // outside of a render pass, only the first a_layers layers are filtered
+  void CmdBlurRows(VkCommandBuffer a_cmdBuff, uint32_t a_layers);
+  void CmdBlurColumns(VkCommandBuffer a_cmdBuff, uint32_t a_layers);
+
+private:
+  struct BlurPushConst
+  {
+    int32_t  size[2];
+    int32_t  axis[2];
+    uint32_t fromDepth;
+  };
+
+  void CmdBlur(VkCommandBuffer a_cmdBuff, VkDescriptorSet a_set, bool a_rows, uint32_t a_layers);
+  void DestroyPipeline();
+
+  VkDevice       m_device = VK_NULL_HANDLE;
+  PipelineCache &m_cache;
+  VkSampler      m_sampler = VK_NULL_HANDLE;
+  VkExtent2D     m_extent  = {};
+
+  std::shared_ptr<vk_utils::DescriptorMaker> m_pBindings;
+  VkDescriptorSet       m_rowsDS    = VK_NULL_HANDLE;  ///!< depth -> rows
+  VkDescriptorSet       m_columnsDS = VK_NULL_HANDLE;  ///!< rows -> moments
+  VkDescriptorSetLayout m_dsLayout  = VK_NULL_HANDLE;
+  VkPipelineLayout      m_layout    = VK_NULL_HANDLE;
+  VkPipeline            m_pipeline  = VK_NULL_HANDLE;
+};
+
+#endif// VK_GRAPHICS_BASIC_SHADOW_FILTER_H
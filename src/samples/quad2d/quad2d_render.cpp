@@ -1,5 +1,6 @@
 #include "quad2d_render.h"
 #include "utils/input_definitions.h"
+#include "utils/profiler.h"
 
 #include <geom/vk_mesh.h>
 #include <vk_pipeline.h>
@@ -59,7 +60,9 @@ void Quad2D_Render::InitVulkan(const char** a_instanceExtensions, uint32_t a_ins
     VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
   }
   
-  m_pCopyHelper = std::make_shared<vk_utils::SimpleCopyHelper>(m_physicalDevice, m_device, m_transferQueue, m_queueFamilyIDXs.graphics, 8*1024*1024);
+  m_pAllocator = std::make_shared<DeviceAllocator>(m_device, m_physicalDevice);
+  m_pUploader  = std::make_unique<AsyncUploader>(m_device, m_pAllocator, m_transferQueue, m_queueFamilyIDXs.transfer,
+                                                 m_graphicsQueue, m_queueFamilyIDXs.graphics, 8 * 1024 * 1024);
 }
 
 void Quad2D_Render::InitPresentation(VkSurfaceKHR &a_surface, bool)
@@ -142,6 +145,7 @@ void Quad2D_Render::SetupSimplePipeline()
 
 void Quad2D_Render::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff, VkImageView a_targetImageView)
 {
+  PROFILE_FUNCTION();
   vkResetCommandBuffer(a_cmdBuff, 0);
 
   VkCommandBufferBeginInfo beginInfo = {};
@@ -192,10 +196,6 @@ void Quad2D_Render::CleanupPipelineAndSwapchain()
     vkDestroyFence(m_device, m_frameFences[i], nullptr);
   }
 
-  vkDestroyImageView(m_device, m_imageData.view, nullptr);
-  vkDestroyImage(m_device, m_imageData.image, nullptr);
-  vkFreeMemory(m_device, m_imageData.mem, nullptr);
-
   for (size_t i = 0; i < m_frameBuffers.size(); i++)
   {
     vkDestroyFramebuffer(m_device, m_frameBuffers[i], nullptr);
@@ -244,6 +244,15 @@ void Quad2D_Render::Cleanup()
   m_pFSQuad     = nullptr; // smartptr delete it's resources
   CleanupPipelineAndSwapchain();
 
+  m_pUploader = nullptr;  // waits for uploads still in flight
+
+  // texture is not size dependent, so it lives until the end
+  vkDestroyImageView(m_device, m_imageData.view, nullptr);
+  vkDestroyImage(m_device, m_imageData.image, nullptr);
+  if(m_pAllocator != nullptr)
+    m_pAllocator->Free(m_imageAlloc);
+  m_pAllocator = nullptr;
+
 
   if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
     vkDestroySemaphore(m_device, m_presentationResources.imageAvailable, nullptr);
@@ -265,6 +274,7 @@ void Quad2D_Render::ProcessInput(const AppInput &input)
   // recreate pipeline to reload shaders
   if(input.keyPressed[GLFW_KEY_B])
   {
+    PROFILE_SCOPE("ShaderReload");
 #ifdef WIN32
     std::system("cd ../resources/shaders && python compile_quad_render_shaders.py");
 #else
@@ -333,11 +343,13 @@ static std::vector<unsigned> LoadBMP(const char* filename, unsigned* pW, unsigne
 
 void Quad2D_Render::LoadScene(const char*, bool)
 {
+  PROFILE_FUNCTION();
   uint32_t texW, texH;
   auto texData = LoadBMP("../resources/textures/texture1.bmp", &texW, &texH);
   
-  m_imageData    = vk_utils::allocateColorTextureFromDataLDR(m_device, m_physicalDevice, (const unsigned char*)texData.data(), texW, texH, 1, VK_FORMAT_R8G8B8A8_UNORM,
-                                                             m_pCopyHelper, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  m_imageData    = createTextureFromDataLDR(*m_pAllocator, *m_pUploader, (const unsigned char*)texData.data(), texW, texH,
+                                            VK_FORMAT_R8G8B8A8_UNORM, m_imageAlloc, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+  m_pUploader->Flush();
 
   m_imageSampler = vk_utils::createSampler(m_device, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT);
 
@@ -349,6 +361,7 @@ void Quad2D_Render::LoadScene(const char*, bool)
 
 void Quad2D_Render::DrawFrameSimple()
 {
+  PROFILE_FUNCTION();
   vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
   vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
 
@@ -395,5 +408,6 @@ void Quad2D_Render::DrawFrameSimple()
 
 void Quad2D_Render::DrawFrame(float, DrawMode)
 {
+  PROFILE_FUNCTION();
   DrawFrameSimple();
 }
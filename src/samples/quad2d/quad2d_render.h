@@ -3,13 +3,14 @@
 
 #define VK_NO_PROTOTYPES
 #include "../../render/render_common.h"
+#include "../../render/device_allocator.h"
+#include "../../render/async_uploader.h"
 #include "../resources/shaders/common.h"
 #include <vk_descriptor_sets.h>
 #include <vk_fbuf_attachment.h>
 #include <vk_images.h>
 #include <vk_swapchain.h>
 #include <vk_quad.h>
-#include <vk_copy.h>
 
 #include <string>
 #include <iostream>
@@ -98,13 +99,15 @@ private:
 
   bool m_enableValidation;
   std::vector<const char*> m_validationLayers;
-  std::shared_ptr<vk_utils::ICopyEngine> m_pCopyHelper;
+  std::shared_ptr<DeviceAllocator> m_pAllocator;
+  std::unique_ptr<AsyncUploader>   m_pUploader;
 
   std::shared_ptr<vk_utils::IQuad> m_pFSQuad;
   VkDescriptorSet       m_quadDS; 
   VkDescriptorSetLayout m_quadDSLayout = nullptr;
  
   vk_utils::VulkanImageMem m_imageData;
+  DeviceAllocation         m_imageAlloc;
   VkSampler                m_imageSampler;
 
   void DrawFrameSimple();
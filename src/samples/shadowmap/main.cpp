@@ -1,5 +1,9 @@
 #include "shadowmap_render.h"
 #include "utils/glfw_window.h"
+#include "utils/headless_loop.h"
+#include "utils/benchmark.h"
+
+#include <chrono>
 
 void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int deviceID)
 {
@@ -23,24 +27,96 @@ void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int devic
   }
 }
 
-int main()
+int main(int argc, const char** argv)
 {
   constexpr int WIDTH = 1024;
   constexpr int HEIGHT = 1024;
   constexpr int VULKAN_DEVICE_ID = 0;
 
-  std::shared_ptr<IRender> app = std::make_unique<SimpleShadowmapRender>(WIDTH, HEIGHT);
+  // time from launch to the loaded scene, compare cold and warm pipeline cache with it
+  const auto startupBegin = std::chrono::steady_clock::now();
+  auto printStartupTime = [&startupBegin]() {
+    std::cout << "Startup time: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count()
+              << " ms" << std::endl;
+  };
+
+  // --headless [--frames N] [--save-every N] [--out dir] : render without window, i.e. on machines with no display
+  auto params = readCommandLineParams(argc, argv);
+  const bool headless = params.count("--headless") != 0;
+
+  // --benchmark camera_path.cpath [--results file.json] [--label name] [--timestep sec] [--warmup N] : replay camera path
+  BenchmarkParams benchParams;
+  bool benchmark = false;
+  if(!readBenchmarkParams(params, benchParams, benchmark))
+    return 1;
+
+  // --scene path.xml|city : hydra scene or the generated city, a dense scene for occlusion culling
+  std::string scenePath = "../resources/scenes/043_cornell_normals/statex_00001.xml";
+  if(params.count("--scene"))
+    scenePath = params["--scene"] == "city" ? SceneManager::GENERATED_CITY : params["--scene"];
+
+  // --culling off|gpu|cpu : GPU Hi-Z or CPU software occlusion culling of the main view, GPU by default
+  auto cullingMode = SimpleShadowmapRender::CullingMode::GPU;
+  if(params.count("--culling"))
+  {
+    const std::string mode = params["--culling"];
+    cullingMode = mode == "off" ? SimpleShadowmapRender::CullingMode::OFF :
+                  mode == "cpu" ? SimpleShadowmapRender::CullingMode::CPU : SimpleShadowmapRender::CullingMode::GPU;
+  }
+
+  auto render = std::make_shared<SimpleShadowmapRender>(WIDTH, HEIGHT);
+  std::shared_ptr<IRender> app = render;
   if(app == nullptr)
   {
     std::cout << "Can't create render of specified type" << std::endl;
     return 1;
   }
 
+  // [--frames-in-flight N] [--present-mode fifo|mailbox] [--fps-limit F] : latency versus throughput
+  app->SetFramePacing(readFramePacingParams(params));
+
+  // --depth-prepass : depth-only pass before the main one, 'Z' toggles it at runtime
+  app->SetDepthPrepass(params.count("--depth-prepass") != 0);
+
+  // --caster-culling off : shadow passes draw every instance, 'G' toggles it at runtime
+  render->SetCasterCulling(!(params.count("--caster-culling") && params["--caster-culling"] == "off"));
+
+  // --shadow-filter vsm : soft shadows from blurred variance shadow maps, 'V' toggles them at runtime
+  render->SetVarianceShadows(params.count("--shadow-filter") && params["--shadow-filter"] == "vsm");
+
+  if(headless)
+  {
+    HeadlessParams headlessParams;
+    uint32_t framesNum = 1000u;
+    if(!readUintParam(params, "--save-every", headlessParams.saveEveryNthFrame) ||
+       !readUintParam(params, "--frames", framesNum))
+      return 1;
+    if(params.count("--out"))
+      headlessParams.outputDir = params["--out"];
+
+    app->InitVulkan(nullptr, 0, VULKAN_DEVICE_ID);
+    app->InitPresentationHeadless(headlessParams);
+    app->LoadScene(scenePath.c_str(), false);
+    render->SetCullingMode(cullingMode);
+    printStartupTime();
+
+    if(benchmark)
+      return runCameraPathBenchmark(app, benchParams) ? 0 : 1;
+
+    mainLoopHeadless(app, framesNum);
+    return 0;
+  }
+
   auto* window = initWindow(WIDTH, HEIGHT);
 
   initVulkanGLFW(app, window, VULKAN_DEVICE_ID);
 
-  app->LoadScene("../resources/scenes/043_cornell_normals/statex_00001.xml", false);
+  app->LoadScene(scenePath.c_str(), false);
+  render->SetCullingMode(cullingMode);
+  printStartupTime();
+
+  if(benchmark)
+    return runCameraPathBenchmark(app, benchParams, [] { glfwPollEvents(); }) ? 0 : 1;
 
   mainLoop(app, window);
 
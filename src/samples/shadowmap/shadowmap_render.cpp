@@ -1,9 +1,35 @@
 #include "shadowmap_render.h"
 #include "../../utils/input_definitions.h"
+#include "../../utils/profiler.h"
 
 #include <geom/vk_mesh.h>
 #include <vk_pipeline.h>
 #include <vk_buffers.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+
+// main view depth range, also bounds the slices of clustered lighting
+constexpr float CAMERA_Z_NEAR = 0.1f;
+constexpr float CAMERA_Z_FAR  = 1000.0f;
+
+// 1 - logarithmic cascade splits, 0 - uniform ones
+constexpr float CASCADE_SPLIT_LAMBDA = 0.9f;
+
+// variance shadow maps: variance is clamped against depth quantization, the lowest part of the Chebyshev bound is
+// cut off as light bleeding where shadows of several casters overlap
+constexpr float VSM_MIN_VARIANCE       = 2e-5f;
+constexpr float VSM_BLEEDING_REDUCTION = 0.2f;
+
+static float3 boxCorner(const LiteMath::Box4f &a_box, uint32_t a_corner)
+{
+  return float3((a_corner & 1) == 0 ? a_box.boxMin.x : a_box.boxMax.x,
+                (a_corner & 2) == 0 ? a_box.boxMin.y : a_box.boxMax.y,
+                (a_corner & 4) == 0 ? a_box.boxMin.z : a_box.boxMax.z);
+}
 
 SimpleShadowmapRender::SimpleShadowmapRender(uint32_t a_width, uint32_t a_height) : m_width(a_width), m_height(a_height)
 {
@@ -17,6 +43,8 @@ SimpleShadowmapRender::SimpleShadowmapRender(uint32_t a_width, uint32_t a_height
 void SimpleShadowmapRender::SetupDeviceFeatures()
 {
   // m_enabledDeviceFeatures.fillModeNonSolid = VK_TRUE;
+  m_cullingSupported = OcclusionCuller::EnableFeatures(m_physicalDevice, m_enabledDeviceFeatures);
+  m_shadowFilterSupported = ShadowFilter::EnableFeatures(m_physicalDevice, m_enabledDeviceFeatures);
 }
 
 void SimpleShadowmapRender::SetupDeviceExtensions()
@@ -47,78 +75,388 @@ void SimpleShadowmapRender::InitVulkan(const char** a_instanceExtensions, uint32
 
   m_commandPool = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-  m_cmdBuffersDrawMain.reserve(m_framesInFlight);
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
+  m_framesInFlight = m_framePacer.Params().framesInFlight;
+  CreateFrameResources();
 
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
-  {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
+  m_pPipelineCache  = std::make_unique<PipelineCache>(m_device, m_physicalDevice);
+  m_pDeletionQueue  = std::make_shared<DeletionQueue>(m_framesInFlight);
+  m_pShaderReloader = std::make_unique<ShaderReloader>(m_device, m_pDeletionQueue);
+
+  m_pAllocator = std::make_shared<DeviceAllocator>(m_device, m_physicalDevice);
+  m_pScnMgr = std::make_shared<SceneManager>(m_device, m_physicalDevice, m_queueFamilyIDXs.transfer, m_queueFamilyIDXs.graphics, false, m_pAllocator);
+  m_pScnMgr->SetPositionStream(true); // depth pre-pass and shadow passes
 
-  m_pScnMgr = std::make_shared<SceneManager>(m_device, m_physicalDevice, m_queueFamilyIDXs.transfer, m_queueFamilyIDXs.graphics, false);
+  if(m_cullingSupported)
+    m_pCuller = std::make_unique<OcclusionCuller>(m_device, m_pAllocator, *m_pPipelineCache, m_enabledDeviceFeatures);
+  else
+    std::cout << "[SimpleShadowmapRender] drawIndirectFirstInstance is not supported, GPU occlusion culling is disabled" << std::endl;
+  m_pCpuCuller = std::make_unique<CpuOcclusionCuller>();
+  m_pLighting  = std::make_unique<ClusteredLighting>(m_device, m_pAllocator, *m_pPipelineCache);
+  m_pShadowAtlas = std::make_unique<ShadowAtlas>(m_device, m_pAllocator);
+  if(m_shadowFilterSupported)
+    m_pShadowFilter = std::make_unique<ShadowFilter>(m_device, *m_pPipelineCache);
+  else
+    std::cout << "[SimpleShadowmapRender] rg32f storage images with linear filtering are not supported, variance shadow maps are disabled" << std::endl;
 }
 
 void SimpleShadowmapRender::InitPresentation(VkSurfaceKHR &a_surface, bool)
 {
   m_surface = a_surface;
 
+  m_framePacer.QuerySupportedModes(m_physicalDevice, m_surface);
   m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface,
-                                                              m_width, m_height, m_framesInFlight, m_vsync);
+                                                              m_width, m_height, m_framesInFlight, m_framePacer.VSync());
   m_presentationResources.currentFrame = 0;
+  CreatePresentSemaphores();
 
-  VkSemaphoreCreateInfo semaphoreInfo = {};
-  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable));
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished));
+  SetupRenderGraph(m_swapchain.GetFormat(), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+}
 
-  std::vector<VkFormat> depthFormats = {
-    VK_FORMAT_D32_SFLOAT,
-    VK_FORMAT_D32_SFLOAT_S8_UINT,
-    VK_FORMAT_D24_UNORM_S8_UINT,
-    VK_FORMAT_D16_UNORM_S8_UINT,
-    VK_FORMAT_D16_UNORM
-  };
-  vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &m_depthBuffer.format);
-  m_screenRenderPass = vk_utils::createDefaultRenderPass(m_device, m_swapchain.GetFormat(), m_depthBuffer.format);
-  m_depthBuffer  = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
-  m_frameBuffers = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
-  
+void SimpleShadowmapRender::InitPresentationHeadless(const HeadlessParams &a_params)
+{
+  m_headlessParams = a_params;
+  m_headlessFrame  = 0;
+
+  // saved frames and benchmark results should not depend on how fast previous frames were
+  auto drsParams    = m_dynamicResolution.GetParams();
+  drsParams.enabled = false;
+  m_dynamicResolution.SetParams(drsParams);
+
+  m_pHeadless = std::make_unique<HeadlessTarget>(m_device, m_pAllocator, m_queueFamilyIDXs.graphics,
+                                                 m_width, m_height, m_framesInFlight);
+  m_presentationResources.queue        = m_graphicsQueue;
+  m_presentationResources.currentFrame = 0;
+
+  SetupRenderGraph(m_pHeadless->GetFormat(), HeadlessTarget::FINAL_LAYOUT);
+}
+
+VkImage SimpleShadowmapRender::GetTargetImage(uint32_t a_imageIdx) const
+{
+  return m_pHeadless ? m_pHeadless->GetAttachment(a_imageIdx).image : m_swapchain.GetAttachment(a_imageIdx).image;
+}
+
+VkImageView SimpleShadowmapRender::GetTargetImageView(uint32_t a_imageIdx) const
+{
+  return m_pHeadless ? m_pHeadless->GetAttachment(a_imageIdx).view : m_swapchain.GetAttachment(a_imageIdx).view;
+}
+
+void SimpleShadowmapRender::SetupRenderGraph(VkFormat a_colorFormat, VkImageLayout a_colorLayout)
+{
   // create full screen quad for debug purposes
   // 
   m_pFSQuad = std::make_shared<vk_utils::QuadRenderer>(0,0, 512, 512);
   m_pFSQuad->Create(m_device, "../resources/shaders/quad3_vert.vert.spv", "../resources/shaders/quad.frag.spv", 
-                    vk_utils::RenderTargetInfo2D{ VkExtent2D{ m_width, m_height }, m_swapchain.GetFormat(),                                        // this is debug full scree quad
-                                                  VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR }); // seems we need LOAD_OP_LOAD if we want to draw quad to part of screen
+                    vk_utils::RenderTargetInfo2D{ VkExtent2D{ m_width, m_height }, a_colorFormat,        // this is debug full scree quad
+                                                  VK_ATTACHMENT_LOAD_OP_LOAD, a_colorLayout, a_colorLayout }); // seems we need LOAD_OP_LOAD if we want to draw quad to part of screen
 
-  // create shadow map
+  if(m_shadowMapSampler == VK_NULL_HANDLE)
+    m_shadowMapSampler = vk_utils::createSampler(m_device, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+  if(m_upscaleSampler == VK_NULL_HANDLE)
+    m_upscaleSampler = vk_utils::createSampler(m_device, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+  m_dynamicResolution.SetMaxExtent(VkExtent2D{m_width, m_height});
+
+  // depth is sampled to build the occlusion culling pyramid, so formats with stencil are not used
+  std::vector<VkFormat> depthFormats = {
+    VK_FORMAT_D32_SFLOAT,
+    VK_FORMAT_D16_UNORM
+  };
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+  vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &depthFormat);
+
+  if(m_pRenderGraph == nullptr)
+    m_pRenderGraph = std::make_unique<RenderGraph>(m_device, m_pAllocator);
+  else
+    m_pRenderGraph->Reset();
+  auto &graph = *m_pRenderGraph;
+
+  // shadow map, scene color and screen depth are owned by the graph, swapchain (or headless) image is imported;
+  // scene color and depth have the window size, dynamic resolution only changes the viewport of the main pass
   //
-  m_pShadowMap2 = std::make_shared<vk_utils::RenderTarget>(m_device, VkExtent2D{2048, 2048});
-
-  vk_utils::AttachmentInfo infoDepth;
-  infoDepth.format           = VK_FORMAT_D16_UNORM;
-  infoDepth.usage            = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-  infoDepth.imageSampleCount = VK_SAMPLE_COUNT_1_BIT;
-  m_shadowMapId              = m_pShadowMap2->CreateAttachment(infoDepth);
-  auto memReq                = m_pShadowMap2->GetMemoryRequirements()[0]; // we know that we have only one texture
-  
-  // memory for all shadowmaps (well, if you have them more than 1 ...)
+  m_shadowStatic = graph.CreateImage("shadow_static", {VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE}, VK_FORMAT_D16_UNORM,
+                                                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT, SHADOW_CASCADES, true});
+  m_shadowMap  = graph.CreateImage("shadow_map", {VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE}, VK_FORMAT_D16_UNORM,
+                                                  VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, SHADOW_CASCADES});
+  if(m_pShadowFilter != nullptr)
   {
-    VkMemoryAllocateInfo allocateInfo = {};
-    allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.pNext           = nullptr;
-    allocateInfo.allocationSize  = memReq.size;
-    allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physicalDevice);
+    m_shadowRows    = graph.CreateImage("shadow_rows", {VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE}, ShadowFilter::MOMENTS_FORMAT,
+                                                        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, SHADOW_CASCADES});
+    m_shadowMoments = graph.CreateImage("shadow_moments", {VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE}, ShadowFilter::MOMENTS_FORMAT,
+                                                           VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, SHADOW_CASCADES});
+  }
+  m_shadowAtlas = graph.CreateImage("shadow_atlas", {VkExtent2D{SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE}, VK_FORMAT_D16_UNORM,
+                                                    VK_IMAGE_USAGE_SAMPLED_BIT, 1, true});
+  m_sceneColor = graph.CreateImage("scene_color", {VkExtent2D{m_width, m_height}, a_colorFormat, VK_IMAGE_USAGE_SAMPLED_BIT});
+  auto depth   = graph.CreateImage("depth", {VkExtent2D{m_width, m_height}, depthFormat, 0});
+  m_backbuffer = graph.ImportImage("backbuffer", a_colorFormat, VkExtent2D{m_width, m_height},
+                                   VK_IMAGE_LAYOUT_UNDEFINED, a_colorLayout);
+
+  m_pCpuCuller->SetViewport(VkExtent2D{m_width, m_height});
+  m_cpuOcclusion = graph.CreateImage("cpu_occlusion", {VkExtent2D{m_pCpuCuller->Width(), m_pCpuCuller->Height()},
+                                     VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_TRANSFER_DST_BIT});
 
-    VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, NULL, &m_memShadowMap));
+  VkClearValue clearDepth = {};
+  clearDepth.depthStencil = {1.0f, 0};
+  VkClearValue clearColor = {};
+  clearColor.color = {0.0f, 0.0f, 0.0f, 1.0f};
+
+  //// draw static casters to the shadow cache, a layer per cascade; without cascades only the light camera is drawn
+  //// to layer 0. Cached layers are loaded and left as they are, see CmdUpdateMovedInstances()
+  //
+  for(uint32_t cascade = 0; cascade < SHADOW_CASCADES; ++cascade)
+  {
+    auto pass = graph.AddPass("shadow_static" + std::to_string(cascade), [this, cascade, clearDepth](VkCommandBuffer a_cmdBuff) {
+      if(!m_shadowCache.redraw[cascade])
+        return;
+      VkClearAttachment clear = {};
+      clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+      clear.clearValue = clearDepth;
+      VkClearRect rect = {};
+      rect.rect.extent = VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE};
+      rect.layerCount  = 1;
+      vkCmdClearAttachments(a_cmdBuff, 1, &clear, 1, &rect);
+
+      vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipeline.pipeline);
+      const float4x4 lightMatrix = ShadowMatrix(cascade);
+      DrawInstancesCmd(a_cmdBuff, lightMatrix, CullShadowCasters(lightMatrix, m_shadowCache.staticCasters));
+    }).WriteDepth(m_shadowStatic, VK_ATTACHMENT_LOAD_OP_LOAD, {}, cascade).Id();
+    if(cascade == 0)
+      m_shadowPass = pass;
+  }
+
+  //// shadow map starts as a copy of the cache
+  //
+  graph.AddPass("shadow_copy", [this](VkCommandBuffer a_cmdBuff) {
+    VkImageCopy region    = {};
+    region.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, SHADOW_CASCADES};
+    region.dstSubresource = region.srcSubresource;
+    region.extent         = VkExtent3D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1};
+    vkCmdCopyImage(a_cmdBuff, m_pRenderGraph->GetImage(m_shadowStatic), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   m_pRenderGraph->GetImage(m_shadowMap), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  }).Access(m_shadowStatic, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, false)
+    .Access(m_shadowMap, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, true);
+
+  //// casters which have moved are drawn over the copy every frame
+  //
+  for(uint32_t cascade = 0; cascade < SHADOW_CASCADES; ++cascade)
+  {
+    graph.AddPass("shadow_dynamic" + std::to_string(cascade), [this, cascade](VkCommandBuffer a_cmdBuff) {
+      if(m_shadowCache.dynamicCasters.empty() || (!m_input.cascades && cascade != 0))
+        return;
+      vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipeline.pipeline);
+      const float4x4 lightMatrix = ShadowMatrix(cascade);
+      DrawInstancesCmd(a_cmdBuff, lightMatrix, CullShadowCasters(lightMatrix, m_shadowCache.dynamicCasters));
+    }).WriteDepth(m_shadowMap, VK_ATTACHMENT_LOAD_OP_LOAD, {}, cascade);
+  }
+
+  //// variance shadow maps: moments of the shadow map are blurred along rows, then along columns
+  //
+  if(m_pShadowFilter != nullptr)
+  {
+    graph.AddPass("shadow_blur_rows", [this](VkCommandBuffer a_cmdBuff) {
+      if(VarianceShadowsEnabled())
+        m_pShadowFilter->CmdBlurRows(a_cmdBuff, m_input.cascades ? SHADOW_CASCADES : 1);
+    }).ReadTexture(m_shadowMap, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      .Access(m_shadowRows, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, true);
+
+    graph.AddPass("shadow_blur_columns", [this](VkCommandBuffer a_cmdBuff) {
+      if(VarianceShadowsEnabled())
+        m_pShadowFilter->CmdBlurColumns(a_cmdBuff, m_input.cascades ? SHADOW_CASCADES : 1);
+    }).ReadTexture(m_shadowRows, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      .Access(m_shadowMoments, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, true);
   }
 
-  m_pShadowMap2->CreateViewAndBindMemory(m_memShadowMap, {0});
-  m_pShadowMap2->CreateDefaultSampler();
-  m_pShadowMap2->CreateDefaultRenderPass();
+  //// cube faces of point lights to their atlas tiles, only tiles whose content is not valid anymore are drawn
+  //
+  m_atlasPass = graph.AddPass("shadow_atlas", [this, clearDepth](VkCommandBuffer a_cmdBuff) {
+    const auto &views = m_pShadowAtlas->GetRenderViews();
+    if(views.empty())
+      return;
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_atlasPipeline.pipeline);
+    for(const auto &view : views)
+    {
+      VkViewport viewport = {};
+      viewport.x        = static_cast<float>(view.rect.offset.x);
+      viewport.y        = static_cast<float>(view.rect.offset.y);
+      viewport.width    = static_cast<float>(view.rect.extent.width);
+      viewport.height   = static_cast<float>(view.rect.extent.height);
+      viewport.minDepth = 0.0f;
+      viewport.maxDepth = 1.0f;
+      vkCmdSetViewport(a_cmdBuff, 0, 1, &viewport);
+      vkCmdSetScissor(a_cmdBuff, 0, 1, &view.rect);
+
+      VkClearAttachment clear = {};
+      clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+      clear.clearValue = clearDepth;
+      VkClearRect rect = {};
+      rect.rect       = view.rect;
+      rect.layerCount = 1;
+      vkCmdClearAttachments(a_cmdBuff, 1, &clear, 1, &rect);
+
+      DrawInstancesCmd(a_cmdBuff, view.viewProj, CullShadowCasters(view.viewProj, m_shadowCache.staticCasters));
+      DrawInstancesCmd(a_cmdBuff, view.viewProj, CullShadowCasters(view.viewProj, m_shadowCache.dynamicCasters));
+    }
+  }).WriteDepth(m_shadowAtlas, VK_ATTACHMENT_LOAD_OP_LOAD).Id();
+
+  auto setMainViewport = [this](VkCommandBuffer a_cmdBuff) {
+    const VkExtent2D ext = m_dynamicResolution.Extent();
+
+    VkViewport viewport = {};
+    viewport.width    = static_cast<float>(ext.width);
+    viewport.height   = static_cast<float>(ext.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    VkRect2D scissor  = {};
+    scissor.extent    = ext;
+    vkCmdSetViewport(a_cmdBuff, 0, 1, &viewport);
+    vkCmdSetScissor(a_cmdBuff, 0, 1, &scissor);
+  };
+
+  //// instances which were visible in the previous frame
+  //
+  graph.AddPass("cull_early", [this](VkCommandBuffer a_cmdBuff) {
+    if(CullingEnabled())
+      m_pCuller->CmdCullEarly(a_cmdBuff, m_presentationResources.currentFrame, m_worldViewProj, m_dynamicResolution.Extent());
+  }).SideEffects();
+
+  //// point lights to clusters of the main view, read by the forward passes
+  //
+  graph.AddPass("light_binning", [this](VkCommandBuffer a_cmdBuff) {
+    m_pLighting->CmdBinLights(a_cmdBuff, m_viewMatrix, m_projMatrix, m_dynamicResolution.Extent(), CAMERA_Z_NEAR, CAMERA_Z_FAR);
+  }).SideEffects();
+
+  //// depth of the nearest surfaces front to back, the pass always clears depth for the main pass
+  //
+  m_prepassPass = graph.AddPass("depth_prepass", [this, setMainViewport](VkCommandBuffer a_cmdBuff) {
+    if(!DepthPrepassEnabled())
+      return;
+    setMainViewport(a_cmdBuff);
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_depthPrepassPipeline.pipeline);
+    DrawSceneCmd(a_cmdBuff, m_worldViewProj, CpuCullingEnabled(), true);
+  }).WriteDepth(depth, VK_ATTACHMENT_LOAD_OP_CLEAR, clearDepth).Id();
+
+  //// draw scene to the top left part of scene color
+  //
+  auto mainPass = graph.AddPass("main", [this, setMainViewport](VkCommandBuffer a_cmdBuff) {
+    setMainViewport(a_cmdBuff);
+    if(CullingEnabled())
+    {
+      DrawCulledSceneCmd(a_cmdBuff, m_worldViewProj, false);
+      return;
+    }
+    const VkPipeline pipeline = DepthPrepassEnabled() ? m_prepassForwardPipeline.pipeline : m_basicForwardPipeline.pipeline;
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1, &m_dSet, 0, VK_NULL_HANDLE);
+    DrawSceneCmd(a_cmdBuff, m_worldViewProj, CpuCullingEnabled());
+  }).WriteColor(m_sceneColor, VK_ATTACHMENT_LOAD_OP_CLEAR, clearColor)
+    .WriteDepth(depth, VK_ATTACHMENT_LOAD_OP_LOAD)
+    .ReadTexture(m_shadowMap)
+    .ReadTexture(m_shadowAtlas);
+  if(m_pShadowFilter != nullptr)
+    mainPass.ReadTexture(m_shadowMoments);
+  m_mainPass = mainPass.Id();
+
+  //// depth pyramid from the main pass, instances it occluded in the early test are tested again
+  //
+  graph.AddPass("depth_pyramid", [this](VkCommandBuffer a_cmdBuff) {
+    if(!CullingEnabled())
+      return;
+    m_pCuller->CmdBuildPyramid(a_cmdBuff);
+    m_pCuller->CmdCullLate(a_cmdBuff, m_presentationResources.currentFrame);
+  }).ReadTexture(depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+    .SideEffects();
+
+  //// draw instances the early test missed over the main pass
+  //
+  auto mainLatePass = graph.AddPass("main_late", [this, setMainViewport](VkCommandBuffer a_cmdBuff) {
+    if(!CullingEnabled())
+      return;
+    setMainViewport(a_cmdBuff);
+    DrawCulledSceneCmd(a_cmdBuff, m_worldViewProj, true);
+  }).WriteColor(m_sceneColor, VK_ATTACHMENT_LOAD_OP_LOAD)
+    .WriteDepth(depth, VK_ATTACHMENT_LOAD_OP_LOAD)
+    .ReadTexture(m_shadowMap)
+    .ReadTexture(m_shadowAtlas);
+  if(m_pShadowFilter != nullptr)
+    mainLatePass.ReadTexture(m_shadowMoments);
+
+  //// stretch rendered part of scene color to the whole screen
+  //
+  m_upscalePass = graph.AddPass("upscale", [this](VkCommandBuffer a_cmdBuff) {
+    const VkExtent2D ext = m_dynamicResolution.Extent();
+    const float2 texel   = float2(1.0f / float(m_width), 1.0f / float(m_height));
+
+    pushConstUpscale.uvScaleAndMax     = float4(float(ext.width) * texel.x, float(ext.height) * texel.y,
+                                                (float(ext.width) - 0.5f) * texel.x, (float(ext.height) - 0.5f) * texel.y);
+    pushConstUpscale.texelAndSharpness = float4(texel.x, texel.y, m_input.sharpenUpscale ? 0.5f : 0.0f, 0.0f);
+
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_upscalePipeline.pipeline);
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_upscalePipeline.layout, 0, 1, &m_upscaleDS, 0, VK_NULL_HANDLE);
+    vkCmdPushConstants(a_cmdBuff, m_upscalePipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(pushConstUpscale), &pushConstUpscale);
+    vkCmdDraw(a_cmdBuff, 3, 1, 0, 0);
+  }).WriteColor(m_backbuffer, VK_ATTACHMENT_LOAD_OP_DONT_CARE)
+    .ReadTexture(m_sceneColor).Id();
+
+  //// occlusion buffer of the CPU culler for the debug quad, written to the slice of this frame
+  //
+  graph.AddPass("cpu_occlusion_upload", [this](VkCommandBuffer a_cmdBuff) {
+    if(!m_input.drawFSQuad || !CpuCullingEnabled())
+      return;
+    const VkDeviceSize offset = VkDeviceSize(m_pCpuCuller->Width()) * m_pCpuCuller->Height() * m_presentationResources.currentFrame;
+    m_pCpuCuller->DebugImage(static_cast<uint8_t*>(m_cpuOcclusionAlloc.mapped) + offset);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset      = offset;
+    region.imageSubresource  = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent       = VkExtent3D{m_pCpuCuller->Width(), m_pCpuCuller->Height(), 1};
+    vkCmdCopyBufferToImage(a_cmdBuff, m_cpuOcclusionBuf, m_pRenderGraph->GetImage(m_cpuOcclusion),
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  }).Access(m_cpuOcclusion, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT, true);
+
+  // quad renderer begins its own render pass and expects the target in a_colorLayout
+  //
+  graph.AddPass("debug_quad", [this](VkCommandBuffer a_cmdBuff) {
+    if(!m_input.drawFSQuad)
+      return;
+    float scaleAndOffset[4] = {0.5f, 0.5f, -0.5f, +0.5f};
+    m_pFSQuad->SetRenderTarget(GetTargetImageView(m_targetImageIdx));
+    m_pFSQuad->DrawCmd(a_cmdBuff, CpuCullingEnabled() ? m_cpuOcclusionDS : m_quadDS, scaleAndOffset);
+  }).Access(m_backbuffer, a_colorLayout, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true)
+    .ReadTexture(m_shadowMap)
+    .ReadTexture(m_cpuOcclusion);
+
+  graph.Compile();
+  graph.PrintStats();
+
+  if(m_pCuller != nullptr)
+    m_pCuller->SetDepth(graph.GetImageView(depth), VkExtent2D{m_width, m_height});
+  if(m_pShadowFilter != nullptr)
+    m_pShadowFilter->SetImages(graph.GetImageView(m_shadowMap), graph.GetImageView(m_shadowRows), graph.GetImageView(m_shadowMoments),
+                               VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE});
+  CreateCpuOcclusionBuffer();
+  ResetShadowCache(); // content of the recreated cache images is undefined
+  m_pShadowAtlas->Invalidate();
+}
+
+// frames which use the previous buffer must be finished, its size depends on the aspect of the window
+void SimpleShadowmapRender::CreateCpuOcclusionBuffer()
+{
+  DestroyCpuOcclusionBuffer();
+  const VkDeviceSize size = VkDeviceSize(m_pCpuCuller->Width()) * m_pCpuCuller->Height() * MAX_FRAMES_IN_FLIGHT;
+  m_cpuOcclusionBuf   = vk_utils::createBuffer(m_device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+  m_cpuOcclusionAlloc = m_pAllocator->AllocateForBuffer(m_cpuOcclusionBuf, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+void SimpleShadowmapRender::DestroyCpuOcclusionBuffer()
+{
+  if(m_cpuOcclusionBuf == VK_NULL_HANDLE)
+    return;
+  vkDestroyBuffer(m_device, m_cpuOcclusionBuf, nullptr);
+  m_cpuOcclusionBuf = VK_NULL_HANDLE;
+  m_pAllocator->Free(m_cpuOcclusionAlloc);
 }
 
 void SimpleShadowmapRender::CreateInstance()
@@ -152,99 +490,325 @@ void SimpleShadowmapRender::CreateDevice(uint32_t a_deviceId)
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.transfer, 0, &m_transferQueue);
 }
 
+void SimpleShadowmapRender::CreateFrameResources()
+{
+  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
+
+  m_frameFences.resize(m_framesInFlight);
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  for (size_t i = 0; i < m_framesInFlight; i++)
+  {
+    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
+  }
+
+  m_presentationResources.imageAvailable.resize(m_framesInFlight);
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (auto &semaphore : m_presentationResources.imageAvailable)
+  {
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+  }
+
+  m_pGpuTimer = std::make_unique<GpuFrameTimer>(m_device, m_physicalDevice, m_queueFamilyIDXs.graphics, m_framesInFlight);
+  m_presentationResources.currentFrame = 0;
+}
+
+void SimpleShadowmapRender::DestroyFrameResources()
+{
+  if (!m_cmdBuffersDrawMain.empty())
+  {
+    vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_cmdBuffersDrawMain.size()),
+                         m_cmdBuffersDrawMain.data());
+    m_cmdBuffersDrawMain.clear();
+  }
+
+  for (auto fence : m_frameFences)
+    vkDestroyFence(m_device, fence, nullptr);
+  m_frameFences.clear();
+
+  for (auto semaphore : m_presentationResources.imageAvailable)
+    vkDestroySemaphore(m_device, semaphore, nullptr);
+  m_presentationResources.imageAvailable.clear();
+
+  m_pGpuTimer = nullptr;
+}
+
+void SimpleShadowmapRender::CreatePresentSemaphores()
+{
+  // the previous swapchain may still be presenting with the old ones
+  for (auto semaphore : m_presentationResources.renderingFinished)
+    m_pDeletionQueue->Push([device = m_device, semaphore]() { vkDestroySemaphore(device, semaphore, nullptr); });
+
+  m_presentationResources.renderingFinished.resize(m_swapchain.GetImageCount());
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (auto &semaphore : m_presentationResources.renderingFinished)
+  {
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+  }
+}
+
+void SimpleShadowmapRender::SetFramePacing(const FramePacingParams &a_params)
+{
+  m_requestedPacing = a_params;
+  if(m_device == VK_NULL_HANDLE) // nothing is created yet, frames in flight are used as is by InitVulkan
+    m_framePacer.SetParams(a_params);
+}
+
+void SimpleShadowmapRender::ApplyFramePacing()
+{
+  const FramePacingParams current = m_framePacer.Params();
+  m_framePacer.SetParams(m_requestedPacing);
+  const FramePacingParams &requested = m_framePacer.Params();
+
+  const bool framesChanged = requested.framesInFlight != current.framesInFlight;
+  const bool vsyncChanged  = (current.presentMode == PresentMode::FIFO) != m_framePacer.VSync();
+  if(!framesChanged && !vsyncChanged)
+    return;
+
+  std::cout << "[SimpleShadowmapRender] frames in flight: " << requested.framesInFlight << ", present mode: "
+            << FramePacer::ModeName(m_framePacer.EffectivePresentMode()) << std::endl;
+
+  if(framesChanged)
+  {
+    // command buffers, fences and timestamp queries exist per frame in flight, so every frame has to finish
+    vkWaitForFences(m_device, static_cast<uint32_t>(m_frameFences.size()), m_frameFences.data(), VK_TRUE, UINT64_MAX);
+    DestroyFrameResources();
+    m_framesInFlight = requested.framesInFlight;
+    CreateFrameResources();
+    m_pDeletionQueue->SetFramesInFlight(m_framesInFlight);
+  }
+
+  // swapchain image count follows frames in flight, present mode is fixed at swapchain creation
+  if(m_surface != VK_NULL_HANDLE)
+    RecreateSwapChain();
+}
+
+void SimpleShadowmapRender::WaitForFrameStart()
+{
+  PROFILE_FUNCTION();
+  if(m_pHeadless != nullptr)
+    return;
+
+  ApplyFramePacing();
+  m_framePacer.Limit();
+
+  // the frame fence is waited here and not in DrawFrame, so the frame is recorded with input sampled after the wait
+  const uint32_t frame = m_presentationResources.currentFrame;
+  vkWaitForFences(m_device, 1, &m_frameFences[frame], VK_TRUE, UINT64_MAX);
+  m_framePacer.OnFrameCompleted(frame);
+  m_framePacer.OnInputSampled(frame);
+}
+
 
 void SimpleShadowmapRender::SetupSimplePipeline()
 {
+  PROFILE_FUNCTION();
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             1},
-      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,     2}
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             3},
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,             6},
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,     6}
   };
 
-  m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 2);
+  m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 4);
   
-  auto shadowMap = m_pShadowMap2->m_attachments[m_shadowMapId];
+  const VkImageView shadowMapView = m_pRenderGraph->GetImageView(m_shadowMap);
 
-  m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
+  m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
   m_pBindings->BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-  m_pBindings->BindImage (1, shadowMap.view, m_pShadowMap2->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  m_pBindings->BindImage (1, shadowMapView, m_shadowMapSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  m_pBindings->BindBuffer(2, m_pScnMgr->GetInstanceMatricesBuffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(3, m_pScnMgr->GetLightsBuffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(4, m_pLighting->GetCountsBuffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(5, m_pLighting->GetIndicesBuffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(6, m_pLighting->GetParamsBuffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  m_pBindings->BindBuffer(7, m_shadowUbo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  m_pBindings->BindBuffer(8, m_pShadowAtlas->GetViewsBuffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindBuffer(9, m_pShadowAtlas->GetLightViewsBuffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  m_pBindings->BindImage (10, m_pRenderGraph->GetImageView(m_shadowAtlas), m_shadowMapSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  // without the filter the moments are never read, the shadow map only fills the binding
+  const VkImageView momentsView = m_pShadowFilter != nullptr ? m_pRenderGraph->GetImageView(m_shadowMoments) : shadowMapView;
+  m_pBindings->BindImage (11, momentsView, m_shadowMapSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
   m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
 
   //m_pBindings->BindImage(0, m_GBufTarget->m_attachments[m_GBuf_idx[GBUF_ATTACHMENT::POS_Z]].view, m_GBufTarget->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
+  // quad shows the first cascade
   m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-  m_pBindings->BindImage(0, shadowMap.view, m_pShadowMap2->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  m_pBindings->BindImage(0, m_pRenderGraph->GetLayerView(m_shadowMap, 0), m_shadowMapSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
   m_pBindings->BindEnd(&m_quadDS, &m_quadDSLayout);
 
-  // if we are recreating pipeline (for example, to reload shaders)
-  // we need to cleanup old pipeline
-  if(m_basicForwardPipeline.layout != VK_NULL_HANDLE)
-  {
-    vkDestroyPipelineLayout(m_device, m_basicForwardPipeline.layout, nullptr);
-    m_basicForwardPipeline.layout = VK_NULL_HANDLE;
-  }
-  if(m_basicForwardPipeline.pipeline != VK_NULL_HANDLE)
-  {
-    vkDestroyPipeline(m_device, m_basicForwardPipeline.pipeline, nullptr);
-    m_basicForwardPipeline.pipeline = VK_NULL_HANDLE;
-  }
+  m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
+  m_pBindings->BindImage(0, m_pRenderGraph->GetImageView(m_cpuOcclusion), m_upscaleSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  m_pBindings->BindEnd(&m_cpuOcclusionDS, &m_quadDSLayout);
 
-  if(m_shadowPipeline.pipeline != VK_NULL_HANDLE)
-  {
-    vkDestroyPipeline(m_device, m_shadowPipeline.pipeline, nullptr);
-    m_shadowPipeline.pipeline = VK_NULL_HANDLE;
-  }
+  m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
+  m_pBindings->BindImage(0, m_pRenderGraph->GetImageView(m_sceneColor), m_upscaleSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  m_pBindings->BindEnd(&m_upscaleDS, &m_upscaleDSLayout);
+
+  // pipeline layout and render passes are read by the shader reloader thread when it rebuilds pipelines
+  auto pauseReload = m_pShaderReloader->PauseBuilds();
+
+  // if we are recreating pipelines (for example, after the render graph was rebuilt)
+  // old ones can still be used by frames in flight
+  m_pDeletionQueue->PushPipelineLayout(m_device, m_basicForwardPipeline.layout);
+  m_pDeletionQueue->PushPipeline(m_device, m_basicForwardPipeline.pipeline);
+  m_pDeletionQueue->PushPipeline(m_device, m_culledForwardPipeline.pipeline);
+  m_pDeletionQueue->PushPipeline(m_device, m_depthPrepassPipeline.pipeline);
+  m_pDeletionQueue->PushPipeline(m_device, m_prepassForwardPipeline.pipeline);
+  m_pDeletionQueue->PushPipeline(m_device, m_shadowPipeline.pipeline);
+  m_pDeletionQueue->PushPipeline(m_device, m_atlasPipeline.pipeline);
+  m_pDeletionQueue->PushPipelineLayout(m_device, m_upscalePipeline.layout);
+  m_pDeletionQueue->PushPipeline(m_device, m_upscalePipeline.pipeline);
+  m_basicForwardPipeline.layout   = VK_NULL_HANDLE;
+  m_basicForwardPipeline.pipeline = VK_NULL_HANDLE;
+  m_culledForwardPipeline.pipeline = VK_NULL_HANDLE;
+  m_depthPrepassPipeline.pipeline = VK_NULL_HANDLE;
+  m_prepassForwardPipeline.pipeline = VK_NULL_HANDLE;
+  m_shadowPipeline.pipeline       = VK_NULL_HANDLE;
+  m_atlasPipeline.pipeline        = VK_NULL_HANDLE;
+  m_upscalePipeline.layout        = VK_NULL_HANDLE;
+  m_upscalePipeline.pipeline      = VK_NULL_HANDLE;
+
+  vk_utils::GraphicsPipelineMaker layoutMaker;
+  m_basicForwardPipeline.layout = layoutMaker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
+  m_shadowPipeline.layout       = m_basicForwardPipeline.layout;
+  m_atlasPipeline.layout        = m_basicForwardPipeline.layout;
+  m_culledForwardPipeline.layout = m_basicForwardPipeline.layout;
+  m_depthPrepassPipeline.layout  = m_basicForwardPipeline.layout;
+  m_prepassForwardPipeline.layout = m_basicForwardPipeline.layout;
+  m_upscalePipeline.layout      = layoutMaker.MakeLayout(m_device, {m_upscaleDSLayout}, sizeof(pushConstUpscale));
+
+  // all pipelines are declared up front, so simple.vert is loaded once and pipelines are created in parallel
+  PipelineBuilder builder(m_device, *m_pPipelineCache);
+  builder.AddGraphics(&m_basicForwardPipeline.pipeline, ForwardPipelineDesc());
+  builder.AddGraphics(&m_culledForwardPipeline.pipeline, CulledForwardPipelineDesc());
+  builder.AddGraphics(&m_depthPrepassPipeline.pipeline, DepthPrepassPipelineDesc());
+  builder.AddGraphics(&m_prepassForwardPipeline.pipeline, PrepassForwardPipelineDesc());
+  builder.AddGraphics(&m_shadowPipeline.pipeline, ShadowPipelineDesc());
+  builder.AddGraphics(&m_atlasPipeline.pipeline, AtlasPipelineDesc());
+  builder.AddGraphics(&m_upscalePipeline.pipeline, UpscalePipelineDesc());
+  builder.Build();
+
+  m_pShaderReloader->WatchPipeline(&m_basicForwardPipeline.pipeline,
+                                   {"../resources/shaders/simple.vert", "../resources/shaders/simple_shadow.frag"},
+                                   [this]() { return PipelineBuilder::BuildGraphics(m_device, *m_pPipelineCache, ForwardPipelineDesc()); });
+  m_pShaderReloader->WatchPipeline(&m_culledForwardPipeline.pipeline,
+                                   {"../resources/shaders/simple_instanced.vert", "../resources/shaders/simple_shadow.frag"},
+                                   [this]() { return PipelineBuilder::BuildGraphics(m_device, *m_pPipelineCache, CulledForwardPipelineDesc()); });
+  m_pShaderReloader->WatchPipeline(&m_depthPrepassPipeline.pipeline, {"../resources/shaders/depth_prepass.vert"},
+                                   [this]() { return PipelineBuilder::BuildGraphics(m_device, *m_pPipelineCache, DepthPrepassPipelineDesc()); });
+  m_pShaderReloader->WatchPipeline(&m_prepassForwardPipeline.pipeline,
+                                   {"../resources/shaders/simple.vert", "../resources/shaders/simple_shadow.frag"},
+                                   [this]() { return PipelineBuilder::BuildGraphics(m_device, *m_pPipelineCache, PrepassForwardPipelineDesc()); });
+  m_pShaderReloader->WatchPipeline(&m_shadowPipeline.pipeline, {"../resources/shaders/depth_prepass.vert"},
+                                   [this]() { return PipelineBuilder::BuildGraphics(m_device, *m_pPipelineCache, ShadowPipelineDesc()); });
+  m_pShaderReloader->WatchPipeline(&m_atlasPipeline.pipeline, {"../resources/shaders/depth_prepass.vert"},
+                                   [this]() { return PipelineBuilder::BuildGraphics(m_device, *m_pPipelineCache, AtlasPipelineDesc()); });
+  m_pShaderReloader->WatchPipeline(&m_upscalePipeline.pipeline,
+                                   {"../resources/shaders/upscale.vert", "../resources/shaders/upscale.frag"},
+                                   [this]() { return PipelineBuilder::BuildGraphics(m_device, *m_pPipelineCache, UpscalePipelineDesc()); });
+}
 
-  vk_utils::GraphicsPipelineMaker maker;
-  
-  // pipeline for drawing objects
-  //
-  std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
-  {
-    shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = "../resources/shaders/simple_shadow.frag.spv";
-    shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = "../resources/shaders/simple.vert.spv";
-  }
-  maker.LoadShaders(m_device, shader_paths);
+// pipeline for drawing objects
+//
+GraphicsPipelineDesc SimpleShadowmapRender::ForwardPipelineDesc()
+{
+  GraphicsPipelineDesc desc;
+  desc.shaderPaths[VK_SHADER_STAGE_FRAGMENT_BIT] = "../resources/shaders/simple_shadow.frag.spv";
+  desc.shaderPaths[VK_SHADER_STAGE_VERTEX_BIT]   = "../resources/shaders/simple.vert.spv";
+  desc.layout      = m_basicForwardPipeline.layout;
+  desc.renderPass  = m_pRenderGraph->GetRenderPass(m_mainPass);
+  desc.vertexInput = m_pScnMgr->GetPipelineVertexInputStateCreateInfo();
+  desc.extent      = VkExtent2D{m_width, m_height};
+  desc.dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR}; // resolution changes every frame
+  return desc;
+}
 
-  m_basicForwardPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
-  maker.SetDefaultState(m_width, m_height);
+// pipeline for drawing instances which passed GPU culling, the draws are indirect;
+// main_late pass has a compatible render pass (only load ops differ), so the pipeline is used in both
+//
+GraphicsPipelineDesc SimpleShadowmapRender::CulledForwardPipelineDesc()
+{
+  GraphicsPipelineDesc desc = ForwardPipelineDesc();
+  desc.shaderPaths[VK_SHADER_STAGE_VERTEX_BIT] = "../resources/shaders/simple_instanced.vert.spv";
+  desc.layout = m_culledForwardPipeline.layout;
+  return desc;
+}
 
-  m_basicForwardPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
-                                                       m_screenRenderPass);
-                                                       //, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR}
-  
-  // pipeline for rendering objects to shadowmap
-  //
-  // maker.SetDefaultState(m_width, m_height);
-  shader_paths.clear();
-  shader_paths[VK_SHADER_STAGE_VERTEX_BIT] = "../resources/shaders/simple.vert.spv";
-  maker.LoadShaders(m_device, shader_paths);
+// depth pre-pass: positions only, no fragment shader
+//
+GraphicsPipelineDesc SimpleShadowmapRender::DepthPrepassPipelineDesc()
+{
+  GraphicsPipelineDesc desc;
+  desc.shaderPaths[VK_SHADER_STAGE_VERTEX_BIT] = "../resources/shaders/depth_prepass.vert.spv";
+  desc.layout        = m_depthPrepassPipeline.layout;
+  desc.renderPass    = m_pRenderGraph->GetRenderPass(m_prepassPass);
+  desc.vertexInput   = m_pScnMgr->GetPositionOnlyVertexInputStateCreateInfo();
+  desc.extent        = VkExtent2D{m_width, m_height};
+  desc.dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  return desc;
+}
 
-  maker.viewport.width  = float(m_pShadowMap2->m_resolution.width);
-  maker.viewport.height = float(m_pShadowMap2->m_resolution.height);
-  maker.scissor.extent  = VkExtent2D{ uint32_t(m_pShadowMap2->m_resolution.width), uint32_t(m_pShadowMap2->m_resolution.height) };
+// main pass after the depth pre-pass shades only fragments with the depth it wrote
+//
+GraphicsPipelineDesc SimpleShadowmapRender::PrepassForwardPipelineDesc()
+{
+  GraphicsPipelineDesc desc = ForwardPipelineDesc();
+  desc.layout     = m_prepassForwardPipeline.layout;
+  desc.depthEqual = true;
+  return desc;
+}
 
-  m_shadowPipeline.layout   = m_basicForwardPipeline.layout;
-  m_shadowPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(), 
-                                                 m_pShadowMap2->m_renderPass);                                                       
+// pipeline for rendering objects to shadowmap, positions only like the depth pre-pass
+//
+GraphicsPipelineDesc SimpleShadowmapRender::ShadowPipelineDesc()
+{
+  GraphicsPipelineDesc desc;
+  desc.shaderPaths[VK_SHADER_STAGE_VERTEX_BIT] = "../resources/shaders/depth_prepass.vert.spv";
+  desc.layout      = m_shadowPipeline.layout;
+  desc.renderPass  = m_pRenderGraph->GetRenderPass(m_shadowPass);
+  desc.vertexInput = m_pScnMgr->GetPositionOnlyVertexInputStateCreateInfo();
+  desc.extent      = VkExtent2D{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE};
+  return desc;
 }
 
-void SimpleShadowmapRender::CreateUniformBuffer()
+// pipeline for rendering objects to tiles of the shadow atlas
+//
+GraphicsPipelineDesc SimpleShadowmapRender::AtlasPipelineDesc()
+{
+  GraphicsPipelineDesc desc = ShadowPipelineDesc();
+  desc.layout        = m_atlasPipeline.layout;
+  desc.renderPass    = m_pRenderGraph->GetRenderPass(m_atlasPass);
+  desc.extent        = VkExtent2D{SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE};
+  desc.dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  return desc;
+}
+
+// pipeline for stretching scene color to the screen, full screen triangle without vertex buffers
+//
+GraphicsPipelineDesc SimpleShadowmapRender::UpscalePipelineDesc()
 {
-  VkMemoryRequirements memReq;
-  m_ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq);
+  GraphicsPipelineDesc desc;
+  desc.shaderPaths[VK_SHADER_STAGE_FRAGMENT_BIT] = "../resources/shaders/upscale.frag.spv";
+  desc.shaderPaths[VK_SHADER_STAGE_VERTEX_BIT]   = "../resources/shaders/upscale.vert.spv";
+  desc.layout            = m_upscalePipeline.layout;
+  desc.renderPass        = m_pRenderGraph->GetRenderPass(m_upscalePass);
+  desc.vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  desc.extent            = VkExtent2D{m_width, m_height};
+  return desc;
+}
 
-  VkMemoryAllocateInfo allocateInfo = {};
-  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocateInfo.pNext = nullptr;
-  allocateInfo.allocationSize = memReq.size;
-  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
-                                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                                          m_physicalDevice);
-  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_uboAlloc));
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_ubo, m_uboAlloc, 0));
+void SimpleShadowmapRender::CreateUniformBuffer()
+{
+  // written by vkCmdUpdateBuffer at the start of every frame, so frames in flight don't need a copy each
+  m_ubo      = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_uboAlloc = m_pAllocator->AllocateForBuffer(m_ubo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-  vkMapMemory(m_device, m_uboAlloc, 0, sizeof(m_uniforms), 0, &m_uboMappedMem);
+  m_shadowUbo      = vk_utils::createBuffer(m_device, sizeof(ShadowParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_shadowUboAlloc = m_pAllocator->AllocateForBuffer(m_shadowUbo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
   UpdateUniformBuffer(0.0f);
 }
@@ -256,188 +820,340 @@ void SimpleShadowmapRender::UpdateUniformBuffer(float a_time)
   m_uniforms.time        = a_time;
 
   m_uniforms.baseColor = LiteMath::float3(0.9f, 0.92f, 1.0f);
-  memcpy(m_uboMappedMem, &m_uniforms, sizeof(m_uniforms));
 }
 
-void SimpleShadowmapRender::DrawSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp)
+// the previous frame can still read the buffer, so the update is ordered after it on the GPU instead of memcpy
+static void cmdUpdateUniforms(VkCommandBuffer a_cmdBuff, VkBuffer a_ubo, const void *a_data, VkDeviceSize a_size)
 {
+  VkBufferMemoryBarrier barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask       = VK_ACCESS_UNIFORM_READ_BIT;
+  barrier.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer              = a_ubo;
+  barrier.offset              = 0;
+  barrier.size                = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                       0, nullptr, 1, &barrier, 0, nullptr);
+
+  vkCmdUpdateBuffer(a_cmdBuff, a_ubo, 0, a_size, a_data);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                       0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// a_cpuCulled skips instances the CPU culler rejected for the main view,
+// a_depthPrepass draws positions only and orders instances by distance from the camera
+void SimpleShadowmapRender::DrawSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp, bool a_cpuCulled, bool a_depthPrepass)
+{
+  PROFILE_FUNCTION();
   VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
   VkDeviceSize zero_offset = 0u;
-  VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
+  VkBuffer vertexBuf = a_depthPrepass ? m_pScnMgr->GetPositionBuffer() : m_pScnMgr->GetVertexBuffer();
   VkBuffer indexBuf  = m_pScnMgr->GetIndexBuffer();
   
   vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
   vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
 
+  if(a_depthPrepass)
+    m_pScnMgr->SortInstancesFrontToBack(m_cam.pos, m_prepassOrder);
+
   pushConst2M.projView = a_wvp;
-  for (uint32_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
+  for (uint32_t n = 0; n < m_pScnMgr->InstancesNum(); ++n)
   {
+    const uint32_t i = a_depthPrepass ? m_prepassOrder[n] : n;
+    if(a_cpuCulled && !m_pCpuCuller->Visible(i))
+      continue;
+
     auto inst         = m_pScnMgr->GetInstanceInfo(i);
     pushConst2M.model = m_pScnMgr->GetInstanceMatrix(i);
     vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0, sizeof(pushConst2M), &pushConst2M);
 
     auto mesh_info = m_pScnMgr->GetMeshInfo(inst.mesh_id);
     vkCmdDrawIndexed(a_cmdBuff, mesh_info.m_indNum, 1, mesh_info.m_indexOffset, mesh_info.m_vertexOffset, 0);
+    m_frameStats.drawCalls++;
+    m_frameStats.triangles += mesh_info.m_indNum / 3;
   }
 }
 
-void SimpleShadowmapRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
-                                                     VkImageView a_targetImageView, VkPipeline a_pipeline)
+void SimpleShadowmapRender::DrawCulledSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp, bool a_late)
 {
-  vkResetCommandBuffer(a_cmdBuff, 0);
+  PROFILE_FUNCTION();
+  VkDeviceSize zero_offset = 0u;
+  VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
+  VkBuffer indexBuf  = m_pScnMgr->GetIndexBuffer();
 
-  VkCommandBufferBeginInfo beginInfo = {};
-  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_culledForwardPipeline.pipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_culledForwardPipeline.layout, 0, 1, &m_dSet, 0, VK_NULL_HANDLE);
+  vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
+  vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
 
-  VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
+  // model matrices are taken by instance id in the shader
+  pushConst2M.projView = a_wvp;
+  pushConst2M.model    = float4x4();
+  vkCmdPushConstants(a_cmdBuff, m_culledForwardPipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                     sizeof(pushConst2M), &pushConst2M);
 
-  VkViewport viewport{};
-  VkRect2D scissor{};
-  VkExtent2D ext;
-  ext.height = m_height;
-  ext.width  = m_width;
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width  = static_cast<float>(ext.width);
-  viewport.height = static_cast<float>(ext.height);
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-  scissor.offset = {0, 0};
-  scissor.extent = ext;
-
-  std::vector<VkViewport> viewports = {viewport};
-  std::vector<VkRect2D> scissors = {scissor};
-  vkCmdSetViewport(a_cmdBuff, 0, 1, viewports.data());
-  vkCmdSetScissor(a_cmdBuff, 0, 1, scissors.data());
-
-  //// draw scene to shadowmap
-  //
-  VkClearValue clearDepth = {};
-  clearDepth.depthStencil.depth   = 1.0f;
-  clearDepth.depthStencil.stencil = 0;
-  std::vector<VkClearValue> clear =  {clearDepth};
-  VkRenderPassBeginInfo renderToShadowMap = m_pShadowMap2->GetRenderPassBeginInfo(0, clear);
-  vkCmdBeginRenderPass(a_cmdBuff, &renderToShadowMap, VK_SUBPASS_CONTENTS_INLINE);
-  {
-    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipeline.pipeline);
-    DrawSceneCmd(a_cmdBuff, m_lightMatrix);
-  }
-  vkCmdEndRenderPass(a_cmdBuff);
+  // triangles of indirect draws are not known on the CPU, only draw commands are counted
+  m_frameStats.drawCalls += a_late ? m_pCuller->CmdDrawLate(a_cmdBuff) : m_pCuller->CmdDrawEarly(a_cmdBuff);
+}
 
-  //// draw final scene to screen
-  //
+// shadow casters are drawn from lists of instances, positions only
+void SimpleShadowmapRender::DrawInstancesCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp, const std::vector<uint32_t> &a_instances)
+{
+  PROFILE_FUNCTION();
+  VkDeviceSize zero_offset = 0u;
+  VkBuffer vertexBuf = m_pScnMgr->GetPositionBuffer();
+  VkBuffer indexBuf  = m_pScnMgr->GetIndexBuffer();
+
+  vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
+  vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
+
+  pushConst2M.projView = a_wvp;
+  for(auto i : a_instances)
   {
-    VkRenderPassBeginInfo renderPassInfo = {};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = m_screenRenderPass;
-    renderPassInfo.framebuffer = a_frameBuff;
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = m_swapchain.GetExtent();
+    pushConst2M.model = m_pScnMgr->GetInstanceMatrix(i);
+    vkCmdPushConstants(a_cmdBuff, m_shadowPipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(pushConst2M), &pushConst2M);
 
-    VkClearValue clearValues[2] = {};
-    clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-    clearValues[1].depthStencil = {1.0f, 0};
-    renderPassInfo.clearValueCount = 2;
-    renderPassInfo.pClearValues    = &clearValues[0];
+    auto mesh_info = m_pScnMgr->GetMeshInfo(m_pScnMgr->GetInstanceInfo(i).mesh_id);
+    vkCmdDrawIndexed(a_cmdBuff, mesh_info.m_indNum, 1, mesh_info.m_indexOffset, mesh_info.m_vertexOffset, 0);
+    m_frameStats.drawCalls++;
+    m_frameStats.shadowDraws++;
+    m_frameStats.triangles += mesh_info.m_indNum / 3;
+  }
+}
 
-    vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+// true if the box may be inside the clip volume of a_viewProj, it is rejected if all its corners are outside
+// of the same clip plane (Vulkan depth range is [0, w])
+static bool boxInClipVolume(const LiteMath::Box4f &a_box, const float4x4 &a_viewProj)
+{
+  uint32_t outside[6] = {0, 0, 0, 0, 0, 0};
+  for(uint32_t i = 0; i < 8; ++i)
+  {
+    const float4 p = a_viewProj * LiteMath::to_float4(boxCorner(a_box, i), 1.0f);
+    outside[0] += p.x < -p.w ? 1 : 0;
+    outside[1] += p.x > +p.w ? 1 : 0;
+    outside[2] += p.y < -p.w ? 1 : 0;
+    outside[3] += p.y > +p.w ? 1 : 0;
+    outside[4] += p.z < 0.0f ? 1 : 0;
+    outside[5] += p.z > +p.w ? 1 : 0;
+  }
+  return std::none_of(outside, outside + 6, [](uint32_t count) { return count == 8; });
+}
 
-    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
-    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1, &m_dSet, 0, VK_NULL_HANDLE);
+// a caster can shadow visible receivers only if it is inside the light volume: cascade projections cover their
+// part of the view frustum and reach back to the light side of the scene bbox, the light camera covers its frustum
+const std::vector<uint32_t> &SimpleShadowmapRender::CullShadowCasters(const float4x4 &a_lightMatrix, const std::vector<uint32_t> &a_casters)
+{
+  PROFILE_FUNCTION();
+  m_shadowDrawList.clear();
+  for(auto i : a_casters)
+  {
+    if(!m_input.casterCulling || boxInClipVolume(m_pScnMgr->GetInstanceBbox(i), a_lightMatrix))
+      m_shadowDrawList.push_back(i);
+  }
+  m_frameStats.culledShadowCasters += uint32_t(a_casters.size() - m_shadowDrawList.size());
+  return m_shadowDrawList;
+}
 
-    DrawSceneCmd(a_cmdBuff, m_worldViewProj);
+// the cache is drawn again when the graph (and the cache image with it) is recreated or a scene is loaded
+void SimpleShadowmapRender::ResetShadowCache()
+{
+  m_shadowCache.dynamic.resize(m_pScnMgr->InstancesNum(), false);
+  m_shadowCache.staticCasters.clear();
+  m_shadowCache.dynamicCasters.clear();
+  for(uint32_t i = 0; i < m_shadowCache.dynamic.size(); ++i)
+    (m_shadowCache.dynamic[i] ? m_shadowCache.dynamicCasters : m_shadowCache.staticCasters).push_back(i);
+  for(auto &valid : m_shadowCache.valid)
+    valid = false;
+}
 
-    vkCmdEndRenderPass(a_cmdBuff);
+// matrices of instances moved since the previous frame are copied to the buffer of indirect draws; a cached caster
+// which moves becomes dynamic and the cache is drawn again without it, a cascade is also drawn when its matrix changes
+void SimpleShadowmapRender::CmdUpdateMovedInstances(VkCommandBuffer a_cmdBuff)
+{
+  VkBufferMemoryBarrier barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask       = VK_ACCESS_SHADER_READ_BIT;
+  barrier.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer              = m_pScnMgr->GetInstanceMatricesBuffer();
+  barrier.offset              = 0;
+  barrier.size                = VK_WHOLE_SIZE;
+
+  bool moved = false, staticMoved = false;
+  for(uint32_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
+  {
+    const auto inst = m_pScnMgr->GetInstanceInfo(i);
+    if(!inst.dirty)
+      continue;
+    if(!moved)
+      vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                           0, nullptr, 1, &barrier, 0, nullptr);
+    moved = true;
+
+    const float4x4 matrix = m_pScnMgr->GetInstanceMatrix(i);
+    vkCmdUpdateBuffer(a_cmdBuff, barrier.buffer, inst.instBufOffset, sizeof(matrix), &matrix);
+    staticMoved = staticMoved || !m_shadowCache.dynamic[i];
+    m_shadowCache.dynamic[i] = true;
   }
 
-  if(m_input.drawFSQuad)
+  if(moved)
   {
-    float scaleAndOffset[4] = {0.5f, 0.5f, -0.5f, +0.5f};
-    m_pFSQuad->SetRenderTarget(a_targetImageView);
-    m_pFSQuad->DrawCmd(a_cmdBuff, m_quadDS, scaleAndOffset);
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
+    m_pScnMgr->ClearDirtyFlags();
+  }
+  if(staticMoved)
+  {
+    ResetShadowCache();
+    m_pShadowAtlas->Invalidate();
   }
 
-  VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
+  for(uint32_t cascade = 0; cascade < SHADOW_CASCADES; ++cascade)
+  {
+    const float4x4 matrix = ShadowMatrix(cascade);
+    const bool     used   = m_input.cascades || cascade == 0;
+    const bool     same   = m_shadowCache.valid[cascade] &&
+                            std::memcmp(&matrix, &m_shadowCache.matrices[cascade], sizeof(matrix)) == 0;
+    m_shadowCache.redraw[cascade] = used && !same;
+    if(!m_shadowCache.redraw[cascade])
+      continue;
+    m_shadowCache.matrices[cascade] = matrix;
+    m_shadowCache.valid[cascade]    = true;
+  }
 }
 
-
-void SimpleShadowmapRender::CleanupPipelineAndSwapchain()
+// key 'J' shows a dynamic shadow caster: the last instance turns around the vertical axis through its bbox center
+void SimpleShadowmapRender::SpinInstance(float a_time)
 {
-  if (!m_cmdBuffersDrawMain.empty())
+  if(!m_input.spinInstance || m_pScnMgr->InstancesNum() == 0)
   {
-    vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_cmdBuffersDrawMain.size()),
-                         m_cmdBuffersDrawMain.data());
-    m_cmdBuffersDrawMain.clear();
+    m_spinStart = -1.0f;
+    return;
   }
 
-  for (size_t i = 0; i < m_frameFences.size(); i++)
+  const uint32_t inst = m_pScnMgr->InstancesNum() - 1;
+  if(m_spinStart < 0.0f)
   {
-    vkDestroyFence(m_device, m_frameFences[i], nullptr);
+    const auto box = m_pScnMgr->GetInstanceBbox(inst);
+    m_spinStart  = a_time;
+    m_spinBase   = m_pScnMgr->GetInstanceMatrix(inst);
+    m_spinCenter = LiteMath::to_float3((box.boxMin + box.boxMax) * 0.5f);
   }
+  const float angle = (a_time - m_spinStart) * 0.5f;
+  m_pScnMgr->SetInstanceMatrix(inst, LiteMath::translate4x4(m_spinCenter) * LiteMath::rotate4x4Y(angle) *
+                                     LiteMath::translate4x4(m_spinCenter * -1.0f) * m_spinBase);
+}
 
-  vkDestroyImageView(m_device, m_depthBuffer.view, nullptr);
-  vkDestroyImage(m_device, m_depthBuffer.image, nullptr);
+void SimpleShadowmapRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, uint32_t a_imageIdx)
+{
+  PROFILE_FUNCTION();
+  vkResetCommandBuffer(a_cmdBuff, 0);
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 
-  for (size_t i = 0; i < m_frameBuffers.size(); i++)
+  VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
+  m_pGpuTimer->CmdBegin(a_cmdBuff, m_presentationResources.currentFrame);
+  m_frameStats.drawCalls = 0; // both shadow and main passes are counted
+  m_frameStats.triangles = 0;
+  m_frameStats.shadowDraws         = 0;
+  m_frameStats.culledShadowCasters = 0;
+
+  cmdUpdateUniforms(a_cmdBuff, m_ubo, &m_uniforms, sizeof(m_uniforms));
+  m_shadowParams.filtering = float4(VarianceShadowsEnabled() ? 1.0f : 0.0f, VSM_MIN_VARIANCE, VSM_BLEEDING_REDUCTION, 0.0f);
+  cmdUpdateUniforms(a_cmdBuff, m_shadowUbo, &m_shadowParams, sizeof(m_shadowParams));
+  CmdUpdateMovedInstances(a_cmdBuff);
+
+  // tiles of point lights which dynamic casters reach are drawn again every frame
+  m_atlasCasterBoxes.clear();
+  for(auto i : m_shadowCache.dynamicCasters)
+    m_atlasCasterBoxes.push_back(m_pScnMgr->GetInstanceBbox(i));
+  m_pShadowAtlas->Update(m_cam.pos, m_worldViewProj, m_dynamicResolution.Extent().height, m_atlasCasterBoxes);
+  m_pShadowAtlas->CmdUpdateBuffers(a_cmdBuff);
+
+  // visibility must be known when the main pass is recorded
+  if(CpuCullingEnabled())
   {
-    vkDestroyFramebuffer(m_device, m_frameBuffers[i], nullptr);
+    PROFILE_SCOPE("CpuOcclusionCull");
+    m_pCpuCuller->Cull(m_worldViewProj);
+    m_frameStats.culledFrustum   = m_pCpuCuller->GetStats().culledFrustum;
+    m_frameStats.culledOcclusion = m_pCpuCuller->GetStats().culledOcclusion;
   }
 
-  vkDestroyRenderPass(m_device, m_screenRenderPass, nullptr);
+  // passes and barriers between them come from the render graph
+  m_targetImageIdx = a_imageIdx;
+  m_pRenderGraph->SetImportedImage(m_backbuffer, GetTargetImage(a_imageIdx), GetTargetImageView(a_imageIdx));
+  m_pRenderGraph->Execute(a_cmdBuff);
+
+  m_pGpuTimer->CmdEnd(a_cmdBuff, m_presentationResources.currentFrame);
+  VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
+}
+
 
+void SimpleShadowmapRender::CleanupPipelineAndSwapchain()
+{
+  m_pRenderGraph = nullptr;
+  m_pHeadless = nullptr;
   //m_swapchain.Cleanup();
 }
 
 void SimpleShadowmapRender::RecreateSwapChain()
 {
-  vkDeviceWaitIdle(m_device);
-
-  CleanupPipelineAndSwapchain();
-  auto oldImgNum = m_swapchain.GetImageCount();
-  m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface, m_width, m_height,
-         oldImgNum, m_vsync);
-  std::vector<VkFormat> depthFormats = {
-      VK_FORMAT_D32_SFLOAT,
-      VK_FORMAT_D32_SFLOAT_S8_UINT,
-      VK_FORMAT_D24_UNORM_S8_UINT,
-      VK_FORMAT_D16_UNORM_S8_UINT,
-      VK_FORMAT_D16_UNORM
-  };                                                            
-  vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &m_depthBuffer.format);
-
-  m_screenRenderPass = vk_utils::createDefaultRenderPass(m_device, m_swapchain.GetFormat(), m_depthBuffer.format);
-  m_depthBuffer      = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
-  m_frameBuffers     = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
-
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
+  PROFILE_FUNCTION();
+  // minimized window has zero extent, try again when it is restored
+  VkSurfaceCapabilitiesKHR surfaceCaps = {};
+  VK_CHECK_RESULT(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physicalDevice, m_surface, &surfaceCaps));
+  if(surfaceCaps.currentExtent.width == 0 || surfaceCaps.currentExtent.height == 0)
+    return;
+
+  // the current swapchain is passed as oldSwapchain and destroyed together with its image views as soon as
+  // the new one is created, so frames which render to its images must be finished; the rest of the device
+  // (uploads, other queues) is not drained
+  vkWaitForFences(m_device, static_cast<uint32_t>(m_frameFences.size()), m_frameFences.data(), VK_TRUE, UINT64_MAX);
   {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
+    auto pauseReload = m_pShaderReloader->PauseBuilds(); // render passes are recreated
 
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-  for (uint32_t i = 0; i < m_swapchain.GetImageCount(); ++i)
-  {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-  }
+    m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface, m_width, m_height,
+           m_framesInFlight, m_framePacer.VSync());
+    CreatePresentSemaphores();
 
+    // transient images of the graph (screen depth) are size dependent, fences and command buffers are kept
+    SetupRenderGraph(m_swapchain.GetFormat(), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  }
+  SetupSimplePipeline(); // descriptor sets point to the recreated shadow map
 }
 
 void SimpleShadowmapRender::Cleanup()
 {
-  m_pShadowMap2 = nullptr;
-  m_pFSQuad     = nullptr; // smartptr delete it's resources
-  
-  if(m_memShadowMap != VK_NULL_HANDLE)
+  // headless frames are not waited for after submit
+  if(m_device != VK_NULL_HANDLE)
+    vkDeviceWaitIdle(m_device);
+
+  m_pShaderReloader = nullptr; // stops the worker before pipeline state it reads is destroyed
+  m_pDeletionQueue  = nullptr; // device is idle, everything replaced during rendering is destroyed here
+
+  m_pFSQuad = nullptr; // smartptr delete it's resources
+
+  if(m_shadowMapSampler != VK_NULL_HANDLE)
+  {
+    vkDestroySampler(m_device, m_shadowMapSampler, nullptr);
+    m_shadowMapSampler = VK_NULL_HANDLE;
+  }
+  if(m_upscaleSampler != VK_NULL_HANDLE)
   {
-    vkFreeMemory(m_device, m_memShadowMap, VK_NULL_HANDLE);
-    m_memShadowMap = VK_NULL_HANDLE;
+    vkDestroySampler(m_device, m_upscaleSampler, nullptr);
+    m_upscaleSampler = VK_NULL_HANDLE;
   }
 
   CleanupPipelineAndSwapchain();
@@ -450,20 +1166,69 @@ void SimpleShadowmapRender::Cleanup()
   {
     vkDestroyPipelineLayout(m_device, m_basicForwardPipeline.layout, nullptr);
   }
-
-  if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
+  if (m_culledForwardPipeline.pipeline != VK_NULL_HANDLE)
   {
-    vkDestroySemaphore(m_device, m_presentationResources.imageAvailable, nullptr);
+    vkDestroyPipeline(m_device, m_culledForwardPipeline.pipeline, nullptr);
   }
-  if (m_presentationResources.renderingFinished != VK_NULL_HANDLE)
+  if (m_depthPrepassPipeline.pipeline != VK_NULL_HANDLE)
   {
-    vkDestroySemaphore(m_device, m_presentationResources.renderingFinished, nullptr);
+    vkDestroyPipeline(m_device, m_depthPrepassPipeline.pipeline, nullptr);
   }
+  if (m_prepassForwardPipeline.pipeline != VK_NULL_HANDLE)
+  {
+    vkDestroyPipeline(m_device, m_prepassForwardPipeline.pipeline, nullptr);
+  }
+  if (m_atlasPipeline.pipeline != VK_NULL_HANDLE)
+  {
+    vkDestroyPipeline(m_device, m_atlasPipeline.pipeline, nullptr);
+  }
+  if (m_upscalePipeline.pipeline != VK_NULL_HANDLE)
+  {
+    vkDestroyPipeline(m_device, m_upscalePipeline.pipeline, nullptr);
+  }
+  if (m_upscalePipeline.layout != VK_NULL_HANDLE)
+  {
+    vkDestroyPipelineLayout(m_device, m_upscalePipeline.layout, nullptr);
+  }
+
+  DestroyFrameResources();
+  for (auto semaphore : m_presentationResources.renderingFinished)
+    vkDestroySemaphore(m_device, semaphore, nullptr);
+  m_presentationResources.renderingFinished.clear();
 
   if (m_commandPool != VK_NULL_HANDLE)
   {
     vkDestroyCommandPool(m_device, m_commandPool, nullptr);
   }
+
+  if(m_ubo != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_ubo, nullptr);
+    m_ubo = VK_NULL_HANDLE;
+  }
+  if(m_shadowUbo != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_shadowUbo, nullptr);
+    m_shadowUbo = VK_NULL_HANDLE;
+  }
+  if(m_pAllocator != nullptr)
+  {
+    m_pAllocator->Free(m_uboAlloc);
+    m_pAllocator->Free(m_shadowUboAlloc);
+  }
+  DestroyCpuOcclusionBuffer();
+
+  m_pCuller    = nullptr;
+  m_pCpuCuller = nullptr;
+  m_pLighting  = nullptr;
+  m_pShadowAtlas = nullptr;
+  m_pShadowFilter = nullptr;
+  m_pScnMgr = nullptr;
+  if(m_pAllocator != nullptr)
+    m_pAllocator->PrintStats();
+  m_pAllocator = nullptr; // all memory of the render is returned to the driver here
+
+  m_pPipelineCache = nullptr; // saves cache to disk
 }
 
 void SimpleShadowmapRender::ProcessInput(const AppInput &input)
@@ -477,27 +1242,90 @@ void SimpleShadowmapRender::ProcessInput(const AppInput &input)
   if(input.keyReleased[GLFW_KEY_P])
     m_light.usePerspectiveM = !m_light.usePerspectiveM;
 
-  // recreate pipeline to reload shaders
-  if(input.keyPressed[GLFW_KEY_B])
+  if(input.keyReleased[GLFW_KEY_G])
   {
-#ifdef WIN32
-    std::system("cd ../resources/shaders && python compile_shadowmap_shaders.py");
-#else
-    std::system("cd ../resources/shaders && python3 compile_shadowmap_shaders.py");
-#endif
+    m_input.casterCulling = !m_input.casterCulling;
+    std::cout << "[SimpleShadowmapRender] shadow caster culling " << (m_input.casterCulling ? "on" : "off") << std::endl;
+  }
 
-    SetupSimplePipeline();
+  if(input.keyReleased[GLFW_KEY_J])
+    m_input.spinInstance = !m_input.spinInstance;
 
-    for (uint32_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                               m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-    }
+  if(input.keyReleased[GLFW_KEY_H])
+  {
+    m_input.cascades = !m_input.cascades;
+    std::cout << "[SimpleShadowmapRender] cascaded shadows " << (m_input.cascades ? "on" : "off") << std::endl;
+  }
+
+  if(input.keyReleased[GLFW_KEY_O])
+  {
+    auto params    = m_dynamicResolution.GetParams();
+    params.enabled = !params.enabled;
+    m_dynamicResolution.SetParams(params);
+    std::cout << "[SimpleShadowmapRender] dynamic resolution " << (params.enabled ? "on" : "off") << std::endl;
+  }
+
+  if(input.keyReleased[GLFW_KEY_U])
+    m_input.sharpenUpscale = !m_input.sharpenUpscale;
+
+  if(input.keyReleased[GLFW_KEY_Z])
+  {
+    m_input.depthPrepass = !m_input.depthPrepass;
+    std::cout << "[SimpleShadowmapRender] depth pre-pass " << (m_input.depthPrepass ? "on" : "off") << std::endl;
+    if(m_input.depthPrepass && CullingEnabled())
+      std::cout << "[SimpleShadowmapRender] depth pre-pass is not used with GPU culling" << std::endl;
+  }
+
+  if(input.keyReleased[GLFW_KEY_K])
+  {
+    m_pLighting->SetEnabled(!m_pLighting->Enabled());
+    std::cout << "[SimpleShadowmapRender] clustered lights " << (m_pLighting->Enabled() ? "on" : "off") << std::endl;
+  }
+
+  if(input.keyReleased[GLFW_KEY_V])
+  {
+    m_input.varianceShadows = !m_input.varianceShadows;
+    std::cout << "[SimpleShadowmapRender] variance shadow maps " << (m_input.varianceShadows ? "on" : "off") << std::endl;
+    if(m_input.varianceShadows && m_pShadowFilter == nullptr)
+      std::cout << "[SimpleShadowmapRender] variance shadow maps are not supported by the device" << std::endl;
   }
+
+  if(input.keyReleased[GLFW_KEY_X])
+  {
+    m_pShadowAtlas->SetEnabled(!m_pShadowAtlas->Enabled());
+    std::cout << "[SimpleShadowmapRender] point light shadows " << (m_pShadowAtlas->Enabled() ? "on" : "off") << std::endl;
+  }
+
+  // off -> GPU -> CPU -> off
+  if(input.keyReleased[GLFW_KEY_C])
+  {
+    auto next = CullingMode((uint32_t(m_input.culling) + 1) % 3);
+    if(next == CullingMode::GPU && m_pCuller == nullptr)
+      next = CullingMode::CPU;
+    SetCullingMode(next);
+  }
+
+  // recompile changed shaders in background, new pipelines are used as soon as they are ready
+  if(input.keyPressed[GLFW_KEY_B])
+    m_pShaderReloader->RequestReload();
+}
+
+void SimpleShadowmapRender::SetCullingMode(CullingMode a_mode)
+{
+  if(a_mode == CullingMode::GPU && m_pCuller == nullptr)
+  {
+    std::cout << "[SimpleShadowmapRender] GPU culling is not supported, CPU culling is used instead" << std::endl;
+    a_mode = CullingMode::CPU;
+  }
+  m_input.culling = a_mode;
+
+  const char *names[] = {"off", "GPU", "CPU"};
+  std::cout << "[SimpleShadowmapRender] occlusion culling: " << names[uint32_t(a_mode)] << std::endl;
 }
 
 void SimpleShadowmapRender::UpdateCamera(const Camera* cams, uint32_t a_camsNumber)
 {
+  PROFILE_FUNCTION();
   m_cam = cams[0];
   if(a_camsNumber >= 2)
     m_light.cam = cams[1];
@@ -510,11 +1338,13 @@ void SimpleShadowmapRender::UpdateView()
   //
   const float aspect = float(m_width) / float(m_height);
   auto mProjFix = OpenglToVulkanProjectionMatrixFix();
-  auto mProj = projectionMatrix(m_cam.fov, aspect, 0.1f, 1000.0f);
+  auto mProj = projectionMatrix(m_cam.fov, aspect, CAMERA_Z_NEAR, CAMERA_Z_FAR);
   auto mLookAt = LiteMath::lookAt(m_cam.pos, m_cam.lookAt, m_cam.up);
   auto mWorldViewProj = mProjFix * mProj * mLookAt;
   
   m_worldViewProj = mWorldViewProj;
+  m_viewMatrix    = mLookAt;
+  m_projMatrix    = mProjFix * mProj;
   
   ///// calc light matrix
   //
@@ -530,11 +1360,103 @@ void SimpleShadowmapRender::UpdateView()
   
   mLookAt       = LiteMath::lookAt(m_light.cam.pos, m_light.cam.pos + m_light.cam.forward()*10.0f, m_light.cam.up);
   m_lightMatrix = mProjFix*mProj*mLookAt;
+
+  UpdateCascades();
+}
+
+// directional light shines along the light camera, the view frustum up to the farthest point of the scene is split
+// into cascades, every cascade is covered by an orthographic projection
+//
+void SimpleShadowmapRender::UpdateCascades()
+{
+  m_shadowParams.lightDir = LiteMath::to_float4(normalize(m_light.cam.pos - m_light.cam.lookAt), m_input.cascades ? 1.0f : 0.0f);
+
+  const LiteMath::Box4f sceneBox = m_pScnMgr->GetSceneBbox();
+  if(sceneBox.boxMin.x > sceneBox.boxMax.x) // scene is not loaded yet
+    return;
+
+  const float3 camForward = m_cam.forward();
+  const float3 camRight   = normalize(m_cam.right());
+  const float3 camUp      = cross(camRight, camForward);
+  const float  tanY       = tanf(m_cam.fov * DEG_TO_RAD * 0.5f);
+  const float  tanX       = tanY * float(m_width) / float(m_height);
+  m_shadowParams.viewDepth = LiteMath::to_float4(camForward, -dot(camForward, m_cam.pos));
+
+  float shadowFar = CAMERA_Z_NEAR * 2.0f;
+  for(uint32_t i = 0; i < 8; ++i)
+    shadowFar = std::max(shadowFar, dot(boxCorner(sceneBox, i) - m_cam.pos, camForward));
+  shadowFar = std::min(shadowFar, CAMERA_Z_FAR);
+
+  // light view has no translation, so cascades snapped to its texels stay on the same texels when the camera moves
+  const float3   lightForward = m_light.cam.forward();
+  const float3   lightUp      = std::abs(lightForward.y) > 0.99f ? float3(1.0f, 0.0f, 0.0f) : float3(0.0f, 1.0f, 0.0f);
+  const float4x4 lightView    = LiteMath::lookAt(float3(0.0f), lightForward, lightUp);
+
+  // every caster of the scene is in front of the near plane
+  float sceneNear = +std::numeric_limits<float>::infinity();
+  float sceneFar  = -std::numeric_limits<float>::infinity();
+  for(uint32_t i = 0; i < 8; ++i)
+  {
+    const float depth = -(lightView * boxCorner(sceneBox, i)).z;
+    sceneNear = std::min(sceneNear, depth);
+    sceneFar  = std::max(sceneFar, depth);
+  }
+
+  float splitNear = CAMERA_Z_NEAR;
+  for(uint32_t cascade = 0; cascade < SHADOW_CASCADES; ++cascade)
+  {
+    const float t        = float(cascade + 1) / float(SHADOW_CASCADES);
+    const float logSplit = CAMERA_Z_NEAR * std::pow(shadowFar / CAMERA_Z_NEAR, t);
+    const float uniSplit = CAMERA_Z_NEAR + (shadowFar - CAMERA_Z_NEAR) * t;
+    const float splitFar = CASCADE_SPLIT_LAMBDA * logSplit + (1.0f - CASCADE_SPLIT_LAMBDA) * uniSplit;
+
+    // bounding sphere of the part of the frustum does not change its size when the camera rotates
+    float3 corners[8];
+    float3 center(0.0f);
+    for(uint32_t i = 0; i < 8; ++i)
+    {
+      const float depth = (i & 4) == 0 ? splitNear : splitFar;
+      const float x     = (i & 1) == 0 ? -tanX : tanX;
+      const float y     = (i & 2) == 0 ? -tanY : tanY;
+      corners[i] = m_cam.pos + (camForward + camRight * x + camUp * y) * depth;
+      center    += corners[i] * 0.125f;
+    }
+    float radius = 0.0f;
+    for(const auto &corner : corners)
+      radius = std::max(radius, length(corner - center));
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // the window moves by whole texels
+    const float texel = 2.0f * radius / float(SHADOW_MAP_SIZE);
+    float3 centerLS   = lightView * center;
+    centerLS.x        = std::floor(centerLS.x / texel) * texel;
+    centerLS.y        = std::floor(centerLS.y / texel) * texel;
+
+    // depth range is the scene bbox, receivers behind the sphere are not in the cascade
+    const float zNear = sceneNear;
+    const float zFar  = std::max(std::min(sceneFar, -centerLS.z + radius), zNear + 1e-3f);
+
+    const float4x4 proj = ortoMatrix(centerLS.x - radius, centerLS.x + radius, centerLS.y - radius, centerLS.y + radius, zNear, zFar);
+    m_shadowParams.cascadeMatrices[cascade] = OpenglToVulkanProjectionMatrixFix() * proj * lightView;
+    m_shadowParams.splits[cascade]          = splitFar;
+    splitNear = splitFar;
+  }
 }
 
 void SimpleShadowmapRender::LoadScene(const char* path, bool transpose_inst_matrices)
 {
-  m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
+  PROFILE_FUNCTION();
+  if(std::string(path) == SceneManager::GENERATED_CITY)
+    m_pScnMgr->GenerateCity();
+  else
+    m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
+  if(m_pCuller != nullptr)
+    m_pCuller->SetScene(*m_pScnMgr);
+  m_pCpuCuller->SetScene(*m_pScnMgr);
+  m_pLighting->SetScene(*m_pScnMgr);
+  m_pShadowAtlas->SetScene(*m_pScnMgr);
+  m_shadowCache.dynamic.clear();
+  ResetShadowCache();
 
   CreateUniformBuffer();
   SetupSimplePipeline();
@@ -546,29 +1468,35 @@ void SimpleShadowmapRender::LoadScene(const char* path, bool transpose_inst_matr
   m_cam.lookAt = float3(loadedCam.lookAt);
   m_cam.tdist  = loadedCam.farPlane;
   UpdateView();
-
-  for (uint32_t i = 0; i < m_framesInFlight; ++i)
-  {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-  }
 }
 
 void SimpleShadowmapRender::DrawFrameSimple()
 {
+  PROFILE_FUNCTION();
   vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
+  BeginFrameStats();
 
   uint32_t imageIdx;
-  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
+  const uint32_t frame = m_presentationResources.currentFrame;
+  auto result = m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable[frame], &imageIdx);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+  {
+    RecreateSwapChain();
+    return;
+  }
+  else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+  {
+    RUN_TIME_ERROR("Failed to acquire the next swapchain image!");
+  }
+  // the fence is reset only when the frame is going to be submitted, otherwise the next wait would never end
+  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
 
   auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
 
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
+  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable[frame]};
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
-  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
-                           m_basicForwardPipeline.pipeline);
+  BuildCommandBufferSimple(currentCmdBuf, imageIdx);
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -578,14 +1506,17 @@ void SimpleShadowmapRender::DrawFrameSimple()
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &currentCmdBuf;
 
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
+  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished[imageIdx]};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
   VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+  m_pDeletionQueue->NextFrame();
+  EndFrameStats();
 
   VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-                                                 m_presentationResources.renderingFinished);
+                                                 m_presentationResources.renderingFinished[imageIdx]);
+  m_framePacer.OnPresented(frame);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -597,13 +1528,92 @@ void SimpleShadowmapRender::DrawFrameSimple()
   }
 
   m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
+}
+
+void SimpleShadowmapRender::DrawFrameHeadless()
+{
+  PROFILE_FUNCTION();
+  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
+  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
+  BeginFrameStats();
+
+  const uint32_t imageIdx = m_pHeadless->AcquireNextImage();
 
-  vkQueueWaitIdle(m_presentationResources.queue);
+  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
+  BuildCommandBufferSimple(currentCmdBuf, imageIdx);
+
+  const bool saveImage = m_headlessParams.saveEveryNthFrame != 0 &&
+                         m_headlessFrame % m_headlessParams.saveEveryNthFrame == 0;
+
+  std::vector<VkCommandBuffer> submitCmdBufs = { currentCmdBuf };
+  if(saveImage)
+    submitCmdBufs.push_back(m_pHeadless->GetReadbackCmd(imageIdx));
+
+  VkSubmitInfo submitInfo = {};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = (uint32_t)submitCmdBufs.size();
+  submitInfo.pCommandBuffers = submitCmdBufs.data();
+
+  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+  m_pDeletionQueue->NextFrame();
+  EndFrameStats();
+
+  if(saveImage)
+  {
+    PROFILE_SCOPE("SaveImage");
+    vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
+    std::stringstream path;
+    path << m_headlessParams.outputDir << "/frame_" << std::setfill('0') << std::setw(5) << m_headlessFrame << ".bmp";
+    m_pHeadless->SaveImage(imageIdx, path.str());
+  }
+
+  m_headlessFrame++;
+  m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
+}
+
+void SimpleShadowmapRender::BeginFrameStats()
+{
+  if(m_pGpuTimer->CollectResult(m_presentationResources.currentFrame))
+  {
+    m_frameStats.gpuTimeMs = m_pGpuTimer->LastFrameMs();
+    m_dynamicResolution.Update(m_frameStats.gpuTimeMs);
+  }
+  m_frameStats.renderScale = m_dynamicResolution.Scale();
+
+  OcclusionCuller::Stats cullStats;
+  if(m_pCuller != nullptr && m_pCuller->CollectStats(m_presentationResources.currentFrame, cullStats))
+  {
+    m_frameStats.culledFrustum   = cullStats.culledFrustum;
+    m_frameStats.culledOcclusion = cullStats.culledOcclusion;
+  }
+  else if(!CullingEnabled() && !CpuCullingEnabled())
+  {
+    m_frameStats.culledFrustum   = 0;
+    m_frameStats.culledOcclusion = 0;
+  }
+  m_frameStats.inputToPresentMs = m_framePacer.InputToPresentMs();
+  m_frameStats.inputToGpuDoneMs = m_framePacer.InputToGpuDoneMs();
+  m_frameCpuStart = std::chrono::steady_clock::now();
+}
+
+void SimpleShadowmapRender::EndFrameStats()
+{
+  m_pGpuTimer->OnSubmit(m_presentationResources.currentFrame);
+  m_frameStats.cpuTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_frameCpuStart).count();
 }
 
 void SimpleShadowmapRender::DrawFrame(float a_time, DrawMode a_mode)
 {
+  PROFILE_FUNCTION();
+  m_pShaderReloader->ApplyReloaded();
+  SpinInstance(a_time);
   UpdateUniformBuffer(a_time);
+  if(m_pHeadless != nullptr)
+  {
+    DrawFrameHeadless();
+    return;
+  }
+
   switch (a_mode)
   {
     case DrawMode::WITH_GUI:
@@ -4,6 +4,21 @@
 #define VK_NO_PROTOTYPES
 #include "../../render/scene_mgr.h"
 #include "../../render/render_common.h"
+#include "../../render/headless_target.h"
+#include "../../render/gpu_timer.h"
+#include "../../render/pipeline_cache.h"
+#include "../../render/pipeline_builder.h"
+#include "../../render/shader_reloader.h"
+#include "../../render/deletion_queue.h"
+#include "../../render/frame_pacer.h"
+#include "../../render/dynamic_resolution.h"
+#include "../../render/occlusion_culler.h"
+#include "../../render/cpu_occlusion_culler.h"
+#include "../../render/clustered_lighting.h"
+#include "../../render/shadow_atlas.h"
+#include "../../render/shadow_filter.h"
+#include "../../render/render_graph.h"
+#include "../../render/device_allocator.h"
 #include "../../../resources/shaders/common.h"
 #include <geom/vk_mesh.h>
 #include <vk_descriptor_sets.h>
@@ -14,10 +29,18 @@
 
 #include <string>
 #include <iostream>
+#include <chrono>
 
 class SimpleShadowmapRender : public IRender
 {
 public:
+  enum class CullingMode
+  {
+    OFF,
+    GPU,  ///!< two-phase Hi-Z culling in compute shaders, see OcclusionCuller
+    CPU,  ///!< software rasterized occluders, see CpuOcclusionCuller
+  };
+
   SimpleShadowmapRender(uint32_t a_width, uint32_t a_height);
   ~SimpleShadowmapRender()  { Cleanup(); };
 
@@ -27,14 +50,25 @@ public:
   void InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId) override;
 
   void InitPresentation(VkSurfaceKHR &a_surface, bool initGUI) override;
+  void InitPresentationHeadless(const HeadlessParams& a_params) override;
+
+  void SetFramePacing(const FramePacingParams& a_params) override;
+  void WaitForFrameStart() override;
 
   void ProcessInput(const AppInput& input) override;
   void UpdateCamera(const Camera* cams, uint32_t a_camsNumber) override;
   Camera GetCurrentCamera() override {return m_cam;}
   void UpdateView();
+  void UpdateCascades();
 
   void LoadScene(const char *path, bool transpose_inst_matrices) override;
   void DrawFrame(float a_time, DrawMode a_mode) override;
+  FrameStats GetFrameStats() const override { return m_frameStats; }
+
+  void SetCullingMode(CullingMode a_mode);
+  void SetDepthPrepass(bool a_enable) override { m_input.depthPrepass = a_enable; }
+  void SetCasterCulling(bool a_enable) { m_input.casterCulling = a_enable; }
+  void SetVarianceShadows(bool a_enable) { m_input.varianceShadows = a_enable; }
 
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -76,8 +110,8 @@ private:
   {
     uint32_t    currentFrame      = 0u;
     VkQueue     queue             = VK_NULL_HANDLE;
-    VkSemaphore imageAvailable    = VK_NULL_HANDLE;
-    VkSemaphore renderingFinished = VK_NULL_HANDLE;
+    std::vector<VkSemaphore> imageAvailable;    ///!< per frame in flight
+    std::vector<VkSemaphore> renderingFinished; ///!< per swapchain image, present of the image must end before it is reused
   } m_presentationResources;
 
   std::vector<VkFence> m_frameFences;
@@ -90,32 +124,56 @@ private:
   } pushConst2M;
 
   float4x4 m_worldViewProj;
+  float4x4 m_viewMatrix;     // m_worldViewProj = m_projMatrix * m_viewMatrix, for light binning
+  float4x4 m_projMatrix;
   float4x4 m_lightMatrix;    
 
   UniformParams m_uniforms {};
   VkBuffer m_ubo = VK_NULL_HANDLE;
-  VkDeviceMemory m_uboAlloc = VK_NULL_HANDLE;
-  void* m_uboMappedMem = nullptr;
+  DeviceAllocation m_uboAlloc;
+
+  ShadowParams     m_shadowParams {};  // cascades of the directional light, updated together with m_uniforms
+  VkBuffer         m_shadowUbo = VK_NULL_HANDLE;
+  DeviceAllocation m_shadowUboAlloc;
 
   pipeline_data_t m_basicForwardPipeline {};
+  pipeline_data_t m_culledForwardPipeline {}; // same layout, instance matrices from a storage buffer for indirect draws
+  pipeline_data_t m_depthPrepassPipeline {};  // same layout, positions only
+  pipeline_data_t m_prepassForwardPipeline {}; // same layout, EQUAL depth test after the pre-pass
+  std::vector<uint32_t> m_prepassOrder;         // instances front to back
   pipeline_data_t m_shadowPipeline {};
+  pipeline_data_t m_atlasPipeline {};   // same layout, viewport and scissor are set per atlas tile
+  pipeline_data_t m_upscalePipeline {};
 
   VkDescriptorSet m_dSet = VK_NULL_HANDLE;
   VkDescriptorSetLayout m_dSetLayout = VK_NULL_HANDLE;
-  VkRenderPass m_screenRenderPass = VK_NULL_HANDLE; // main renderpass
 
   std::shared_ptr<vk_utils::DescriptorMaker> m_pBindings = nullptr;
 
   VkSurfaceKHR m_surface = VK_NULL_HANDLE;
   VulkanSwapChain m_swapchain;
-  std::vector<VkFramebuffer> m_frameBuffers;
-  vk_utils::VulkanImageMem m_depthBuffer{}; // screen depthbuffer
+
+  std::unique_ptr<HeadlessTarget> m_pHeadless; // used instead of swapchain if not null
+  HeadlessParams m_headlessParams;
+  uint32_t m_headlessFrame = 0;
+
+  std::unique_ptr<GpuFrameTimer> m_pGpuTimer;
+  FrameStats m_frameStats;
+  std::chrono::steady_clock::time_point m_frameCpuStart;
+  void BeginFrameStats();
+  void EndFrameStats();
 
   Camera   m_cam;
   uint32_t m_width  = 1024u;
   uint32_t m_height = 1024u;
   uint32_t m_framesInFlight = 2u;
-  bool m_vsync = false;
+
+  FramePacer        m_framePacer;
+  FramePacingParams m_requestedPacing; // applied at the start of the next frame
+  void ApplyFramePacing();
+  void CreateFrameResources();  // command buffers, fences, semaphores and timestamp queries per frame in flight
+  void DestroyFrameResources();
+  void CreatePresentSemaphores();
 
   VkPhysicalDeviceFeatures m_enabledDeviceFeatures = {};
   std::vector<const char*> m_deviceExtensions      = {};
@@ -124,24 +182,81 @@ private:
   bool m_enableValidation;
   std::vector<const char*> m_validationLayers;
 
+  std::shared_ptr<DeviceAllocator>  m_pAllocator; // all device memory of the render, shared with scene manager
   std::shared_ptr<SceneManager>     m_pScnMgr;
+  std::unique_ptr<PipelineCache>    m_pPipelineCache;
+  std::unique_ptr<ShaderReloader>   m_pShaderReloader;
+  std::shared_ptr<DeletionQueue>    m_pDeletionQueue; // resources replaced while frames are in flight
+  std::unique_ptr<OcclusionCuller>  m_pCuller;        // null if the device can't draw culled instances indirectly
+  bool                              m_cullingSupported = false;
+  std::unique_ptr<CpuOcclusionCuller> m_pCpuCuller;
+  std::unique_ptr<ClusteredLighting>  m_pLighting;     // scene point lights binned to clusters of the main view
+  std::unique_ptr<ShadowAtlas>        m_pShadowAtlas;  // shadows of the most important point lights
+  std::unique_ptr<ShadowFilter>       m_pShadowFilter; // null if the device can't write or filter rg32f storage images
+  bool                                m_shadowFilterSupported = false;
   
   // objects and data for shadow map
   //
   std::shared_ptr<vk_utils::IQuad>               m_pFSQuad;
-  //std::shared_ptr<vk_utils::RenderableTexture2D> m_pShadowMap;
-  std::shared_ptr<vk_utils::RenderTarget>        m_pShadowMap2;
-  uint32_t                                       m_shadowMapId = 0;
-  
-  VkDeviceMemory        m_memShadowMap = VK_NULL_HANDLE;
+  VkSampler                                      m_shadowMapSampler = VK_NULL_HANDLE;
+
   VkDescriptorSet       m_quadDS; 
   VkDescriptorSetLayout m_quadDSLayout = nullptr;
 
+  // occlusion buffer of the CPU culler is shown by the debug quad instead of shadow map,
+  // it is copied to the graph image through a host visible buffer with a slice per frame in flight
+  //
+  VkDescriptorSet       m_cpuOcclusionDS  = VK_NULL_HANDLE;  ///!< same layout as m_quadDS
+  VkBuffer              m_cpuOcclusionBuf = VK_NULL_HANDLE;
+  DeviceAllocation      m_cpuOcclusionAlloc;
+
+  // main pass is rendered at the resolution picked by m_dynamicResolution and stretched to the window
+  //
+  DynamicResolution     m_dynamicResolution {VkExtent2D{m_width, m_height}};
+  VkSampler             m_upscaleSampler  = VK_NULL_HANDLE;
+  VkDescriptorSet       m_upscaleDS       = VK_NULL_HANDLE;
+  VkDescriptorSetLayout m_upscaleDSLayout = VK_NULL_HANDLE;
+
+  struct
+  {
+    float4 uvScaleAndMax;
+    float4 texelAndSharpness;
+  } pushConstUpscale;
+
   struct InputControlMouseEtc
   {
     bool drawFSQuad = false;
+    bool sharpenUpscale = true;
+    CullingMode culling = CullingMode::GPU;
+    bool depthPrepass = false;
+    bool cascades = true;  ///!< cascaded shadows of directional light, otherwise the light camera renders layer 0
+    bool spinInstance = false; ///!< the last instance of the scene turns, it becomes a dynamic shadow caster
+    bool casterCulling = true; ///!< shadow passes skip instances outside of the light volume
+    bool varianceShadows = false; ///!< soft shadows of the directional light from blurred moments, see ShadowFilter
   } m_input;
 
+  /**
+  \brief shadow casters which did not move are cached in a persistent layered image, a cascade is redrawn only
+         when its light matrix changes or a cached caster moves; every frame the cache is copied to the shadow map
+         and instances which have moved at least once (dynamic casters) are drawn over it
+  */
+  struct ShadowCache
+  {
+    std::vector<bool>     dynamic;         ///!< per instance, moved since the scene was loaded
+    std::vector<uint32_t> staticCasters;
+    std::vector<uint32_t> dynamicCasters;
+    float4x4 matrices[SHADOW_CASCADES];    ///!< light matrices the cached layers were drawn with
+    bool     valid [SHADOW_CASCADES] = {};
+    bool     redraw[SHADOW_CASCADES] = {}; ///!< of the frame being recorded
+  } m_shadowCache;
+
+  std::vector<uint32_t> m_shadowDrawList;  // casters of one shadow pass which passed CullShadowCasters()
+  std::vector<LiteMath::Box4f> m_atlasCasterBoxes; // world boxes of dynamic casters, for ShadowAtlas::Update()
+
+  float4x4 m_spinBase;       // matrix and bbox center of the spinning instance when spinning started
+  float3   m_spinCenter;
+  float    m_spinStart = -1.0f;
+
   /**
   \brief basic parameters that you usually need for shadow mapping
   */
@@ -166,16 +281,62 @@ private:
   } m_light;
  
   void DrawFrameSimple();
+  void DrawFrameHeadless();
+
+  // the whole frame (shadow pass, main pass, upscale and debug quad) is declared as a render graph,
+  // it creates shadow map and depth buffer, render passes and places all barriers
+  //
+  static constexpr uint32_t SHADOW_MAP_SIZE = 1024;  ///!< of every cascade
+
+  std::unique_ptr<RenderGraph> m_pRenderGraph;
+  RenderGraph::ResourceId      m_backbuffer  = 0;
+  RenderGraph::ResourceId      m_shadowMap   = 0;
+  RenderGraph::ResourceId      m_shadowStatic = 0;  ///!< persistent, static casters of every cascade
+  RenderGraph::ResourceId      m_shadowAtlas = 0;   ///!< persistent, point light shadows, see ShadowAtlas
+  RenderGraph::ResourceId      m_shadowRows  = 0;   ///!< moments of the shadow map blurred along rows
+  RenderGraph::ResourceId      m_shadowMoments = 0; ///!< blurred along both axes, read by the main pass
+  RenderGraph::ResourceId      m_sceneColor  = 0;
+  RenderGraph::ResourceId      m_cpuOcclusion = 0;
+  RenderGraph::PassId          m_shadowPass  = 0;  ///!< of the first cascade, render passes of all cascades are compatible
+  RenderGraph::PassId          m_atlasPass   = 0;
+  RenderGraph::PassId          m_prepassPass = 0;
+  RenderGraph::PassId          m_mainPass    = 0;
+  RenderGraph::PassId          m_upscalePass = 0;
+  uint32_t                     m_targetImageIdx = 0;
+
+  void SetupRenderGraph(VkFormat a_colorFormat, VkImageLayout a_colorLayout);
+  VkImage     GetTargetImage(uint32_t a_imageIdx) const;
+  VkImageView GetTargetImageView(uint32_t a_imageIdx) const;
 
   void CreateInstance();
   void CreateDevice(uint32_t a_deviceId);
 
-  void BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
-                                VkImageView a_targetImageView, VkPipeline a_pipeline);
-
-  void DrawSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp);
+  void BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, uint32_t a_imageIdx);
+
+  void DrawSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp, bool a_cpuCulled = false, bool a_depthPrepass = false);
+  void DrawCulledSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp, bool a_late);
+  void DrawInstancesCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp, const std::vector<uint32_t> &a_instances);
+  const std::vector<uint32_t> &CullShadowCasters(const float4x4 &a_lightMatrix, const std::vector<uint32_t> &a_casters);
+  float4x4 ShadowMatrix(uint32_t a_cascade) const { return m_input.cascades ? m_shadowParams.cascadeMatrices[a_cascade] : m_lightMatrix; }
+  void ResetShadowCache();
+  void CmdUpdateMovedInstances(VkCommandBuffer a_cmdBuff);
+  void SpinInstance(float a_time);
+  bool CullingEnabled() const { return m_input.culling == CullingMode::GPU && m_pCuller != nullptr && m_pCuller->IsReady(); }
+  bool CpuCullingEnabled() const { return m_input.culling == CullingMode::CPU; }
+  bool VarianceShadowsEnabled() const { return m_input.varianceShadows && m_pShadowFilter != nullptr; }
+  // GPU culled instances are drawn indirectly in instance order, the pre-pass is only used with direct draws
+  bool DepthPrepassEnabled() const { return m_input.depthPrepass && !CullingEnabled(); }
+  void CreateCpuOcclusionBuffer();
+  void DestroyCpuOcclusionBuffer();
 
   void SetupSimplePipeline();
+  GraphicsPipelineDesc ForwardPipelineDesc();
+  GraphicsPipelineDesc CulledForwardPipelineDesc();
+  GraphicsPipelineDesc DepthPrepassPipelineDesc();
+  GraphicsPipelineDesc PrepassForwardPipelineDesc();
+  GraphicsPipelineDesc ShadowPipelineDesc();
+  GraphicsPipelineDesc AtlasPipelineDesc();
+  GraphicsPipelineDesc UpscalePipelineDesc();
   void CleanupPipelineAndSwapchain();
   void RecreateSwapChain();
 
@@ -1,11 +1,34 @@
 #include "simple_compute.h"
+#include "utils/profiler.h"
 
-int main()
+#include <cstring>
+
+int main(int argc, const char** argv)
 {
-  constexpr int LENGTH = 10;
   constexpr int VULKAN_DEVICE_ID = 0;
 
-  std::shared_ptr<ICompute> app = std::make_unique<SimpleCompute>(LENGTH);
+  // --length N : elements in the arrays; --chunk N : at most N elements per dispatch, to test chunking of small arrays
+  // --primitives : check reduce, scan and compaction against CPU and measure their throughput on arrays of N elements
+  uint32_t length      = 10;
+  uint32_t chunkLength = UINT32_MAX;
+  bool     primitives  = false;
+  for(int i = 1; i < argc; ++i)
+  {
+    if(std::strcmp(argv[i], "--primitives") == 0)
+      primitives = true;
+    else if(std::strcmp(argv[i], "--length") == 0 && i + 1 < argc)
+      length = static_cast<uint32_t>(std::stoul(argv[++i]));
+    else if(std::strcmp(argv[i], "--chunk") == 0 && i + 1 < argc)
+      chunkLength = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+    else
+      std::cout << "WARNING. Unexpected command line argument: " << argv[i] << std::endl;
+  }
+
+  auto compute = std::make_shared<SimpleCompute>(length);
+  compute->SetMaxChunkLength(chunkLength);
+  compute->SetPrimitives(primitives);
+
+  std::shared_ptr<ICompute> app = compute;
   if(app == nullptr)
   {
     std::cout << "Can't create render of specified type" << std::endl;
@@ -16,5 +39,7 @@ int main()
 
   app->Execute();
 
+  PROFILE_DUMP("profile_trace.json");
+
   return 0;
 }
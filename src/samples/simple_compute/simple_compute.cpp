@@ -3,6 +3,15 @@
 #include <vk_pipeline.h>
 #include <vk_buffers.h>
 #include <vk_utils.h>
+#include "../../render/compute_primitives.h"
+#include "../../render/gpu_timer.h"
+#include "../../utils/profiler.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <random>
 
 SimpleCompute::SimpleCompute(uint32_t a_length) : m_length(a_length)
 {
@@ -37,6 +46,8 @@ void SimpleCompute::InitVulkan(const char** a_instanceExtensions, uint32_t a_ins
 
   m_cmdBufferCompute = vk_utils::createCommandBuffers(m_device, m_commandPool, 1)[0];
   
+  m_pPipelineCache = std::make_unique<PipelineCache>(m_device, m_physicalDevice);
+  m_pAllocator     = std::make_shared<DeviceAllocator>(m_device, m_physicalDevice);
   m_pCopyHelper = std::make_shared<vk_utils::SimpleCopyHelper>(m_physicalDevice, m_device, m_transferQueue, m_queueFamilyIDXs.compute, 8*1024*1024);
 }
 
@@ -70,44 +81,84 @@ void SimpleCompute::CreateDevice(uint32_t a_deviceId)
 }
 
 
+uint32_t SimpleCompute::ChunkLength() const
+{
+  VkPhysicalDeviceMaintenance3Properties maintenance3 = {};
+  maintenance3.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES;
+  VkPhysicalDeviceProperties2 props = {};
+  props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  props.pNext = &maintenance3;
+  vkGetPhysicalDeviceProperties2(m_physicalDevice, &props);
+
+  // every array of a chunk must be bindable as a whole, and the three of them share one allocation
+  VkDeviceSize maxBytes = props.properties.limits.maxStorageBufferRange;
+  if(maintenance3.maxMemoryAllocationSize != 0)
+    maxBytes = std::min(maxBytes, maintenance3.maxMemoryAllocationSize / 3);
+
+  VkDeviceSize length = std::min<VkDeviceSize>(maxBytes / sizeof(float), m_maxChunkLength);
+  if(length > SIMPLE_COMPUTE_GROUP)
+    length -= length % SIMPLE_COMPUTE_GROUP;
+  return static_cast<uint32_t>(std::max<VkDeviceSize>(length, 1));
+}
+
 void SimpleCompute::SetupSimplePipeline()
 {
+  PROFILE_FUNCTION();
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &props);
+  m_maxGroups = props.limits.maxComputeWorkGroupCount[0];
+
+  const uint32_t chunkLength = ChunkLength();
+  const uint32_t chunksNum   = static_cast<uint32_t>(std::max<uint64_t>((uint64_t(m_length) + chunkLength - 1) / chunkLength, 1));
+
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,             3}
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,             3 * chunksNum}
   };
+  m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, chunksNum);
 
-  // Создание и аллокация буферов
-  m_A = vk_utils::createBuffer(m_device, sizeof(float) * m_length, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                                                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-  m_B = vk_utils::createBuffer(m_device, sizeof(float) * m_length, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                                                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-  m_sum = vk_utils::createBuffer(m_device, sizeof(float) * m_length, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                                                                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-  vk_utils::allocateAndBindWithPadding(m_device, m_physicalDevice, {m_A, m_B, m_sum}, 0);
-
-  m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 1);
-
-  // Создание descriptor set для передачи буферов в шейдер
-  m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
-  m_pBindings->BindBuffer(0, m_A);
-  m_pBindings->BindBuffer(1, m_B);
-  m_pBindings->BindBuffer(2, m_sum);
-  m_pBindings->BindEnd(&m_sumDS, &m_sumDSLayout);
-
-  // Заполнение буферов
-  std::vector<float> values(m_length);
-  for (uint32_t i = 0; i < values.size(); ++i) {
-    values[i] = (float)i;
-  }
-  m_pCopyHelper->UpdateBuffer(m_A, 0, values.data(), sizeof(float) * values.size());
-  for (uint32_t i = 0; i < values.size(); ++i) {
-    values[i] = (float)i * i;
+  std::vector<float> values(std::min(m_length, chunkLength));
+  m_chunks.resize(chunksNum);
+  for(uint32_t i = 0; i < chunksNum; ++i)
+  {
+    Chunk &chunk = m_chunks[i];
+    chunk.first  = i * chunkLength;
+    chunk.length = std::min(m_length - chunk.first, chunkLength);
+
+    // Создание и аллокация буферов
+    const VkDeviceSize size = sizeof(float) * std::max(chunk.length, 1u);
+    chunk.A   = vk_utils::createBuffer(m_device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    chunk.B   = vk_utils::createBuffer(m_device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    chunk.sum = vk_utils::createBuffer(m_device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    chunk.alloc = m_pAllocator->AllocateForBuffers({chunk.A, chunk.B, chunk.sum}, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    // Создание descriptor set для передачи буферов в шейдер
+    m_pBindings->BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+    m_pBindings->BindBuffer(0, chunk.A);
+    m_pBindings->BindBuffer(1, chunk.B);
+    m_pBindings->BindBuffer(2, chunk.sum);
+    m_pBindings->BindEnd(&chunk.sumDS, &m_sumDSLayout);
+
+    // Заполнение буферов
+    for (uint32_t j = 0; j < chunk.length; ++j) {
+      values[j] = (float)(chunk.first + j);
+    }
+    m_pCopyHelper->UpdateBuffer(chunk.A, 0, values.data(), sizeof(float) * chunk.length);
+    for (uint32_t j = 0; j < chunk.length; ++j) {
+      values[j] = (float)(chunk.first + j) * (chunk.first + j);
+    }
+    m_pCopyHelper->UpdateBuffer(chunk.B, 0, values.data(), sizeof(float) * chunk.length);
   }
-  m_pCopyHelper->UpdateBuffer(m_B, 0, values.data(), sizeof(float) * values.size());
+
+  std::cout << "[SimpleCompute] " << m_length << " elements in " << chunksNum << " chunk(s) of up to "
+            << chunkLength << std::endl;
 }
 
 void SimpleCompute::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkPipeline)
 {
+  PROFILE_FUNCTION();
   vkResetCommandBuffer(a_cmdBuff, 0);
 
   VkCommandBufferBeginInfo beginInfo = {};
@@ -117,12 +168,17 @@ void SimpleCompute::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkPipeli
   // Заполняем буфер команд
   VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
 
-  vkCmdBindPipeline      (a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
-  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_layout, 0, 1, &m_sumDS, 0, NULL);
-
-  vkCmdPushConstants(a_cmdBuff, m_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(m_length), &m_length);
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
 
-  vkCmdDispatch(a_cmdBuff, 1, 1, 1);
+  // chunks are independent, no barriers between them
+  for(const Chunk &chunk : m_chunks)
+  {
+    if(chunk.length == 0)
+      continue;
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_layout, 0, 1, &chunk.sumDS, 0, NULL);
+    vkCmdPushConstants(a_cmdBuff, m_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(chunk.length), &chunk.length);
+    vkCmdDispatch(a_cmdBuff, GridSize(chunk.length, SIMPLE_COMPUTE_GROUP, m_maxGroups), 1, 1);
+  }
 
   VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
 }
@@ -135,9 +191,14 @@ void SimpleCompute::CleanupPipeline()
     vkFreeCommandBuffers(m_device, m_commandPool, 1, &m_cmdBufferCompute);
   }
 
-  vkDestroyBuffer(m_device, m_A, nullptr);
-  vkDestroyBuffer(m_device, m_B, nullptr);
-  vkDestroyBuffer(m_device, m_sum, nullptr);
+  for(Chunk &chunk : m_chunks)
+  {
+    vkDestroyBuffer(m_device, chunk.A, nullptr);
+    vkDestroyBuffer(m_device, chunk.B, nullptr);
+    vkDestroyBuffer(m_device, chunk.sum, nullptr);
+    m_pAllocator->Free(chunk.alloc);
+  }
+  m_chunks.clear();
 
   vkDestroyPipelineLayout(m_device, m_layout, nullptr);
   vkDestroyPipeline(m_device, m_pipeline, nullptr);
@@ -147,6 +208,8 @@ void SimpleCompute::CleanupPipeline()
 void SimpleCompute::Cleanup()
 {
   CleanupPipeline();
+  m_pPipelineCache = nullptr;
+  m_pAllocator     = nullptr;
 
   if (m_commandPool != VK_NULL_HANDLE)
   {
@@ -157,6 +220,7 @@ void SimpleCompute::Cleanup()
 
 void SimpleCompute::CreateComputePipeline()
 {
+  PROFILE_FUNCTION();
   // Загружаем шейдер
   std::vector<uint32_t> code = vk_utils::readSPVFile("../resources/shaders/simple.comp.spv");
   VkShaderModuleCreateInfo createInfo = {};
@@ -176,7 +240,7 @@ void SimpleCompute::CreateComputePipeline()
 
   VkPushConstantRange pcRange = {};
   pcRange.offset = 0;
-  pcRange.size = sizeof(m_length);
+  pcRange.size = sizeof(uint32_t);
   pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
   // Создаём layout для pipeline
@@ -194,7 +258,7 @@ void SimpleCompute::CreateComputePipeline()
   pipelineCreateInfo.layout = m_layout;
 
   // Создаём pipeline - объект, который выставляет шейдер и его параметры
-  VK_CHECK_RESULT(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL, &m_pipeline));
+  m_pipeline = m_pPipelineCache->MakeComputePipeline(pipelineCreateInfo);
 
   vkDestroyShaderModule(m_device, shaderModule, nullptr);
 }
@@ -202,6 +266,12 @@ void SimpleCompute::CreateComputePipeline()
 
 void SimpleCompute::Execute()
 {
+  PROFILE_FUNCTION();
+  if (m_primitives) {
+    RunPrimitives();
+    return;
+  }
+
   SetupSimplePipeline();
   CreateComputePipeline();
 
@@ -223,9 +293,227 @@ void SimpleCompute::Execute()
   //Ждём конца выполнения команд
   VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, 100000000000));
 
-  std::vector<float> values(m_length);
-  m_pCopyHelper->ReadBuffer(m_sum, 0, values.data(), sizeof(float) * values.size());
-  for (auto v: values) {
-    std::cout << v << ' ';
+  // read back chunk by chunk and compare with the same float operations on CPU, allowing for contraction into fma
+  constexpr uint32_t PRINT_MAX = 16;
+  uint64_t errors = 0;
+  std::vector<float> values;
+  for(const Chunk &chunk : m_chunks)
+  {
+    values.resize(chunk.length);
+    m_pCopyHelper->ReadBuffer(chunk.sum, 0, values.data(), sizeof(float) * values.size());
+    for (uint32_t j = 0; j < chunk.length; ++j) {
+      const uint32_t i = chunk.first + j;
+      if (i < PRINT_MAX) {
+        std::cout << values[j] << ' ';
+      }
+      const float reference = (float)i + (float)i * i;
+      if (std::abs(values[j] - reference) > 4.0f * FLT_EPSILON * reference) {
+        ++errors;
+      }
+    }
+  }
+  if (m_length > PRINT_MAX) {
+    std::cout << "...";
+  }
+  std::cout << std::endl << "[SimpleCompute] " << errors << " wrong elements of " << m_length << std::endl;
+}
+
+
+void SimpleCompute::RunPrimitives()
+{
+  PROFILE_FUNCTION();
+  constexpr uint32_t REPEATS = 10;
+
+  // the primitives bind buffers whole
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &props);
+  const uint32_t length = static_cast<uint32_t>(std::min<VkDeviceSize>(m_length, props.limits.maxStorageBufferRange / sizeof(uint32_t)));
+
+  ComputePrimitives primitives(m_device, m_physicalDevice, m_pAllocator, *m_pPipelineCache);
+  primitives.SetMaxLength(length);
+  GpuFrameTimer timer(m_device, m_physicalDevice, m_queueFamilyIDXs.compute, 1);
+
+  std::cout << "[SimpleCompute] primitives on " << length << " elements, subgroups "
+            << (primitives.Subgroups() ? "are" : "are not") << " supported" << std::endl;
+
+  // sums of uints wrap around the same way on CPU and GPU, floats are in [0, 1), every other flag is set on average
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<uint32_t> uints(length), floats(length), flags(length);
+  for (uint32_t i = 0; i < length; ++i) {
+    uints[i] = rng();
+    const float f = unit(rng);
+    std::memcpy(&floats[i], &f, sizeof(float));
+    flags[i] = rng() & 1;
+  }
+
+  const VkDeviceSize size = sizeof(uint32_t) * std::max(length, 1u);
+  const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  VkBuffer uintsBuf  = vk_utils::createBuffer(m_device, size, usage);
+  VkBuffer floatsBuf = vk_utils::createBuffer(m_device, size, usage);
+  VkBuffer flagsBuf  = vk_utils::createBuffer(m_device, size, usage);
+  VkBuffer outputBuf = vk_utils::createBuffer(m_device, size, usage);
+  VkBuffer resultBuf = vk_utils::createBuffer(m_device, sizeof(uint32_t), usage);
+  DeviceAllocation alloc = m_pAllocator->AllocateForBuffers({uintsBuf, floatsBuf, flagsBuf, outputBuf, resultBuf},
+                                                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_pCopyHelper->UpdateBuffer(uintsBuf, 0, uints.data(), sizeof(uint32_t) * length);
+  m_pCopyHelper->UpdateBuffer(floatsBuf, 0, floats.data(), sizeof(uint32_t) * length);
+  m_pCopyHelper->UpdateBuffer(flagsBuf, 0, flags.data(), sizeof(uint32_t) * length);
+
+  VkFenceCreateInfo fenceCreateInfo = {};
+  fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  VkFence fence = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateFence(m_device, &fenceCreateInfo, NULL, &fence));
+
+  // records a_record REPEATS times, returns GPU time of one run in ms, 0 if timestamps are not supported
+  auto run = [&](const std::function<void(VkCommandBuffer)> &a_record) {
+    primitives.BeginFrame(0);  // the previous run was waited for
+    vkResetCommandBuffer(m_cmdBufferCompute, 0);
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_cmdBufferCompute, &beginInfo));
+
+    timer.CmdBegin(m_cmdBufferCompute, 0);
+    for (uint32_t i = 0; i < REPEATS; ++i) {
+      a_record(m_cmdBufferCompute);
+
+      VkMemoryBarrier barrier = {};
+      barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT |
+                              VK_ACCESS_TRANSFER_WRITE_BIT;
+      const VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+      vkCmdPipelineBarrier(m_cmdBufferCompute, stages, stages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+    timer.CmdEnd(m_cmdBufferCompute, 0);
+    VK_CHECK_RESULT(vkEndCommandBuffer(m_cmdBufferCompute));
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_cmdBufferCompute;
+    VK_CHECK_RESULT(vkQueueSubmit(m_computeQueue, 1, &submitInfo, fence));
+    timer.OnSubmit(0);
+    VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &fence, VK_TRUE, 100000000000));
+    VK_CHECK_RESULT(vkResetFences(m_device, 1, &fence));
+    return timer.CollectResult(0) ? timer.LastFrameMs() / REPEATS : 0.0f;
+  };
+
+  // plain copy of the array reads and writes it once, primitives are compared with its bandwidth
+  float copyGBs = 0.0f;
+  auto report = [&](const std::string &a_name, bool a_ok, float a_ms, VkDeviceSize a_bytes) {
+    std::cout << "[SimpleCompute] " << a_name << ": " << (a_ok ? "ok" : "WRONG");
+    if (a_ms > 0.0f) {
+      const float gbs = float(a_bytes) / (a_ms * 1e6f);
+      std::cout << ", " << a_ms << " ms, " << gbs << " GB/s";
+      if (copyGBs > 0.0f) {
+        std::cout << " (" << int(100.0f * gbs / copyGBs) << "% of copy)";
+      }
+    }
+    std::cout << std::endl;
+  };
+
+  const VkDeviceSize bytes = sizeof(uint32_t) * VkDeviceSize(length);
+  const float copyMs = run([&](VkCommandBuffer a_cmdBuff) {
+    VkBufferCopy region = {0, 0, size};
+    vkCmdCopyBuffer(a_cmdBuff, uintsBuf, outputBuf, 1, &region);
+  });
+  report("copy", true, copyMs, 2 * bytes);
+  copyGBs = copyMs > 0.0f ? float(2 * bytes) / (copyMs * 1e6f) : 0.0f;
+
+  // reduce, CPU sums floats in double
+  const char* opNames[] = {"sum", "min", "max"};
+  for (auto op : {ComputePrimitives::Op::SUM, ComputePrimitives::Op::MIN, ComputePrimitives::Op::MAX}) {
+    for (auto type : {ComputePrimitives::Type::UINT, ComputePrimitives::Type::FLOAT}) {
+      const bool isFloat = type == ComputePrimitives::Type::FLOAT;
+      const float ms = run([&](VkCommandBuffer a_cmdBuff) {
+        primitives.CmdReduce(a_cmdBuff, isFloat ? floatsBuf : uintsBuf, length, op, type, resultBuf);
+      });
+      uint32_t gpu = 0;
+      m_pCopyHelper->ReadBuffer(resultBuf, 0, &gpu, sizeof(uint32_t));
+
+      bool ok = false;
+      if (isFloat) {
+        double sum = 0.0;
+        float  minValue = INFINITY, maxValue = -INFINITY;
+        for (uint32_t bits : floats) {
+          float f;
+          std::memcpy(&f, &bits, sizeof(float));
+          sum += f;
+          minValue = std::min(minValue, f);
+          maxValue = std::max(maxValue, f);
+        }
+        float value;
+        std::memcpy(&value, &gpu, sizeof(float));
+        if (op == ComputePrimitives::Op::SUM) {
+          ok = std::abs(value - sum) <= 1e-4 * std::max(sum, 1.0);
+        } else {
+          ok = value == (op == ComputePrimitives::Op::MIN ? minValue : maxValue);
+        }
+      } else {
+        uint32_t sum = 0, minValue = UINT32_MAX, maxValue = 0;
+        for (uint32_t v : uints) {
+          sum += v;
+          minValue = std::min(minValue, v);
+          maxValue = std::max(maxValue, v);
+        }
+        ok = gpu == (op == ComputePrimitives::Op::SUM ? sum : (op == ComputePrimitives::Op::MIN ? minValue : maxValue));
+      }
+      report(std::string("reduce ") + opNames[uint32_t(op)] + (isFloat ? " float" : " uint"), ok, ms, bytes);
+    }
+  }
+
+  // scan and compaction with both paths if the single pass one is supported
+  std::vector<uint32_t> gpu(length), cpu(length);
+  std::vector<bool> paths = {false};
+  if (primitives.Subgroups()) {
+    paths.push_back(true);
+  }
+  for (bool singlePass : paths) {
+    primitives.SetSinglePass(singlePass);
+    const std::string path = singlePass ? " (single pass)" : " (multi-pass)";
+
+    for (bool inclusive : {false, true}) {
+      const float ms = run([&](VkCommandBuffer a_cmdBuff) {
+        primitives.CmdScan(a_cmdBuff, uintsBuf, outputBuf, length, inclusive);
+      });
+      m_pCopyHelper->ReadBuffer(outputBuf, 0, gpu.data(), sizeof(uint32_t) * length);
+
+      uint32_t sum = 0;
+      for (uint32_t i = 0; i < length; ++i) {
+        cpu[i] = inclusive ? sum + uints[i] : sum;
+        sum += uints[i];
+      }
+      report(std::string(inclusive ? "inclusive" : "exclusive") + " scan" + path, gpu == cpu, ms, 2 * bytes);
+    }
+
+    const float ms = run([&](VkCommandBuffer a_cmdBuff) {
+      primitives.CmdCompact(a_cmdBuff, uintsBuf, flagsBuf, outputBuf, resultBuf, length);
+    });
+    uint32_t count = 0;
+    m_pCopyHelper->ReadBuffer(resultBuf, 0, &count, sizeof(uint32_t));
+    cpu.clear();
+    for (uint32_t i = 0; i < length; ++i) {
+      if (flags[i] != 0) {
+        cpu.push_back(uints[i]);
+      }
+    }
+    bool ok = count == cpu.size();
+    if (ok && count != 0) {
+      gpu.resize(count);
+      m_pCopyHelper->ReadBuffer(outputBuf, 0, gpu.data(), sizeof(uint32_t) * count);
+      ok = gpu == cpu;
+    }
+    report("compaction" + path, ok, ms, 2 * bytes + sizeof(uint32_t) * VkDeviceSize(count));
+    gpu.resize(length);
+    cpu.resize(length);
+  }
+
+  vkDestroyFence(m_device, fence, nullptr);
+  for (VkBuffer buffer : {uintsBuf, floatsBuf, flagsBuf, outputBuf, resultBuf}) {
+    vkDestroyBuffer(m_device, buffer, nullptr);
   }
+  m_pAllocator->Free(alloc);
 }
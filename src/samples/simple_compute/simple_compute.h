@@ -3,6 +3,8 @@
 
 #define VK_NO_PROTOTYPES
 #include "../../render/compute_common.h"
+#include "../../render/pipeline_cache.h"
+#include "../../render/device_allocator.h"
 #include "../resources/shaders/common.h"
 #include <vk_descriptor_sets.h>
 #include <vk_copy.h>
@@ -10,6 +12,7 @@
 #include <string>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 class SimpleCompute : public ICompute
 {
@@ -17,6 +20,13 @@ public:
   SimpleCompute(uint32_t a_length);
   ~SimpleCompute()  { Cleanup(); };
 
+  // arrays are split into chunks which fit into maxStorageBufferRange and maxMemoryAllocationSize,
+  // a smaller limit can be set before Execute() to test chunking on small arrays
+  void SetMaxChunkLength(uint32_t a_length) { m_maxChunkLength = a_length; }
+
+  // Execute() checks ComputePrimitives against CPU and measures their throughput instead of adding the arrays
+  void SetPrimitives(bool a_enabled) { m_primitives = a_enabled; }
+
   inline VkInstance   GetVkInstance() const override { return m_instance; }
   void InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId) override;
 
@@ -64,6 +74,9 @@ private:
   std::shared_ptr<vk_utils::DescriptorMaker> m_pBindings = nullptr;
 
   uint32_t m_length  = 16u;
+  uint32_t m_maxChunkLength = UINT32_MAX;
+  uint32_t m_maxGroups      = 65535u;  ///!< maxComputeWorkGroupCount[0]
+  bool     m_primitives     = false;
   
   VkPhysicalDeviceFeatures m_enabledDeviceFeatures = {};
   std::vector<const char*> m_deviceExtensions      = {};
@@ -72,24 +85,38 @@ private:
   bool m_enableValidation;
   std::vector<const char*> m_validationLayers;
   std::shared_ptr<vk_utils::ICopyEngine> m_pCopyHelper;
+  std::unique_ptr<PipelineCache> m_pPipelineCache;
+  std::shared_ptr<DeviceAllocator> m_pAllocator;
+
+  // part of the arrays with its own buffers and descriptor set, one dispatch per chunk
+  struct Chunk
+  {
+    uint32_t         first  = 0;
+    uint32_t         length = 0;
+    VkBuffer         A = VK_NULL_HANDLE, B = VK_NULL_HANDLE, sum = VK_NULL_HANDLE;
+    DeviceAllocation alloc;
+    VkDescriptorSet  sumDS = VK_NULL_HANDLE;
+  };
 
-  VkDescriptorSet       m_sumDS; 
   VkDescriptorSetLayout m_sumDSLayout = nullptr;
   
-  VkPipeline m_pipeline;
-  VkPipelineLayout m_layout;
+  VkPipeline m_pipeline = VK_NULL_HANDLE;
+  VkPipelineLayout m_layout = VK_NULL_HANDLE;
 
-  VkBuffer m_A, m_B, m_sum;
+  std::vector<Chunk> m_chunks;
  
   void CreateInstance();
   void CreateDevice(uint32_t a_deviceId);
 
   void BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline);
 
+  uint32_t ChunkLength() const;
   void SetupSimplePipeline();
   void CreateComputePipeline();
   void CleanupPipeline();
 
+  void RunPrimitives();
+
   void Cleanup();
 
   void SetupValidationLayers();
@@ -1,6 +1,10 @@
 #include "simple_render.h"
 #include "create_render.h"
 #include "utils/glfw_window.h"
+#include "utils/headless_loop.h"
+#include "utils/benchmark.h"
+
+#include <chrono>
 
 void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int deviceID, bool showGUI)
 {
@@ -27,7 +31,7 @@ void initVulkanGLFW(std::shared_ptr<IRender> &app, GLFWwindow* window, int devic
   }
 }
 
-int main()
+int main(int argc, const char** argv)
 {
   constexpr int WIDTH = 1024;
   constexpr int HEIGHT = 1024;
@@ -35,8 +39,33 @@ int main()
 
   bool showGUI = true;
 
-  std::shared_ptr<IRender> app = CreateRender(WIDTH, HEIGHT, RenderEngineType::SIMPLE_FORWARD);
-//  std::shared_ptr<IRender> app = CreateRender(WIDTH, HEIGHT, RenderEngineType::SIMPLE_TEXTURE);
+  // time from launch to the loaded scene, compare cold and warm pipeline cache with it
+  const auto startupBegin = std::chrono::steady_clock::now();
+  auto printStartupTime = [&startupBegin]() {
+    std::cout << "Startup time: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count()
+              << " ms" << std::endl;
+  };
+
+  // --headless [--frames N] [--save-every N] [--out dir] : render without window, i.e. on machines with no display
+  auto params = readCommandLineParams(argc, argv);
+  const bool headless = params.count("--headless") != 0;
+
+  // --benchmark camera_path.cpath [--results file.json] [--label name] [--timestep sec] [--warmup N] : replay camera path
+  BenchmarkParams benchParams;
+  bool benchmark = false;
+  if(!readBenchmarkParams(params, benchParams, benchmark))
+    return 1;
+
+  // --renderer forward|texture|deferred : SIMPLE_FORWARD by default, compare GPU time of forward and deferred with --benchmark
+  auto renderType = RenderEngineType::SIMPLE_FORWARD;
+  if(params.count("--renderer"))
+  {
+    const std::string renderer = params["--renderer"];
+    renderType = renderer == "texture"  ? RenderEngineType::SIMPLE_TEXTURE :
+                 renderer == "deferred" ? RenderEngineType::SIMPLE_DEFERRED : RenderEngineType::SIMPLE_FORWARD;
+  }
+
+  std::shared_ptr<IRender> app = CreateRender(WIDTH, HEIGHT, renderType);
 
   if(app == nullptr)
   {
@@ -44,11 +73,43 @@ int main()
     return 1;
   }
 
+  // [--frames-in-flight N] [--present-mode fifo|mailbox] [--fps-limit F] : latency versus throughput
+  app->SetFramePacing(readFramePacingParams(params));
+
+  // --depth-prepass : depth-only pass before the main one, 'Z' toggles it at runtime
+  app->SetDepthPrepass(params.count("--depth-prepass") != 0);
+
+  if(headless)
+  {
+    HeadlessParams headlessParams;
+    uint32_t framesNum = 1000u;
+    if(!readUintParam(params, "--save-every", headlessParams.saveEveryNthFrame) ||
+       !readUintParam(params, "--frames", framesNum))
+      return 1;
+    if(params.count("--out"))
+      headlessParams.outputDir = params["--out"];
+
+    app->InitVulkan(nullptr, 0, VULKAN_DEVICE_ID);
+    app->InitPresentationHeadless(headlessParams);
+    app->LoadScene("../resources/scenes/043_cornell_normals/statex_00001.xml", false);
+    printStartupTime();
+
+    if(benchmark)
+      return runCameraPathBenchmark(app, benchParams) ? 0 : 1;
+
+    mainLoopHeadless(app, framesNum);
+    return 0;
+  }
+
   auto* window = initWindow(WIDTH, HEIGHT);
 
   initVulkanGLFW(app, window, VULKAN_DEVICE_ID, showGUI);
 
   app->LoadScene("../resources/scenes/043_cornell_normals/statex_00001.xml", false);
+  printStartupTime();
+
+  if(benchmark)
+    return runCameraPathBenchmark(app, benchParams, [] { glfwPollEvents(); }) ? 0 : 1;
 
   mainLoop(app, window, showGUI);
 
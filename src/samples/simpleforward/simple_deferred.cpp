@@ -0,0 +1,453 @@
+#include "simple_deferred.h"
+#include "../../utils/profiler.h"
+
+#include <vk_pipeline.h>
+#include <array>
+
+
+SimpleDeferredRender::SimpleDeferredRender(uint32_t a_width, uint32_t a_height) : SimpleRender(a_width, a_height)
+{
+}
+
+VkRenderPass SimpleDeferredRender::CreateScreenRenderPass()
+{
+  const VkFormat      targetFormat = m_pHeadless != nullptr ? m_pHeadless->GetFormat() : m_swapchain.GetFormat();
+  const VkImageLayout targetLayout = m_pHeadless != nullptr ? HeadlessTarget::FINAL_LAYOUT : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  // target is fully overwritten by the lighting subpass, G-buffer and depth live only inside the render pass
+  std::array<VkAttachmentDescription, 3> attachments = {};
+  attachments[0].format         = targetFormat;
+  attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+  attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[0].finalLayout    = targetLayout;
+
+  attachments[1].format         = GBUFFER_FORMAT;
+  attachments[1].samples        = VK_SAMPLE_COUNT_1_BIT;
+  attachments[1].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].storeOp        = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[1].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  attachments[2].format         = m_depthBuffer.format;
+  attachments[2].samples        = VK_SAMPLE_COUNT_1_BIT;
+  attachments[2].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[2].storeOp        = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[2].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[2].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[2].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+  VkAttachmentReference gbufferOutput = {1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depthOutput   = {2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference targetOutput  = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  std::array<VkAttachmentReference, 2> lightingInputs = {
+    VkAttachmentReference{1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+    VkAttachmentReference{2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL}
+  };
+
+  std::array<VkSubpassDescription, 2> subpasses = {};
+  subpasses[SUBPASS_GBUFFER].pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpasses[SUBPASS_GBUFFER].colorAttachmentCount    = 1;
+  subpasses[SUBPASS_GBUFFER].pColorAttachments       = &gbufferOutput;
+  subpasses[SUBPASS_GBUFFER].pDepthStencilAttachment = &depthOutput;
+
+  subpasses[SUBPASS_LIGHTING].pipelineBindPoint    = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpasses[SUBPASS_LIGHTING].inputAttachmentCount = static_cast<uint32_t>(lightingInputs.size());
+  subpasses[SUBPASS_LIGHTING].pInputAttachments    = lightingInputs.data();
+  subpasses[SUBPASS_LIGHTING].colorAttachmentCount = 1;
+  subpasses[SUBPASS_LIGHTING].pColorAttachments    = &targetOutput;
+
+  // the previous frame reads G-buffer and depth in its lighting subpass (and copies the headless image) before they
+  // are overwritten; within the frame every pixel is lit from the G-buffer texels of the same pixel, so by region
+  std::array<VkSubpassDependency, 3> dependencies = {};
+  dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass      = SUBPASS_GBUFFER;
+  dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].srcAccessMask   = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  dependencies[1].srcSubpass      = SUBPASS_GBUFFER;
+  dependencies[1].dstSubpass      = SUBPASS_LIGHTING;
+  dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstAccessMask   = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+  dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  dependencies[2].srcSubpass      = SUBPASS_LIGHTING;
+  dependencies[2].dstSubpass      = VK_SUBPASS_EXTERNAL;
+  dependencies[2].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[2].dstStageMask    = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[2].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[2].dstAccessMask   = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  VkRenderPassCreateInfo renderPassInfo = {};
+  renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments    = attachments.data();
+  renderPassInfo.subpassCount    = static_cast<uint32_t>(subpasses.size());
+  renderPassInfo.pSubpasses      = subpasses.data();
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  renderPassInfo.pDependencies   = dependencies.data();
+
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &renderPass));
+  return renderPass;
+}
+
+vk_utils::VulkanImageMem SimpleDeferredRender::CreateTransientAttachment(VkFormat a_format, VkImageUsageFlags a_usage,
+                                                                         VkImageAspectFlags a_aspect, DeviceAllocation &a_alloc)
+{
+  vk_utils::VulkanImageMem result {};
+  result.format = a_format;
+
+  VkImageCreateInfo imageInfo = {};
+  imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imageInfo.format        = a_format;
+  imageInfo.extent        = VkExtent3D{m_width, m_height, 1};
+  imageInfo.mipLevels     = 1;
+  imageInfo.arrayLayers   = 1;
+  imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage         = a_usage | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK_RESULT(vkCreateImage(m_device, &imageInfo, nullptr, &result.image));
+
+  // lazily allocated memory is backed only if the attachment ever leaves tile memory, desktop GPUs don't have it
+  VkMemoryRequirements memReq = {};
+  vkGetImageMemoryRequirements(m_device, result.image, &memReq);
+  VkPhysicalDeviceMemoryProperties memProps = {};
+  vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProps);
+
+  VkMemoryPropertyFlags props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  for(uint32_t i = 0; i < memProps.memoryTypeCount; ++i)
+  {
+    if((memReq.memoryTypeBits & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+    {
+      props |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+      break;
+    }
+  }
+  a_alloc = m_pAllocator->AllocateForImage(result.image, props, true);
+
+  VkImageViewCreateInfo viewInfo = {};
+  viewInfo.sType            = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image            = result.image;
+  viewInfo.viewType         = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format           = a_format;
+  viewInfo.subresourceRange = {a_aspect, 0, 1, 0, 1}; // depth only, input attachment view must have a single aspect
+  VK_CHECK_RESULT(vkCreateImageView(m_device, &viewInfo, nullptr, &result.view));
+
+  return result;
+}
+
+void SimpleDeferredRender::CreateScreenTargets()
+{
+  m_gbuffer      = CreateTransientAttachment(GBUFFER_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                                             VK_IMAGE_ASPECT_COLOR_BIT, m_gbufferAlloc);
+  m_gbufferDepth = CreateTransientAttachment(m_depthBuffer.format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                                             VK_IMAGE_ASPECT_DEPTH_BIT, m_gbufferDepthAlloc);
+
+  const uint32_t imagesNum = m_pHeadless != nullptr ? m_pHeadless->GetImageCount() : m_swapchain.GetImageCount();
+  m_frameBuffers.resize(imagesNum);
+  for(uint32_t i = 0; i < imagesNum; ++i)
+  {
+    std::array<VkImageView, 3> views = {GetTargetImageView(i), m_gbuffer.view, m_gbufferDepth.view};
+
+    VkFramebufferCreateInfo frameBufferInfo = {};
+    frameBufferInfo.sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    frameBufferInfo.renderPass      = m_screenRenderPass;
+    frameBufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+    frameBufferInfo.pAttachments    = views.data();
+    frameBufferInfo.width           = m_width;
+    frameBufferInfo.height          = m_height;
+    frameBufferInfo.layers          = 1;
+    VK_CHECK_RESULT(vkCreateFramebuffer(m_device, &frameBufferInfo, nullptr, &m_frameBuffers[i]));
+  }
+
+  CreateLightingDescriptorSet();
+}
+
+void SimpleDeferredRender::ReleaseScreenTargets()
+{
+  for(auto frameBuffer : m_frameBuffers)
+    m_pDeletionQueue->PushFramebuffer(m_device, frameBuffer);
+  m_frameBuffers.clear();
+
+  m_pDeletionQueue->Push([device = m_device, pAllocator = m_pAllocator,
+                          images = std::array<vk_utils::VulkanImageMem, 2>{m_gbuffer, m_gbufferDepth},
+                          allocs = std::array<DeviceAllocation, 2>{m_gbufferAlloc, m_gbufferDepthAlloc}]() mutable {
+    for(auto &image : images)
+    {
+      vkDestroyImageView(device, image.view, nullptr);
+      vkDestroyImage(device, image.image, nullptr);
+    }
+    for(auto &alloc : allocs)
+      pAllocator->Free(alloc);
+  });
+  m_gbuffer           = {};
+  m_gbufferDepth      = {};
+  m_gbufferAlloc      = {};
+  m_gbufferDepthAlloc = {};
+}
+
+void SimpleDeferredRender::CreateLightingDescriptorSet()
+{
+  if(m_lightingDSLayout == VK_NULL_HANDLE)
+  {
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+    for(uint32_t i = 0; i < bindings.size(); ++i)
+    {
+      bindings[i].binding         = i;
+      bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings    = bindings.data();
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_lightingDSLayout));
+
+    VkDescriptorPoolSize poolSize = {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, static_cast<uint32_t>(bindings.size())};
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets       = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes    = &poolSize;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_lightingDSPool));
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool     = m_lightingDSPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts        = &m_lightingDSLayout;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_device, &allocInfo, &m_lightingDS));
+  }
+
+  // rewritten in place on resize: RecreateSwapChain has waited for all frames, so none of them uses the set
+  std::array<VkDescriptorImageInfo, 2> imageInfos = {
+    VkDescriptorImageInfo{VK_NULL_HANDLE, m_gbuffer.view,      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+    VkDescriptorImageInfo{VK_NULL_HANDLE, m_gbufferDepth.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL}
+  };
+  std::array<VkWriteDescriptorSet, 2> writes = {};
+  for(uint32_t i = 0; i < writes.size(); ++i)
+  {
+    writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet          = m_lightingDS;
+    writes[i].dstBinding      = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType  = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    writes[i].pImageInfo      = &imageInfos[i];
+  }
+  vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void SimpleDeferredRender::SetupSimplePipeline()
+{
+  PROFILE_FUNCTION();
+  std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             1}
+  };
+
+  if(m_pBindings == nullptr)
+    m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 1);
+
+  m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
+  m_pBindings->BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
+
+  // pipeline layouts and render pass are read by the shader reloader thread when it rebuilds the pipelines
+  auto pauseReload = m_pShaderReloader->PauseBuilds();
+
+  m_pDeletionQueue->PushPipelineLayout(m_device, m_basicForwardPipeline.layout);
+  m_pDeletionQueue->PushPipelineLayout(m_device, m_lightingPipeline.layout);
+  m_pDeletionQueue->PushPipeline(m_device, m_basicForwardPipeline.pipeline);
+  m_pDeletionQueue->PushPipeline(m_device, m_lightingPipeline.pipeline);
+  m_basicForwardPipeline = {};
+  m_lightingPipeline     = {};
+
+  vk_utils::GraphicsPipelineMaker layoutMaker;
+  m_basicForwardPipeline.layout = layoutMaker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
+  m_lightingPipeline.layout     = layoutMaker.MakeLayout(m_device, {m_dSetLayout, m_lightingDSLayout}, sizeof(pushConstLighting));
+
+  auto makeGBufferPipeline = [this]() {
+    vk_utils::GraphicsPipelineMaker maker;
+
+    std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+    shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = GBUFFER_SHADER_PATH + ".spv";
+    shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = VERTEX_SHADER_PATH + ".spv";
+
+    maker.LoadShaders(m_device, shader_paths);
+    maker.SetDefaultState(m_width, m_height);
+
+    return m_pPipelineCache->MakeGraphicsPipeline(maker, m_basicForwardPipeline.layout,
+                                                  m_pScnMgr->GetPipelineVertexInputStateCreateInfo(), m_screenRenderPass,
+                                                  {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR}, true, SUBPASS_GBUFFER);
+  };
+
+  // full screen triangle without vertex buffers, lighting subpass has no depth attachment
+  auto makeLightingPipeline = [this]() {
+    vk_utils::GraphicsPipelineMaker maker;
+
+    std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+    shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = LIGHTING_SHADER_PATH + ".spv";
+    shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = LIGHTING_VERTEX_SHADER_PATH + ".spv";
+
+    maker.LoadShaders(m_device, shader_paths);
+    maker.SetDefaultState(m_width, m_height);
+    maker.rasterizer.cullMode               = VK_CULL_MODE_NONE;
+    maker.depthStencilTest.depthTestEnable  = VK_FALSE;
+    maker.depthStencilTest.depthWriteEnable = VK_FALSE;
+
+    VkPipelineVertexInputStateCreateInfo noVertices = {};
+    noVertices.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    return m_pPipelineCache->MakeGraphicsPipeline(maker, m_lightingPipeline.layout, noVertices, m_screenRenderPass,
+                                                  {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR}, true, SUBPASS_LIGHTING);
+  };
+
+  m_basicForwardPipeline.pipeline = makeGBufferPipeline();
+  m_lightingPipeline.pipeline     = makeLightingPipeline();
+  m_pShaderReloader->WatchPipeline(&m_basicForwardPipeline.pipeline, {VERTEX_SHADER_PATH, GBUFFER_SHADER_PATH},
+                                   makeGBufferPipeline);
+  m_pShaderReloader->WatchPipeline(&m_lightingPipeline.pipeline, {LIGHTING_VERTEX_SHADER_PATH, LIGHTING_SHADER_PATH},
+                                   makeLightingPipeline);
+}
+
+void SimpleDeferredRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
+                                                    VkImageView, VkPipeline a_pipeline)
+{
+  PROFILE_FUNCTION();
+  vkResetCommandBuffer(a_cmdBuff, 0);
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+
+  VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
+  m_pGpuTimer->CmdBegin(a_cmdBuff, m_presentationResources.currentFrame);
+  m_frameStats.drawCalls = 0;
+  m_frameStats.triangles = 0;
+
+  CmdUpdateUniforms(a_cmdBuff, m_ubo, &m_uniforms, sizeof(m_uniforms));
+
+  vk_utils::setDefaultViewport(a_cmdBuff, static_cast<float>(m_width), static_cast<float>(m_height));
+  vk_utils::setDefaultScissor(a_cmdBuff, m_width, m_height);
+
+  {
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = m_screenRenderPass;
+    renderPassInfo.framebuffer = a_frameBuff;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = VkExtent2D{m_width, m_height};
+
+    VkClearValue clearValues[3] = {};
+    clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+    clearValues[1].color.uint32[0] = 0;
+    clearValues[2].depthStencil = {1.0f, 0};
+    renderPassInfo.clearValueCount = 3;
+    renderPassInfo.pClearValues = &clearValues[0];
+
+    vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    ///// G-buffer
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1,
+                            &m_dSet, 0, VK_NULL_HANDLE);
+
+    VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+
+    VkDeviceSize zero_offset = 0u;
+    VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
+    VkBuffer indexBuf = m_pScnMgr->GetIndexBuffer();
+
+    vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
+    vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
+
+    for (uint32_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
+    {
+      auto inst = m_pScnMgr->GetInstanceInfo(i);
+
+      pushConst2M.model = m_pScnMgr->GetInstanceMatrix(i);
+      vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0,
+                         sizeof(pushConst2M), &pushConst2M);
+
+      auto mesh_info = m_pScnMgr->GetMeshInfo(inst.mesh_id);
+      vkCmdDrawIndexed(a_cmdBuff, mesh_info.m_indNum, 1, mesh_info.m_indexOffset, mesh_info.m_vertexOffset, 0);
+      m_frameStats.drawCalls++;
+      m_frameStats.triangles += mesh_info.m_indNum / 3;
+    }
+
+    ///// lighting, once per pixel
+    vkCmdNextSubpass(a_cmdBuff, VK_SUBPASS_CONTENTS_INLINE);
+
+    pushConstLighting.invProjView   = LiteMath::inverse4x4(pushConst2M.projView);
+    pushConstLighting.invScreenSize = LiteMath::float2(1.0f / float(m_width), 1.0f / float(m_height));
+
+    std::array<VkDescriptorSet, 2> lightingSets = {m_dSet, m_lightingDS};
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_lightingPipeline.pipeline);
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_lightingPipeline.layout, 0,
+                            static_cast<uint32_t>(lightingSets.size()), lightingSets.data(), 0, VK_NULL_HANDLE);
+    vkCmdPushConstants(a_cmdBuff, m_lightingPipeline.layout, stageFlags, 0, sizeof(pushConstLighting), &pushConstLighting);
+    vkCmdDraw(a_cmdBuff, 3, 1, 0, 0);
+    m_frameStats.drawCalls++;
+
+    vkCmdEndRenderPass(a_cmdBuff);
+  }
+
+  m_pGpuTimer->CmdEnd(a_cmdBuff, m_presentationResources.currentFrame);
+  VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
+}
+
+void SimpleDeferredRender::Cleanup()
+{
+  if(m_device != VK_NULL_HANDLE)
+    vkDeviceWaitIdle(m_device);
+
+  m_pShaderReloader = nullptr; // stops the worker before pipeline state it reads is destroyed
+
+  if(m_lightingPipeline.pipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(m_device, m_lightingPipeline.pipeline, nullptr);
+  if(m_lightingPipeline.layout != VK_NULL_HANDLE)
+    vkDestroyPipelineLayout(m_device, m_lightingPipeline.layout, nullptr);
+  m_lightingPipeline = {};
+
+  if(m_lightingDSPool != VK_NULL_HANDLE)
+    vkDestroyDescriptorPool(m_device, m_lightingDSPool, nullptr);
+  if(m_lightingDSLayout != VK_NULL_HANDLE)
+    vkDestroyDescriptorSetLayout(m_device, m_lightingDSLayout, nullptr);
+  m_lightingDSPool   = VK_NULL_HANDLE;
+  m_lightingDSLayout = VK_NULL_HANDLE;
+  m_lightingDS       = VK_NULL_HANDLE;
+
+  for(auto *image : {&m_gbuffer, &m_gbufferDepth})
+  {
+    if(image->view != VK_NULL_HANDLE)
+      vkDestroyImageView(m_device, image->view, nullptr);
+    if(image->image != VK_NULL_HANDLE)
+      vkDestroyImage(m_device, image->image, nullptr);
+    *image = {};
+  }
+  if(m_pAllocator != nullptr)
+  {
+    m_pAllocator->Free(m_gbufferAlloc);
+    m_pAllocator->Free(m_gbufferDepthAlloc);
+  }
+}
@@ -0,0 +1,81 @@
+#ifndef SIMPLE_DEFERRED_H
+#define SIMPLE_DEFERRED_H
+
+#define VK_NO_PROTOTYPES
+
+#include "simple_render.h"
+
+/**
+\brief Deferred shading version of SimpleRender with the same lights.
+
+  The frame is one render pass with two subpasses. The first one draws the scene into a single R32G32_UINT G-buffer
+  (albedo as RGBA8 and octahedral normal as two snorm16, 8 bytes per pixel, see gbuffer.h) and depth. The second one
+  draws a full screen triangle which reads G-buffer and depth of its pixel as input attachments, reconstructs world
+  position from depth and evaluates lights once per pixel, however many surfaces were drawn over it.
+
+  G-buffer and depth are never stored: they are transient attachments in lazily allocated memory when the device has
+  it, so on tiled GPUs they can stay in tile memory. All framebuffers share them, the external dependency of the
+  render pass orders reads of the previous frame before writes of the next one.
+*/
+class SimpleDeferredRender : public SimpleRender
+{
+public:
+  const std::string GBUFFER_SHADER_PATH        = "../resources/shaders/gbuffer.frag";
+  const std::string LIGHTING_VERTEX_SHADER_PATH = "../resources/shaders/upscale.vert"; // full screen triangle
+  const std::string LIGHTING_SHADER_PATH       = "../resources/shaders/deferred_light.frag";
+
+  static constexpr VkFormat GBUFFER_FORMAT = VK_FORMAT_R32G32_UINT;
+
+  SimpleDeferredRender(uint32_t a_width, uint32_t a_height);
+  ~SimpleDeferredRender() override { Cleanup(); };
+
+  // every pixel is already shaded once, depth pre-pass would only add vertex work
+  void SetDepthPrepass(bool) override {}
+
+  //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+protected:
+
+  enum Subpass : uint32_t
+  {
+    SUBPASS_GBUFFER  = 0,
+    SUBPASS_LIGHTING = 1
+  };
+
+  struct
+  {
+    LiteMath::float4x4 invProjView;
+    LiteMath::float2   invScreenSize;
+  } pushConstLighting;
+
+  // scene is drawn to the G-buffer with m_basicForwardPipeline (simple.vert + gbuffer.frag), lit with m_lightingPipeline
+  pipeline_data_t m_lightingPipeline {};
+
+  // set 1 of the lighting pipeline, input attachments; set 0 is m_dSet with the uniform buffer
+  VkDescriptorSetLayout m_lightingDSLayout = VK_NULL_HANDLE;
+  VkDescriptorPool      m_lightingDSPool   = VK_NULL_HANDLE;
+  VkDescriptorSet       m_lightingDS       = VK_NULL_HANDLE;
+
+  // *** G-buffer, recreated on resize, m_depthBuffer is not used except for its format
+  vk_utils::VulkanImageMem m_gbuffer {};
+  DeviceAllocation         m_gbufferAlloc;
+  vk_utils::VulkanImageMem m_gbufferDepth {};
+  DeviceAllocation         m_gbufferDepthAlloc;
+  // ***
+
+  VkRenderPass CreateScreenRenderPass() override;
+  void CreateScreenTargets() override;
+  void ReleaseScreenTargets() override;
+
+  vk_utils::VulkanImageMem CreateTransientAttachment(VkFormat a_format, VkImageUsageFlags a_usage,
+                                                     VkImageAspectFlags a_aspect, DeviceAllocation &a_alloc);
+  void CreateLightingDescriptorSet();
+
+  void BuildCommandBufferSimple(VkCommandBuffer cmdBuff, VkFramebuffer frameBuff,
+                                VkImageView a_targetImageView, VkPipeline a_pipeline) override;
+
+  void SetupSimplePipeline() override;
+  void Cleanup();
+};
+
+
+#endif //SIMPLE_DEFERRED_H
@@ -1,10 +1,13 @@
 #include "simple_render.h"
 #include "../../utils/input_definitions.h"
+#include "../../utils/profiler.h"
 
 #include <geom/vk_mesh.h>
 #include <vk_pipeline.h>
 #include <vk_buffers.h>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 
 SimpleRender::SimpleRender(uint32_t a_width, uint32_t a_height) : m_width(a_width), m_height(a_height)
 {
@@ -49,34 +52,28 @@ void SimpleRender::InitVulkan(const char** a_instanceExtensions, uint32_t a_inst
   m_commandPool = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics,
                                               VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-  m_cmdBuffersDrawMain.reserve(m_framesInFlight);
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
+  m_framesInFlight = m_framePacer.Params().framesInFlight;
+  CreateFrameResources();
 
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
-  {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
+  m_pPipelineCache = std::make_unique<PipelineCache>(m_device, m_physicalDevice);
+  m_pDeletionQueue  = std::make_shared<DeletionQueue>(m_framesInFlight);
+  m_pShaderReloader = std::make_unique<ShaderReloader>(m_device, m_pDeletionQueue);
 
+  m_pAllocator = std::make_shared<DeviceAllocator>(m_device, m_physicalDevice);
   m_pScnMgr = std::make_shared<SceneManager>(m_device, m_physicalDevice, m_queueFamilyIDXs.transfer,
-                                             m_queueFamilyIDXs.graphics, false);
+                                             m_queueFamilyIDXs.graphics, false, m_pAllocator);
+  m_pScnMgr->SetPositionStream(true); // depth pre-pass
 }
 
 void SimpleRender::InitPresentation(VkSurfaceKHR &a_surface, bool initGUI)
 {
   m_surface = a_surface;
 
+  m_framePacer.QuerySupportedModes(m_physicalDevice, m_surface);
   m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface,
-                                                              m_width, m_height, m_framesInFlight, m_vsync);
+                                                              m_width, m_height, m_framesInFlight, m_framePacer.VSync());
   m_presentationResources.currentFrame = 0;
-
-  VkSemaphoreCreateInfo semaphoreInfo = {};
-  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable));
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished));
+  CreatePresentSemaphores();
 
   std::vector<VkFormat> depthFormats = {
     VK_FORMAT_D32_SFLOAT,
@@ -86,12 +83,102 @@ void SimpleRender::InitPresentation(VkSurfaceKHR &a_surface, bool initGUI)
     VK_FORMAT_D16_UNORM
   };
   vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &m_depthBuffer.format);
-  m_screenRenderPass = vk_utils::createDefaultRenderPass(m_device, m_swapchain.GetFormat(), m_depthBuffer.format);
-  m_depthBuffer  = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
-  m_frameBuffers = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
+  m_screenRenderPass = CreateScreenRenderPass();
+  CreateScreenTargets();
 
   if(initGUI)
-    m_pGUIRender = std::make_shared<ImGuiRender>(m_instance, m_device, m_physicalDevice, m_queueFamilyIDXs.graphics, m_graphicsQueue, m_swapchain);
+    m_pGUIRender = std::make_shared<ImGuiRender>(m_instance, m_device, m_physicalDevice, m_queueFamilyIDXs.graphics, m_graphicsQueue, m_swapchain,
+                                                 m_pPipelineCache->Get());
+}
+
+void SimpleRender::InitPresentationHeadless(const HeadlessParams &a_params)
+{
+  m_headlessParams = a_params;
+  m_headlessFrame  = 0;
+
+  // one offscreen image per frame in flight, so the image is free as soon as the frame fence is signaled
+  m_pHeadless = std::make_unique<HeadlessTarget>(m_device, m_pAllocator, m_queueFamilyIDXs.graphics,
+                                                 m_width, m_height, m_framesInFlight);
+  m_presentationResources.queue        = m_graphicsQueue;
+  m_presentationResources.currentFrame = 0;
+
+  std::vector<VkFormat> depthFormats = {
+    VK_FORMAT_D32_SFLOAT,
+    VK_FORMAT_D32_SFLOAT_S8_UINT,
+    VK_FORMAT_D24_UNORM_S8_UINT,
+    VK_FORMAT_D16_UNORM_S8_UINT,
+    VK_FORMAT_D16_UNORM
+  };
+  vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &m_depthBuffer.format);
+  m_screenRenderPass = CreateScreenRenderPass();
+  CreateScreenTargets();
+}
+
+VkImageView SimpleRender::GetTargetImageView(uint32_t a_imageIdx) const
+{
+  return m_pHeadless ? m_pHeadless->GetAttachment(a_imageIdx).view : m_swapchain.GetAttachment(a_imageIdx).view;
+}
+
+VkRenderPass SimpleRender::CreateScreenRenderPass()
+{
+  if(m_pHeadless != nullptr)
+    return m_pHeadless->CreateRenderPass(m_depthBuffer.format);
+  return vk_utils::createDefaultRenderPass(m_device, m_swapchain.GetFormat(), m_depthBuffer.format);
+}
+
+void SimpleRender::CreateScreenTargets()
+{
+  const VkFormat depthFormat = m_depthBuffer.format;
+  m_depthBuffer = {};
+
+  VkImageCreateInfo imageInfo = {};
+  imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imageInfo.format        = depthFormat;
+  imageInfo.extent        = VkExtent3D{m_width, m_height, 1};
+  imageInfo.mipLevels     = 1;
+  imageInfo.arrayLayers   = 1;
+  imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage         = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK_RESULT(vkCreateImage(m_device, &imageInfo, nullptr, &m_depthBuffer.image));
+
+  // recreated on resize, dedicated memory like the other screen targets
+  m_depthBufferAlloc = m_pAllocator->AllocateForImage(m_depthBuffer.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+
+  const bool hasStencil = depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT ||
+                          depthFormat == VK_FORMAT_D16_UNORM_S8_UINT;
+  m_depthBuffer.format     = depthFormat;
+  m_depthBuffer.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+
+  VkImageViewCreateInfo viewInfo = {};
+  viewInfo.sType            = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image            = m_depthBuffer.image;
+  viewInfo.viewType         = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format           = depthFormat;
+  viewInfo.subresourceRange = {m_depthBuffer.aspectMask, 0, 1, 0, 1};
+  VK_CHECK_RESULT(vkCreateImageView(m_device, &viewInfo, nullptr, &m_depthBuffer.view));
+
+  m_frameBuffers = m_pHeadless != nullptr ? m_pHeadless->CreateFrameBuffers(m_screenRenderPass, m_depthBuffer.view)
+                                          : vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
+}
+
+void SimpleRender::ReleaseScreenTargets()
+{
+  for(auto frameBuffer : m_frameBuffers)
+    m_pDeletionQueue->PushFramebuffer(m_device, frameBuffer);
+  m_frameBuffers.clear();
+  m_pDeletionQueue->Push([device = m_device, pAllocator = m_pAllocator, depthBuffer = m_depthBuffer,
+                          alloc = m_depthBufferAlloc]() mutable {
+    vkDestroyImageView(device, depthBuffer.view, nullptr);
+    vkDestroyImage(device, depthBuffer.image, nullptr);
+    pAllocator->Free(alloc);
+  });
+  m_depthBuffer.image  = VK_NULL_HANDLE;
+  m_depthBuffer.view   = VK_NULL_HANDLE;
+  m_depthBufferAlloc  = {};
 }
 
 void SimpleRender::CreateInstance()
@@ -125,9 +212,127 @@ void SimpleRender::CreateDevice(uint32_t a_deviceId)
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.transfer, 0, &m_transferQueue);
 }
 
+void SimpleRender::CreateFrameResources()
+{
+  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
+
+  m_frameFences.resize(m_framesInFlight);
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  for (size_t i = 0; i < m_framesInFlight; i++)
+  {
+    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
+  }
+
+  m_presentationResources.imageAvailable.resize(m_framesInFlight);
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (auto &semaphore : m_presentationResources.imageAvailable)
+  {
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+  }
+
+  m_pGpuTimer = std::make_unique<GpuFrameTimer>(m_device, m_physicalDevice, m_queueFamilyIDXs.graphics, m_framesInFlight);
+  m_presentationResources.currentFrame = 0;
+  std::fill(m_imageFences.begin(), m_imageFences.end(), VK_NULL_HANDLE);
+}
+
+void SimpleRender::DestroyFrameResources()
+{
+  if (!m_cmdBuffersDrawMain.empty())
+  {
+    vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_cmdBuffersDrawMain.size()),
+                         m_cmdBuffersDrawMain.data());
+    m_cmdBuffersDrawMain.clear();
+  }
+
+  for (auto fence : m_frameFences)
+    vkDestroyFence(m_device, fence, nullptr);
+  m_frameFences.clear();
+
+  for (auto semaphore : m_presentationResources.imageAvailable)
+    vkDestroySemaphore(m_device, semaphore, nullptr);
+  m_presentationResources.imageAvailable.clear();
+
+  m_pGpuTimer = nullptr;
+}
+
+void SimpleRender::CreatePresentSemaphores()
+{
+  // the previous swapchain may still be presenting with the old ones
+  for (auto semaphore : m_presentationResources.renderingFinished)
+    m_pDeletionQueue->Push([device = m_device, semaphore]() { vkDestroySemaphore(device, semaphore, nullptr); });
+
+  m_presentationResources.renderingFinished.resize(m_swapchain.GetImageCount());
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (auto &semaphore : m_presentationResources.renderingFinished)
+  {
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+  }
+
+  m_imageFences.assign(m_swapchain.GetImageCount(), VK_NULL_HANDLE);
+}
+
+void SimpleRender::SetFramePacing(const FramePacingParams &a_params)
+{
+  m_requestedPacing = a_params;
+  if(a_params.fpsLimit > 0.0f)
+    m_guiFpsLimit = a_params.fpsLimit;
+  if(m_device == VK_NULL_HANDLE) // nothing is created yet, frames in flight are used as is by InitVulkan
+    m_framePacer.SetParams(a_params);
+}
+
+void SimpleRender::ApplyFramePacing()
+{
+  const FramePacingParams current = m_framePacer.Params();
+  m_framePacer.SetParams(m_requestedPacing);
+  const FramePacingParams &requested = m_framePacer.Params();
+
+  const bool framesChanged = requested.framesInFlight != current.framesInFlight;
+  const bool vsyncChanged  = (current.presentMode == PresentMode::FIFO) != m_framePacer.VSync();
+  if(!framesChanged && !vsyncChanged)
+    return;
+
+  std::cout << "[SimpleRender] frames in flight: " << requested.framesInFlight << ", present mode: "
+            << FramePacer::ModeName(m_framePacer.EffectivePresentMode()) << std::endl;
+
+  if(framesChanged)
+  {
+    // command buffers, fences and timestamp queries exist per frame in flight, so every frame has to finish
+    vkWaitForFences(m_device, static_cast<uint32_t>(m_frameFences.size()), m_frameFences.data(), VK_TRUE, UINT64_MAX);
+    DestroyFrameResources();
+    m_framesInFlight = requested.framesInFlight;
+    CreateFrameResources();
+    m_pDeletionQueue->SetFramesInFlight(m_framesInFlight);
+  }
+
+  // swapchain image count follows frames in flight, present mode is fixed at swapchain creation
+  if(m_surface != VK_NULL_HANDLE)
+    RecreateSwapChain();
+}
+
+void SimpleRender::WaitForFrameStart()
+{
+  PROFILE_FUNCTION();
+  if(m_pHeadless != nullptr)
+    return;
+
+  ApplyFramePacing();
+  m_framePacer.Limit();
+
+  // the frame fence is waited here and not in DrawFrame, so the frame is recorded with input sampled after the wait
+  const uint32_t frame = m_presentationResources.currentFrame;
+  vkWaitForFences(m_device, 1, &m_frameFences[frame], VK_TRUE, UINT64_MAX);
+  m_framePacer.OnFrameCompleted(frame);
+  m_framePacer.OnInputSampled(frame);
+}
+
 
 void SimpleRender::SetupSimplePipeline()
 {
+  PROFILE_FUNCTION();
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
       {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             1}
   };
@@ -139,52 +344,84 @@ void SimpleRender::SetupSimplePipeline()
   m_pBindings->BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
   m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
 
-  // if we are recreating pipeline (for example, to reload shaders)
-  // we need to cleanup old pipeline
-  if(m_basicForwardPipeline.layout != VK_NULL_HANDLE)
-  {
-    vkDestroyPipelineLayout(m_device, m_basicForwardPipeline.layout, nullptr);
-    m_basicForwardPipeline.layout = VK_NULL_HANDLE;
-  }
-  if(m_basicForwardPipeline.pipeline != VK_NULL_HANDLE)
-  {
-    vkDestroyPipeline(m_device, m_basicForwardPipeline.pipeline, nullptr);
-    m_basicForwardPipeline.pipeline = VK_NULL_HANDLE;
-  }
-
-  vk_utils::GraphicsPipelineMaker maker;
+  // pipeline layout and render pass are read by the shader reloader thread when it rebuilds the pipeline
+  auto pauseReload = m_pShaderReloader->PauseBuilds();
 
-  std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
-  shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = FRAGMENT_SHADER_PATH + ".spv";
-  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = VERTEX_SHADER_PATH + ".spv";
+  // if we are recreating pipeline (for example, after the render pass has changed)
+  // old one can still be used by frames in flight
+  m_pDeletionQueue->PushPipelineLayout(m_device, m_basicForwardPipeline.layout);
+  m_basicForwardPipeline.layout = VK_NULL_HANDLE;
 
-  maker.LoadShaders(m_device, shader_paths);
+  vk_utils::GraphicsPipelineMaker layoutMaker;
+  m_basicForwardPipeline.layout = layoutMaker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
 
-  m_basicForwardPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
-  maker.SetDefaultState(m_width, m_height);
-
-  m_basicForwardPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
-                                                       m_screenRenderPass, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+  SetupForwardPipelines(VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH);
 }
 
-void SimpleRender::CreateUniformBuffer()
+void SimpleRender::SetupForwardPipelines(const std::string &a_vertexPath, const std::string &a_fragmentPath)
 {
-  VkMemoryRequirements memReq;
-  m_ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq);
+  m_pDeletionQueue->PushPipeline(m_device, m_basicForwardPipeline.pipeline);
+  m_pDeletionQueue->PushPipeline(m_device, m_prepassForwardPipeline);
+  m_pDeletionQueue->PushPipeline(m_device, m_depthPrepassPipeline);
+  m_basicForwardPipeline.pipeline = VK_NULL_HANDLE;
+  m_prepassForwardPipeline        = VK_NULL_HANDLE;
+  m_depthPrepassPipeline          = VK_NULL_HANDLE;
+
+  // a_afterPrepass: depth buffer already has the nearest surfaces, only fragments with exactly that depth are shaded
+  auto makePipeline = [this, a_vertexPath, a_fragmentPath](bool a_afterPrepass) {
+    vk_utils::GraphicsPipelineMaker maker;
+
+    std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+    shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = a_fragmentPath + ".spv";
+    shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = a_vertexPath + ".spv";
+
+    maker.LoadShaders(m_device, shader_paths);
+    maker.SetDefaultState(m_width, m_height);
+    if(a_afterPrepass)
+    {
+      maker.depthStencilTest.depthCompareOp   = VK_COMPARE_OP_EQUAL;
+      maker.depthStencilTest.depthWriteEnable = VK_FALSE;
+    }
+
+    return m_pPipelineCache->MakeGraphicsPipeline(maker, m_basicForwardPipeline.layout,
+                                                  m_pScnMgr->GetPipelineVertexInputStateCreateInfo(), m_screenRenderPass,
+                                                  {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+  };
 
-  VkMemoryAllocateInfo allocateInfo = {};
-  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocateInfo.pNext = nullptr;
-  allocateInfo.allocationSize = memReq.size;
-  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
-                                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                                          m_physicalDevice);
-  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_uboAlloc));
+  // positions only and no fragment shader, color attachment of the screen render pass is not written
+  auto makeDepthPrepassPipeline = [this, vertexPath = DEPTH_PREPASS_SHADER_PATH]() {
+    vk_utils::GraphicsPipelineMaker maker;
 
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_ubo, m_uboAlloc, 0));
+    std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+    shader_paths[VK_SHADER_STAGE_VERTEX_BIT] = vertexPath + ".spv";
 
-  vkMapMemory(m_device, m_uboAlloc, 0, sizeof(m_uniforms), 0, &m_uboMappedMem);
+    maker.LoadShaders(m_device, shader_paths);
+    maker.SetDefaultState(m_width, m_height);
+
+    VkPipelineColorBlendAttachmentState noColorWrites = {};
+    maker.colorBlending.attachmentCount = 1;
+    maker.colorBlending.pAttachments    = &noColorWrites;
+
+    return m_pPipelineCache->MakeGraphicsPipeline(maker, m_basicForwardPipeline.layout,
+                                                  m_pScnMgr->GetPositionOnlyVertexInputStateCreateInfo(), m_screenRenderPass,
+                                                  {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+  };
+
+  m_basicForwardPipeline.pipeline = makePipeline(false);
+  m_prepassForwardPipeline        = makePipeline(true);
+  m_depthPrepassPipeline          = makeDepthPrepassPipeline();
+  m_pShaderReloader->WatchPipeline(&m_basicForwardPipeline.pipeline, {a_vertexPath, a_fragmentPath},
+                                   [makePipeline]() { return makePipeline(false); });
+  m_pShaderReloader->WatchPipeline(&m_prepassForwardPipeline, {a_vertexPath, a_fragmentPath},
+                                   [makePipeline]() { return makePipeline(true); });
+  m_pShaderReloader->WatchPipeline(&m_depthPrepassPipeline, {DEPTH_PREPASS_SHADER_PATH}, makeDepthPrepassPipeline);
+}
+
+void SimpleRender::CreateUniformBuffer()
+{
+  // written by vkCmdUpdateBuffer at the start of every frame, so frames in flight don't need a copy each
+  m_ubo      = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_uboAlloc = m_pAllocator->AllocateForBuffer(m_ubo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
   m_uniforms.lightPos = LiteMath::float3(0.0f, 1.0f, 1.0f);
   m_uniforms.baseColor = LiteMath::float3(0.9f, 0.92f, 1.0f);
@@ -195,14 +432,37 @@ void SimpleRender::CreateUniformBuffer()
 
 void SimpleRender::UpdateUniformBuffer(float a_time)
 {
-// most uniforms are updated in GUI -> SetupGUIElements()
+// most uniforms are updated in GUI -> SetupGUIElements(), all of them are uploaded in BuildCommandBufferSimple()
   m_uniforms.time = a_time;
-  memcpy(m_uboMappedMem, &m_uniforms, sizeof(m_uniforms));
+}
+
+// the previous frame can still read the buffer, so the update is ordered after it on the GPU instead of memcpy
+void SimpleRender::CmdUpdateUniforms(VkCommandBuffer a_cmdBuff, VkBuffer a_ubo, const void *a_data, VkDeviceSize a_size)
+{
+  VkBufferMemoryBarrier barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask       = VK_ACCESS_UNIFORM_READ_BIT;
+  barrier.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer              = a_ubo;
+  barrier.offset              = 0;
+  barrier.size                = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                       0, nullptr, 1, &barrier, 0, nullptr);
+
+  vkCmdUpdateBuffer(a_cmdBuff, a_ubo, 0, a_size, a_data);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                       0, nullptr, 1, &barrier, 0, nullptr);
 }
 
 void SimpleRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
                                             VkImageView, VkPipeline a_pipeline)
 {
+  PROFILE_FUNCTION();
   vkResetCommandBuffer(a_cmdBuff, 0);
 
   VkCommandBufferBeginInfo beginInfo = {};
@@ -210,6 +470,11 @@ void SimpleRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebu
   beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 
   VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
+  m_pGpuTimer->CmdBegin(a_cmdBuff, m_presentationResources.currentFrame);
+  m_frameStats.drawCalls = 0;
+  m_frameStats.triangles = 0;
+
+  CmdUpdateUniforms(a_cmdBuff, m_ubo, &m_uniforms, sizeof(m_uniforms));
 
   vk_utils::setDefaultViewport(a_cmdBuff, static_cast<float>(m_width), static_cast<float>(m_height));
   vk_utils::setDefaultScissor(a_cmdBuff, m_width, m_height);
@@ -221,7 +486,7 @@ void SimpleRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebu
     renderPassInfo.renderPass = m_screenRenderPass;
     renderPassInfo.framebuffer = a_frameBuff;
     renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = m_swapchain.GetExtent();
+    renderPassInfo.renderArea.extent = VkExtent2D{m_width, m_height};
 
     VkClearValue clearValues[2] = {};
     clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
@@ -230,7 +495,6 @@ void SimpleRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebu
     renderPassInfo.pClearValues = &clearValues[0];
 
     vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
 
     vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1,
                             &m_dSet, 0, VK_NULL_HANDLE);
@@ -244,47 +508,52 @@ void SimpleRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebu
     vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
     vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
 
-    for (uint32_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
-    {
-      auto inst = m_pScnMgr->GetInstanceInfo(i);
+    auto drawInstance = [&](uint32_t a_instId) {
+      auto inst = m_pScnMgr->GetInstanceInfo(a_instId);
 
-      pushConst2M.model = m_pScnMgr->GetInstanceMatrix(i);
+      pushConst2M.model = m_pScnMgr->GetInstanceMatrix(a_instId);
       vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0,
                          sizeof(pushConst2M), &pushConst2M);
 
       auto mesh_info = m_pScnMgr->GetMeshInfo(inst.mesh_id);
       vkCmdDrawIndexed(a_cmdBuff, mesh_info.m_indNum, 1, mesh_info.m_indexOffset, mesh_info.m_vertexOffset, 0);
+      m_frameStats.drawCalls++;
+      m_frameStats.triangles += mesh_info.m_indNum / 3;
+    };
+
+    // depth of the nearest surfaces first, front to back so that most hidden fragments fail early depth test
+    const bool depthPrepass = m_depthPrepass && m_depthPrepassPipeline != VK_NULL_HANDLE;
+    if(depthPrepass)
+    {
+      VkBuffer positionBuf = m_pScnMgr->GetPositionBuffer();
+      m_pScnMgr->SortInstancesFrontToBack(m_cam.pos, m_prepassOrder);
+      vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_depthPrepassPipeline);
+      vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &positionBuf, &zero_offset);
+      for (uint32_t instId : m_prepassOrder)
+        drawInstance(instId);
+      vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
     }
 
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPrepass ? m_prepassForwardPipeline : a_pipeline);
+    for (uint32_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
+      drawInstance(i);
+
     vkCmdEndRenderPass(a_cmdBuff);
   }
 
+  m_pGpuTimer->CmdEnd(a_cmdBuff, m_presentationResources.currentFrame);
   VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
 }
 
 
 void SimpleRender::CleanupPipelineAndSwapchain()
 {
-  if (!m_cmdBuffersDrawMain.empty())
-  {
-    vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_cmdBuffersDrawMain.size()),
-                         m_cmdBuffersDrawMain.data());
-    m_cmdBuffersDrawMain.clear();
-  }
-
-  for (size_t i = 0; i < m_frameFences.size(); i++)
-  {
-    vkDestroyFence(m_device, m_frameFences[i], nullptr);
-  }
-  m_frameFences.clear();
-
-  vk_utils::deleteImg(m_device, &m_depthBuffer);
-  
-  if(m_depthBuffer.mem != VK_NULL_HANDLE)
-  {
-    vkFreeMemory(m_device, m_depthBuffer.mem, nullptr);
-    m_depthBuffer.mem = VK_NULL_HANDLE;
-  }
+  vkDestroyImageView(m_device, m_depthBuffer.view, nullptr);
+  vkDestroyImage(m_device, m_depthBuffer.image, nullptr);
+  m_depthBuffer.view  = VK_NULL_HANDLE;
+  m_depthBuffer.image = VK_NULL_HANDLE;
+  if(m_pAllocator != nullptr)
+    m_pAllocator->Free(m_depthBufferAlloc);
 
   for (size_t i = 0; i < m_frameBuffers.size(); i++)
   {
@@ -298,52 +567,61 @@ void SimpleRender::CleanupPipelineAndSwapchain()
     m_screenRenderPass = VK_NULL_HANDLE;
   }
 
+  m_pHeadless = nullptr;
   m_swapchain.Cleanup();
 }
 
 void SimpleRender::RecreateSwapChain()
 {
-  vkDeviceWaitIdle(m_device);
+  PROFILE_FUNCTION();
+  // minimized window has zero extent, try again when it is restored
+  VkSurfaceCapabilitiesKHR surfaceCaps = {};
+  VK_CHECK_RESULT(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physicalDevice, m_surface, &surfaceCaps));
+  if(surfaceCaps.currentExtent.width == 0 || surfaceCaps.currentExtent.height == 0)
+    return;
 
-  CleanupPipelineAndSwapchain();
-  auto oldImagesNum = m_swapchain.GetImageCount();
-  m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface, m_width, m_height,
-    oldImagesNum, m_vsync);
+  // the current swapchain is passed as oldSwapchain and destroyed together with its image views as soon as
+  // the new one is created, so frames which render to its images must be finished; the rest of the device
+  // (uploads, other queues) is not drained
+  vkWaitForFences(m_device, static_cast<uint32_t>(m_frameFences.size()), m_frameFences.data(), VK_TRUE, UINT64_MAX);
 
-  std::vector<VkFormat> depthFormats = {
-      VK_FORMAT_D32_SFLOAT,
-      VK_FORMAT_D32_SFLOAT_S8_UINT,
-      VK_FORMAT_D24_UNORM_S8_UINT,
-      VK_FORMAT_D16_UNORM_S8_UINT,
-      VK_FORMAT_D16_UNORM
-  };                                                            
-  vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &m_depthBuffer.format);
-  
-  m_screenRenderPass = vk_utils::createDefaultRenderPass(m_device, m_swapchain.GetFormat(), m_depthBuffer.format);
-  m_depthBuffer      = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
-  m_frameBuffers     = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
-
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
+  const VkFormat oldFormat = m_swapchain.GetFormat();
   {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
+    auto pauseReload = m_pShaderReloader->PauseBuilds(); // m_width, m_height and render pass are changed
 
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-  for (uint32_t i = 0; i < m_swapchain.GetImageCount(); ++i)
-  {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
+    m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface, m_width, m_height,
+      m_framesInFlight, m_framePacer.VSync());
+    CreatePresentSemaphores();
+
+    // only size dependent resources are recreated, fences, command buffers and pipelines are kept
+    ReleaseScreenTargets();
+
+    if(m_swapchain.GetFormat() != oldFormat)
+    {
+      m_pDeletionQueue->PushRenderPass(m_device, m_screenRenderPass);
+      m_screenRenderPass = CreateScreenRenderPass();
+    }
+
+    CreateScreenTargets();
   }
 
-  m_pGUIRender->OnSwapchainChanged(m_swapchain);
+  // pipeline is only incompatible with the new render pass if the surface format has changed
+  if(m_swapchain.GetFormat() != oldFormat)
+    SetupSimplePipeline();
+
+  if(m_pGUIRender)
+    m_pGUIRender->OnSwapchainChanged(m_swapchain);
 }
 
 void SimpleRender::Cleanup()
 {
+  // headless frames are not waited for after submit
+  if(m_device != VK_NULL_HANDLE)
+    vkDeviceWaitIdle(m_device);
+
+  m_pShaderReloader = nullptr; // stops the worker before pipeline state it reads is destroyed
+  m_pDeletionQueue  = nullptr; // device is idle, everything replaced during rendering is destroyed here
+
   if(m_pGUIRender)
   {
     m_pGUIRender = nullptr;
@@ -366,17 +644,18 @@ void SimpleRender::Cleanup()
     vkDestroyPipelineLayout(m_device, m_basicForwardPipeline.layout, nullptr);
     m_basicForwardPipeline.layout = VK_NULL_HANDLE;
   }
-
-  if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
-  {
-    vkDestroySemaphore(m_device, m_presentationResources.imageAvailable, nullptr);
-    m_presentationResources.imageAvailable = VK_NULL_HANDLE;
-  }
-  if (m_presentationResources.renderingFinished != VK_NULL_HANDLE)
+  for (auto pipeline : {m_prepassForwardPipeline, m_depthPrepassPipeline})
   {
-    vkDestroySemaphore(m_device, m_presentationResources.renderingFinished, nullptr);
-    m_presentationResources.renderingFinished = VK_NULL_HANDLE;
+    if (pipeline != VK_NULL_HANDLE)
+      vkDestroyPipeline(m_device, pipeline, nullptr);
   }
+  m_prepassForwardPipeline = VK_NULL_HANDLE;
+  m_depthPrepassPipeline   = VK_NULL_HANDLE;
+
+  DestroyFrameResources();
+  for (auto semaphore : m_presentationResources.renderingFinished)
+    vkDestroySemaphore(m_device, semaphore, nullptr);
+  m_presentationResources.renderingFinished.clear();
 
   if (m_commandPool != VK_NULL_HANDLE)
   {
@@ -390,14 +669,15 @@ void SimpleRender::Cleanup()
     m_ubo = VK_NULL_HANDLE;
   }
 
-  if(m_uboAlloc != VK_NULL_HANDLE)
-  {
-    vkFreeMemory(m_device, m_uboAlloc, nullptr);
-    m_uboAlloc = VK_NULL_HANDLE;
-  }
+  if(m_pAllocator != nullptr)
+    m_pAllocator->Free(m_uboAlloc);
 
   m_pBindings = nullptr;
   m_pScnMgr   = nullptr;
+  if(m_pAllocator != nullptr)
+    m_pAllocator->PrintStats();
+  m_pAllocator = nullptr; // all memory of the render is returned to the driver here
+  m_pPipelineCache = nullptr; // saves cache to disk
 
   if(m_device != VK_NULL_HANDLE)
   {
@@ -423,28 +703,20 @@ void SimpleRender::ProcessInput(const AppInput &input)
   // add keyboard controls here
   // camera movement is processed separately
 
-  // recreate pipeline to reload shaders
+  // recompile changed shaders in background, new pipeline is used as soon as it is ready
   if(input.keyPressed[GLFW_KEY_B])
-  {
-#ifdef WIN32
-    std::system("cd ../resources/shaders && python compile_simple_render_shaders.py");
-#else
-    std::system("cd ../resources/shaders && python3 compile_simple_render_shaders.py");
-#endif
+    m_pShaderReloader->RequestReload();
 
-    SetupSimplePipeline();
-
-    for (uint32_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                               m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-    }
+  if(input.keyReleased[GLFW_KEY_Z])
+  {
+    m_depthPrepass = !m_depthPrepass;
+    std::cout << "[SimpleRender] depth pre-pass " << (m_depthPrepass ? "on" : "off") << std::endl;
   }
-
 }
 
 void SimpleRender::UpdateCamera(const Camera* cams, uint32_t a_camsCount)
 {
+  PROFILE_FUNCTION();
   assert(a_camsCount > 0);
   m_cam = cams[0];
   UpdateView();
@@ -466,6 +738,11 @@ void SimpleRender::UpdateView()
     {
       m_cameraTrajectory.push_back(mLookAt);
     }
+
+    // keys for playback are stored at no more than 30 Hz, playback interpolates between them
+    const float time = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_trackingStart).count();
+    if(m_cameraPath.Empty() || time - m_cameraPath.Keys().back().time >= 1.0f / 30.0f)
+      m_cameraPath.AddKey(time, m_cam);
   }
   else
   {
@@ -475,6 +752,7 @@ void SimpleRender::UpdateView()
 
 void SimpleRender::LoadScene(const char* path, bool transpose_inst_matrices)
 {
+  PROFILE_FUNCTION();
   m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
 
   CreateUniformBuffer();
@@ -492,21 +770,34 @@ void SimpleRender::LoadScene(const char* path, bool transpose_inst_matrices)
   for (uint32_t i = 0; i < m_framesInFlight; ++i)
   {
     BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
+                             GetTargetImageView(i), m_basicForwardPipeline.pipeline);
   }
 }
 
 void SimpleRender::DrawFrameSimple()
 {
+  PROFILE_FUNCTION();
   vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
+  BeginFrameStats();
 
   uint32_t imageIdx;
-  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
+  const uint32_t frame = m_presentationResources.currentFrame;
+  auto result = m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable[frame], &imageIdx);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+  {
+    RecreateSwapChain();
+    return;
+  }
+  else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+  {
+    RUN_TIME_ERROR("Failed to acquire the next swapchain image!");
+  }
+  // the fence is reset only when the frame is going to be submitted, otherwise the next wait would never end
+  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
 
   auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
 
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
+  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable[frame]};
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
   BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
@@ -520,14 +811,17 @@ void SimpleRender::DrawFrameSimple()
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &currentCmdBuf;
 
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
+  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished[imageIdx]};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
   VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+  m_pDeletionQueue->NextFrame();
+  EndFrameStats();
 
   VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-                                                 m_presentationResources.renderingFinished);
+                                                 m_presentationResources.renderingFinished[imageIdx]);
+  m_framePacer.OnPresented(frame);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -539,13 +833,78 @@ void SimpleRender::DrawFrameSimple()
   }
 
   m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
+}
+
+void SimpleRender::DrawFrameHeadless()
+{
+  PROFILE_FUNCTION();
+  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
+  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
+  BeginFrameStats();
+
+  const uint32_t imageIdx = m_pHeadless->AcquireNextImage();
+
+  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
+  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_pHeadless->GetAttachment(imageIdx).view,
+                           m_basicForwardPipeline.pipeline);
+
+  const bool saveImage = m_headlessParams.saveEveryNthFrame != 0 &&
+                         m_headlessFrame % m_headlessParams.saveEveryNthFrame == 0;
+
+  std::vector<VkCommandBuffer> submitCmdBufs = { currentCmdBuf };
+  if(saveImage)
+    submitCmdBufs.push_back(m_pHeadless->GetReadbackCmd(imageIdx));
+
+  VkSubmitInfo submitInfo = {};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = (uint32_t)submitCmdBufs.size();
+  submitInfo.pCommandBuffers = submitCmdBufs.data();
 
-  vkQueueWaitIdle(m_presentationResources.queue);
+  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+  m_pDeletionQueue->NextFrame();
+  EndFrameStats();
+
+  // nothing to present, so frames are not waited for unless we need to read the image back
+  if(saveImage)
+  {
+    PROFILE_SCOPE("SaveImage");
+    vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
+    std::stringstream path;
+    path << m_headlessParams.outputDir << "/frame_" << std::setfill('0') << std::setw(5) << m_headlessFrame << ".bmp";
+    m_pHeadless->SaveImage(imageIdx, path.str());
+  }
+
+  m_headlessFrame++;
+  m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
+}
+
+void SimpleRender::BeginFrameStats()
+{
+  // fence of the current frame is signaled, so its timestamps from m_framesInFlight frames ago are ready
+  if(m_pGpuTimer->CollectResult(m_presentationResources.currentFrame))
+    m_frameStats.gpuTimeMs = m_pGpuTimer->LastFrameMs();
+  m_frameStats.inputToPresentMs = m_framePacer.InputToPresentMs();
+  m_frameStats.inputToGpuDoneMs = m_framePacer.InputToGpuDoneMs();
+  m_frameCpuStart = std::chrono::steady_clock::now();
+}
+
+void SimpleRender::EndFrameStats()
+{
+  m_pGpuTimer->OnSubmit(m_presentationResources.currentFrame);
+  m_frameStats.cpuTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_frameCpuStart).count();
 }
 
 void SimpleRender::DrawFrame(float a_time, DrawMode a_mode)
 {
+  PROFILE_FUNCTION();
+  m_pShaderReloader->ApplyReloaded();
   UpdateUniformBuffer(a_time);
+  if(m_pHeadless != nullptr)
+  {
+    DrawFrameHeadless();
+    return;
+  }
+
   switch (a_mode)
   {
   case DrawMode::WITH_GUI:
@@ -565,6 +924,7 @@ void SimpleRender::DrawFrame(float a_time, DrawMode a_mode)
 
 void SimpleRender::SetupGUIElements()
 {
+  PROFILE_FUNCTION();
   ImGui_ImplVulkan_NewFrame();
   ImGui_ImplGlfw_NewFrame();
   ImGui::NewFrame();
@@ -577,6 +937,8 @@ void SimpleRender::SetupGUIElements()
     ImGui::SliderFloat3("Light source position", m_uniforms.lightPos.M, -10.f, 10.f);
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    if(m_depthPrepassPipeline != VK_NULL_HANDLE) // not created by the deferred render
+      ImGui::Checkbox("Depth pre-pass ('Z')", &m_depthPrepass);
 
     ImGui::NewLine();
 
@@ -584,10 +946,19 @@ void SimpleRender::SetupGUIElements()
     ImGui::Text("Changing bindings is not supported.");
     ImGui::Text("Vertex shader path: %s", VERTEX_SHADER_PATH.c_str());
     ImGui::Text("Fragment shader path: %s", FRAGMENT_SHADER_PATH.c_str());
+    bool watchShaders = m_pShaderReloader->IsWatchingFiles();
+    if(ImGui::Checkbox("Reload shaders on file change", &watchShaders))
+      m_pShaderReloader->SetWatchFiles(watchShaders);
+    ImGui::Text("Shader reload: %s", m_pShaderReloader->Status().c_str());
+
+    ImGui::NewLine();
+
+    SetupFramePacingGUI();
 
     ImGui::NewLine();
 
     ImGui::Text("Trajectory path: %s", TRAJECTORY_SAVE_PATH.c_str());
+    ImGui::Text("Camera path for benchmark playback: %s", CAMERA_PATH_SAVE_PATH.c_str());
     ImGui::InputInt("Save camera frequency", &m_saveFreq);
     std::string button_text;
     if(m_trackCameraTrajectory)
@@ -602,8 +973,16 @@ void SimpleRender::SetupGUIElements()
     {
       auto oldState = m_trackCameraTrajectory;
       m_trackCameraTrajectory = !oldState;
-      if(!m_trackCameraTrajectory)
+      if(m_trackCameraTrajectory)
       {
+        m_cameraPath.Clear();
+        m_trackingStart = std::chrono::steady_clock::now();
+      }
+      else
+      {
+        m_cameraPath.Save(CAMERA_PATH_SAVE_PATH);
+        m_cameraPath.Clear();
+
         std::ofstream out(TRAJECTORY_SAVE_PATH, std::ios::trunc);
         for(auto& look_at : m_cameraTrajectory)
         {
@@ -626,13 +1005,43 @@ void SimpleRender::SetupGUIElements()
   ImGui::Render();
 }
 
+void SimpleRender::SetupFramePacingGUI()
+{
+  // fewer frames in flight, no vsync and an fps limit slightly below the GPU rate give the lowest latency,
+  // more frames in flight and no limit give the highest throughput
+  ImGui::Text("Frame pacing");
+  int framesInFlight = int(m_requestedPacing.framesInFlight);
+  if(ImGui::SliderInt("Frames in flight", &framesInFlight, 1, int(MAX_FRAMES_IN_FLIGHT)))
+    m_requestedPacing.framesInFlight = uint32_t(framesInFlight);
+  // without vsync the swapchain picks MAILBOX or falls back to IMMEDIATE, the mode in use is shown next to the choice
+  if(ImGui::RadioButton("FIFO", m_requestedPacing.presentMode == PresentMode::FIFO))
+    m_requestedPacing.presentMode = PresentMode::FIFO;
+  if(m_framePacer.IsSupported(PresentMode::MAILBOX) || m_framePacer.IsSupported(PresentMode::IMMEDIATE))
+  {
+    ImGui::SameLine();
+    if(ImGui::RadioButton("No vsync", m_requestedPacing.presentMode != PresentMode::FIFO))
+      m_requestedPacing.presentMode = PresentMode::MAILBOX;
+  }
+  ImGui::SameLine();
+  ImGui::Text("(in use: %s)", FramePacer::ModeName(m_framePacer.EffectivePresentMode()));
+  bool limitFps = m_requestedPacing.fpsLimit > 0.0f;
+  if(ImGui::Checkbox("Limit FPS", &limitFps))
+    m_requestedPacing.fpsLimit = limitFps ? m_guiFpsLimit : 0.0f;
+  if(limitFps && ImGui::SliderFloat("Target FPS", &m_guiFpsLimit, 10.0f, 360.0f, "%.0f"))
+    m_requestedPacing.fpsLimit = m_guiFpsLimit;
+  ImGui::Text("Input to present %.2f ms, to GPU done %.2f ms, limiter wait %.2f ms", m_framePacer.InputToPresentMs(),
+              m_framePacer.InputToGpuDoneMs(), m_framePacer.LimiterWaitMs());
+}
+
 void SimpleRender::DrawFrameWithGUI()
 {
+  PROFILE_FUNCTION();
   vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
+  BeginFrameStats();
 
   uint32_t imageIdx;
-  auto result = m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
+  const uint32_t frame = m_presentationResources.currentFrame;
+  auto result = m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable[frame], &imageIdx);
   if (result == VK_ERROR_OUT_OF_DATE_KHR)
   {
     RecreateSwapChain();
@@ -642,10 +1051,15 @@ void SimpleRender::DrawFrameWithGUI()
   {
     RUN_TIME_ERROR("Failed to acquire the next swapchain image!");
   }
+  // GUI command buffer of the image may still be executed by an earlier frame from another frame slot
+  if(m_imageFences[imageIdx] != VK_NULL_HANDLE && m_imageFences[imageIdx] != m_frameFences[frame])
+    vkWaitForFences(m_device, 1, &m_imageFences[imageIdx], VK_TRUE, UINT64_MAX);
+  m_imageFences[imageIdx] = m_frameFences[frame];
+  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
 
   auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
 
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
+  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable[frame]};
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
   BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
@@ -664,14 +1078,17 @@ void SimpleRender::DrawFrameWithGUI()
   submitInfo.commandBufferCount = (uint32_t)submitCmdBufs.size();
   submitInfo.pCommandBuffers = submitCmdBufs.data();
 
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
+  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished[imageIdx]};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
   VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+  m_pDeletionQueue->NextFrame();
+  EndFrameStats();
 
   VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-    m_presentationResources.renderingFinished);
+    m_presentationResources.renderingFinished[imageIdx]);
+  m_framePacer.OnPresented(frame);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -683,6 +1100,4 @@ void SimpleRender::DrawFrameWithGUI()
   }
 
   m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
-
-  vkQueueWaitIdle(m_presentationResources.queue);
 }
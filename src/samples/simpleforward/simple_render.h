@@ -6,6 +6,14 @@
 #include "../../render/scene_mgr.h"
 #include "../../render/render_common.h"
 #include "../../render/render_gui.h"
+#include "../../render/headless_target.h"
+#include "../../render/gpu_timer.h"
+#include "../../render/pipeline_cache.h"
+#include "../../render/shader_reloader.h"
+#include "../../render/deletion_queue.h"
+#include "../../render/frame_pacer.h"
+#include "../../render/device_allocator.h"
+#include "../../utils/camera_path.h"
 #include "../../../resources/shaders/common.h"
 #include <geom/vk_mesh.h>
 #include <vk_descriptor_sets.h>
@@ -14,14 +22,17 @@
 #include <vk_swapchain.h>
 #include <string>
 #include <iostream>
+#include <chrono>
 
 class SimpleRender : public IRender
 {
 public:
   const std::string VERTEX_SHADER_PATH = "../resources/shaders/simple.vert";
   const std::string FRAGMENT_SHADER_PATH = "../resources/shaders/simple.frag";
+  const std::string DEPTH_PREPASS_SHADER_PATH = "../resources/shaders/depth_prepass.vert";
 
   const std::string TRAJECTORY_SAVE_PATH = "trajectory.txt";
+  const std::string CAMERA_PATH_SAVE_PATH = "camera_path.cpath";
 
   SimpleRender(uint32_t a_width, uint32_t a_height);
   ~SimpleRender()  { Cleanup(); };
@@ -32,6 +43,11 @@ public:
   void InitVulkan(const char** a_instanceExtensions, uint32_t a_instanceExtensionsCount, uint32_t a_deviceId) override;
 
   void InitPresentation(VkSurfaceKHR& a_surface, bool initGUI) override;
+  void InitPresentationHeadless(const HeadlessParams& a_params) override;
+
+  void SetFramePacing(const FramePacingParams& a_params) override;
+  void SetDepthPrepass(bool a_enable) override { m_depthPrepass = a_enable; }
+  void WaitForFrameStart() override;
 
   void ProcessInput(const AppInput& input) override;
   void UpdateCamera(const Camera* cams, uint32_t a_camsCount) override;
@@ -40,6 +56,7 @@ public:
 
   void LoadScene(const char *path, bool transpose_inst_matrices) override;
   void DrawFrame(float a_time, DrawMode a_mode) override;
+  FrameStats GetFrameStats() const override { return m_frameStats; }
 
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -81,12 +98,13 @@ protected:
   {
     uint32_t    currentFrame      = 0u;
     VkQueue     queue             = VK_NULL_HANDLE;
-    VkSemaphore imageAvailable    = VK_NULL_HANDLE;
-    VkSemaphore renderingFinished = VK_NULL_HANDLE;
+    std::vector<VkSemaphore> imageAvailable;    ///!< per frame in flight
+    std::vector<VkSemaphore> renderingFinished; ///!< per swapchain image, present of the image must end before it is reused
   } m_presentationResources;
 
   std::vector<VkFence> m_frameFences;
   std::vector<VkCommandBuffer> m_cmdBuffersDrawMain;
+  std::vector<VkFence> m_imageFences; // fence of the frame which rendered to each swapchain image last, GUI command buffers are per image
 
   struct
   {
@@ -96,11 +114,18 @@ protected:
 
   UniformParams m_uniforms {};
   VkBuffer m_ubo = VK_NULL_HANDLE;
-  VkDeviceMemory m_uboAlloc = VK_NULL_HANDLE;
-  void* m_uboMappedMem = nullptr;
+  DeviceAllocation m_uboAlloc;
 
   pipeline_data_t m_basicForwardPipeline {};
 
+  // *** depth pre-pass: instances are drawn front to back with m_depthPrepassPipeline first, then shaded with
+  // m_prepassForwardPipeline, which tests depth for EQUAL and doesn't write it; both use m_basicForwardPipeline.layout
+  bool                  m_depthPrepass = false;
+  VkPipeline            m_depthPrepassPipeline   = VK_NULL_HANDLE;
+  VkPipeline            m_prepassForwardPipeline = VK_NULL_HANDLE;
+  std::vector<uint32_t> m_prepassOrder;
+  // ***
+
   VkDescriptorSet m_dSet = VK_NULL_HANDLE;
   VkDescriptorSetLayout m_dSetLayout = VK_NULL_HANDLE;
   VkRenderPass m_screenRenderPass = VK_NULL_HANDLE; // main renderpass
@@ -112,16 +137,34 @@ protected:
   VulkanSwapChain m_swapchain;
   std::vector<VkFramebuffer> m_frameBuffers;
   vk_utils::VulkanImageMem m_depthBuffer{};
+  DeviceAllocation m_depthBufferAlloc;
+  // ***
+
+  // *** headless presentation, used instead of swapchain when m_pHeadless != nullptr
+  std::unique_ptr<HeadlessTarget> m_pHeadless;
+  HeadlessParams m_headlessParams;
+  uint32_t m_headlessFrame = 0;
+  // ***
+
+  // *** statistics
+  std::unique_ptr<GpuFrameTimer> m_pGpuTimer;
+  FrameStats m_frameStats;
+  std::chrono::steady_clock::time_point m_frameCpuStart;
+  void BeginFrameStats();
+  void EndFrameStats();
   // ***
 
   // *** GUI
   std::shared_ptr<IRenderGUI> m_pGUIRender;
   virtual void SetupGUIElements();
+  void SetupFramePacingGUI();
   void DrawFrameWithGUI();
 
   bool m_trackCameraTrajectory = false;
   bool m_saveCameraTrajectory = false;
   std::vector<float4x4> m_cameraTrajectory;
+  CameraPath m_cameraPath; // timestamped keys for benchmark playback, recorded along with m_cameraTrajectory
+  std::chrono::steady_clock::time_point m_trackingStart;
   uint32_t m_updateCounter = 0;
   int32_t m_saveFreq = 100;
   //
@@ -130,7 +173,13 @@ protected:
   uint32_t m_width  = 1024u;
   uint32_t m_height = 1024u;
   uint32_t m_framesInFlight  = 2u;
-  bool m_vsync = false;
+
+  // *** frame pacing, GUI and SetFramePacing change m_requestedPacing, it is applied at the start of the next frame
+  FramePacer        m_framePacer;
+  FramePacingParams m_requestedPacing;
+  float             m_guiFpsLimit = 60.0f;
+  void ApplyFramePacing();
+  // ***
 
   VkPhysicalDeviceFeatures m_enabledDeviceFeatures = {};
   std::vector<const char*> m_deviceExtensions      = {};
@@ -139,22 +188,43 @@ protected:
   bool m_enableValidation;
   std::vector<const char*> m_validationLayers;
 
+  std::shared_ptr<DeviceAllocator> m_pAllocator; // all device memory of the render, shared with scene manager
   std::shared_ptr<SceneManager> m_pScnMgr;
+  std::unique_ptr<PipelineCache> m_pPipelineCache; // shared by all pipelines of the render
+  std::unique_ptr<ShaderReloader> m_pShaderReloader;
+  std::shared_ptr<DeletionQueue> m_pDeletionQueue; // resources replaced while frames are in flight
 
   void DrawFrameSimple();
+  void DrawFrameHeadless();
+
+  VkImageView GetTargetImageView(uint32_t a_imageIdx) const;
+
+  // render pass and size dependent attachments (depth buffer, framebuffers) of the swapchain or headless images,
+  // m_depthBuffer.format is selected before; on resize the old targets are handed to the deletion queue
+  virtual VkRenderPass CreateScreenRenderPass();
+  virtual void CreateScreenTargets();
+  virtual void ReleaseScreenTargets();
 
   void CreateInstance();
   void CreateDevice(uint32_t a_deviceId);
 
-  void BuildCommandBufferSimple(VkCommandBuffer cmdBuff, VkFramebuffer frameBuff,
-                                VkImageView a_targetImageView, VkPipeline a_pipeline);
+  void CreateFrameResources();  // command buffers, fences, semaphores and timestamp queries per frame in flight
+  void DestroyFrameResources();
+  void CreatePresentSemaphores();
+
+  virtual void BuildCommandBufferSimple(VkCommandBuffer cmdBuff, VkFramebuffer frameBuff,
+                                        VkImageView a_targetImageView, VkPipeline a_pipeline);
 
   virtual void SetupSimplePipeline();
+  // forward pipelines of the screen render pass with these shaders, with and without the depth pre-pass;
+  // descriptor set layout and m_basicForwardPipeline.layout must be created
+  void SetupForwardPipelines(const std::string &a_vertexPath, const std::string &a_fragmentPath);
   void CleanupPipelineAndSwapchain();
   void RecreateSwapChain();
 
   void CreateUniformBuffer();
   void UpdateUniformBuffer(float a_time);
+  static void CmdUpdateUniforms(VkCommandBuffer a_cmdBuff, VkBuffer a_ubo, const void *a_data, VkDeviceSize a_size);
 
   void Cleanup();
 
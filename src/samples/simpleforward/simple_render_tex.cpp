@@ -2,6 +2,7 @@
 #include "simple_render_tex.h"
 #include "loader_utils/images.h"
 #include "imgui/misc/cpp/imgui_stdlib.h"
+#include "../../utils/profiler.h"
 
 
 SimpleRenderTexture::SimpleRenderTexture(uint32_t a_width, uint32_t a_height) : SimpleRender(a_width, a_height)
@@ -11,6 +12,7 @@ SimpleRenderTexture::SimpleRenderTexture(uint32_t a_width, uint32_t a_height) :
 
 void SimpleRenderTexture::LoadScene(const char* path, bool transpose_inst_matrices)
 {
+  PROFILE_FUNCTION();
   m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
 
   CreateUniformBuffer();
@@ -28,12 +30,13 @@ void SimpleRenderTexture::LoadScene(const char* path, bool transpose_inst_matric
   for (uint32_t i = 0; i < m_framesInFlight; ++i)
   {
     BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-      m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
+      GetTargetImageView(i), m_basicForwardPipeline.pipeline);
   }
 }
 
 void SimpleRenderTexture::LoadTexture()
 {
+  PROFILE_FUNCTION();
   int w, h, channels;
   auto pixels = loadImageLDR(m_texturePath.c_str(), w, h, channels);
 
@@ -45,18 +48,24 @@ void SimpleRenderTexture::LoadTexture()
     return;
   }
 
-  // in this sample we simply reallocate memory every time
-  // in more practical scenario you would try to reuse the same memory
-  // or even better utilize some sort of allocator
-  vk_utils::deleteImg(m_device, &m_texture);
-  if(m_textureSampler != VK_NULL_HANDLE)
+  // previous texture can still be sampled by frames in flight, its memory goes back to the allocator when they finish
+  if(m_texture.image != VK_NULL_HANDLE)
   {
-    vkDestroySampler(m_device, m_textureSampler, VK_NULL_HANDLE);
+    m_pDeletionQueue->Push([device = m_device, pAllocator = m_pAllocator, texture = m_texture, alloc = m_textureAlloc,
+                            sampler = m_textureSampler]() mutable {
+      vk_utils::deleteImg(device, &texture);
+      pAllocator->Free(alloc);
+      if(sampler != VK_NULL_HANDLE)
+        vkDestroySampler(device, sampler, VK_NULL_HANDLE);
+    });
+    m_texture        = {};
+    m_textureAlloc   = {};
+    m_textureSampler = VK_NULL_HANDLE;
   }
 
-  int mipLevels = 1;
-  m_texture = allocateColorTextureFromDataLDR(m_device, m_physicalDevice, pixels, w, h, mipLevels,
-           VK_FORMAT_R8G8B8A8_UNORM, m_pScnMgr->GetCopyHelper());
+  m_texture = createTextureFromDataLDR(*m_pAllocator, *m_pScnMgr->GetUploader(), pixels, uint32_t(w), uint32_t(h),
+                                       VK_FORMAT_R8G8B8A8_UNORM, m_textureAlloc);
+  m_pScnMgr->GetUploader()->Flush();
   m_textureSampler = vk_utils::createSampler(m_device, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT,
     VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK);
 
@@ -65,6 +74,7 @@ void SimpleRenderTexture::LoadTexture()
 
 void SimpleRenderTexture::SetupSimplePipeline()
 {
+  PROFILE_FUNCTION();
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
     {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 128},  // overallocate descriptors to allow recreation when texture is updated
                                                        // one alternative would be to recreate descriptor pool when we get VK_OUT_OF_POOL_MEMORY error
@@ -79,36 +89,24 @@ void SimpleRenderTexture::SetupSimplePipeline()
   m_pBindings->BindImage(1, m_texture.view, m_textureSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
   m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
 
-  // if we are recreating pipeline (for example, to reload shaders)
-  // we need to cleanup old pipeline
-  if(m_basicForwardPipeline.layout != VK_NULL_HANDLE)
-  {
-    vkDestroyPipelineLayout(m_device, m_basicForwardPipeline.layout, nullptr);
-    m_basicForwardPipeline.layout = VK_NULL_HANDLE;
-  }
-  if(m_basicForwardPipeline.pipeline != VK_NULL_HANDLE)
-  {
-    vkDestroyPipeline(m_device, m_basicForwardPipeline.pipeline, nullptr);
-    m_basicForwardPipeline.pipeline = VK_NULL_HANDLE;
-  }
+  // pipeline layout and render pass are read by the shader reloader thread when it rebuilds the pipeline
+  auto pauseReload = m_pShaderReloader->PauseBuilds();
 
-  vk_utils::GraphicsPipelineMaker maker;
+  // if we are recreating pipeline (for example, when the texture is reloaded)
+  // old one can still be used by frames in flight
+  m_pDeletionQueue->PushPipelineLayout(m_device, m_basicForwardPipeline.layout);
+  m_basicForwardPipeline.layout = VK_NULL_HANDLE;
 
-  std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
-  shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = FRAGMENT_SHADER_PATH + ".spv";
-  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = VERTEX_SHADER_PATH + ".spv";
+  vk_utils::GraphicsPipelineMaker layoutMaker;
+  m_basicForwardPipeline.layout = layoutMaker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
 
-  maker.LoadShaders(m_device, shader_paths);
-
-  m_basicForwardPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M));
-  maker.SetDefaultState(m_width, m_height);
-
-  m_basicForwardPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
-    m_screenRenderPass, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+  SetupForwardPipelines(VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH);
 }
 
 void SimpleRenderTexture::DrawFrame(float a_time, DrawMode a_mode)
 {
+  PROFILE_FUNCTION();
+  m_pShaderReloader->ApplyReloaded();
   if(m_textureNeedsReload)
   {
     LoadTexture();
@@ -117,6 +115,12 @@ void SimpleRenderTexture::DrawFrame(float a_time, DrawMode a_mode)
   }
 
   UpdateUniformBuffer(a_time);
+  if(m_pHeadless != nullptr)
+  {
+    DrawFrameHeadless();
+    return;
+  }
+
   switch (a_mode)
   {
   case DrawMode::WITH_GUI:
@@ -133,42 +137,33 @@ void SimpleRenderTexture::DrawFrame(float a_time, DrawMode a_mode)
 
 void SimpleRenderTexture::ProcessInput(const AppInput &input)
 {
-  // recreate pipeline to reload shaders
+  // recompile changed shaders in background, new pipeline is used as soon as it is ready
   if(input.keyPressed[GLFW_KEY_B])
-  {
-#ifdef WIN32
-    std::system("cd ../resources/shaders && python compile_simple_render_shaders.py");
-#else
-    std::system("cd ../resources/shaders && python3 compile_simple_texture_shaders.py");
-#endif
-
-    SetupSimplePipeline();
-
-    for (uint32_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-        m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-    }
-  }
+    m_pShaderReloader->RequestReload();
 
+  if(input.keyReleased[GLFW_KEY_Z])
+    m_depthPrepass = !m_depthPrepass;
 }
 
 void SimpleRenderTexture::Cleanup()
 {
+  if(m_device != VK_NULL_HANDLE)
+    vkDeviceWaitIdle(m_device);
+
+  m_pShaderReloader = nullptr; // stops the worker before pipeline state it reads is destroyed
+
   vk_utils::deleteImg(m_device, &m_texture);
   if(m_textureSampler != VK_NULL_HANDLE)
   {
     vkDestroySampler(m_device, m_textureSampler, VK_NULL_HANDLE);
   }
-  if(m_texture.mem != VK_NULL_HANDLE)
-  {
-    vkFreeMemory(m_device, m_texture.mem, nullptr);
-    m_texture.mem = VK_NULL_HANDLE;
-  }
+  if(m_pAllocator != nullptr)
+    m_pAllocator->Free(m_textureAlloc);
 }
 
 void SimpleRenderTexture::SetupGUIElements()
 {
+  PROFILE_FUNCTION();
   ImGui_ImplVulkan_NewFrame();
   ImGui_ImplGlfw_NewFrame();
   ImGui::NewFrame();
@@ -184,6 +179,7 @@ void SimpleRenderTexture::SetupGUIElements()
     ImGui::NewLine();
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Checkbox("Depth pre-pass ('Z')", &m_depthPrepass);
 
     ImGui::NewLine();
 
@@ -191,6 +187,13 @@ void SimpleRenderTexture::SetupGUIElements()
     ImGui::Text("Changing bindings is not supported.");
     ImGui::Text("Vertex shader path: %s", VERTEX_SHADER_PATH.c_str());
     ImGui::Text("Fragment shader path: %s", FRAGMENT_SHADER_PATH.c_str());
+    bool watchShaders = m_pShaderReloader->IsWatchingFiles();
+    if(ImGui::Checkbox("Reload shaders on file change", &watchShaders))
+      m_pShaderReloader->SetWatchFiles(watchShaders);
+    ImGui::Text("Shader reload: %s", m_pShaderReloader->Status().c_str());
+
+    ImGui::NewLine();
+    SetupFramePacingGUI();
     ImGui::End();
   }
 
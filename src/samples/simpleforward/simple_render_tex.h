@@ -26,6 +26,7 @@ protected:
   std::string m_texturePath = "../resources/textures/test_tex_1.png";
 
   vk_utils::VulkanImageMem m_texture {};
+  DeviceAllocation m_textureAlloc;
   VkSampler m_textureSampler = VK_NULL_HANDLE;
 
   void LoadTexture();
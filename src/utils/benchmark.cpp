@@ -0,0 +1,208 @@
+#include "benchmark.h"
+#include "camera_path.h"
+#include "glfw_window.h"
+#include "json_string.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  struct FrameRecord
+  {
+    float      frameMs;
+    FrameStats stats;
+  };
+
+  struct Percentiles
+  {
+    double avg = 0.0, p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+  };
+
+  // nearest-rank percentiles
+  Percentiles computePercentiles(std::vector<float> a_values)
+  {
+    Percentiles res;
+    if(a_values.empty())
+      return res;
+
+    std::sort(a_values.begin(), a_values.end());
+    auto rank = [&a_values](double p) {
+      const size_t idx = size_t(std::ceil(p * double(a_values.size()))) - 1;
+      return double(a_values[std::min(idx, a_values.size() - 1)]);
+    };
+
+    double sum = 0.0;
+    for(float v : a_values)
+      sum += v;
+
+    res.avg = sum / double(a_values.size());
+    res.p50 = rank(0.50);
+    res.p95 = rank(0.95);
+    res.p99 = rank(0.99);
+    res.max = double(a_values.back());
+    return res;
+  }
+
+  void writePercentiles(std::ostream &a_out, const char* a_name, const Percentiles &a_p)
+  {
+    a_out << "  \"" << a_name << "\": {\"avg\": " << a_p.avg << ", \"p50\": " << a_p.p50 << ", \"p95\": " << a_p.p95
+          << ", \"p99\": " << a_p.p99 << ", \"max\": " << a_p.max << "},\n";
+  }
+
+  void printPercentiles(const char* a_name, const Percentiles &a_p)
+  {
+    std::cout << std::left << std::setw(12) << a_name << std::right << std::fixed << std::setprecision(3)
+              << " avg " << std::setw(9) << a_p.avg << " p50 " << std::setw(9) << a_p.p50
+              << " p95 " << std::setw(9) << a_p.p95 << " p99 " << std::setw(9) << a_p.p99
+              << " max " << std::setw(9) << a_p.max << std::defaultfloat << std::endl;
+  }
+}
+
+bool readBenchmarkParams(const std::unordered_map<std::string, std::string> &a_cmdParams, BenchmarkParams &a_out,
+                         bool &a_benchmark)
+{
+  auto it = a_cmdParams.find("--benchmark");
+  a_benchmark = it != a_cmdParams.end();
+  if(!a_benchmark)
+    return true;
+
+  a_out.cameraPath = it->second;
+  if((it = a_cmdParams.find("--results")) != a_cmdParams.end())
+    a_out.resultsPath = it->second;
+  if((it = a_cmdParams.find("--label")) != a_cmdParams.end())
+    a_out.label = it->second;
+
+  if(!readFloatParam(a_cmdParams, "--timestep", a_out.timeStep) ||
+     !readUintParam(a_cmdParams, "--warmup", a_out.warmupFrames))
+    return false;
+
+  // the number of measured frames is path duration divided by the timestep
+  if(a_out.timeStep <= 0.0f)
+  {
+    std::cout << "Usage error: --timestep expects a positive number of seconds" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool runCameraPathBenchmark(std::shared_ptr<IRender> &app, const BenchmarkParams &a_params,
+                            const std::function<void()> &a_onFrame)
+{
+  CameraPath path;
+  if(!path.Load(a_params.cameraPath) || path.Empty())
+  {
+    std::cout << "[benchmark] can't use camera path " << a_params.cameraPath << std::endl;
+    return false;
+  }
+
+  PROFILE_THREAD_NAME("main");
+
+  AppInput input;
+  input.cams[0] = app->GetCurrentCamera();
+
+  const uint32_t measuredFrames = uint32_t(path.Duration() / a_params.timeStep) + 1;
+  std::vector<FrameRecord> records;
+  records.reserve(measuredFrames);
+
+  std::cout << "[benchmark] " << a_params.cameraPath << ": " << path.Keys().size() << " keys, "
+            << path.Duration() << " s, " << measuredFrames << " frames" << std::endl;
+
+  auto prevFrameEnd = std::chrono::steady_clock::now();
+  for(uint32_t frame = 0; frame < a_params.warmupFrames + measuredFrames; ++frame)
+  {
+    PROFILE_SCOPE("Frame");
+    const bool  warmup = frame < a_params.warmupFrames;
+    const float time   = warmup ? 0.0f : float(frame - a_params.warmupFrames) * a_params.timeStep;
+
+    if(a_onFrame)
+      a_onFrame();
+
+    input.cams[0] = path.Sample(time);
+    app->UpdateCamera(input.cams, 2);
+    {
+      PROFILE_SCOPE("DrawFrame");
+      app->DrawFrame(time, DrawMode::NO_GUI);
+    }
+
+    const auto frameEnd = std::chrono::steady_clock::now();
+    const float frameMs = std::chrono::duration<float, std::milli>(frameEnd - prevFrameEnd).count();
+    prevFrameEnd = frameEnd;
+
+    // GPU time reported by the render lags by its frames in flight, it does not matter for the distribution
+    if(!warmup)
+      records.push_back({frameMs, app->GetFrameStats()});
+  }
+
+  std::vector<float> frameMs, cpuMs, gpuMs;
+  double drawCalls = 0.0, triangles = 0.0, culledFrustum = 0.0, culledOcclusion = 0.0;
+  double shadowDraws = 0.0, culledShadowCasters = 0.0;
+  for(const auto &rec : records)
+  {
+    frameMs.push_back(rec.frameMs);
+    cpuMs.push_back(rec.stats.cpuTimeMs);
+    gpuMs.push_back(rec.stats.gpuTimeMs);
+    drawCalls += double(rec.stats.drawCalls);
+    triangles += double(rec.stats.triangles);
+    culledFrustum   += double(rec.stats.culledFrustum);
+    culledOcclusion += double(rec.stats.culledOcclusion);
+    shadowDraws         += double(rec.stats.shadowDraws);
+    culledShadowCasters += double(rec.stats.culledShadowCasters);
+  }
+  const double framesNum = double(std::max<size_t>(records.size(), 1));
+  const auto frameP = computePercentiles(frameMs);
+  const auto cpuP   = computePercentiles(cpuMs);
+  const auto gpuP   = computePercentiles(gpuMs);
+
+  printPercentiles("frame (ms)", frameP);
+  printPercentiles("cpu (ms)",   cpuP);
+  printPercentiles("gpu (ms)",   gpuP);
+  std::cout << "avg draw calls " << drawCalls / framesNum << ", avg triangles " << uint64_t(triangles / framesNum) << std::endl;
+  std::cout << "avg culled instances: frustum " << culledFrustum / framesNum << ", occlusion " << culledOcclusion / framesNum << std::endl;
+  std::cout << "avg shadow draws " << shadowDraws / framesNum << ", culled shadow casters " << culledShadowCasters / framesNum << std::endl;
+
+  std::ofstream out(a_params.resultsPath, std::ios::trunc);
+  if(!out.is_open())
+  {
+    std::cout << "[benchmark] can't open " << a_params.resultsPath << " for writing" << std::endl;
+    return true;
+  }
+
+  out << std::fixed << std::setprecision(4);
+  out << "{\n";
+  out << "  \"label\": ";
+  writeJsonString(out, a_params.label);
+  out << ",\n  \"camera_path\": ";
+  writeJsonString(out, a_params.cameraPath);
+  out << ",\n";
+  out << "  \"time_step\": " << a_params.timeStep << ",\n";
+  out << "  \"warmup_frames\": " << a_params.warmupFrames << ",\n";
+  out << "  \"frames\": " << records.size() << ",\n";
+  writePercentiles(out, "frame_ms", frameP);
+  writePercentiles(out, "cpu_ms",   cpuP);
+  writePercentiles(out, "gpu_ms",   gpuP);
+  out << "  \"avg_draw_calls\": " << drawCalls / framesNum << ",\n";
+  out << "  \"avg_triangles\": " << triangles / framesNum << ",\n";
+  out << "  \"avg_culled_frustum\": " << culledFrustum / framesNum << ",\n";
+  out << "  \"avg_culled_occlusion\": " << culledOcclusion / framesNum << ",\n";
+  out << "  \"avg_shadow_draws\": " << shadowDraws / framesNum << ",\n";
+  out << "  \"avg_culled_shadow_casters\": " << culledShadowCasters / framesNum << ",\n";
+  out << "  \"per_frame\": {\"columns\": [\"frame_ms\", \"cpu_ms\", \"gpu_ms\", \"draw_calls\", \"triangles\"], \"rows\": [\n";
+  for(size_t i = 0; i < records.size(); ++i)
+  {
+    const auto &rec = records[i];
+    out << "    [" << rec.frameMs << ", " << rec.stats.cpuTimeMs << ", " << rec.stats.gpuTimeMs << ", "
+        << rec.stats.drawCalls << ", " << rec.stats.triangles << "]" << (i + 1 < records.size() ? ",\n" : "\n");
+  }
+  out << "  ]}\n}\n";
+
+  std::cout << "[benchmark] results saved to " << a_params.resultsPath << std::endl;
+  PROFILE_DUMP("profile_trace.json");
+  return true;
+}
@@ -0,0 +1,32 @@
+#ifndef VK_GRAPHICS_BASIC_BENCHMARK_H
+#define VK_GRAPHICS_BASIC_BENCHMARK_H
+
+#include "../render/render_common.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+struct BenchmarkParams
+{
+  std::string cameraPath;                  ///!< file recorded with CameraPath::Save
+  std::string resultsPath = "benchmark.json";
+  std::string label;                       ///!< stored in results as is, i.e. build or scene name
+  float       timeStep     = 1.0f / 60.0f; ///!< camera path time advanced per frame, independent of real frame time
+  uint32_t    warmupFrames = 16;           ///!< rendered before measurements start, not included in results
+};
+
+// fills a_out from "--benchmark path [--results file] [--label name] [--timestep sec] [--warmup N]",
+// a_benchmark is set if there is --benchmark parameter. Returns false after a usage error is reported for
+// malformed numeric values, the caller is expected to exit then.
+bool readBenchmarkParams(const std::unordered_map<std::string, std::string> &a_cmdParams, BenchmarkParams &a_out,
+                         bool &a_benchmark);
+
+// Replays camera path at a fixed timestep and writes frame time, CPU/GPU time, draw call and triangle statistics
+// as JSON. Works with both window and headless presentation, a_onFrame is called once per frame (i.e. to poll events).
+// Returns false if camera path could not be loaded.
+bool runCameraPathBenchmark(std::shared_ptr<IRender> &app, const BenchmarkParams &a_params,
+                            const std::function<void()> &a_onFrame = nullptr);
+
+#endif// VK_GRAPHICS_BASIC_BENCHMARK_H
@@ -0,0 +1,127 @@
+#include "camera_path.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char CAMERA_PATH_MAGIC[4] = {'C', 'P', 'T', 'H'};
+
+void CameraPath::AddKey(float a_time, const Camera &a_cam)
+{
+  CameraKey key;
+  key.time   = a_time;
+  key.pos    = a_cam.pos;
+  key.lookAt = a_cam.lookAt;
+  key.up     = a_cam.up;
+  key.fov    = a_cam.fov;
+
+  if(!m_keys.empty() && a_time <= m_keys.back().time)
+    key.time = m_keys.back().time + 1e-6f;
+  m_keys.push_back(key);
+}
+
+static float3 catmullRom(const float3 &p0, const float3 &p1, const float3 &p2, const float3 &p3, float t)
+{
+  const float t2 = t * t;
+  const float t3 = t2 * t;
+  return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+                 (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+Camera CameraPath::Sample(float a_time) const
+{
+  Camera cam;
+  if(m_keys.empty())
+    return cam;
+
+  const float time = std::clamp(a_time + m_keys.front().time, m_keys.front().time, m_keys.back().time);
+  auto next = std::upper_bound(m_keys.begin(), m_keys.end(), time,
+                               [](float t, const CameraKey &key) { return t < key.time; });
+
+  const size_t i1 = next == m_keys.begin() ? 0 : size_t(next - m_keys.begin()) - 1;
+  const size_t i2 = std::min(i1 + 1, m_keys.size() - 1);
+  const size_t i0 = i1 > 0 ? i1 - 1 : i1;
+  const size_t i3 = std::min(i2 + 1, m_keys.size() - 1);
+
+  const auto &k1 = m_keys[i1];
+  const auto &k2 = m_keys[i2];
+  const float t  = i1 == i2 ? 0.0f : (time - k1.time) / (k2.time - k1.time);
+
+  cam.pos    = catmullRom(m_keys[i0].pos,    k1.pos,    k2.pos,    m_keys[i3].pos,    t);
+  cam.lookAt = catmullRom(m_keys[i0].lookAt, k1.lookAt, k2.lookAt, m_keys[i3].lookAt, t);
+  cam.up     = LiteMath::normalize(LiteMath::lerp(k1.up, k2.up, t));
+  cam.fov    = k1.fov + (k2.fov - k1.fov) * t;
+  cam.tdist  = LiteMath::length(cam.lookAt - cam.pos);
+
+  return cam;
+}
+
+bool CameraPath::Save(const std::string &a_path) const
+{
+  std::ofstream out(a_path, std::ios::binary | std::ios::trunc);
+  if(!out.is_open())
+  {
+    std::cout << "[CameraPath::Save] can't open " << a_path << std::endl;
+    return false;
+  }
+
+  const uint32_t version = VERSION;
+  const auto     keysNum = static_cast<uint32_t>(m_keys.size());
+  out.write(CAMERA_PATH_MAGIC, sizeof(CAMERA_PATH_MAGIC));
+  out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  out.write(reinterpret_cast<const char*>(&keysNum), sizeof(keysNum));
+  for(const auto &key : m_keys)
+  {
+    const float data[11] = {key.time, key.pos.x, key.pos.y, key.pos.z, key.lookAt.x, key.lookAt.y, key.lookAt.z,
+                            key.up.x, key.up.y, key.up.z, key.fov};
+    out.write(reinterpret_cast<const char*>(data), sizeof(data));
+  }
+
+  return out.good();
+}
+
+bool CameraPath::Load(const std::string &a_path)
+{
+  std::ifstream in(a_path, std::ios::binary);
+  if(!in.is_open())
+  {
+    std::cout << "[CameraPath::Load] can't open " << a_path << std::endl;
+    return false;
+  }
+
+  char     magic[4] = {};
+  uint32_t version  = 0;
+  uint32_t keysNum  = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  in.read(reinterpret_cast<char*>(&keysNum), sizeof(keysNum));
+  if(!in.good() || std::memcmp(magic, CAMERA_PATH_MAGIC, sizeof(magic)) != 0 || version != VERSION)
+  {
+    std::cout << "[CameraPath::Load] " << a_path << " is not a camera path file or has unsupported version" << std::endl;
+    return false;
+  }
+
+  m_keys.clear();
+  m_keys.reserve(keysNum);
+  for(uint32_t i = 0; i < keysNum; ++i)
+  {
+    float data[11];
+    in.read(reinterpret_cast<char*>(data), sizeof(data));
+    if(!in.good())
+    {
+      std::cout << "[CameraPath::Load] " << a_path << " is truncated" << std::endl;
+      return false;
+    }
+
+    CameraKey key;
+    key.time   = data[0];
+    key.pos    = float3(data[1], data[2], data[3]);
+    key.lookAt = float3(data[4], data[5], data[6]);
+    key.up     = float3(data[7], data[8], data[9]);
+    key.fov    = data[10];
+    m_keys.push_back(key);
+  }
+
+  return true;
+}
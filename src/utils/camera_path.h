@@ -0,0 +1,49 @@
+#ifndef VK_GRAPHICS_BASIC_CAMERA_PATH_H
+#define VK_GRAPHICS_BASIC_CAMERA_PATH_H
+
+#include <cstdint>
+#include "Camera.h"
+
+#include <string>
+#include <vector>
+
+/**
+\brief Timestamped camera keys which can be recorded during interactive session and replayed for benchmarking.
+
+  Binary file layout (little endian):
+    char     magic[4] = "CPTH"
+    uint32_t version
+    uint32_t keysNum
+    CameraKey keys[keysNum]
+*/
+class CameraPath
+{
+public:
+  struct CameraKey
+  {
+    float  time;   ///!< seconds from the beginning of the path, keys are sorted by time
+    float3 pos;
+    float3 lookAt;
+    float3 up;
+    float  fov;
+  };
+
+  static constexpr uint32_t VERSION = 1;
+
+  void  AddKey(float a_time, const Camera &a_cam);
+  void  Clear() { m_keys.clear(); }
+  bool  Empty() const { return m_keys.empty(); }
+  float Duration() const { return m_keys.empty() ? 0.0f : m_keys.back().time - m_keys.front().time; }
+  const std::vector<CameraKey>& Keys() const { return m_keys; }
+
+  // Catmull-Rom interpolation of position and target, up vector and fov are interpolated linearly
+  Camera Sample(float a_time) const;
+
+  bool Save(const std::string &a_path) const;
+  bool Load(const std::string &a_path);
+
+private:
+  std::vector<CameraKey> m_keys;
+};
+
+#endif// VK_GRAPHICS_BASIC_CAMERA_PATH_H
@@ -3,14 +3,19 @@
 #ifdef WIN32
 #pragma comment(lib,"glfw3.lib")
 #endif
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
 #include <memory>
 #include <cstdint>
 #include <sstream>
+#include <iomanip>
 
 #include "Camera.h"
+#include "profiler.h"
 
 #ifdef NDEBUG
 constexpr bool g_enableValidationLayers = false;
@@ -104,6 +109,7 @@ void onMouseScrollBasic(GLFWwindow*, double, double yoffset)
 
 void UpdateCamera(GLFWwindow* a_window, Camera& a_cam, float secondsElapsed)
 {
+  PROFILE_FUNCTION();
   //move position of camera based on WASD keys, and FR keys for up and down
   if (glfwGetKey(a_window, 'S'))
     a_cam.offsetPosition(secondsElapsed * g_inputDesktop.camMoveSpeed * -1.0f * a_cam.forward());
@@ -190,16 +196,24 @@ void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI
   int avgCounter = 0;
   int currCam    = 0;
 
+  PROFILE_THREAD_NAME("main");
   g_appInput.cams[0] = app->GetCurrentCamera();
   double lastTime = glfwGetTime();
   while (!glfwWindowShouldClose(window))
   {
+    PROFILE_SCOPE("Frame");
+    // frame limiter and waiting for a free frame slot happen before input is sampled, not after it
+    app->WaitForFrameStart();
+
     double thisTime = glfwGetTime();
     double diffTime = thisTime - lastTime;
     lastTime        = thisTime;
     
     g_appInput.clearKeys();
-    glfwPollEvents();
+    {
+      PROFILE_SCOPE("PollEvents");
+      glfwPollEvents();
+    }
     
     if(g_appInput.keyReleased[GLFW_KEY_L])
       currCam = 1 - currCam;
@@ -208,10 +222,13 @@ void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI
     
     app->ProcessInput(g_appInput);
     app->UpdateCamera(g_appInput.cams, 2);
-    if(displayGUI)
-      app->DrawFrame(static_cast<float>(thisTime), DrawMode::WITH_GUI);
-    else
-      app->DrawFrame(static_cast<float>(thisTime), DrawMode::NO_GUI);
+    {
+      PROFILE_SCOPE("DrawFrame");
+      if(displayGUI)
+        app->DrawFrame(static_cast<float>(thisTime), DrawMode::WITH_GUI);
+      else
+        app->DrawFrame(static_cast<float>(thisTime), DrawMode::NO_GUI);
+    }
 
     // count and print FPS
     //
@@ -222,10 +239,102 @@ void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI
       auto title = "test";//app->GetWindowTitle();
       std::stringstream strout;
       strout << "FPS = " << int( 1.0/(avgTime/double(NAverage)) ) << " " << title;
+      const auto stats = app->GetFrameStats();
+      if(stats.inputToPresentMs > 0.0f)
+        strout << " | input to present " << std::fixed << std::setprecision(1) << stats.inputToPresentMs << " ms";
+      if(stats.renderScale != 1.0f)
+        strout << " | resolution " << int(stats.renderScale * 100.0f + 0.5f) << "%";
+      if(stats.culledFrustum + stats.culledOcclusion > 0)
+        strout << " | culled " << stats.culledFrustum << " frustum, " << stats.culledOcclusion << " occlusion";
+      if(stats.shadowDraws + stats.culledShadowCasters > 0)
+        strout << " | shadow draws " << stats.shadowDraws << ", " << stats.culledShadowCasters << " casters culled";
 
       glfwSetWindowTitle(window, strout.str().c_str());
       avgTime    = 0.0;
       avgCounter = 0;
     }
   }
+
+  PROFILE_DUMP("profile_trace.json");
+}
+
+std::unordered_map<std::string, std::string> readCommandLineParams(int argc, const char** argv)
+{
+  // "--key value" pairs, a key which is not followed by a value (i.e. "--headless") is stored with empty value
+  std::unordered_map<std::string, std::string> params;
+  for(int i = 1; i < argc; ++i)
+  {
+    std::string key = argv[i];
+    if(key.rfind("--", 0) != 0)
+    {
+      std::cout << "WARNING. Unexpected command line argument: " << key << std::endl;
+      continue;
+    }
+
+    if(i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0)
+      params[key] = argv[++i];
+    else
+      params[key] = "";
+  }
+  return params;
+}
+
+bool readUintParam(const std::unordered_map<std::string, std::string> &a_params, const char* a_key, uint32_t &a_out)
+{
+  auto it = a_params.find(a_key);
+  if(it == a_params.end())
+    return true;
+
+  // std::stoul alone throws on "abc", accepts "12abc" and wraps "-1"
+  const std::string &str = it->second;
+  errno = 0;
+  const unsigned long long value = std::strtoull(str.c_str(), nullptr, 10);
+  if(str.empty() || str.find_first_not_of("0123456789") != std::string::npos || errno == ERANGE || value > UINT32_MAX)
+  {
+    std::cout << "Usage error: " << a_key << " expects a non-negative integer, got '" << str << "'" << std::endl;
+    return false;
+  }
+  a_out = uint32_t(value);
+  return true;
+}
+
+bool readFloatParam(const std::unordered_map<std::string, std::string> &a_params, const char* a_key, float &a_out)
+{
+  auto it = a_params.find(a_key);
+  if(it == a_params.end())
+    return true;
+
+  const std::string &str = it->second;
+  errno = 0;
+  char* end = nullptr;
+  const float value = std::strtof(str.c_str(), &end);
+  if(str.empty() || end != str.c_str() + str.size() || errno == ERANGE || !std::isfinite(value))
+  {
+    std::cout << "Usage error: " << a_key << " expects a number, got '" << str << "'" << std::endl;
+    return false;
+  }
+  a_out = value;
+  return true;
+}
+
+FramePacingParams readFramePacingParams(const std::unordered_map<std::string, std::string> &a_params)
+{
+  // --frames-in-flight N --present-mode fifo|mailbox --fps-limit F
+  FramePacingParams pacing;
+  // malformed values are reported and the defaults are kept
+  readUintParam(a_params, "--frames-in-flight", pacing.framesInFlight);
+  readFloatParam(a_params, "--fps-limit", pacing.fpsLimit);
+  if(a_params.count("--present-mode"))
+  {
+    const auto &mode = a_params.at("--present-mode");
+    if(mode == "fifo")
+      pacing.presentMode = PresentMode::FIFO;
+    else if(mode == "mailbox")
+      pacing.presentMode = PresentMode::MAILBOX;
+    else if(mode == "immediate")
+      std::cout << "WARNING. IMMEDIATE present mode can't be requested, MAILBOX is used when supported" << std::endl;
+    else
+      std::cout << "WARNING. Unknown present mode: " << mode << std::endl;
+  }
+  return pacing;
 }
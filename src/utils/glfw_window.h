@@ -26,4 +26,11 @@ void setupImGuiContext(GLFWwindow* a_window);
 
 std::unordered_map<std::string, std::string> readCommandLineParams(int argc, const char** argv);
 
+// parse value of a_key into a_out if the parameter is present, a malformed or out of range value is reported
+// as a usage error and leaves a_out untouched. Return false only in that case.
+bool readUintParam(const std::unordered_map<std::string, std::string> &a_params, const char* a_key, uint32_t &a_out);
+bool readFloatParam(const std::unordered_map<std::string, std::string> &a_params, const char* a_key, float &a_out);
+
+FramePacingParams readFramePacingParams(const std::unordered_map<std::string, std::string> &a_params);
+
 #endif //CBVH_STF_GLFW_WINDOW_H
@@ -0,0 +1,34 @@
+#include "headless_loop.h"
+#include "profiler.h"
+
+#include <chrono>
+#include <iostream>
+
+void mainLoopHeadless(std::shared_ptr<IRender> &app, uint32_t a_framesNum, float a_timeStep)
+{
+  PROFILE_THREAD_NAME("main");
+
+  // there is no user input, cameras stay where the scene put them
+  AppInput input;
+  input.cams[0] = app->GetCurrentCamera();
+
+  const auto start = std::chrono::steady_clock::now();
+  for(uint32_t frame = 0; frame < a_framesNum; ++frame)
+  {
+    PROFILE_SCOPE("Frame");
+    app->ProcessInput(input);
+    app->UpdateCamera(input.cams, 2);
+    {
+      PROFILE_SCOPE("DrawFrame");
+      app->DrawFrame(float(frame) * a_timeStep, DrawMode::NO_GUI);
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  const double totalMs = std::chrono::duration<double, std::milli>(end - start).count();
+  std::cout << "[headless] " << a_framesNum << " frames in " << totalMs << " ms, avg "
+            << totalMs / double(a_framesNum > 0 ? a_framesNum : 1) << " ms/frame ("
+            << (totalMs > 0.0 ? 1000.0 * double(a_framesNum) / totalMs : 0.0) << " FPS)" << std::endl;
+
+  PROFILE_DUMP("profile_trace.json");
+}
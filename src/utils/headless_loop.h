@@ -0,0 +1,11 @@
+#ifndef VK_GRAPHICS_BASIC_HEADLESS_LOOP_H
+#define VK_GRAPHICS_BASIC_HEADLESS_LOOP_H
+
+#include "../render/render_common.h"
+#include <memory>
+
+// Counterpart of mainLoop for renders initialized with InitPresentationHeadless.
+// Renders a_framesNum frames as fast as possible with a fixed animation timestep and prints timings.
+void mainLoopHeadless(std::shared_ptr<IRender> &app, uint32_t a_framesNum, float a_timeStep = 1.0f / 60.0f);
+
+#endif// VK_GRAPHICS_BASIC_HEADLESS_LOOP_H
@@ -0,0 +1,35 @@
+#ifndef VK_GRAPHICS_BASIC_JSON_STRING_H
+#define VK_GRAPHICS_BASIC_JSON_STRING_H
+
+#include <cstdio>
+#include <ostream>
+#include <string_view>
+
+// writes a_str as a quoted JSON string, escapes quotes, backslashes (i.e. in Windows paths) and control characters
+inline void writeJsonString(std::ostream &a_out, std::string_view a_str)
+{
+  a_out << '"';
+  for(const char c : a_str)
+  {
+    switch(c)
+    {
+    case '"':  a_out << "\\\""; break;
+    case '\\': a_out << "\\\\"; break;
+    case '\n': a_out << "\\n";  break;
+    case '\r': a_out << "\\r";  break;
+    case '\t': a_out << "\\t";  break;
+    default:
+      if(static_cast<unsigned char>(c) < 0x20)
+      {
+        char code[8];
+        std::snprintf(code, sizeof(code), "\\u%04x", unsigned(c));
+        a_out << code;
+      }
+      else
+        a_out << c;
+    }
+  }
+  a_out << '"';
+}
+
+#endif// VK_GRAPHICS_BASIC_JSON_STRING_H
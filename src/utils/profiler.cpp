@@ -0,0 +1,200 @@
+#include "profiler.h"
+
+#ifdef USE_PROFILER
+
+#include "json_string.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace profiler
+{
+  struct ZoneEvent
+  {
+    const char* name;
+    uint64_t    beginNs;
+    uint64_t    endNs;
+  };
+
+  // Each thread owns one buffer. Only the owning thread writes events, 'written' is published with release
+  // semantics so dump functions see complete events. When the buffer is full the oldest events are overwritten.
+  struct ThreadBuffer
+  {
+    static constexpr uint32_t CAPACITY = 1u << 18;
+
+    std::vector<ZoneEvent> events = std::vector<ZoneEvent>(CAPACITY);
+    std::atomic<uint64_t>  written{0};
+    uint32_t               threadId = 0;
+    std::string            threadName;
+  };
+
+  struct Registry
+  {
+    std::mutex                                 lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    uint64_t                                   startNs = 0;
+  };
+
+  static Registry& GetRegistry()
+  {
+    static Registry registry;
+    return registry;
+  }
+
+  uint64_t NowNs()
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  // registry lock is taken only once per thread, when the thread records its first zone
+  static ThreadBuffer* RegisterThread()
+  {
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+
+    auto buffer      = std::make_unique<ThreadBuffer>();
+    buffer->threadId = static_cast<uint32_t>(registry.buffers.size());
+    if(registry.buffers.empty())
+      registry.startNs = NowNs();
+
+    registry.buffers.push_back(std::move(buffer));
+    return registry.buffers.back().get();
+  }
+
+  static ThreadBuffer* GetThreadBuffer()
+  {
+    thread_local ThreadBuffer* pBuffer = RegisterThread();
+    return pBuffer;
+  }
+
+  void RecordZone(const char* a_name, uint64_t a_beginNs, uint64_t a_endNs)
+  {
+    auto* pBuffer = GetThreadBuffer();
+    const uint64_t idx = pBuffer->written.load(std::memory_order_relaxed);
+    pBuffer->events[idx % ThreadBuffer::CAPACITY] = ZoneEvent{a_name, a_beginNs, a_endNs};
+    pBuffer->written.store(idx + 1, std::memory_order_release);
+  }
+
+  void SetThreadName(const char* a_name)
+  {
+    GetThreadBuffer()->threadName = a_name;
+  }
+
+  template<typename Func>
+  static void ForEachEvent(Func a_func)
+  {
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for(const auto& buffer : registry.buffers)
+    {
+      const uint64_t written = buffer->written.load(std::memory_order_acquire);
+      const uint64_t first   = written > ThreadBuffer::CAPACITY ? written - ThreadBuffer::CAPACITY : 0;
+      for(uint64_t i = first; i < written; ++i)
+        a_func(*buffer, buffer->events[i % ThreadBuffer::CAPACITY]);
+    }
+  }
+
+  bool DumpChromeTrace(const std::string &a_path)
+  {
+    std::ofstream out(a_path, std::ios::trunc);
+    if(!out.is_open())
+    {
+      std::cout << "[profiler] can't open " << a_path << " for writing" << std::endl;
+      return false;
+    }
+
+    const uint64_t startNs = GetRegistry().startNs;
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    {
+      auto& registry = GetRegistry();
+      std::lock_guard<std::mutex> guard(registry.lock);
+      for(const auto& buffer : registry.buffers)
+      {
+        if(buffer->threadName.empty())
+          continue;
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+            << ",\"args\":{\"name\":";
+        writeJsonString(out, buffer->threadName);
+        out << "}}";
+        first = false;
+      }
+    }
+
+    // chrome trace timestamps are in microseconds, keep nanosecond precision with fractional part
+    out << std::fixed << std::setprecision(3);
+    ForEachEvent([&](const ThreadBuffer &a_buffer, const ZoneEvent &a_event) {
+      out << (first ? "" : ",\n") << "{\"name\":";
+      writeJsonString(out, a_event.name);
+      out << ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << a_buffer.threadId
+          << ",\"ts\":"  << double(a_event.beginNs - startNs) * 1e-3
+          << ",\"dur\":" << double(a_event.endNs - a_event.beginNs) * 1e-3 << "}";
+      first = false;
+    });
+    out << "\n]}\n";
+
+    std::cout << "[profiler] chrome trace saved to " << a_path << std::endl;
+    return true;
+  }
+
+  void PrintSummary(std::ostream &a_out)
+  {
+    struct ZoneStats
+    {
+      uint64_t count   = 0;
+      uint64_t totalNs = 0;
+      uint64_t minNs   = UINT64_MAX;
+      uint64_t maxNs   = 0;
+    };
+
+    // aggregate by name so that identical literals from different translation units end up in one row
+    std::unordered_map<std::string, ZoneStats> stats;
+    ForEachEvent([&](const ThreadBuffer &, const ZoneEvent &a_event) {
+      auto& zone = stats[a_event.name];
+      const uint64_t dur = a_event.endNs - a_event.beginNs;
+      zone.count++;
+      zone.totalNs += dur;
+      zone.minNs    = std::min(zone.minNs, dur);
+      zone.maxNs    = std::max(zone.maxNs, dur);
+    });
+
+    std::vector<std::pair<std::string, ZoneStats>> sorted(stats.begin(), stats.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second.totalNs > b.second.totalNs; });
+
+    a_out << "[profiler] CPU zones summary (ms)" << std::endl;
+    a_out << std::left << std::setw(40) << "zone" << std::right
+          << std::setw(10) << "count" << std::setw(12) << "total" << std::setw(10) << "avg"
+          << std::setw(10) << "min" << std::setw(10) << "max" << std::endl;
+    a_out << std::fixed << std::setprecision(3);
+    for(const auto& [name, zone] : sorted)
+    {
+      a_out << std::left << std::setw(40) << name << std::right
+            << std::setw(10) << zone.count
+            << std::setw(12) << double(zone.totalNs) * 1e-6
+            << std::setw(10) << double(zone.totalNs) * 1e-6 / double(zone.count)
+            << std::setw(10) << double(zone.minNs) * 1e-6
+            << std::setw(10) << double(zone.maxNs) * 1e-6 << std::endl;
+    }
+    a_out << std::defaultfloat;
+  }
+
+  void Reset()
+  {
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for(auto& buffer : registry.buffers)
+      buffer->written.store(0, std::memory_order_release);
+    registry.startNs = NowNs();
+  }
+}
+
+#endif // USE_PROFILER
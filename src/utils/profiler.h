@@ -0,0 +1,62 @@
+#ifndef VK_GRAPHICS_BASIC_PROFILER_H
+#define VK_GRAPHICS_BASIC_PROFILER_H
+
+// Lightweight CPU zone profiler.
+// Every thread writes zones into its own ring buffer without taking locks,
+// results can be dumped as Chrome trace_event JSON (chrome://tracing, ui.perfetto.dev) or as a summary table.
+//
+// Everything is compiled out unless USE_PROFILER is defined (cmake -DUSE_PROFILER=ON),
+// so use the PROFILE_* macros below instead of calling profiler:: functions directly.
+
+#ifdef USE_PROFILER
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace profiler
+{
+  uint64_t NowNs();
+
+  // a_name must have static storage duration (string literal or __FUNCTION__)
+  void RecordZone(const char* a_name, uint64_t a_beginNs, uint64_t a_endNs);
+  void SetThreadName(const char* a_name);
+
+  // dump functions are expected to be called when other threads do not record zones (i.e. at shutdown)
+  bool DumpChromeTrace(const std::string &a_path);
+  void PrintSummary(std::ostream &a_out);
+  void Reset();
+
+  class ScopedZone
+  {
+  public:
+    explicit ScopedZone(const char* a_name) : m_name(a_name), m_beginNs(NowNs()) {}
+    ~ScopedZone() { RecordZone(m_name, m_beginNs, NowNs()); }
+
+    ScopedZone(const ScopedZone &) = delete;
+    ScopedZone &operator=(const ScopedZone &) = delete;
+
+  private:
+    const char* m_name;
+    uint64_t    m_beginNs;
+  };
+}
+
+#define PROFILER_CONCAT_IMPL(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_IMPL(a, b)
+
+#define PROFILE_SCOPE(name)         profiler::ScopedZone PROFILER_CONCAT(profilerZone_, __LINE__)(name)
+#define PROFILE_FUNCTION()          PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_THREAD_NAME(name)   profiler::SetThreadName(name)
+#define PROFILE_DUMP(path)          do { profiler::DumpChromeTrace(path); profiler::PrintSummary(std::cout); } while(0)
+
+#else
+
+#define PROFILE_SCOPE(name)         ((void)0)
+#define PROFILE_FUNCTION()          ((void)0)
+#define PROFILE_THREAD_NAME(name)   ((void)0)
+#define PROFILE_DUMP(path)          ((void)0)
+
+#endif // USE_PROFILER
+
+#endif// VK_GRAPHICS_BASIC_PROFILER_H